@@ -38,6 +38,7 @@
 #include "soup-cache-input-stream.h"
 #include "soup-cache-private.h"
 #include "soup-content-processor.h"
+#include "soup-date-utils-private.h"
 #include "soup-message-private.h"
 #include "soup-message-headers-private.h"
 #include "soup.h"
@@ -193,23 +194,19 @@ get_cacheability (SoupCache *cache, SoupMessage *msg)
 	if (cache_control && *cache_control) {
 		GHashTable *hash;
 
-		hash = soup_header_parse_param_list (cache_control);
+		hash = soup_message_headers_get_param_list_common (soup_message_get_response_headers (msg), SOUP_HEADER_CACHE_CONTROL);
 
 		/* Shared caches MUST NOT store private resources */
 		if (priv->cache_type == SOUP_CACHE_SHARED) {
-			if (g_hash_table_lookup_extended (hash, "private", NULL, NULL)) {
-				soup_header_free_param_list (hash);
+			if (g_hash_table_lookup_extended (hash, "private", NULL, NULL))
 				return SOUP_CACHE_UNCACHEABLE;
-			}
 		}
 
 		/* 2. The 'no-store' cache directive does not appear in the
 		 * headers
 		 */
-		if (g_hash_table_lookup_extended (hash, "no-store", NULL, NULL)) {
-			soup_header_free_param_list (hash);
+		if (g_hash_table_lookup_extended (hash, "no-store", NULL, NULL))
 			return SOUP_CACHE_UNCACHEABLE;
-		}
 
 		if (g_hash_table_lookup_extended (hash, "max-age", NULL, NULL))
 			has_max_age = TRUE;
@@ -217,12 +214,8 @@ get_cacheability (SoupCache *cache, SoupMessage *msg)
 		/* This does not appear in section 2.1, but I think it makes
 		 * sense to check it too?
 		 */
-		if (g_hash_table_lookup_extended (hash, "no-cache", NULL, NULL)) {
-			soup_header_free_param_list (hash);
+		if (g_hash_table_lookup_extended (hash, "no-cache", NULL, NULL))
 			return SOUP_CACHE_UNCACHEABLE;
-		}
-
-		soup_header_free_param_list (hash);
 	}
 
 	/* Section 13.9 */
@@ -376,7 +369,7 @@ soup_cache_entry_set_freshness (SoupCacheEntry *entry, SoupMessage *msg, SoupCac
 		GHashTable *hash;
 		SoupCachePrivate *priv = soup_cache_get_instance_private (cache);
 
-		hash = soup_header_parse_param_list (cache_control);
+		hash = soup_message_headers_get_param_list_common (entry->headers, SOUP_HEADER_CACHE_CONTROL);
 
 		/* Should we re-validate the entry when it goes stale */
 		entry->must_revalidate = g_hash_table_lookup_extended (hash, "must-revalidate", NULL, NULL);
@@ -389,7 +382,6 @@ soup_cache_entry_set_freshness (SoupCacheEntry *entry, SoupMessage *msg, SoupCac
 				if (freshness_lifetime) {
 					/* Implies proxy-revalidate. TODO: is it true? */
 					entry->must_revalidate = TRUE;
-					soup_header_free_param_list (hash);
 					return;
 				}
 			}
@@ -402,11 +394,8 @@ soup_cache_entry_set_freshness (SoupCacheEntry *entry, SoupMessage *msg, SoupCac
 
 		if (freshness_lifetime) {
 			entry->freshness_lifetime = (guint32) MIN (freshness_lifetime, G_MAXUINT32);
-			soup_header_free_param_list (hash);
 			return;
 		}
-
-		soup_header_free_param_list (hash);
 	}
 
 	/* If the 'Expires' response header is present, use its value
@@ -415,19 +404,10 @@ soup_cache_entry_set_freshness (SoupCacheEntry *entry, SoupMessage *msg, SoupCac
 	expires = soup_message_headers_get_one_common (entry->headers, SOUP_HEADER_EXPIRES);
 	date = soup_message_headers_get_one_common (entry->headers, SOUP_HEADER_DATE);
 	if (expires && date) {
-		GDateTime *expires_d, *date_d;
 		gint64 expires_t, date_t;
 
-		expires_d = soup_date_time_new_from_http_string (expires);
-		date_d = soup_date_time_new_from_http_string (date);
-
-		if (expires_d && date_d) {
-			expires_t = g_date_time_to_unix (expires_d);
-			date_t = g_date_time_to_unix (date_d);
-
-			g_date_time_unref (expires_d);
-			g_date_time_unref (date_d);
-
+		if (soup_date_time_parse_http_string (expires, &expires_t) &&
+		    soup_date_time_parse_http_string (date, &date_t)) {
 			if (expires_t && date_t) {
 				entry->freshness_lifetime = (guint32) MAX (expires_t - date_t, 0);
 				return;
@@ -459,18 +439,14 @@ soup_cache_entry_set_freshness (SoupCacheEntry *entry, SoupMessage *msg, SoupCac
 	/* Last-Modified based heuristic */
 	last_modified = soup_message_headers_get_one_common (entry->headers, SOUP_HEADER_LAST_MODIFIED);
 	if (last_modified) {
-		GDateTime *soup_date;
 		gint64 now, last_modified_t;
 
-		soup_date = soup_date_time_new_from_http_string (last_modified);
-		if (soup_date) {
-			last_modified_t = g_date_time_to_unix (soup_date);
+		if (soup_date_time_parse_http_string (last_modified, &last_modified_t)) {
 			now = time (NULL);
 
 #define HEURISTIC_FACTOR 0.1 /* From Section 2.3.1.1 */
 
 			entry->freshness_lifetime = MAX (0, (now - last_modified_t) * HEURISTIC_FACTOR);
-			g_date_time_unref (soup_date);
 		}
 	}
 
@@ -486,7 +462,7 @@ soup_cache_entry_new (SoupCache *cache, SoupMessage *msg, time_t request_time, t
 {
 	SoupCacheEntry *entry;
 	const char *date;
-	GDateTime *soup_date = NULL;
+	gint64 date_value;
 
 	entry = g_slice_new0 (SoupCacheEntry);
 	entry->dirty = FALSE;
@@ -507,15 +483,9 @@ soup_cache_entry_new (SoupCache *cache, SoupMessage *msg, time_t request_time, t
 
 	/* Section 2.3.2, Calculating Age */
 	date = soup_message_headers_get_one_common (entry->headers, SOUP_HEADER_DATE);
-	if (date)
-		soup_date = soup_date_time_new_from_http_string (date);
-
-	if (soup_date) {
+	if (date && soup_date_time_parse_http_string (date, &date_value)) {
 		const char *age;
-		gint64 date_value, apparent_age, corrected_received_age, response_delay, age_value = 0;
-
-		date_value = g_date_time_to_unix (soup_date);
-		g_date_time_unref (soup_date);
+		gint64 apparent_age, corrected_received_age, response_delay, age_value = 0;
 
 		age = soup_message_headers_get_one_common (entry->headers, SOUP_HEADER_AGE);
 		if (age)
@@ -1215,26 +1185,20 @@ soup_cache_has_response (SoupCache *cache, SoupMessage *msg)
 
 	cache_control = soup_message_headers_get_list_common (soup_message_get_request_headers (msg), SOUP_HEADER_CACHE_CONTROL);
 	if (cache_control && *cache_control) {
-		GHashTable *hash = soup_header_parse_param_list (cache_control);
+		GHashTable *hash = soup_message_headers_get_param_list_common (soup_message_get_request_headers (msg), SOUP_HEADER_CACHE_CONTROL);
 
-		if (g_hash_table_lookup_extended (hash, "no-store", NULL, NULL)) {
-			soup_header_free_param_list (hash);
+		if (g_hash_table_lookup_extended (hash, "no-store", NULL, NULL))
 			return SOUP_CACHE_RESPONSE_STALE;
-		}
 
-		if (g_hash_table_lookup_extended (hash, "no-cache", NULL, NULL)) {
-			soup_header_free_param_list (hash);
+		if (g_hash_table_lookup_extended (hash, "no-cache", NULL, NULL))
 			return SOUP_CACHE_RESPONSE_STALE;
-		}
 
 		if (g_hash_table_lookup_extended (hash, "max-age", NULL, &value) && value) {
 			max_age = (int)MIN (g_ascii_strtoll (value, NULL, 10), G_MAXINT32);
 			/* Forcing cache revalidaton
 			 */
-			if (!max_age) {
-				soup_header_free_param_list (hash);
+			if (!max_age)
 				return SOUP_CACHE_RESPONSE_NEEDS_VALIDATION;
-			}
 		}
 
 		/* max-stale can have no value set, we need to use _extended */
@@ -1249,8 +1213,6 @@ soup_cache_has_response (SoupCache *cache, SoupMessage *msg)
 		if (value)
 			min_fresh = (int)MIN (g_ascii_strtoll (value, NULL, 10), G_MAXINT32);
 
-		soup_header_free_param_list (hash);
-
 		if (max_age > 0) {
 			guint current_age = soup_cache_entry_get_current_age (entry);
 
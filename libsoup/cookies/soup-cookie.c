@@ -160,12 +160,13 @@ static GDateTime *
 parse_date (const char **val_p)
 {
 	char *value;
-	GDateTime *date;
+	gint64 unix_time;
+	gboolean parsed;
 
 	value = parse_value (val_p, TRUE);
-	date = soup_date_time_new_from_http_string (value);
+	parsed = soup_date_time_parse_http_string (value, &unix_time);
 	g_free (value);
-	return date;
+	return parsed ? g_date_time_new_from_unix_utc (unix_time) : NULL;
 }
 
 #define MAX_AGE_CAP_IN_SECONDS 31536000  // 1 year
@@ -57,6 +57,15 @@ SoupHeaderName soup_header_name_from_string (const char *str)
         return entry ? entry->header_name : SOUP_HEADER_UNKNOWN;
 }
 
+SoupHeaderName soup_header_name_from_string_len (const char *str,
+                                                 size_t      len)
+{
+        const struct SoupHeaderHashEntry *entry;
+
+        entry = soup_header_name_find (str, len);
+        return entry ? entry->header_name : SOUP_HEADER_UNKNOWN;
+}
+
 const char *soup_header_name_to_string (SoupHeaderName name)
 {
         if (name == SOUP_HEADER_UNKNOWN)
@@ -82,6 +91,8 @@ output = '''/* This file has been generated with generate-header-names.py script
 
 #pragma once
 
+#include <stddef.h>
+
 typedef enum {
 '''
 
@@ -92,8 +103,10 @@ output +='''
         SOUP_HEADER_UNKNOWN
 } SoupHeaderName;
 
-SoupHeaderName soup_header_name_from_string (const char    *str);
-const char    *soup_header_name_to_string   (SoupHeaderName name);
+SoupHeaderName soup_header_name_from_string     (const char    *str);
+SoupHeaderName soup_header_name_from_string_len (const char    *str,
+                                                 size_t         len);
+const char    *soup_header_name_to_string       (SoupHeaderName name);
 '''
 
 with open('soup-header-names.h', 'w+') as o:
@@ -10,6 +10,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <glib/gi18n-lib.h>
 
@@ -164,6 +165,100 @@ soup_body_input_stream_read_raw (SoupBodyInputStream  *bistream,
 	return nread;
 }
 
+/* Longest chunk-size line accepted, including extensions and CRLF */
+#define CHUNK_SIZE_LINE_MAX 128
+
+/* If nothing is buffered in the filter stream, reads up to @length
+ * bytes into it so that the caller can be served from the buffer.
+ * Returns the number of bytes buffered, 0 at EOF or -1 on error.
+ */
+static gssize
+soup_body_input_stream_read_ahead (SoupBodyInputStream  *bistream,
+                                   gsize                 length,
+                                   gboolean              blocking,
+                                   GCancellable         *cancellable,
+                                   GError              **error)
+{
+        SoupBodyInputStreamPrivate *priv = soup_body_input_stream_get_instance_private (bistream);
+	SoupFilterInputStream *fstream = SOUP_FILTER_INPUT_STREAM (priv->base_stream);
+	gsize buffered_length;
+
+	soup_filter_input_stream_peek_buffer (fstream, &buffered_length);
+	if (buffered_length)
+		return buffered_length;
+
+	return soup_filter_input_stream_fill (fstream, length, blocking, cancellable, error);
+}
+
+/* Decodes as many chunks as possible from the data that is already
+ * buffered in the filter stream, copying their payload to @buffer.
+ * Anything other than well-formed chunk data, CRLFs and non-zero
+ * chunk-size lines is left for soup_body_input_stream_read_chunked()
+ * to handle, including reporting errors.
+ */
+static gsize
+soup_body_input_stream_read_chunked_buffered (SoupBodyInputStream *bistream,
+                                              guint8              *buffer,
+                                              gsize                count)
+{
+        SoupBodyInputStreamPrivate *priv = soup_body_input_stream_get_instance_private (bistream);
+	SoupFilterInputStream *fstream = SOUP_FILTER_INPUT_STREAM (priv->base_stream);
+	const guint8 *data, *eol, *p;
+	gsize avail, n, nread = 0;
+	guint64 chunk_size;
+
+	while (nread < count) {
+		data = soup_filter_input_stream_peek_buffer (fstream, &avail);
+		if (!avail)
+			break;
+
+		switch (priv->chunked_state) {
+		case SOUP_BODY_INPUT_STREAM_STATE_CHUNK:
+			n = MIN (MIN (avail, (gsize)priv->read_length), count - nread);
+			if (buffer)
+				memcpy (buffer + nread, data, n);
+			soup_filter_input_stream_consume (fstream, n);
+			nread += n;
+			priv->read_length -= n;
+			if (priv->read_length == 0)
+				priv->chunked_state = SOUP_BODY_INPUT_STREAM_STATE_CHUNK_END;
+			break;
+
+		case SOUP_BODY_INPUT_STREAM_STATE_CHUNK_END:
+			if (avail < 2 || data[0] != '\r' || data[1] != '\n')
+				return nread;
+			soup_filter_input_stream_consume (fstream, 2);
+			priv->chunked_state = SOUP_BODY_INPUT_STREAM_STATE_CHUNK_SIZE;
+			break;
+
+		case SOUP_BODY_INPUT_STREAM_STATE_CHUNK_SIZE:
+			eol = memchr (data, '\n', MIN (avail, CHUNK_SIZE_LINE_MAX));
+			if (!eol || eol == data || eol[-1] != '\r')
+				return nread;
+
+			chunk_size = 0;
+			for (p = data; p < eol - 1 && g_ascii_isxdigit (*p); p++) {
+				if (chunk_size > (guint64)G_MAXOFFSET >> 4)
+					return nread;
+				chunk_size = (chunk_size << 4) | g_ascii_xdigit_value (*p);
+			}
+			/* The last chunk and its trailers take the slow path */
+			if (p == data || (p != eol - 1 && *p != ';') || chunk_size == 0)
+				return nread;
+
+			soup_filter_input_stream_consume (fstream, eol + 1 - data);
+			priv->read_length = (goffset)chunk_size;
+			priv->chunked_state = SOUP_BODY_INPUT_STREAM_STATE_CHUNK;
+			break;
+
+		default:
+			return nread;
+		}
+	}
+
+	return nread;
+}
+
 static gssize
 soup_body_input_stream_read_chunked (SoupBodyInputStream  *bistream,
 				     void                 *buffer,
@@ -174,7 +269,9 @@ soup_body_input_stream_read_chunked (SoupBodyInputStream  *bistream,
 {
         SoupBodyInputStreamPrivate *priv = soup_body_input_stream_get_instance_private (bistream);
 	SoupFilterInputStream *fstream = SOUP_FILTER_INPUT_STREAM (priv->base_stream);
-	char metabuf[128];
+	char metabuf[CHUNK_SIZE_LINE_MAX];
+	const guint8 *buffered;
+	gsize buffered_length, read_size;
 	gssize nread;
         guint64 chunk_size;
         gchar *end;
@@ -233,18 +330,51 @@ again:
 		break;
 
 	case SOUP_BODY_INPUT_STREAM_STATE_CHUNK:
+		/* Read ahead when the caller's buffer or the chunk are
+		 * small, so that the following chunks can be decoded
+		 * from the buffer without going back to the socket.
+		 */
+		read_size = soup_filter_input_stream_get_read_size (fstream);
+		if (count < read_size || (priv->read_length < count && priv->read_length < read_size)) {
+			nread = soup_body_input_stream_read_ahead (bistream, read_size,
+								   blocking, cancellable, error);
+			if (nread == 0) {
+				priv->eof = TRUE;
+				g_set_error_literal (error, G_IO_ERROR,
+						     G_IO_ERROR_PARTIAL_INPUT,
+						     _("Connection terminated unexpectedly"));
+				return -1;
+			}
+			if (nread < 0)
+				return nread;
+
+			return soup_body_input_stream_read_chunked_buffered (bistream, buffer, count);
+		}
+
 		nread = soup_body_input_stream_read_raw (
 			bistream, buffer,
 			MIN (count, priv->read_length),
 			blocking, cancellable, error);
 		if (nread > 0) {
 			priv->read_length -= nread;
-			if (priv->read_length == 0)
+			if (priv->read_length == 0) {
 				priv->chunked_state = SOUP_BODY_INPUT_STREAM_STATE_CHUNK_END;
+				nread += soup_body_input_stream_read_chunked_buffered (
+					bistream, buffer ? (guint8 *)buffer + nread : NULL,
+					count - nread);
+			}
 		}
 		return nread;
 
 	case SOUP_BODY_INPUT_STREAM_STATE_CHUNK_END:
+		/* The CRLF after the chunk data is usually already buffered */
+		buffered = soup_filter_input_stream_peek_buffer (fstream, &buffered_length);
+		if (buffered_length >= 2 && buffered[0] == '\r' && buffered[1] == '\n') {
+			soup_filter_input_stream_consume (fstream, 2);
+			priv->chunked_state = SOUP_BODY_INPUT_STREAM_STATE_CHUNK_SIZE;
+			break;
+		}
+
 		nread = soup_filter_input_stream_read_until (
 			SOUP_FILTER_INPUT_STREAM (priv->base_stream),
 			metabuf, sizeof (metabuf),
@@ -325,6 +455,22 @@ read_internal (GInputStream  *stream,
 				return 0;
 		}
 
+		/* Turn small reads into fewer, larger reads on the
+		 * socket while the body keeps arriving fast.
+		 */
+		if (SOUP_IS_FILTER_INPUT_STREAM (priv->base_stream)) {
+			gsize read_size = soup_filter_input_stream_get_read_size (SOUP_FILTER_INPUT_STREAM (priv->base_stream));
+
+			if (priv->read_length != -1)
+				read_size = MIN (read_size, priv->read_length);
+			if (count < read_size) {
+				nread = soup_body_input_stream_read_ahead (bistream, read_size,
+									   blocking, cancellable, error);
+				if (nread < 0)
+					return nread;
+			}
+		}
+
 		nread = soup_body_input_stream_read_raw (bistream, buffer, count,
 							 blocking, cancellable, error);
 		if (priv->read_length != -1 && nread > 0) {
@@ -580,3 +726,36 @@ soup_body_input_stream_new (GInputStream *base_stream,
 			     "content-length", content_length,
 			     NULL);
 }
+
+/* Returns how many body bytes are left to read from the base stream
+ * when that is known in advance, or -1. Used by callers that move the
+ * body past this stream, reporting it with soup_body_input_stream_skipped().
+ */
+goffset
+soup_body_input_stream_get_remaining (SoupBodyInputStream *bistream)
+{
+        SoupBodyInputStreamPrivate *priv = soup_body_input_stream_get_instance_private (bistream);
+
+        if (priv->eof)
+                return 0;
+
+        if (priv->encoding != SOUP_ENCODING_CONTENT_LENGTH &&
+            priv->encoding != SOUP_ENCODING_EOF)
+                return -1;
+
+        return priv->read_length;
+}
+
+void
+soup_body_input_stream_skipped (SoupBodyInputStream *bistream,
+                                gsize                count)
+{
+        SoupBodyInputStreamPrivate *priv = soup_body_input_stream_get_instance_private (bistream);
+
+        g_return_if_fail (priv->read_length >= 0 && count <= (gsize)priv->read_length);
+
+        priv->read_length -= count;
+        priv->pos += count;
+        if (priv->read_length == 0)
+                priv->eof = TRUE;
+}
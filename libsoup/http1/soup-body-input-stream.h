@@ -19,4 +19,8 @@ GInputStream *soup_body_input_stream_new (GInputStream *base_stream,
 					  SoupEncoding  encoding,
 					  goffset       content_length);
 
+goffset       soup_body_input_stream_get_remaining (SoupBodyInputStream *bistream);
+void          soup_body_input_stream_skipped       (SoupBodyInputStream *bistream,
+						    gsize                count);
+
 G_END_DECLS
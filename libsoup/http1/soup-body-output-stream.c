@@ -416,3 +416,19 @@ soup_body_output_stream_new (GOutputStream *base_stream,
 			     "content-length", content_length,
 			     NULL);
 }
+
+/* Accounts for @count bytes of body that the caller wrote to the base
+ * stream's underlying socket directly (eg, with sendfile(2)), so that
+ * Content-Length truncation stays correct. Only valid for raw encodings.
+ */
+void
+soup_body_output_stream_advance (SoupBodyOutputStream *bostream,
+                                 gsize                 count)
+{
+        SoupBodyOutputStreamPrivate *priv = soup_body_output_stream_get_instance_private (bostream);
+
+        g_return_if_fail (priv->encoding != SOUP_ENCODING_CHUNKED);
+
+        if (priv->write_length)
+                priv->written += count;
+}
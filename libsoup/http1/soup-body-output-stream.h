@@ -17,4 +17,7 @@ GOutputStream *soup_body_output_stream_new (GOutputStream *base_stream,
 					    SoupEncoding   encoding,
 					    goffset        content_length);
 
+void           soup_body_output_stream_advance (SoupBodyOutputStream *bostream,
+                                                gsize                 count);
+
 G_END_DECLS
@@ -45,6 +45,15 @@ typedef struct {
 #ifdef HAVE_SYSPROF
         gint64 begin_time_nsec;
 #endif
+
+        /* Whether the request was sent before the response to the
+         * previous one was read.
+         */
+        gboolean pipelined;
+        /* Whether base.async_wait is waiting for the messages ahead
+         * in the pipeline rather than for an async operation.
+         */
+        gboolean pipeline_wait;
 } SoupMessageIOHTTP1;
 
 typedef struct {
@@ -54,9 +63,27 @@ typedef struct {
         GInputStream *istream;
         GOutputStream *ostream;
 
-        SoupMessageIOHTTP1 *msg_io;
+        /* The messages sent on the connection, in the order their
+         * requests are written. Responses come back in the same
+         * order, so only the first message that hasn't finished
+         * reading can read.
+         */
+        GQueue msg_ios;
         gboolean is_reusable;
         gboolean ever_used;
+
+        /* The server kept the connection open after an HTTP/1.1
+         * response, so more requests can be pipelined on it.
+         */
+        gboolean can_pipeline;
+        /* A response in the pipeline was lost or abandoned, so the
+         * connection can't be used once the pending messages are done.
+         */
+        gboolean pipeline_broken;
+        /* The server closed the connection with pipelined requests
+         * still unanswered.
+         */
+        gboolean pipeline_failed;
 } SoupClientMessageIOHTTP1;
 
 #define RESPONSE_BLOCK_SIZE 8192
@@ -76,18 +103,146 @@ soup_client_message_io_http1_destroy (SoupClientMessageIO *iface)
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
 
         g_clear_object (&io->iostream);
-        g_clear_pointer (&io->msg_io, soup_message_io_http1_free);
+        g_queue_clear_full (&io->msg_ios, (GDestroyNotify)soup_message_io_http1_free);
 
         g_slice_free (SoupClientMessageIOHTTP1, io);
 }
 
+static SoupMessageIOHTTP1 *
+soup_client_message_io_http1_get_msg_io (SoupClientMessageIOHTTP1 *io,
+                                         SoupMessage              *msg)
+{
+        GList *l;
+
+        for (l = io->msg_ios.head; l; l = g_list_next (l)) {
+                SoupMessageIOHTTP1 *msg_io = (SoupMessageIOHTTP1 *)l->data;
+
+                if (msg_io->item->msg == msg)
+                        return msg_io;
+        }
+
+        return NULL;
+}
+
+/* The message whose response is the next one on the wire */
+static SoupMessageIOHTTP1 *
+pipeline_get_reader (SoupClientMessageIOHTTP1 *io)
+{
+        GList *l;
+
+        for (l = io->msg_ios.head; l; l = g_list_next (l)) {
+                SoupMessageIOHTTP1 *msg_io = (SoupMessageIOHTTP1 *)l->data;
+
+                if (msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_FINISHING)
+                        return msg_io;
+        }
+
+        return NULL;
+}
+
+/* Requests are written in order, and responses are read in the same
+ * order, so @msg_io can only write once the requests ahead of it are
+ * fully written, and only read once the responses ahead of it are
+ * fully read.
+ */
+static gboolean
+pipeline_is_turn (SoupClientMessageIOHTTP1 *io,
+                  SoupMessageIOHTTP1       *msg_io)
+{
+        GList *l;
+
+        if (SOUP_MESSAGE_IO_STATE_ACTIVE (msg_io->base.read_state))
+                return pipeline_get_reader (io) == msg_io;
+
+        for (l = io->msg_ios.head; l && l->data != msg_io; l = g_list_next (l)) {
+                SoupMessageIOHTTP1 *prev = (SoupMessageIOHTTP1 *)l->data;
+
+                if (prev->base.write_state != SOUP_MESSAGE_IO_STATE_DONE)
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+static void
+pipeline_wait (SoupMessageIOHTTP1 *msg_io)
+{
+        if (msg_io->base.async_wait)
+                return;
+
+        msg_io->base.async_wait = g_cancellable_new ();
+        msg_io->pipeline_wait = TRUE;
+}
+
+static void
+pipeline_wake (SoupMessageIOHTTP1 *msg_io)
+{
+        GCancellable *async_wait;
+
+        if (!msg_io->pipeline_wait)
+                return;
+
+        msg_io->pipeline_wait = FALSE;
+        async_wait = g_steal_pointer (&msg_io->base.async_wait);
+        g_cancellable_cancel (async_wait);
+        g_object_unref (async_wait);
+}
+
+/* Wakes up the messages that can now use the connection */
+static void
+pipeline_kick (SoupClientMessageIOHTTP1 *io)
+{
+        GList *l;
+
+        for (l = io->msg_ios.head; l; l = g_list_next (l)) {
+                SoupMessageIOHTTP1 *msg_io = (SoupMessageIOHTTP1 *)l->data;
+
+                if (msg_io->pipeline_wait && pipeline_is_turn (io, msg_io))
+                        pipeline_wake (msg_io);
+        }
+}
+
+/* The responses to the messages behind @msg_io will never be read
+ * on this connection. Fail them with an error that makes the session
+ * send them again, since only requests that are safe to repeat are
+ * pipelined.
+ */
+static void
+pipeline_abort (SoupClientMessageIOHTTP1 *io,
+                SoupMessageIOHTTP1       *msg_io)
+{
+        GList *l;
+
+        io->pipeline_broken = TRUE;
+        io->can_pipeline = FALSE;
+
+        l = g_queue_find (&io->msg_ios, msg_io);
+        for (l = l ? g_list_next (l) : NULL; l; l = g_list_next (l)) {
+                SoupMessageIOHTTP1 *next = (SoupMessageIOHTTP1 *)l->data;
+
+                if (!next->base.async_error) {
+                        next->base.async_error = g_error_new_literal (G_IO_ERROR,
+                                                                      G_IO_ERROR_CONNECTION_CLOSED,
+                                                                      _("Connection terminated unexpectedly"));
+                }
+                pipeline_wake (next);
+        }
+}
+
+static gboolean
+message_io_request_started (SoupMessageIOHTTP1 *msg_io)
+{
+        return msg_io->base.write_state != SOUP_MESSAGE_IO_STATE_HEADERS ||
+                msg_io->base.written > 0;
+}
+
 static int
-soup_client_message_io_http1_get_priority (SoupClientMessageIOHTTP1 *io)
+soup_client_message_io_http1_get_priority (SoupMessageIOHTTP1 *msg_io)
 {
-        if (!io->msg_io->item->task)
+        if (!msg_io->item->task)
                 return G_PRIORITY_DEFAULT;
 
-        return g_task_get_priority (io->msg_io->item->task);
+        return g_task_get_priority (msg_io->item->task);
 }
 
 static void
@@ -95,18 +250,35 @@ soup_client_message_io_complete (SoupClientMessageIOHTTP1 *io,
                                  SoupMessage *msg,
                                  SoupMessageIOCompletion completion)
 {
+        SoupMessageIOHTTP1 *msg_io;
         SoupMessageIOCompletionFn completion_cb;
         gpointer completion_data;
 
-        completion_cb = io->msg_io->base.completion_cb;
-        completion_data = io->msg_io->base.completion_data;
+        msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
+        g_return_if_fail (msg_io != NULL);
+
+        completion_cb = msg_io->base.completion_cb;
+        completion_data = msg_io->base.completion_data;
 
         g_object_ref (msg);
         if (io->istream)
                 g_signal_handlers_disconnect_by_data (io->istream, msg);
-        if (io->msg_io->base.body_ostream)
-                g_signal_handlers_disconnect_by_data (io->msg_io->base.body_ostream, msg);
-        g_clear_pointer (&io->msg_io, soup_message_io_http1_free);
+        if (msg_io->base.body_ostream)
+                g_signal_handlers_disconnect_by_data (msg_io->base.body_ostream, msg);
+
+        /* If the request went out but its response wasn't fully read,
+         * the rest of the response is still on the wire ahead of the
+         * responses to the requests pipelined after it.
+         */
+        if (completion != SOUP_MESSAGE_IO_COMPLETE && message_io_request_started (msg_io)) {
+                pipeline_abort (io, msg_io);
+                io->is_reusable = FALSE;
+        }
+
+        g_queue_remove (&io->msg_ios, msg_io);
+        soup_message_io_http1_free (msg_io);
+        pipeline_kick (io);
+
         if (completion_cb)
                 completion_cb (G_OBJECT (msg), completion, completion_data);
         g_object_unref (msg);
@@ -117,10 +289,13 @@ soup_client_message_io_http1_finished (SoupClientMessageIO *iface,
                                        SoupMessage         *msg)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
         SoupMessageIOCompletion completion;
 
-        if ((io->msg_io->base.read_state >= SOUP_MESSAGE_IO_STATE_FINISHING &&
-             io->msg_io->base.write_state >= SOUP_MESSAGE_IO_STATE_FINISHING))
+        g_return_if_fail (msg_io != NULL);
+
+        if ((msg_io->base.read_state >= SOUP_MESSAGE_IO_STATE_FINISHING &&
+             msg_io->base.write_state >= SOUP_MESSAGE_IO_STATE_FINISHING))
                 completion = SOUP_MESSAGE_IO_COMPLETE;
         else
                 completion = SOUP_MESSAGE_IO_INTERRUPTED;
@@ -132,8 +307,17 @@ static void
 soup_client_message_io_http1_stolen (SoupClientMessageIO *iface)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = pipeline_get_reader (io);
+
+        if (!msg_io)
+                msg_io = g_queue_peek_tail (&io->msg_ios);
+        g_return_if_fail (msg_io != NULL);
 
-        soup_client_message_io_complete (io, io->msg_io->item->msg, SOUP_MESSAGE_IO_STOLEN);
+        /* Whatever was pipelined behind the message that took over
+         * the connection has to go elsewhere.
+         */
+        pipeline_abort (io, msg_io);
+        soup_client_message_io_complete (io, msg_io->item->msg, SOUP_MESSAGE_IO_STOLEN);
 }
 
 static void
@@ -143,16 +327,17 @@ request_body_stream_wrote_data_cb (SoupMessage *msg,
                                    gboolean     is_metadata)
 {
         SoupClientMessageIOHTTP1 *client_io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (client_io, msg);
 
-        if (client_io->msg_io->metrics) {
-                client_io->msg_io->metrics->request_body_bytes_sent += count;
+        if (msg_io->metrics) {
+                msg_io->metrics->request_body_bytes_sent += count;
                 if (!is_metadata)
-                        client_io->msg_io->metrics->request_body_size += count;
+                        msg_io->metrics->request_body_size += count;
         }
 
         if (!is_metadata) {
-                if (client_io->msg_io->logger)
-                        soup_logger_log_request_data (client_io->msg_io->logger, msg, (const char *)buffer, count);
+                if (msg_io->logger)
+                        soup_logger_log_request_data (msg_io->logger, msg, (const char *)buffer, count);
                 soup_message_wrote_body_data (msg, count);
         }
 }
@@ -163,6 +348,7 @@ request_body_stream_wrote_cb (GOutputStream *ostream,
                               SoupMessage   *msg)
 {
         SoupClientMessageIOHTTP1 *io;
+        SoupMessageIOHTTP1 *msg_io;
         gssize nwrote;
         GCancellable *async_wait;
         GError *error = NULL;
@@ -170,18 +356,19 @@ request_body_stream_wrote_cb (GOutputStream *ostream,
         nwrote = g_output_stream_splice_finish (ostream, result, &error);
 
         io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
-        if (!io || !io->msg_io || !io->msg_io->base.async_wait || io->msg_io->base.body_ostream != ostream) {
+        msg_io = io ? soup_client_message_io_http1_get_msg_io (io, msg) : NULL;
+        if (!msg_io || !msg_io->base.async_wait || msg_io->base.body_ostream != ostream) {
                 g_clear_error (&error);
                 g_object_unref (msg);
                 return;
         }
 
         if (nwrote != -1)
-                io->msg_io->base.write_state = SOUP_MESSAGE_IO_STATE_BODY_FLUSH;
+                msg_io->base.write_state = SOUP_MESSAGE_IO_STATE_BODY_FLUSH;
 
         if (error)
-                g_propagate_error (&io->msg_io->base.async_error, error);
-        async_wait = g_steal_pointer (&io->msg_io->base.async_wait);
+                g_propagate_error (&msg_io->base.async_error, error);
+        async_wait = g_steal_pointer (&msg_io->base.async_wait);
         g_cancellable_cancel (async_wait);
         g_object_unref (async_wait);
 
@@ -196,18 +383,20 @@ closed_async (GObject      *source,
         GOutputStream *body_ostream = G_OUTPUT_STREAM (source);
         SoupMessage *msg = user_data;
         SoupClientMessageIOHTTP1 *io;
+        SoupMessageIOHTTP1 *msg_io;
         GCancellable *async_wait;
 
         io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
-        if (!io || !io->msg_io || !io->msg_io->base.async_wait || io->msg_io->base.body_ostream != body_ostream) {
+        msg_io = io ? soup_client_message_io_http1_get_msg_io (io, msg) : NULL;
+        if (!msg_io || !msg_io->base.async_wait || msg_io->base.body_ostream != body_ostream) {
                 g_object_unref (msg);
                 return;
         }
 
-        g_output_stream_close_finish (body_ostream, result, &io->msg_io->base.async_error);
-        g_clear_object (&io->msg_io->base.body_ostream);
+        g_output_stream_close_finish (body_ostream, result, &msg_io->base.async_error);
+        g_clear_object (&msg_io->base.body_ostream);
 
-        async_wait = g_steal_pointer (&io->msg_io->base.async_wait);
+        async_wait = g_steal_pointer (&msg_io->base.async_wait);
         g_cancellable_cancel (async_wait);
         g_object_unref (async_wait);
 
@@ -247,8 +436,6 @@ write_headers (SoupMessage  *msg,
 {
         GUri *uri = soup_message_get_uri (msg);
         char *uri_string;
-        SoupMessageHeadersIter iter;
-        const char *name, *value;
 
         if (soup_message_get_method (msg) == SOUP_METHOD_CONNECT) {
                 char *uri_host = soup_uri_get_host_for_headers (uri);
@@ -287,10 +474,8 @@ write_headers (SoupMessage  *msg,
 
         *encoding = soup_message_headers_get_encoding (soup_message_get_request_headers (msg));
 
-        soup_message_headers_iter_init (&iter, soup_message_get_request_headers (msg));
-        while (soup_message_headers_iter_next (&iter, &name, &value))
-                g_string_append_printf (header, "%s: %s\r\n", name, value);
-        g_string_append (header, "\r\n");
+        soup_message_headers_serialize (soup_message_get_request_headers (msg), header);
+        g_string_append_len (header, "\r\n", 2);
 }
 
 /* Attempts to push forward the writing side of @msg's I/O. Returns
@@ -301,12 +486,13 @@ write_headers (SoupMessage  *msg,
  */
 static gboolean
 io_write (SoupClientMessageIOHTTP1 *client_io,
+          SoupMessageIOHTTP1       *msg_io,
           gboolean                  blocking,
           GCancellable             *cancellable,
           GError                  **error)
 {
-        SoupMessageIOData *io = &client_io->msg_io->base;
-        SoupMessage *msg = client_io->msg_io->item->msg;
+        SoupMessageIOData *io = &msg_io->base;
+        SoupMessage *msg = msg_io->item->msg;
         SoupSessionFeature *logger;
         gssize nwrote;
 
@@ -335,8 +521,8 @@ io_write (SoupClientMessageIOHTTP1 *client_io,
                         if (nwrote == -1)
                                 return FALSE;
                         io->written += nwrote;
-                        if (client_io->msg_io->metrics)
-                                client_io->msg_io->metrics->request_header_bytes_sent += nwrote;
+                        if (msg_io->metrics)
+                                msg_io->metrics->request_header_bytes_sent += nwrote;
                 }
 
                 io->written = 0;
@@ -360,9 +546,9 @@ io_write (SoupClientMessageIOHTTP1 *client_io,
                                                                 io->write_encoding,
                                                                 io->write_length);
                 io->write_state = SOUP_MESSAGE_IO_STATE_BODY;
-                logger = soup_session_get_feature_for_message (client_io->msg_io->item->session,
+                logger = soup_session_get_feature_for_message (msg_io->item->session,
                                                                SOUP_TYPE_LOGGER, msg);
-                client_io->msg_io->logger = logger ? SOUP_LOGGER (logger) : NULL;
+                msg_io->logger = logger ? SOUP_LOGGER (logger) : NULL;
                 break;
 
         case SOUP_MESSAGE_IO_STATE_BODY:
@@ -393,7 +579,7 @@ io_write (SoupClientMessageIOHTTP1 *client_io,
                                 g_output_stream_splice_async (io->body_ostream,
                                                               soup_message_get_request_body_stream (msg),
                                                               G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
-                                                              soup_client_message_io_http1_get_priority (client_io),
+                                                              soup_client_message_io_http1_get_priority (msg_io),
                                                               cancellable,
                                                               (GAsyncReadyCallback)request_body_stream_wrote_cb,
                                                               g_object_ref (msg));
@@ -412,7 +598,7 @@ io_write (SoupClientMessageIOHTTP1 *client_io,
                         } else {
                                 io->async_wait = g_cancellable_new ();
                                 g_output_stream_close_async (io->body_ostream,
-                                                             soup_client_message_io_http1_get_priority (client_io),
+                                                             soup_client_message_io_http1_get_priority (msg_io),
                                                              cancellable,
                                                              closed_async, g_object_ref (msg));
                         }
@@ -429,6 +615,7 @@ io_write (SoupClientMessageIOHTTP1 *client_io,
         case SOUP_MESSAGE_IO_STATE_FINISHING:
                 io->write_state = SOUP_MESSAGE_IO_STATE_DONE;
                 io->read_state = SOUP_MESSAGE_IO_STATE_HEADERS;
+                pipeline_kick (client_io);
                 break;
 
         default:
@@ -493,16 +680,23 @@ response_network_stream_read_data_cb (SoupMessage *msg,
                                       guint        count)
 {
         SoupClientMessageIOHTTP1 *client_io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
+        SoupMessageIOHTTP1 *msg_io = pipeline_get_reader (client_io);
 
-        if (client_io->msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY_START) {
-                client_io->msg_io->response_header_bytes_received += count;
-                if (client_io->msg_io->metrics)
-                        client_io->msg_io->metrics->response_header_bytes_received += count;
+        /* Every message in the pipeline is connected to the stream,
+         * but the data belongs to the one reading.
+         */
+        if (!msg_io || msg_io->item->msg != msg)
+                return;
+
+        if (msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY_START) {
+                msg_io->response_header_bytes_received += count;
+                if (msg_io->metrics)
+                        msg_io->metrics->response_header_bytes_received += count;
                 return;
         }
 
-        if (client_io->msg_io->metrics)
-                client_io->msg_io->metrics->response_body_bytes_received += count;
+        if (msg_io->metrics)
+                msg_io->metrics->response_body_bytes_received += count;
 
         soup_message_got_body_data (msg, count);
 }
@@ -515,12 +709,13 @@ response_network_stream_read_data_cb (SoupMessage *msg,
  */
 static gboolean
 io_read (SoupClientMessageIOHTTP1 *client_io,
+         SoupMessageIOHTTP1       *msg_io,
          gboolean                  blocking,
          GCancellable             *cancellable,
          GError                  **error)
 {
-        SoupMessageIOData *io = &client_io->msg_io->base;
-        SoupMessage *msg = client_io->msg_io->item->msg;
+        SoupMessageIOData *io = &msg_io->base;
+        SoupMessage *msg = msg_io->item->msg;
         gboolean succeeded;
         gboolean is_first_read;
         gushort extra_bytes;
@@ -541,14 +736,14 @@ io_read (SoupClientMessageIOHTTP1 *client_io,
                 /* Adjust the header and body bytes received, since we might
                  * have read part of the body already that is queued by the stream.
                  */
-                if (client_io->msg_io->response_header_bytes_received > io->read_header_buf->len + extra_bytes) {
-                        response_body_bytes_received = client_io->msg_io->response_header_bytes_received - io->read_header_buf->len - extra_bytes;
-                        if (client_io->msg_io->metrics) {
-                                client_io->msg_io->metrics->response_body_bytes_received = response_body_bytes_received;
-                                client_io->msg_io->metrics->response_header_bytes_received -= response_body_bytes_received;
+                if (msg_io->response_header_bytes_received > io->read_header_buf->len + extra_bytes) {
+                        response_body_bytes_received = msg_io->response_header_bytes_received - io->read_header_buf->len - extra_bytes;
+                        if (msg_io->metrics) {
+                                msg_io->metrics->response_body_bytes_received = response_body_bytes_received;
+                                msg_io->metrics->response_header_bytes_received -= response_body_bytes_received;
                         }
                 }
-                client_io->msg_io->response_header_bytes_received = 0;
+                msg_io->response_header_bytes_received = 0;
 
                 succeeded = parse_headers (msg,
                                            (char *)io->read_header_buf->data,
@@ -570,6 +765,8 @@ io_read (SoupClientMessageIOHTTP1 *client_io,
                                                             SOUP_HEADER_VALUE_TRUSTED);
                         soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_RESPONSE_END);
                         io->read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
+                        /* Nothing that follows on the connection can be trusted */
+                        pipeline_abort (client_io, msg_io);
                         break;
                 }
 
@@ -636,7 +833,7 @@ io_read (SoupClientMessageIOHTTP1 *client_io,
                                                                                  io->read_encoding,
                                                                                  io->read_length);
 
-                        io->body_istream = soup_session_setup_message_body_input_stream (client_io->msg_io->item->session,
+                        io->body_istream = soup_session_setup_message_body_input_stream (msg_io->item->session,
                                                                                          msg, body_istream,
                                                                                          SOUP_STAGE_MESSAGE_BODY);
                         g_object_unref (body_istream);
@@ -663,8 +860,8 @@ io_read (SoupClientMessageIOHTTP1 *client_io,
                 if (nread == 0)
                         io->read_state = SOUP_MESSAGE_IO_STATE_BODY_DONE;
 
-                if (client_io->msg_io->metrics)
-                        client_io->msg_io->metrics->response_body_size += nread;
+                if (msg_io->metrics)
+                        msg_io->metrics->response_body_size += nread;
 
                 break;
         }
@@ -672,8 +869,13 @@ io_read (SoupClientMessageIOHTTP1 *client_io,
         case SOUP_MESSAGE_IO_STATE_BODY_DONE:
                 io->read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
                 soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_RESPONSE_END);
-                client_io->is_reusable = soup_message_is_keepalive (msg);
+                client_io->is_reusable = soup_message_is_keepalive (msg) && !client_io->pipeline_broken;
                 client_io->ever_used = TRUE;
+                if (client_io->is_reusable)
+                        client_io->can_pipeline = soup_message_get_http_version (msg) == SOUP_HTTP_1_1;
+                else
+                        pipeline_abort (client_io, msg_io);
+                pipeline_kick (client_io);
                 soup_message_got_body (msg);
                 break;
 
@@ -692,12 +894,14 @@ static gboolean
 request_is_restartable (SoupMessage *msg, GError *error)
 {
         SoupClientMessageIOHTTP1 *client_io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
+        SoupMessageIOHTTP1 *msg_io;
         SoupMessageIOData *io;
 
-        if (!client_io || !client_io->msg_io)
+        msg_io = client_io ? soup_client_message_io_http1_get_msg_io (client_io, msg) : NULL;
+        if (!msg_io)
                 return FALSE;
 
-        io = &client_io->msg_io->base;
+        io = &msg_io->base;
 
         return (io->read_state <= SOUP_MESSAGE_IO_STATE_HEADERS &&
                 io->read_header_buf->len == 0 &&
@@ -709,42 +913,65 @@ request_is_restartable (SoupMessage *msg, GError *error)
                 SOUP_METHOD_IS_IDEMPOTENT (soup_message_get_method (msg)));
 }
 
+static gboolean
+message_io_is_current (SoupClientMessageIOHTTP1 *client_io,
+                       SoupMessageIOHTTP1       *msg_io,
+                       SoupMessage              *msg)
+{
+        return (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg) == client_io &&
+                soup_client_message_io_http1_get_msg_io (client_io, msg) == msg_io;
+}
+
 static gboolean
 io_run_until (SoupClientMessageIOHTTP1 *client_io,
+              SoupMessage              *msg,
               gboolean                  blocking,
               SoupMessageIOState        read_state,
               SoupMessageIOState        write_state,
               GCancellable             *cancellable,
               GError                  **error)
 {
+        SoupMessageIOHTTP1 *msg_io;
         SoupMessageIOData *io;
-        SoupMessage *msg;
         gboolean progress = TRUE, done;
         GError *my_error = NULL;
 
         g_assert (client_io); // Silence clang static analysis
-        io = &client_io->msg_io->base;
+        msg_io = soup_client_message_io_http1_get_msg_io (client_io, msg);
 
         if (g_cancellable_set_error_if_cancelled (cancellable, error))
                 return FALSE;
-        else if (!io) {
+        else if (!msg_io) {
                 g_set_error_literal (error, G_IO_ERROR,
                                      G_IO_ERROR_CANCELLED,
                                      _("Operation was cancelled"));
                 return FALSE;
         }
 
-        msg = client_io->msg_io->item->msg;
+        io = &msg_io->base;
         g_object_ref (msg);
 
-        while (progress && (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg) == client_io &&
+        while (progress && message_io_is_current (client_io, msg_io, msg) &&
                !io->paused && !io->async_wait &&
                (io->read_state < read_state || io->write_state < write_state)) {
 
+                if (io->async_error) {
+                        /* The connection was given up on by a message ahead in the pipeline */
+                        my_error = g_steal_pointer (&io->async_error);
+                        break;
+                }
+
+                if ((SOUP_MESSAGE_IO_STATE_ACTIVE (io->read_state) ||
+                     SOUP_MESSAGE_IO_STATE_ACTIVE (io->write_state)) &&
+                    !pipeline_is_turn (client_io, msg_io)) {
+                        pipeline_wait (msg_io);
+                        break;
+                }
+
                 if (SOUP_MESSAGE_IO_STATE_ACTIVE (io->read_state))
-                        progress = io_read (client_io, blocking, cancellable, &my_error);
+                        progress = io_read (client_io, msg_io, blocking, cancellable, &my_error);
                 else if (SOUP_MESSAGE_IO_STATE_ACTIVE (io->write_state))
-                        progress = io_write (client_io, blocking, cancellable, &my_error);
+                        progress = io_write (client_io, msg_io, blocking, cancellable, &my_error);
                 else
                         progress = FALSE;
         }
@@ -753,7 +980,7 @@ io_run_until (SoupClientMessageIOHTTP1 *client_io,
                 g_propagate_error (error, my_error);
                 g_object_unref (msg);
                 return FALSE;
-        } else if ((SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg) != client_io) {
+        } else if (!message_io_is_current (client_io, msg_io, msg)) {
                 g_set_error_literal (error, G_IO_ERROR,
                                      G_IO_ERROR_CANCELLED,
                                      _("Operation was cancelled"));
@@ -789,8 +1016,8 @@ io_run_until (SoupClientMessageIOHTTP1 *client_io,
 
                 /* FIXME: Expand and generalise sysprof support:
                  * https://gitlab.gnome.org/GNOME/sysprof/-/issues/43 */
-                sysprof_collector_mark_printf (client_io->msg_io->begin_time_nsec,
-                                               SYSPROF_CAPTURE_CURRENT_TIME - client_io->msg_io->begin_time_nsec,
+                sysprof_collector_mark_printf (msg_io->begin_time_nsec,
+                                               SYSPROF_CAPTURE_CURRENT_TIME - msg_io->begin_time_nsec,
                                                "libsoup", "message",
                                                "%s request/response to %s: "
                                                "read %" G_GOFFSET_FORMAT "B, "
@@ -819,9 +1046,16 @@ soup_message_io_finish (SoupMessage  *msg,
 {
         if (request_is_restartable (msg, error)) {
                 SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg);
+                SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
+
+                /* A server that drops pipelined requests on the floor
+                 * shouldn't get any more of them.
+                 */
+                if (msg_io->pipelined && !io->pipeline_broken)
+                        io->pipeline_failed = TRUE;
 
                 /* Connection got closed, but we can safely try again. */
-                io->msg_io->item->state = SOUP_MESSAGE_RESTARTING;
+                msg_io->item->state = SOUP_MESSAGE_RESTARTING;
         } else if (error) {
                 soup_message_set_metrics_timestamp (msg, SOUP_MESSAGE_METRICS_RESPONSE_END);
         }
@@ -829,6 +1063,36 @@ soup_message_io_finish (SoupMessage  *msg,
         soup_message_io_finished (msg);
 }
 
+static GSource *
+message_io_get_source (SoupClientMessageIOHTTP1 *client_io,
+                       SoupMessageIOHTTP1       *msg_io,
+                       GCancellable             *cancellable,
+                       SoupMessageIOSourceFunc   callback,
+                       gpointer                  user_data)
+{
+        GSource *source;
+
+        source = soup_message_io_data_get_source (&msg_io->base, G_OBJECT (msg_io->item->msg),
+                                                  client_io->istream,
+                                                  client_io->ostream,
+                                                  cancellable,
+                                                  callback,
+                                                  user_data);
+
+        /* While waiting for its turn the message isn't polling any
+         * stream, so it has to be woken up on cancellation too.
+         */
+        if (msg_io->pipeline_wait && cancellable) {
+                GSource *cancellable_source = g_cancellable_source_new (cancellable);
+
+                g_source_set_dummy_callback (cancellable_source);
+                g_source_add_child_source (source, cancellable_source);
+                g_source_unref (cancellable_source);
+        }
+
+        return source;
+}
+
 static void soup_client_message_io_http1_run (SoupClientMessageIO *iface, SoupMessage *msg, gboolean blocking);
 
 static gboolean
@@ -844,9 +1108,13 @@ soup_client_message_io_http1_run (SoupClientMessageIO *iface,
                                   gboolean             blocking)
 {
         SoupClientMessageIOHTTP1 *client_io = (SoupClientMessageIOHTTP1 *)iface;
-        SoupMessageIOData *io = &client_io->msg_io->base;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (client_io, msg);
+        SoupMessageIOData *io;
         GError *error = NULL;
 
+        g_return_if_fail (msg_io != NULL);
+
+        io = &msg_io->base;
         if (io->io_source) {
                 g_source_destroy (io->io_source);
                 g_clear_pointer (&io->io_source, g_source_unref);
@@ -854,27 +1122,25 @@ soup_client_message_io_http1_run (SoupClientMessageIO *iface,
 
         g_object_ref (msg);
 
-        if (io_run_until (client_io, blocking,
+        if (io_run_until (client_io, msg, blocking,
                           SOUP_MESSAGE_IO_STATE_DONE,
                           SOUP_MESSAGE_IO_STATE_DONE,
-                          client_io->msg_io->item->cancellable, &error)) {
+                          msg_io->item->cancellable, &error)) {
                 soup_message_io_finished (msg);
         } else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
                 g_clear_error (&error);
-                io->io_source = soup_message_io_data_get_source (io, G_OBJECT (msg),
-                                                                 client_io->istream,
-                                                                 client_io->ostream,
-                                                                 client_io->msg_io->item->cancellable,
-                                                                 (SoupMessageIOSourceFunc)io_run_ready,
-                                                                 NULL);
+                io->io_source = message_io_get_source (client_io, msg_io,
+                                                       msg_io->item->cancellable,
+                                                       (SoupMessageIOSourceFunc)io_run_ready,
+                                                       NULL);
                 g_source_set_priority (io->io_source,
-                                       soup_client_message_io_http1_get_priority (client_io));
+                                       soup_client_message_io_http1_get_priority (msg_io));
                 g_source_attach (io->io_source, g_main_context_get_thread_default ());
         } else {
-                if ((SoupClientMessageIOHTTP1 *)soup_message_get_io_data (msg) == client_io) {
-                        g_assert (!client_io->msg_io->item->error);
-                        client_io->msg_io->item->error = g_steal_pointer (&error);
-                        soup_message_io_finish (msg, client_io->msg_io->item->error);
+                if (message_io_is_current (client_io, msg_io, msg)) {
+                        g_assert (!msg_io->item->error);
+                        msg_io->item->error = g_steal_pointer (&error);
+                        soup_message_io_finish (msg, msg_io->item->error);
                 }
                 g_clear_error (&error);
 
@@ -891,7 +1157,7 @@ soup_client_message_io_http1_run_until_read (SoupClientMessageIO *iface,
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
 
-        if (io_run_until (io, TRUE,
+        if (io_run_until (io, msg, TRUE,
                           SOUP_MESSAGE_IO_STATE_BODY,
                           SOUP_MESSAGE_IO_STATE_ANY,
                           cancellable, error))
@@ -919,16 +1185,17 @@ static void
 io_run_until_read_async (SoupClientMessageIOHTTP1 *client_io,
                          GTask                    *task)
 {
-        SoupMessageIOData *io = &client_io->msg_io->base;
-        SoupMessage *msg = client_io->msg_io->item->msg;
+        SoupMessage *msg = g_task_get_source_object (task);
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (client_io, msg);
+        SoupMessageIOData *io = msg_io ? &msg_io->base : NULL;
         GError *error = NULL;
 
-        if (io->io_source) {
+        if (io && io->io_source) {
                 g_source_destroy (io->io_source);
                 g_clear_pointer (&io->io_source, g_source_unref);
         }
 
-        if (io_run_until (client_io, FALSE,
+        if (io_run_until (client_io, msg, FALSE,
                           SOUP_MESSAGE_IO_STATE_BODY,
                           SOUP_MESSAGE_IO_STATE_ANY,
                           g_task_get_cancellable (task),
@@ -940,12 +1207,10 @@ io_run_until_read_async (SoupClientMessageIOHTTP1 *client_io,
 
         if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
                 g_error_free (error);
-                io->io_source = soup_message_io_data_get_source (io, G_OBJECT (msg),
-                                                                 client_io->istream,
-                                                                 client_io->ostream,
-                                                                 g_task_get_cancellable (task),
-                                                                 (SoupMessageIOSourceFunc)io_run_until_read_ready,
-                                                                 task);
+                io->io_source = message_io_get_source (client_io, msg_io,
+                                                       g_task_get_cancellable (task),
+                                                       (SoupMessageIOSourceFunc)io_run_until_read_ready,
+                                                       task);
                 g_source_set_priority (io->io_source, g_task_get_priority (task));
                 g_source_attach (io->io_source, g_main_context_get_thread_default ());
                 return;
@@ -991,16 +1256,24 @@ soup_client_message_io_http1_skip (SoupClientMessageIO *iface,
                                    GError             **error)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io;
         gboolean success;
 
         g_object_ref (msg);
 
-        if (io && io->msg_io) {
-                if (io->msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY_DONE)
-                        io->msg_io->base.read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
+        msg_io = io ? soup_client_message_io_http1_get_msg_io (io, msg) : NULL;
+        if (msg_io) {
+                if (msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY_DONE) {
+                        /* The rest of the response is left unread */
+                        if (message_io_request_started (msg_io)) {
+                                pipeline_abort (io, msg_io);
+                                io->is_reusable = FALSE;
+                        }
+                        msg_io->base.read_state = SOUP_MESSAGE_IO_STATE_FINISHING;
+                }
         }
 
-        success = io_run_until (io, blocking,
+        success = io_run_until (io, msg, blocking,
                                 SOUP_MESSAGE_IO_STATE_DONE,
                                 SOUP_MESSAGE_IO_STATE_DONE,
                                 cancellable, error);
@@ -1013,8 +1286,10 @@ static void
 client_stream_eof (SoupClientInputStream    *stream,
                    SoupClientMessageIOHTTP1 *io)
 {
-        if (io && io->msg_io && io->msg_io->base.read_state == SOUP_MESSAGE_IO_STATE_BODY)
-                io->msg_io->base.read_state = SOUP_MESSAGE_IO_STATE_BODY_DONE;
+        SoupMessageIOHTTP1 *msg_io = io ? pipeline_get_reader (io) : NULL;
+
+        if (msg_io && msg_io->base.read_state == SOUP_MESSAGE_IO_STATE_BODY)
+                msg_io->base.read_state = SOUP_MESSAGE_IO_STATE_BODY_DONE;
 }
 
 static GInputStream *
@@ -1023,11 +1298,12 @@ soup_client_message_io_http1_get_response_stream (SoupClientMessageIO *iface,
                                                   GError             **error)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
         GInputStream *client_stream;
 
-        g_assert (io->msg_io && io->msg_io->item->msg == msg);
+        g_assert (msg_io);
 
-        client_stream = soup_client_input_stream_new (io->msg_io->base.body_istream, msg);
+        client_stream = soup_client_input_stream_new (msg_io->base.body_istream, msg);
         g_signal_connect (client_stream, "eof",
                           G_CALLBACK (client_stream_eof), io);
 
@@ -1061,10 +1337,13 @@ soup_client_message_io_http1_send_item (SoupClientMessageIO       *iface,
 #ifdef HAVE_SYSPROF
         msg_io->begin_time_nsec = SYSPROF_CAPTURE_CURRENT_TIME;
 #endif
-        if (io->msg_io)
-                g_warn_if_reached ();
+        if (!g_queue_is_empty (&io->msg_ios)) {
+                if (!io->can_pipeline)
+                        g_warn_if_reached ();
+                msg_io->pipelined = TRUE;
+        }
 
-        io->msg_io = msg_io;
+        g_queue_push_tail (&io->msg_ios, msg_io);
         io->is_reusable = FALSE;
 }
 
@@ -1073,11 +1352,12 @@ soup_client_message_io_http1_pause (SoupClientMessageIO *iface,
                                     SoupMessage         *msg)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
 
-        g_assert (io->msg_io && io->msg_io->item->msg == msg);
-        g_assert (io->msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY);
+        g_assert (msg_io);
+        g_assert (msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY);
 
-        soup_message_io_data_pause (&io->msg_io->base);
+        soup_message_io_data_pause (&msg_io->base);
 }
 
 static void
@@ -1085,11 +1365,12 @@ soup_client_message_io_http1_unpause (SoupClientMessageIO *iface,
                                       SoupMessage         *msg)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
 
-        g_assert (io->msg_io && io->msg_io->item->msg == msg);
-        g_assert (io->msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY);
+        g_assert (msg_io);
+        g_assert (msg_io->base.read_state < SOUP_MESSAGE_IO_STATE_BODY);
 
-        io->msg_io->base.paused = FALSE;
+        msg_io->base.paused = FALSE;
 }
 
 static gboolean
@@ -1097,10 +1378,11 @@ soup_client_message_io_http1_is_paused (SoupClientMessageIO *iface,
                                         SoupMessage         *msg)
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
 
-        g_assert (io->msg_io && io->msg_io->item->msg == msg);
+        g_assert (msg_io);
 
-        return io->msg_io->base.paused;
+        return msg_io->base.paused;
 }
 
 static gboolean
@@ -1138,7 +1420,7 @@ soup_client_message_io_http1_in_progress (SoupClientMessageIO *iface,
 {
         SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
 
-        return io->msg_io != NULL;
+        return soup_client_message_io_http1_get_msg_io (io, msg) != NULL;
 }
 
 static gboolean
@@ -1154,8 +1436,9 @@ soup_client_message_io_http1_get_cancellable (SoupClientMessageIO *iface,
                                           SoupMessage         *msg)
 {
 	SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        SoupMessageIOHTTP1 *msg_io = soup_client_message_io_http1_get_msg_io (io, msg);
 
-        return io->msg_io ? io->msg_io->item->cancellable : NULL;
+        return msg_io ? msg_io->item->cancellable : NULL;
 }
 
 static const SoupClientMessageIOFuncs io_funcs = {
@@ -1178,6 +1461,72 @@ static const SoupClientMessageIOFuncs io_funcs = {
         soup_client_message_io_http1_get_cancellable
 };
 
+/* Only requests that can be sent again if the connection goes away
+ * before they are answered are pipelined, and only if nothing in the
+ * request depends on the response to a previous one.
+ */
+static gboolean
+message_can_be_pipelined (SoupMessage *msg)
+{
+        SoupMessageHeaders *request_headers = soup_message_get_request_headers (msg);
+        const char *method = soup_message_get_method (msg);
+
+        if (!SOUP_METHOD_IS_IDEMPOTENT (method) || method == SOUP_METHOD_CONNECT)
+                return FALSE;
+
+        if (soup_message_get_request_body_stream (msg))
+                return FALSE;
+
+        if (soup_message_get_http_version (msg) != SOUP_HTTP_1_1)
+                return FALSE;
+
+        if (soup_message_headers_header_contains_common (request_headers, SOUP_HEADER_CONNECTION, "close") ||
+            soup_message_headers_header_contains_common (request_headers, SOUP_HEADER_CONNECTION, "Upgrade"))
+                return FALSE;
+
+        if (soup_message_headers_get_expectations (request_headers) & SOUP_EXPECTATION_CONTINUE)
+                return FALSE;
+
+        return TRUE;
+}
+
+gboolean
+soup_client_message_io_http1_can_pipeline (SoupClientMessageIO *iface,
+                                           SoupMessage         *msg)
+{
+        SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+        GList *l;
+
+        if (!io->can_pipeline || io->pipeline_broken || g_queue_is_empty (&io->msg_ios))
+                return FALSE;
+
+        if (!message_can_be_pipelined (msg))
+                return FALSE;
+
+        for (l = io->msg_ios.head; l; l = g_list_next (l)) {
+                SoupMessageIOHTTP1 *msg_io = (SoupMessageIOHTTP1 *)l->data;
+                SoupMessage *pending = msg_io->item->msg;
+
+                if (!msg_io->item->async || !message_can_be_pipelined (pending))
+                        return FALSE;
+
+                /* The server already said it's closing the connection */
+                if (msg_io->base.read_state >= SOUP_MESSAGE_IO_STATE_BODY_START &&
+                    !soup_message_is_keepalive (pending))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+gboolean
+soup_client_message_io_http1_get_pipeline_failed (SoupClientMessageIO *iface)
+{
+        SoupClientMessageIOHTTP1 *io = (SoupClientMessageIOHTTP1 *)iface;
+
+        return io->pipeline_failed;
+}
+
 SoupClientMessageIO *
 soup_client_message_io_http1_new (SoupConnection *conn)
 {
@@ -7,4 +7,8 @@
 
 #include "soup-client-message-io.h"
 
-SoupClientMessageIO *soup_client_message_io_http1_new (SoupConnection *conn);
+SoupClientMessageIO *soup_client_message_io_http1_new                 (SoupConnection      *conn);
+
+gboolean             soup_client_message_io_http1_can_pipeline        (SoupClientMessageIO *io,
+                                                                       SoupMessage         *msg);
+gboolean             soup_client_message_io_http1_get_pipeline_failed (SoupClientMessageIO *io);
@@ -31,6 +31,7 @@
 #include "soup-client-message-io-http2.h"
 
 #include "soup-body-input-stream.h"
+#include "soup-filter-input-stream.h"
 #include "soup-message-metrics-private.h"
 #include "soup-message-headers-private.h"
 #include "soup-message-private.h"
@@ -61,7 +62,13 @@ typedef struct {
         GError *error;
         GSource *read_source;
         GSource *write_source;
-        GSource *write_idle_source;
+
+        /* Writes and message status checks requested from nghttp2
+         * callbacks are batched into one dispatch.
+         */
+        GSource *dispatch_source;
+        gboolean write_scheduled;
+        GQueue status_checks;
 
         GHashTable *messages;
         GHashTable *closed_messages;
@@ -74,6 +81,32 @@ typedef struct {
         gssize write_buffer_size;
         gssize written_bytes;
 
+        /* Unsent tail of a DATA frame written from the body memory */
+        GByteArray *pending_frame;
+        gsize pending_frame_written;
+        gboolean write_blocking;
+        GCancellable *write_cancellable;
+        gboolean write_would_block;
+        GError *write_error;
+
+        /* Flow-control window tuning */
+        int initial_window_size;
+        int initial_stream_window_size;
+        int window_size;
+        int max_window_size;
+        gboolean bdp_ping_pending;
+        gint64 bdp_ping_time;
+        gsize bdp_bytes;
+
+        /* PING health checks and RTT */
+        guint ping_interval;
+        GSource *ping_source;
+        gboolean health_ping_pending;
+        gint64 health_ping_time;
+        gint64 last_recv_time;
+        gint64 rtt;
+        gint64 min_rtt;
+
         gboolean is_shutdown;
         GTask *close_task;
         gboolean session_terminated;
@@ -115,9 +148,10 @@ typedef struct {
         uint32_t http2_error;
         gboolean paused;
         guint32 stream_id;
+        gboolean stream_closed;
         gboolean can_be_restarted;
         gboolean expect_continue;
-        GSource *check_status_idle_source;
+        gboolean check_status_scheduled;
 } SoupHTTP2MessageData;
 
 static void soup_client_message_io_http2_finished (SoupClientMessageIO *iface, SoupMessage *msg);
@@ -251,13 +285,13 @@ soup_http2_message_data_can_be_restarted (SoupHTTP2MessageData *data,
 }
 
 static void
-soup_http2_message_data_destroy_check_status_idle_source (SoupHTTP2MessageData *data)
+soup_http2_message_data_unschedule_check_status (SoupHTTP2MessageData *data)
 {
-        if (!data->check_status_idle_source)
+        if (!data->check_status_scheduled)
                 return;
 
-        g_source_destroy (data->check_status_idle_source);
-        g_clear_pointer (&data->check_status_idle_source, g_source_unref);
+        g_queue_remove (&data->io->status_checks, data);
+        data->check_status_scheduled = FALSE;
 }
 
 static void
@@ -268,7 +302,7 @@ soup_http2_message_data_check_status (SoupHTTP2MessageData *data)
         GTask *task = data->task;
         GError *error = NULL;
 
-        soup_http2_message_data_destroy_check_status_idle_source (data);
+        soup_http2_message_data_unschedule_check_status (data);
 
         if (!task)
                 return;
@@ -316,25 +350,21 @@ soup_http2_message_data_check_status (SoupHTTP2MessageData *data)
         g_object_unref (task);
 }
 
-static gboolean
-check_status_idle_source_cb (SoupHTTP2MessageData *data)
-{
-        g_clear_pointer (&data->check_status_idle_source, g_source_unref);
-        soup_http2_message_data_check_status (data);
-        return G_SOURCE_REMOVE;
-}
-
 static void
 soup_http2_message_data_check_status_in_idle (SoupHTTP2MessageData *data)
 {
-        if (data->check_status_idle_source)
+        if (data->check_status_scheduled)
                 return;
 
-        data->check_status_idle_source = g_idle_source_new ();
-        g_source_set_static_name (data->check_status_idle_source, "Soup HTTP/2 check message data status");
-        g_source_set_priority (data->check_status_idle_source, G_PRIORITY_DEFAULT);
-        g_source_set_callback (data->check_status_idle_source, (GSourceFunc)check_status_idle_source_cb, data, NULL);
-        g_source_attach (data->check_status_idle_source, g_main_context_get_thread_default ());
+        data->check_status_scheduled = TRUE;
+        g_queue_push_tail (&data->io->status_checks, data);
+        g_source_set_ready_time (data->io->dispatch_source, 0);
+}
+
+static gboolean
+io_want_write (SoupClientMessageIOHTTP2 *io)
+{
+        return io->pending_frame || nghttp2_session_want_write (io->session);
 }
 
 static gboolean
@@ -343,6 +373,27 @@ io_write (SoupClientMessageIOHTTP2 *io,
           GCancellable             *cancellable,
           GError                  **error)
 {
+        gssize ret;
+
+        /* A DATA frame partially written by on_send_data_callback must be
+         * completed before anything else goes to the socket.
+         */
+        if (io->pending_frame) {
+                ret = g_pollable_stream_write (io->ostream,
+                                               io->pending_frame->data + io->pending_frame_written,
+                                               io->pending_frame->len - io->pending_frame_written,
+                                               blocking, cancellable, error);
+                if (ret < 0)
+                        return FALSE;
+
+                io->pending_frame_written += ret;
+                if (io->pending_frame_written == io->pending_frame->len) {
+                        g_clear_pointer (&io->pending_frame, g_byte_array_unref);
+                        io->pending_frame_written = 0;
+                }
+                return TRUE;
+        }
+
         /* We must write all of nghttp2's buffer before we ask for more */
         if (io->written_bytes == io->write_buffer_size)
                 io->write_buffer = NULL;
@@ -350,19 +401,38 @@ io_write (SoupClientMessageIOHTTP2 *io,
         if (io->write_buffer == NULL) {
                 io->written_bytes = 0;
                 g_warn_if_fail (io->in_callback == 0);
+                io->write_blocking = blocking;
+                io->write_cancellable = cancellable;
                 io->write_buffer_size = nghttp2_session_mem_send (io->session, (const guint8**)&io->write_buffer);
+                io->write_cancellable = NULL;
+                if (io->write_error) {
+                        io->write_buffer = NULL;
+                        io->write_buffer_size = 0;
+                        g_propagate_error (error, g_steal_pointer (&io->write_error));
+                        return FALSE;
+                }
                 NGCHECK (io->write_buffer_size);
                 if (io->write_buffer_size == 0) {
                         /* Done */
                         io->write_buffer = NULL;
+                        if (io->write_would_block) {
+                                io->write_would_block = FALSE;
+                                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                                                     _("Operation would block"));
+                                return FALSE;
+                        }
                         return TRUE;
                 }
+
+                /* Frames already handed to on_send_data_callback come first */
+                if (io->pending_frame)
+                        return TRUE;
         }
 
-        gssize ret = g_pollable_stream_write (io->ostream,
-                                              io->write_buffer + io->written_bytes,
-                                              io->write_buffer_size - io->written_bytes,
-                                              blocking, cancellable, error);
+        ret = g_pollable_stream_write (io->ostream,
+                                       io->write_buffer + io->written_bytes,
+                                       io->write_buffer_size - io->written_bytes,
+                                       blocking, cancellable, error);
         if (ret < 0)
                 return FALSE;
 
@@ -381,7 +451,7 @@ io_write_ready (GObject                  *stream,
                 return G_SOURCE_REMOVE;
         }
 
-        while (!error && nghttp2_session_want_write (io->session))
+        while (!error && io_want_write (io))
                 io_write (io, FALSE, NULL, &error);
 
         if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
@@ -396,8 +466,6 @@ io_write_ready (GObject                  *stream,
         return G_SOURCE_REMOVE;
 }
 
-static gboolean io_write_idle_cb (SoupClientMessageIOHTTP2* io);
-
 static void
 io_try_write (SoupClientMessageIOHTTP2 *io,
               gboolean                  blocking)
@@ -408,27 +476,18 @@ io_try_write (SoupClientMessageIOHTTP2 *io,
                 return;
 
         if (io->in_callback) {
-                if (blocking || !nghttp2_session_want_write (io->session))
-                        return;
-
-                if (io->write_idle_source)
+                if (blocking || !io_want_write (io))
                         return;
 
-                io->write_idle_source = g_idle_source_new ();
-                g_source_set_static_name (io->write_idle_source, "Soup HTTP/2 write idle source");
-                /* Give write more priority than read */
-                g_source_set_priority (io->write_idle_source, G_PRIORITY_DEFAULT - 1);
-                g_source_set_callback (io->write_idle_source, (GSourceFunc)io_write_idle_cb, io, NULL);
-                g_source_attach (io->write_idle_source, g_main_context_get_thread_default ());
+                io->write_scheduled = TRUE;
+                g_source_set_ready_time (io->dispatch_source, 0);
                 return;
         }
 
-        if (io->write_idle_source) {
-                g_source_destroy (io->write_idle_source);
-                g_clear_pointer (&io->write_idle_source, g_source_unref);
-        }
+        /* Everything pending is written now */
+        io->write_scheduled = FALSE;
 
-        while (!error && nghttp2_session_want_write (io->session))
+        while (!error && io_want_write (io))
                 io_write (io, blocking, NULL, &error);
 
         if (!blocking && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
@@ -447,40 +506,86 @@ io_try_write (SoupClientMessageIOHTTP2 *io,
 }
 
 static gboolean
-io_write_idle_cb (SoupClientMessageIOHTTP2* io)
+io_dispatch_cb (SoupClientMessageIOHTTP2 *io)
 {
-        g_clear_pointer (&io->write_idle_source, g_source_unref);
-        io_try_write (io, FALSE);
-        return G_SOURCE_REMOVE;
+        SoupConnection *conn;
+        SoupHTTP2MessageData *data;
+
+        /* Completing messages can release the connection, which owns us */
+        conn = g_weak_ref_get (&io->conn);
+
+        if (io->write_scheduled) {
+                io->write_scheduled = FALSE;
+                io_try_write (io, FALSE);
+        }
+
+        while ((data = g_queue_pop_head (&io->status_checks))) {
+                data->check_status_scheduled = FALSE;
+                soup_http2_message_data_check_status (data);
+        }
+
+        g_clear_object (&conn);
+
+        return G_SOURCE_CONTINUE;
 }
 
+/* Reads are never smaller than a default sized frame, and reads that
+ * return this much or more are followed by non-blocking ones, until
+ * the batch passed to nghttp2 reaches MAX_READ_BATCH_SIZE.
+ */
+#define MIN_READ_SIZE 16384
+#define MAX_READ_BATCH_SIZE SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX
+
 static gboolean
 io_read (SoupClientMessageIOHTTP2  *io,
          gboolean                   blocking,
          GCancellable              *cancellable,
          GError                   **error)
 {
-        guint8 buffer[16384];
-        gssize read;
+        SoupFilterInputStream *fstream = SOUP_FILTER_INPUT_STREAM (io->istream);
+        const guint8 *buffer;
+        gsize buffered, read_size;
+        gssize nread;
         int ret;
 
-        /* Always try to write before read, in case there's a pending reset stream after an error. */
-        io_try_write (io, blocking);
-
-        if ((read = g_pollable_stream_read (io->istream, buffer, sizeof (buffer),
-                                            blocking, cancellable, error)) < 0)
-            return FALSE;
+        /* Write before read only when there's something queued, like a
+         * WINDOW_UPDATE, a SETTINGS ACK or a pending reset stream after an error. */
+        if (io_want_write (io))
+                io_try_write (io, blocking);
 
-        if (read == 0) {
-                g_set_error_literal (error, G_IO_ERROR,
-                                     G_IO_ERROR_PARTIAL_INPUT,
-                                     _("Connection terminated unexpectedly"));
-                return FALSE;
+        /* Data is read into the connection stream buffer, which follows its
+         * adaptive read size, and handed to nghttp2 from there.
+         */
+        read_size = MAX (soup_filter_input_stream_get_read_size (fstream), MIN_READ_SIZE);
+        soup_filter_input_stream_peek_buffer (fstream, &buffered);
+        if (buffered == 0) {
+                nread = soup_filter_input_stream_fill (fstream, read_size, blocking, cancellable, error);
+                if (nread < 0)
+                        return FALSE;
+
+                if (nread == 0) {
+                        g_set_error_literal (error, G_IO_ERROR,
+                                             G_IO_ERROR_PARTIAL_INPUT,
+                                             _("Connection terminated unexpectedly"));
+                        return FALSE;
+                }
+                buffered = nread;
+                io->last_recv_time = g_get_monotonic_time ();
+        } else
+                nread = buffered;
+
+        while (nread >= MIN_READ_SIZE && buffered + read_size <= MAX_READ_BATCH_SIZE) {
+                nread = soup_filter_input_stream_fill (fstream, read_size, FALSE, cancellable, NULL);
+                if (nread > 0)
+                        buffered += nread;
         }
 
+        buffer = soup_filter_input_stream_peek_buffer (fstream, &buffered);
         g_warn_if_fail (io->in_callback == 0);
-        ret = nghttp2_session_mem_recv (io->session, buffer, read);
+        ret = nghttp2_session_mem_recv (io->session, buffer, buffered);
         NGCHECK (ret);
+        /* nghttp2 processes all the data unless it fails */
+        soup_filter_input_stream_consume (fstream, buffered);
         return ret > 0;
 }
 
@@ -610,14 +715,13 @@ soup_client_message_io_http2_terminate_session (SoupClientMessageIOHTTP2 *io)
 static int
 on_header_callback (nghttp2_session     *session,
                     const nghttp2_frame *frame,
-                    const uint8_t       *name,
-                    size_t               namelen,
-                    const uint8_t       *value,
-                    size_t               valuelen,
+                    nghttp2_rcbuf       *name,
+                    nghttp2_rcbuf       *value,
                     uint8_t              flags,
                     void                *user_data)
 {
         SoupHTTP2MessageData *data = nghttp2_session_get_stream_user_data (session, frame->hd.stream_id);
+        nghttp2_vec name_buf;
 
         if (!data)
                 return 0;
@@ -625,20 +729,22 @@ on_header_callback (nghttp2_session     *session,
         data->io->in_callback++;
 
         SoupMessage *msg = data->msg;
-        if (name[0] == ':') {
-                if (strcmp ((char *)name, ":status") == 0) {
-                        guint status_code = (guint)g_ascii_strtoull ((char *)value, NULL, 10);
+        name_buf = nghttp2_rcbuf_get_buf (name);
+        if (name_buf.base[0] == ':') {
+                nghttp2_vec value_buf = nghttp2_rcbuf_get_buf (value);
+
+                if (strcmp ((char *)name_buf.base, ":status") == 0) {
+                        guint status_code = (guint)g_ascii_strtoull ((char *)value_buf.base, NULL, 10);
                         soup_message_set_status (msg, status_code, NULL);
                         data->io->in_callback--;
                         return 0;
                 }
-                g_debug ("Unknown header: %s = %s", name, value);
+                g_debug ("Unknown header: %s = %s", name_buf.base, value_buf.base);
                 data->io->in_callback--;
                 return 0;
         }
 
-        soup_message_headers_append_untrusted_data (soup_message_get_response_headers (data->msg),
-                                                    (const char*)name, (const char*)value);
+        soup_http2_message_headers_append (soup_message_get_response_headers (data->msg), name, value);
         data->io->in_callback--;
         return 0;
 }
@@ -791,6 +897,202 @@ handle_goaway (SoupClientMessageIOHTTP2 *io,
         }
 }
 
+/* While data is being received, a PING is sent and the bytes received
+ * until its ACK arrives give a sample of the bandwidth-delay product.
+ * Like gRPC does, the windows grow to twice the sample when it gets
+ * close to the connection window, as long as the application keeps up
+ * with the data. They shrink back towards their initial size when the
+ * samples are much smaller than the window.
+ */
+static const guint8 bdp_ping_payload[8] = { 's', 'o', 'u', 'p', '-', 'b', 'd', 'p' };
+
+static gboolean
+is_bdp_ping (const nghttp2_frame *frame)
+{
+        return frame->hd.type == NGHTTP2_PING &&
+                memcmp (frame->ping.opaque_data, bdp_ping_payload, sizeof (bdp_ping_payload)) == 0;
+}
+
+static void
+io_set_window_size (SoupClientMessageIOHTTP2 *io,
+                    int                       window_size)
+{
+        nghttp2_settings_entry settings;
+        gint64 stream_window_size;
+
+        stream_window_size = (gint64)window_size * io->initial_stream_window_size / io->initial_window_size;
+        settings.settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+        settings.value = MIN (stream_window_size, NGHTTP2_MAX_WINDOW_SIZE);
+
+        h2_debug (io, NULL, "[SESSION] Window size %d -> %d, stream window size %u",
+                  io->window_size, window_size, settings.value);
+
+        io->window_size = window_size;
+        NGCHECK (nghttp2_session_set_local_window_size (io->session, NGHTTP2_FLAG_NONE, 0, window_size));
+        NGCHECK (nghttp2_submit_settings (io->session, NGHTTP2_FLAG_NONE, &settings, 1));
+}
+
+static void
+io_bdp_data_received (SoupClientMessageIOHTTP2 *io,
+                      gsize                     length)
+{
+        if (io->max_window_size <= io->initial_window_size)
+                return;
+
+        io->bdp_bytes += length;
+        if (io->bdp_ping_pending)
+                return;
+
+        if (nghttp2_submit_ping (io->session, NGHTTP2_FLAG_NONE, bdp_ping_payload) != 0)
+                return;
+
+        io->bdp_ping_pending = TRUE;
+        io->bdp_ping_time = g_get_monotonic_time ();
+        io->bdp_bytes = length;
+}
+
+static void
+update_message_rtt_metrics (SoupMessage              *msg,
+                            SoupHTTP2MessageData     *data,
+                            SoupClientMessageIOHTTP2 *io)
+{
+        if (!data->metrics)
+                return;
+
+        data->metrics->rtt = io->rtt;
+        data->metrics->min_rtt = io->min_rtt;
+}
+
+/* Every PING we send gives an RTT sample, smoothed like TCP does */
+static void
+io_add_rtt_sample (SoupClientMessageIOHTTP2 *io,
+                   gint64                    sent_time)
+{
+        gint64 sample = MAX (g_get_monotonic_time () - sent_time, 1);
+
+        io->rtt = io->rtt ? (io->rtt * 7 + sample) / 8 : sample;
+        io->min_rtt = io->min_rtt ? MIN (io->min_rtt, sample) : sample;
+        h2_debug (io, NULL, "[SESSION] RTT sample %" G_GINT64_FORMAT " us, smoothed %" G_GINT64_FORMAT " us",
+                  sample, io->rtt);
+
+        g_hash_table_foreach (io->messages, (GHFunc)update_message_rtt_metrics, io);
+}
+
+static void
+io_bdp_ping_acked (SoupClientMessageIOHTTP2 *io)
+{
+        int window_size = io->window_size;
+
+        if (!io->bdp_ping_pending)
+                return;
+
+        io->bdp_ping_pending = FALSE;
+        io_add_rtt_sample (io, io->bdp_ping_time);
+        h2_debug (io, NULL, "[SESSION] BDP sample %" G_GSIZE_FORMAT " bytes", io->bdp_bytes);
+
+        if (io->bdp_bytes >= (gsize)io->window_size / 3 * 2) {
+                if (nghttp2_session_get_effective_recv_data_length (io->session) <= io->window_size / 4 * 3)
+                        window_size = (int)MIN ((gint64)io->bdp_bytes * 2, io->max_window_size);
+        } else if (io->bdp_bytes < (gsize)io->window_size / 8)
+                window_size = MAX (io->window_size / 2, io->initial_window_size);
+
+        if (window_size != io->window_size)
+                io_set_window_size (io, window_size);
+        io->bdp_bytes = 0;
+}
+
+/* When health checks are enabled, a PING is sent after ping_interval
+ * seconds without receiving anything, and the connection is considered
+ * dead if it's not acknowledged within another ping_interval.
+ */
+static const guint8 health_ping_payload[8] = { 's', 'o', 'u', 'p', '-', 'h', 'c', 'k' };
+
+static gboolean io_ping_source_cb (SoupClientMessageIOHTTP2 *io);
+
+static void
+io_schedule_ping_check (SoupClientMessageIOHTTP2 *io,
+                        guint                     seconds)
+{
+        if (io->ping_source) {
+                g_source_destroy (io->ping_source);
+                g_source_unref (io->ping_source);
+        }
+
+        io->ping_source = g_timeout_source_new_seconds (seconds);
+        g_source_set_static_name (io->ping_source, "Soup HTTP/2 ping source");
+        g_source_set_callback (io->ping_source, (GSourceFunc)io_ping_source_cb, io, NULL);
+        g_source_attach (io->ping_source, g_main_context_get_thread_default ());
+}
+
+static void
+io_health_check_failed (SoupClientMessageIOHTTP2 *io)
+{
+        SoupConnection *conn;
+
+        h2_debug (io, NULL, "[SESSION] PING not acknowledged after %u seconds", io->ping_interval);
+
+        /* Stop using the connection before anything else is sent on it */
+        io->is_shutdown = TRUE;
+        set_io_error (io, g_error_new_literal (G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                                               _("Connection health check timed out")));
+        g_list_foreach (io->pending_io_messages,
+                        (GFunc)soup_http2_message_data_check_status,
+                        NULL);
+
+        conn = g_weak_ref_get (&io->conn);
+        if (conn) {
+                if (soup_connection_get_state (conn) == SOUP_CONNECTION_IDLE)
+                        soup_connection_disconnect (conn);
+                g_object_unref (conn);
+        }
+}
+
+static gboolean
+io_ping_source_cb (SoupClientMessageIOHTTP2 *io)
+{
+        gint64 interval = (gint64)io->ping_interval * G_USEC_PER_SEC;
+        gint64 now = g_get_monotonic_time ();
+
+        g_clear_pointer (&io->ping_source, g_source_unref);
+
+        if (io->error || io->is_shutdown)
+                return G_SOURCE_REMOVE;
+
+        if (io->health_ping_pending) {
+                io_health_check_failed (io);
+                return G_SOURCE_REMOVE;
+        }
+
+        if (now - io->last_recv_time < interval) {
+                io_schedule_ping_check (io, (interval - (now - io->last_recv_time)) / G_USEC_PER_SEC + 1);
+                return G_SOURCE_REMOVE;
+        }
+
+        if (nghttp2_submit_ping (io->session, NGHTTP2_FLAG_NONE, health_ping_payload) != 0) {
+                io_schedule_ping_check (io, io->ping_interval);
+                return G_SOURCE_REMOVE;
+        }
+
+        h2_debug (io, NULL, "[SESSION] Checking connection health");
+        io->health_ping_pending = TRUE;
+        io->health_ping_time = now;
+        io_schedule_ping_check (io, io->ping_interval);
+        io_try_write (io, FALSE);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+io_health_ping_acked (SoupClientMessageIOHTTP2 *io)
+{
+        if (!io->health_ping_pending)
+                return;
+
+        io->health_ping_pending = FALSE;
+        io_add_rtt_sample (io, io->health_ping_time);
+        io_schedule_ping_check (io, io->ping_interval);
+}
+
 static int
 on_frame_recv_callback (nghttp2_session     *session,
                         const nghttp2_frame *frame,
@@ -818,12 +1120,23 @@ on_frame_recv_callback (nghttp2_session     *session,
                         h2_debug (io, NULL, "[RECV] WINDOW_UPDATE: increment=%d, total=%d", frame->window_update.window_size_increment,
                                   nghttp2_session_get_remote_window_size (session));
                         break;
+                case NGHTTP2_PING:
+                        if (!(frame->hd.flags & NGHTTP2_FLAG_ACK))
+                                break;
+                        if (is_bdp_ping (frame))
+                                io_bdp_ping_acked (io);
+                        else if (memcmp (frame->ping.opaque_data, health_ping_payload, sizeof (health_ping_payload)) == 0)
+                                io_health_ping_acked (io);
+                        break;
                 }
 
                 io->in_callback--;
                 return 0;
         }
 
+        if (frame->hd.type == NGHTTP2_DATA)
+                io_bdp_data_received (io, frame->hd.length);
+
         data = nghttp2_session_get_stream_user_data (session, frame->hd.stream_id);
         h2_debug (io, data, "[RECV] [%s] Received: stream_id=%u, flags=%u", soup_http2_frame_type_to_string (frame->hd.type), frame->hd.stream_id, frame->hd.flags);
 
@@ -1138,6 +1451,7 @@ on_stream_close_callback (nghttp2_session *session,
                 return 0;
 
         data->io->in_callback++;
+        data->stream_closed = TRUE;
 
         switch (error_code) {
         case NGHTTP2_NO_ERROR:
@@ -1237,6 +1551,17 @@ on_data_source_cancelled (GCancellable *cancellable,
         g_cancellable_cancel (linked_cancellable);
 }
 
+/* Bodies set from GBytes are sent straight from their memory */
+static GBytes *
+get_data_source_bytes (SoupHTTP2MessageData *data,
+                       nghttp2_data_source  *source)
+{
+        if (source->ptr != soup_message_get_request_body_stream (data->msg))
+                return NULL;
+
+        return soup_message_get_request_body_bytes (data->msg);
+}
+
 static ssize_t
 on_data_source_read_callback (nghttp2_session     *session,
                               int32_t              stream_id,
@@ -1248,6 +1573,7 @@ on_data_source_read_callback (nghttp2_session     *session,
 {
         SoupClientMessageIOHTTP2 *io = user_data;
         SoupHTTP2MessageData *data = nghttp2_session_get_stream_user_data (session, stream_id);
+        GBytes *bytes;
 
         h2_debug (io, data, "[SEND_BODY] stream_id=%u, paused=%d", stream_id, data ? data->paused : 0);
 
@@ -1258,6 +1584,30 @@ on_data_source_read_callback (nghttp2_session     *session,
 
         data->io->in_callback++;
 
+        bytes = get_data_source_bytes (data, source);
+        if (bytes) {
+                gsize size = g_bytes_get_size (bytes);
+                gsize offset = g_seekable_tell (G_SEEKABLE (source->ptr));
+                gsize read = MIN (length, size - offset);
+
+                /* The frame is written by on_send_data_callback straight
+                 * from the bytes, which also advances the stream. */
+                if (data->request_body_bytes_to_write > 0) {
+                        read = MIN (read, (gsize)data->request_body_bytes_to_write);
+                        data->request_body_bytes_to_write -= read;
+                        if (data->request_body_bytes_to_write == 0)
+                                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                }
+                if (offset + read == size)
+                        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                if (read > 0)
+                        *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+
+                h2_debug (data->io, data, "[SEND_BODY] Sending %zu from bytes%s", read, *data_flags & NGHTTP2_DATA_FLAG_EOF ? ", EOF" : "");
+                data->io->in_callback--;
+                return read;
+        }
+
         if (!data->item->async) {
                 gssize read;
                 GError *error = NULL;
@@ -1343,17 +1693,17 @@ on_data_source_read_callback (nghttp2_session     *session,
                 if (!data->data_source_buffer)
                         data->data_source_buffer = g_byte_array_new ();
 
-                guint buffer_len = data->data_source_buffer->len;
+                gsize buffer_len = data->data_source_buffer->len;
                 if (buffer_len) {
-                        if (data->data_source_eof) {
+                        /* The buffer is written by on_send_data_callback,
+                         * which removes the sent bytes from it. */
+                        buffer_len = MIN (buffer_len, length);
+                        *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+                        if (data->data_source_eof && buffer_len == data->data_source_buffer->len) {
                                 h2_debug (data->io, data, "[SEND_BODY] Sending %zu, EOF", buffer_len);
                                 *data_flags |= NGHTTP2_DATA_FLAG_EOF;
                         } else
                                 h2_debug (data->io, data, "[SEND_BODY] Sending %zu", buffer_len);
-                        g_assert (buffer_len <= length); /* QUESTION: Maybe not reliable */
-                        memcpy (buf, data->data_source_buffer->data, buffer_len);
-                        log_request_data (data, buf, buffer_len);
-                        g_byte_array_set_size (data->data_source_buffer, 0);
                         data->io->in_callback--;
                         return buffer_len;
                 } else if (data->data_source_eof) {
@@ -1387,6 +1737,114 @@ on_data_source_read_callback (nghttp2_session     *session,
         }
 }
 
+static int
+on_send_data_callback (nghttp2_session     *session,
+                       nghttp2_frame       *frame,
+                       const uint8_t       *framehd,
+                       size_t               length,
+                       nghttp2_data_source *source,
+                       void                *user_data)
+{
+        static const guint8 padding[256] = { 0, };
+        SoupClientMessageIOHTTP2 *io = user_data;
+        SoupHTTP2MessageData *data = nghttp2_session_get_stream_user_data (session, frame->hd.stream_id);
+        GOutputVector vectors[4];
+        guint n_vectors = 0;
+        const guint8 *payload;
+        guint8 padlen;
+        gsize frame_len, written = 0;
+        GBytes *bytes;
+        GError *error = NULL;
+
+        if (!data) {
+                /* This can happen in case of cancellation */
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+
+        /* nghttp2_session_mem_send() keeps going after a frame is handed
+         * to us, so the tail of a previous frame may still be unsent. It
+         * must reach the socket first; nghttp2 will retry this frame.
+         */
+        if (io->pending_frame) {
+                io->write_would_block = TRUE;
+                return NGHTTP2_ERR_WOULDBLOCK;
+        }
+
+        io->in_callback++;
+
+        bytes = get_data_source_bytes (data, source);
+        if (bytes)
+                payload = (const guint8 *)g_bytes_get_data (bytes, NULL) + g_seekable_tell (G_SEEKABLE (source->ptr));
+        else
+                payload = data->data_source_buffer->data;
+
+        vectors[n_vectors].buffer = framehd;
+        vectors[n_vectors++].size = 9;
+        if (frame->data.padlen > 0) {
+                padlen = frame->data.padlen - 1;
+                vectors[n_vectors].buffer = &padlen;
+                vectors[n_vectors++].size = 1;
+        }
+        vectors[n_vectors].buffer = payload;
+        vectors[n_vectors++].size = length;
+        if (frame->data.padlen > 1) {
+                vectors[n_vectors].buffer = padding;
+                vectors[n_vectors++].size = frame->data.padlen - 1;
+        }
+        frame_len = 9 + length + frame->data.padlen;
+
+        if (io->write_blocking) {
+                g_output_stream_writev_all (io->ostream, vectors, n_vectors, &written, io->write_cancellable, &error);
+        } else {
+                GPollableReturn ret;
+
+                ret = g_pollable_output_stream_writev_nonblocking (G_POLLABLE_OUTPUT_STREAM (io->ostream),
+                                                                   vectors, n_vectors, &written, NULL, &error);
+                if (ret == G_POLLABLE_RETURN_WOULD_BLOCK) {
+                        /* nghttp2 will call us again with the same frame */
+                        io->write_would_block = TRUE;
+                        io->in_callback--;
+                        return NGHTTP2_ERR_WOULDBLOCK;
+                }
+        }
+
+        if (error) {
+                h2_debug (io, data, "[SEND_BODY] Error writing frame: %s", error->message);
+                g_clear_error (&io->write_error);
+                io->write_error = error;
+                io->in_callback--;
+                return NGHTTP2_ERR_CALLBACK_FAILURE;
+        }
+
+        if (written < frame_len) {
+                guint i;
+
+                /* Once part of a frame is on the wire the rest must follow
+                 * before anything else, so keep a copy of what's missing. */
+                io->pending_frame = g_byte_array_sized_new (frame_len - written);
+                io->pending_frame_written = 0;
+                for (i = 0; i < n_vectors; i++) {
+                        if (written >= vectors[i].size) {
+                                written -= vectors[i].size;
+                                continue;
+                        }
+
+                        g_byte_array_append (io->pending_frame, (const guint8 *)vectors[i].buffer + written, vectors[i].size - written);
+                        written = 0;
+                }
+        }
+
+        log_request_data (data, payload, length);
+
+        if (bytes)
+                g_seekable_seek (G_SEEKABLE (source->ptr), length, G_SEEK_CUR, NULL, NULL);
+        else
+                g_byte_array_remove_range (data->data_source_buffer, 0, length);
+
+        io->in_callback--;
+        return 0;
+}
+
 /* HTTP2 IO functions */
 
 static int32_t
@@ -1408,11 +1866,48 @@ message_priority_to_weight (SoupMessage *msg)
         return NGHTTP2_DEFAULT_WEIGHT;
 }
 
+/* RFC 9218 urgency, from 0 (highest) to 7, 3 being the default */
+#define PRIORITY_DEFAULT_URGENCY 3
+
+static int
+message_priority_to_urgency (SoupMessage *msg)
+{
+        switch (soup_message_get_priority (msg)) {
+        case SOUP_MESSAGE_PRIORITY_VERY_LOW:
+                return PRIORITY_DEFAULT_URGENCY + 2;
+        case SOUP_MESSAGE_PRIORITY_LOW:
+                return PRIORITY_DEFAULT_URGENCY + 1;
+        case SOUP_MESSAGE_PRIORITY_NORMAL:
+                return PRIORITY_DEFAULT_URGENCY;
+        case SOUP_MESSAGE_PRIORITY_HIGH:
+                return PRIORITY_DEFAULT_URGENCY - 1;
+        case SOUP_MESSAGE_PRIORITY_VERY_HIGH:
+                return PRIORITY_DEFAULT_URGENCY - 2;
+        }
+
+        return PRIORITY_DEFAULT_URGENCY;
+}
+
+/* The Priority field value for @msg, or %NULL if the application set
+ * the Priority header itself, in which case it's sent untouched.
+ */
+static char *
+message_priority_field_value (SoupMessage *msg)
+{
+        if (soup_message_headers_get_one (soup_message_get_request_headers (msg), "Priority"))
+                return NULL;
+
+        return g_strdup_printf ("u=%d", message_priority_to_urgency (msg));
+}
+
 static void
 message_priority_changed (SoupHTTP2MessageData *data)
 {
         nghttp2_priority_spec priority_spec;
         int32_t weight;
+#ifdef HAVE_NGHTTP2_EXTENSIBLE_PRIORITIES
+        char *field_value;
+#endif
 
         if (!data->stream_id)
                 return;
@@ -1422,6 +1917,17 @@ message_priority_changed (SoupHTTP2MessageData *data)
 
         nghttp2_priority_spec_init (&priority_spec, 0, weight, 0);
         NGCHECK (nghttp2_submit_priority (data->io->session, NGHTTP2_FLAG_NONE, data->stream_id, &priority_spec));
+
+#ifdef HAVE_NGHTTP2_EXTENSIBLE_PRIORITIES
+        /* This does nothing unless the server supports RFC 9218 */
+        field_value = message_priority_field_value (data->msg);
+        if (field_value) {
+                h2_debug (data->io, data, "[PRIORITY] %s", field_value);
+                NGCHECK (nghttp2_submit_priority_update (data->io->session, NGHTTP2_FLAG_NONE, data->stream_id,
+                                                         (const uint8_t *)field_value, strlen (field_value)));
+                g_free (field_value);
+        }
+#endif
         io_try_write (data->io, !data->item->async);
 }
 
@@ -1436,6 +1942,10 @@ add_message_to_io_data (SoupClientMessageIOHTTP2  *io,
         data->item = soup_message_queue_item_ref (item);
         data->msg = item->msg;
         data->metrics = soup_message_get_metrics (data->msg);
+        if (data->metrics && io->rtt) {
+                data->metrics->rtt = io->rtt;
+                data->metrics->min_rtt = io->min_rtt;
+        }
         data->request_body_bytes_to_write = -1;
         data->completion_cb = completion_cb;
         data->completion_data = completion_data;
@@ -1477,7 +1987,7 @@ soup_http2_message_data_close (SoupHTTP2MessageData *data)
         if (data->msg)
                 g_signal_handlers_disconnect_by_data (data->msg, data);
 
-        soup_http2_message_data_destroy_check_status_idle_source (data);
+        soup_http2_message_data_unschedule_check_status (data);
 
         data->msg = NULL;
         data->metrics = NULL;
@@ -1569,6 +2079,15 @@ send_message_request (SoupMessage          *msg,
                 g_array_append_val (headers, nv);
         }
 
+        /* Urgency is sent with the RFC 9218 Priority header, which can be
+         * omitted for the default one.
+         */
+        char *priority = message_priority_field_value (msg);
+        if (priority && message_priority_to_urgency (msg) != PRIORITY_DEFAULT_URGENCY) {
+                const nghttp2_nv nv = MAKE_NV2 ("priority", priority);
+                g_array_append_val (headers, nv);
+        }
+
         GInputStream *body_stream = soup_message_get_request_body_stream (msg);
         SoupSessionFeature *logger = soup_session_get_feature_for_message (data->item->session, SOUP_TYPE_LOGGER, data->msg);
         if (logger && body_stream)
@@ -1603,6 +2122,7 @@ send_message_request (SoupMessage          *msg,
                 io_try_write (io, !data->item->async);
         }
         g_array_free (headers, TRUE);
+        g_free (priority);
         g_free (authority);
         g_free (host);
         g_free (path_and_query);
@@ -1641,7 +2161,7 @@ soup_client_message_io_http2_finished (SoupClientMessageIO *iface,
 
         data = get_data_for_message (io, msg);
 
-        soup_http2_message_data_destroy_check_status_idle_source (data);
+        soup_http2_message_data_unschedule_check_status (data);
 
         completion = data->state < STATE_READ_DONE ? SOUP_MESSAGE_IO_INTERRUPTED : SOUP_MESSAGE_IO_COMPLETE;
 
@@ -1826,7 +2346,7 @@ io_run (SoupHTTP2MessageData *data,
         SoupClientMessageIOHTTP2 *io = data->io;
         gboolean progress = FALSE;
 
-        if (data->state < STATE_WRITE_DONE && !io->in_callback && nghttp2_session_want_write (io->session))
+        if (data->state < STATE_WRITE_DONE && !io->in_callback && io_want_write (io))
                 progress = io_write (io, TRUE, cancellable, error);
         else if (data->state < STATE_READ_DONE && !io->in_callback && nghttp2_session_want_read (io->session))
                 progress = io_read (io, TRUE, cancellable, error);
@@ -1974,16 +2494,38 @@ soup_client_message_io_http2_set_owner (SoupClientMessageIOHTTP2 *io,
 
         io->owner = owner;
         g_assert (!io->write_source);
-        g_assert (!io->write_idle_source);
+        g_assert (!io->write_scheduled);
+
+        if (io->dispatch_source) {
+                g_source_destroy (io->dispatch_source);
+                g_source_unref (io->dispatch_source);
+        }
+        /* Give write more priority than read */
+        io->dispatch_source = soup_http2_dispatch_source_new ("Soup HTTP/2 dispatch source",
+                                                              G_PRIORITY_DEFAULT - 1,
+                                                              (GSourceFunc)io_dispatch_cb,
+                                                              io);
+        g_source_attach (io->dispatch_source, g_main_context_get_thread_default ());
+        if (!g_queue_is_empty (&io->status_checks))
+                g_source_set_ready_time (io->dispatch_source, 0);
+
         if (io->read_source) {
                 g_source_destroy (io->read_source);
                 g_clear_pointer (&io->read_source, g_source_unref);
         }
 
+        if (io->ping_source) {
+                g_source_destroy (io->ping_source);
+                g_clear_pointer (&io->ping_source, g_source_unref);
+        }
+
         io->async = g_main_context_is_owner (g_main_context_get_thread_default ());
         if (!io->async)
                 return;
 
+        if (io->ping_interval)
+                io_schedule_ping_check (io, io->ping_interval);
+
         io->read_source = g_pollable_input_stream_create_source (G_POLLABLE_INPUT_STREAM (io->istream), NULL);
         g_source_set_static_name (io->read_source, "Soup HTTP/2 read source");
         g_source_set_priority (io->read_source, G_PRIORITY_DEFAULT);
@@ -2030,9 +2572,13 @@ soup_client_message_io_http2_destroy (SoupClientMessageIO *iface)
                 g_source_destroy (io->write_source);
                 g_source_unref (io->write_source);
         }
-        if (io->write_idle_source) {
-                g_source_destroy (io->write_idle_source);
-                g_source_unref (io->write_idle_source);
+        if (io->dispatch_source) {
+                g_source_destroy (io->dispatch_source);
+                g_source_unref (io->dispatch_source);
+        }
+        if (io->ping_source) {
+                g_source_destroy (io->ping_source);
+                g_source_unref (io->ping_source);
         }
 
         g_weak_ref_clear (&io->conn);
@@ -2042,7 +2588,10 @@ soup_client_message_io_http2_destroy (SoupClientMessageIO *iface)
         g_clear_pointer (&io->messages, g_hash_table_unref);
         g_clear_pointer (&io->closed_messages, g_hash_table_unref);
         g_clear_pointer (&io->pending_io_messages, g_list_free);
+        g_queue_clear (&io->status_checks);
         g_clear_error (&io->error);
+        g_clear_pointer (&io->pending_frame, g_byte_array_unref);
+        g_clear_error (&io->write_error);
 
         g_free (io);
 }
@@ -2083,7 +2632,7 @@ soup_client_message_io_http2_init (SoupClientMessageIOHTTP2 *io)
 
         nghttp2_session_callbacks *callbacks;
         NGCHECK (nghttp2_session_callbacks_new (&callbacks));
-        nghttp2_session_callbacks_set_on_header_callback (callbacks, on_header_callback);
+        nghttp2_session_callbacks_set_on_header_callback2 (callbacks, on_header_callback);
         nghttp2_session_callbacks_set_on_invalid_header_callback (callbacks, on_invalid_header_callback);
         nghttp2_session_callbacks_set_on_frame_recv_callback (callbacks, on_frame_recv_callback);
         nghttp2_session_callbacks_set_on_data_chunk_recv_callback (callbacks, on_data_chunk_recv_callback);
@@ -2092,6 +2641,7 @@ soup_client_message_io_http2_init (SoupClientMessageIOHTTP2 *io)
         nghttp2_session_callbacks_set_on_frame_not_send_callback (callbacks, on_frame_not_send_callback);
         nghttp2_session_callbacks_set_on_frame_send_callback (callbacks, on_frame_send_callback);
         nghttp2_session_callbacks_set_on_stream_close_callback (callbacks, on_stream_close_callback);
+        nghttp2_session_callbacks_set_send_data_callback (callbacks, on_send_data_callback);
 
         nghttp2_option *option;
 
@@ -2127,18 +2677,60 @@ soup_client_message_io_http2_new (SoupConnection *conn)
         io->istream = g_io_stream_get_input_stream (io->stream);
         io->ostream = g_io_stream_get_output_stream (io->stream);
         io->connection_id = soup_connection_get_id (conn);
+        io->ping_interval = soup_connection_get_http2_ping_interval (conn);
+        io->last_recv_time = g_get_monotonic_time ();
 
         soup_client_message_io_http2_set_owner (io, soup_connection_get_owner (conn));
 
-        int stream_window_size = soup_connection_get_http2_initial_stream_window_size (conn);
+        io->initial_window_size = soup_connection_get_http2_initial_window_size (conn);
+        io->initial_stream_window_size = soup_connection_get_http2_initial_stream_window_size (conn);
+        io->window_size = io->initial_window_size;
+        io->max_window_size = soup_connection_get_http2_max_window_size (conn);
+
         const nghttp2_settings_entry settings[] = {
-                { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, stream_window_size },
+                { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, io->initial_stream_window_size },
                 { NGHTTP2_SETTINGS_HEADER_TABLE_SIZE, MAX_HEADER_TABLE_SIZE },
                 { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 },
         };
         NGCHECK (nghttp2_submit_settings (io->session, NGHTTP2_FLAG_NONE, settings, G_N_ELEMENTS (settings)));
-        NGCHECK (nghttp2_session_set_local_window_size (io->session, NGHTTP2_FLAG_NONE, 0, soup_connection_get_http2_initial_window_size (conn)));
+        NGCHECK (nghttp2_session_set_local_window_size (io->session, NGHTTP2_FLAG_NONE, 0, io->window_size));
         io_try_write (io, !io->async);
 
         return (SoupClientMessageIO *)io;
 }
+
+int
+soup_client_message_io_http2_get_window_size (SoupClientMessageIO *iface)
+{
+        SoupClientMessageIOHTTP2 *io = (SoupClientMessageIOHTTP2 *)iface;
+
+        return io->window_size;
+}
+
+/* Messages waiting for their stream to be opened count as active too,
+ * since they will take a stream as soon as they are written.
+ */
+guint
+soup_client_message_io_http2_get_active_streams (SoupClientMessageIO *iface)
+{
+        SoupClientMessageIOHTTP2 *io = (SoupClientMessageIOHTTP2 *)iface;
+        GHashTableIter iter;
+        SoupHTTP2MessageData *data;
+        guint active_streams = 0;
+
+        g_hash_table_iter_init (&iter, io->messages);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&data)) {
+                if (!data->stream_closed)
+                        active_streams++;
+        }
+
+        return active_streams;
+}
+
+guint
+soup_client_message_io_http2_get_max_concurrent_streams (SoupClientMessageIO *iface)
+{
+        SoupClientMessageIOHTTP2 *io = (SoupClientMessageIOHTTP2 *)iface;
+
+        return nghttp2_session_get_remote_settings (io->session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+}
@@ -9,6 +9,9 @@
 
 G_BEGIN_DECLS
 
-SoupClientMessageIO *soup_client_message_io_http2_new (SoupConnection *conn);
+SoupClientMessageIO *soup_client_message_io_http2_new                         (SoupConnection      *conn);
+int                  soup_client_message_io_http2_get_window_size             (SoupClientMessageIO *io);
+guint                soup_client_message_io_http2_get_active_streams          (SoupClientMessageIO *io);
+guint                soup_client_message_io_http2_get_max_concurrent_streams  (SoupClientMessageIO *io);
 
 G_END_DECLS
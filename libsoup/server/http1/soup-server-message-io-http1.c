@@ -11,6 +11,11 @@
 
 #include <glib/gi18n-lib.h>
 
+#ifdef HAVE_SENDFILE
+#include <errno.h>
+#include <sys/sendfile.h>
+#endif
+
 #include "soup-server-message-io-http1.h"
 #include "soup.h"
 #include "soup-body-input-stream.h"
@@ -262,7 +267,14 @@ handle_partial_get (SoupServerMessage *msg)
         } else if (status != SOUP_STATUS_PARTIAL_CONTENT)
                 return;
 
-        full_response = soup_message_body_flatten (response_body);
+        /* A body made of a single chunk, such as a mapped file, can be
+         * sliced directly instead of flattened into a copy.
+         */
+        full_response = soup_message_body_get_chunk (response_body, 0);
+        if (full_response && g_bytes_get_size (full_response) != response_body->length)
+                g_clear_pointer (&full_response, g_bytes_unref);
+        if (!full_response)
+                full_response = soup_message_body_flatten (response_body);
         if (!full_response) {
                 soup_message_headers_free_ranges (request_headers, ranges);
                 return;
@@ -335,8 +347,6 @@ write_headers (SoupServerMessage  *msg,
                SoupEncoding       *encoding)
 {
         SoupEncoding claimed_encoding;
-        SoupMessageHeadersIter iter;
-        const char *name, *value;
 	guint status_code;
 	const char *reason_phrase;
 	const char *method;
@@ -384,10 +394,145 @@ write_headers (SoupServerMessage  *msg,
                                                          response_body->length);
         }
 
-        soup_message_headers_iter_init (&iter, response_headers);
-        while (soup_message_headers_iter_next (&iter, &name, &value))
-                g_string_append_printf (headers, "%s: %s\r\n", name, value);
-        g_string_append (headers, "\r\n");
+        soup_message_headers_serialize (response_headers, headers);
+        g_string_append_len (headers, "\r\n", 2);
+}
+
+#ifdef HAVE_SENDFILE
+/* Gets the file that @chunk of the response body was mapped from, if
+ * it can be written to the connection's socket with sendfile(2): the
+ * connection must be plain TCP and the body must not be chunked.
+ */
+static gboolean
+get_sendfile_source (SoupServerMessageIOHTTP1 *server_io,
+                     GBytes                   *chunk,
+                     int                      *fd,
+                     goffset                  *offset)
+{
+        SoupServerMessage *msg = server_io->msg_io->msg;
+        SoupMessageIOData *io = &server_io->msg_io->base;
+        SoupServerConnection *conn;
+
+        if (io->write_encoding != SOUP_ENCODING_CONTENT_LENGTH &&
+            io->write_encoding != SOUP_ENCODING_EOF)
+                return FALSE;
+
+        conn = soup_server_message_get_connection (msg);
+        if (!conn || soup_server_connection_is_ssl (conn) ||
+            !soup_server_connection_get_socket (conn))
+                return FALSE;
+
+        return soup_server_message_get_response_file_range (msg, chunk, fd, offset);
+}
+#endif
+
+/* Writes the rest of the current chunk straight from its file to the
+ * socket, bypassing the body stream. Returns %FALSE if the chunk is not
+ * file-backed or can't be sent that way, in which case @nwrote is unset.
+ */
+static gboolean
+write_chunk_from_file (SoupServerMessageIOHTTP1 *server_io,
+                       gssize                   *nwrote,
+                       GError                  **error)
+{
+#ifdef HAVE_SENDFILE
+        SoupMessageIOData *io = &server_io->msg_io->base;
+        GBytes *chunk = server_io->msg_io->write_chunk;
+        GSocket *socket;
+        int fd;
+        goffset file_offset;
+        off_t offset;
+        gsize count;
+        gssize ret;
+
+        if (!get_sendfile_source (server_io, chunk, &fd, &file_offset))
+                return FALSE;
+
+        /* Let the body stream truncate over-long bodies */
+        count = g_bytes_get_size (chunk) - io->written;
+        if (io->write_length && (goffset)count > io->write_length)
+                return FALSE;
+
+        socket = soup_server_connection_get_socket (soup_server_message_get_connection (server_io->msg_io->msg));
+        offset = file_offset + io->written;
+
+        /* GSocket ignores SIGPIPE process-wide, so a closed peer
+         * shows up as EPIPE here as it would with send().
+         */
+        do {
+                ret = sendfile (g_socket_get_fd (socket), fd, &offset, count);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret == -1) {
+                int errsv = errno;
+
+                if (errsv == EINVAL || errsv == ENOSYS)
+                        return FALSE;
+
+                if (errsv == EAGAIN || errsv == EWOULDBLOCK)
+                        g_set_error_literal (error, G_IO_ERROR,
+                                             G_IO_ERROR_WOULD_BLOCK,
+                                             _("Operation would block"));
+                else
+                        g_set_error (error, G_IO_ERROR,
+                                     g_io_error_from_errno (errsv),
+                                     _("Error sending data: %s"),
+                                     g_strerror (errsv));
+        } else if (ret == 0) {
+                g_set_error_literal (error, G_IO_ERROR,
+                                     G_IO_ERROR_PARTIAL_INPUT,
+                                     _("Response body file was truncated"));
+                ret = -1;
+        } else {
+                soup_body_output_stream_advance (SOUP_BODY_OUTPUT_STREAM (io->body_ostream), ret);
+                soup_server_message_add_response_file_bytes_sent (server_io->msg_io->msg, ret);
+        }
+
+        *nwrote = ret;
+        return TRUE;
+#else
+        return FALSE;
+#endif
+}
+
+/* Gets the first chunk of the response body if it is already available
+ * and can be written together with the response headers.
+ */
+static GBytes *
+get_body_chunk_for_headers (SoupServerMessageIOHTTP1 *server_io)
+{
+        SoupServerMessage *msg = server_io->msg_io->msg;
+        SoupMessageIOData *io = &server_io->msg_io->base;
+        GBytes *chunk;
+
+        if (io->write_encoding != SOUP_ENCODING_CONTENT_LENGTH ||
+            SOUP_STATUS_IS_INFORMATIONAL (soup_server_message_get_status (msg)))
+                return NULL;
+
+        chunk = soup_message_body_get_chunk (soup_server_message_get_response_body (msg), 0);
+        if (!chunk)
+                return NULL;
+
+        if (g_bytes_get_size (chunk) == 0 ||
+            g_bytes_get_size (chunk) > soup_message_headers_get_content_length (soup_server_message_get_response_headers (msg))) {
+                g_bytes_unref (chunk);
+                return NULL;
+        }
+
+#ifdef HAVE_SENDFILE
+        /* Large file-backed chunks are better sent with sendfile(2) */
+        if (g_bytes_get_size (chunk) > RESPONSE_BLOCK_SIZE) {
+                int fd;
+                goffset offset;
+
+                if (get_sendfile_source (server_io, chunk, &fd, &offset)) {
+                        g_bytes_unref (chunk);
+                        return NULL;
+                }
+        }
+#endif
+
+        return chunk;
 }
 
 /* Attempts to push forward the writing side of @msg's I/O. Returns
@@ -404,6 +549,7 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
 	SoupMessageIOData *io = &server_io->msg_io->base;
         GBytes *chunk;
         gssize nwrote;
+        gsize body_written;
 	guint status_code;
 
         if (io->async_error) {
@@ -427,21 +573,48 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                         soup_server_message_set_status (msg, SOUP_STATUS_CONTINUE, NULL);
                 }
 
-                if (!io->write_buf->len)
+                if (!io->write_buf->len) {
                         write_headers (msg, io->write_buf, &io->write_encoding);
+                        server_io->msg_io->write_chunk = get_body_chunk_for_headers (server_io);
+                }
 
+                /* Send the headers and, if available, the first chunk of the
+                 * body in a single vectored write, so that small responses
+                 * only need one syscall.
+                 */
                 while (io->written < io->write_buf->len) {
-                        nwrote = g_pollable_stream_write (server_io->ostream,
-                                                          io->write_buf->str + io->written,
-                                                          io->write_buf->len - io->written,
-                                                          FALSE,
-                                                          NULL, error);
-                        if (nwrote == -1)
+                        GOutputVector vectors[2];
+                        gsize n_vectors = 1;
+                        gsize bytes_written;
+                        GPollableReturn result;
+
+                        vectors[0].buffer = io->write_buf->str + io->written;
+                        vectors[0].size = io->write_buf->len - io->written;
+                        if (server_io->msg_io->write_chunk) {
+                                vectors[1].buffer = g_bytes_get_data (server_io->msg_io->write_chunk, &vectors[1].size);
+                                n_vectors++;
+                        }
+
+                        result = g_pollable_output_stream_writev_nonblocking (G_POLLABLE_OUTPUT_STREAM (server_io->ostream),
+                                                                              vectors, n_vectors,
+                                                                              &bytes_written,
+                                                                              NULL, error);
+                        if (result == G_POLLABLE_RETURN_WOULD_BLOCK) {
+                                g_set_error_literal (error, G_IO_ERROR,
+                                                     G_IO_ERROR_WOULD_BLOCK,
+                                                     _("Operation would block"));
+                                return FALSE;
+                        }
+                        if (result != G_POLLABLE_RETURN_OK)
                                 return FALSE;
-                        io->written += nwrote;
+                        io->written += bytes_written;
                 }
 
-                io->written = 0;
+                /* Any excess went out of the body chunk, which the body
+                 * state will resume writing from.
+                 */
+                body_written = io->written - io->write_buf->len;
+                io->written = body_written;
                 g_string_truncate (io->write_buf, 0);
 
 		status_code = soup_server_message_get_status (msg);
@@ -474,7 +647,7 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                 }
 
                 if (io->write_encoding == SOUP_ENCODING_CONTENT_LENGTH)
-                        io->write_length = soup_message_headers_get_content_length (soup_server_message_get_response_headers (msg));
+                        io->write_length = soup_message_headers_get_content_length (soup_server_message_get_response_headers (msg)) - body_written;
 
                 io->write_state = SOUP_MESSAGE_IO_STATE_BODY_START;
                 /* If the client was waiting for a Continue
@@ -485,6 +658,8 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                         io->read_state = SOUP_MESSAGE_IO_STATE_DONE;
 
                 soup_server_message_wrote_headers (msg);
+                if (body_written)
+                        soup_server_message_wrote_body_data (msg, body_written);
                 break;
 
         case SOUP_MESSAGE_IO_STATE_BODY_START:
@@ -495,6 +670,13 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                 break;
 
         case SOUP_MESSAGE_IO_STATE_BODY:
+                if (server_io->msg_io->write_chunk &&
+                    io->written == g_bytes_get_size (server_io->msg_io->write_chunk)) {
+                        /* The whole chunk was written along with the headers */
+                        io->write_state = SOUP_MESSAGE_IO_STATE_BODY_DATA;
+                        break;
+                }
+
                 if (!io->write_length &&
                     io->write_encoding != SOUP_ENCODING_EOF &&
                     io->write_encoding != SOUP_ENCODING_CHUNKED) {
@@ -515,11 +697,13 @@ io_write (SoupServerMessageIOHTTP1 *server_io,
                         }
                 }
 
-                nwrote = g_pollable_stream_write (io->body_ostream,
-                                                  (guchar*)g_bytes_get_data (server_io->msg_io->write_chunk, NULL) + io->written,
-                                                  g_bytes_get_size (server_io->msg_io->write_chunk) - io->written,
-                                                  FALSE,
-                                                  NULL, error);
+                if (!write_chunk_from_file (server_io, &nwrote, error)) {
+                        nwrote = g_pollable_stream_write (io->body_ostream,
+                                                          (guchar*)g_bytes_get_data (server_io->msg_io->write_chunk, NULL) + io->written,
+                                                          g_bytes_get_size (server_io->msg_io->write_chunk) - io->written,
+                                                          FALSE,
+                                                          NULL, error);
+                }
                 if (nwrote == -1)
                         return FALSE;
 
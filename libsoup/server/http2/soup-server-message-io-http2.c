@@ -54,7 +54,8 @@ typedef struct {
 
         GSource *read_source;
         GSource *write_source;
-        GSource *write_idle_source;
+        /* Writes requested from nghttp2 callbacks are batched into one dispatch */
+        GSource *write_dispatch_source;
 
         nghttp2_session *session;
 
@@ -63,6 +64,12 @@ typedef struct {
         gssize write_buffer_size;
         gssize written_bytes;
 
+        /* Unsent tail of a DATA frame written from a mapped file */
+        GByteArray *pending_frame;
+        gsize pending_frame_written;
+        gboolean write_would_block;
+        GError *write_error;
+
         SoupMessageIOStartedFn started_cb;
         gpointer started_user_data;
 
@@ -158,9 +165,9 @@ soup_server_message_io_http2_destroy (SoupServerMessageIO *iface)
                 g_source_destroy (io->write_source);
                 g_source_unref (io->write_source);
         }
-        if (io->write_idle_source) {
-                g_source_destroy (io->write_idle_source);
-                g_source_unref (io->write_idle_source);
+        if (io->write_dispatch_source) {
+                g_source_destroy (io->write_dispatch_source);
+                g_clear_pointer (&io->write_dispatch_source, g_source_unref);
         }
 
         g_clear_object (&io->iostream);
@@ -170,6 +177,8 @@ soup_server_message_io_http2_destroy (SoupServerMessageIO *iface)
         if (io->protected == 0) {
                 g_clear_pointer (&io->session, nghttp2_session_del);
                 g_clear_pointer (&io->messages, g_hash_table_unref);
+                g_clear_pointer (&io->pending_frame, g_byte_array_unref);
+                g_clear_error (&io->write_error);
                 g_free (io);
         }
 }
@@ -347,6 +356,8 @@ soup_server_message_io_http2_unprotect (SoupServerMessageIOHTTP2 *io)
         if (io->destroyed) {
                 g_clear_pointer (&io->session, nghttp2_session_del);
                 g_clear_pointer (&io->messages, g_hash_table_unref);
+                g_clear_pointer (&io->pending_frame, g_byte_array_unref);
+                g_clear_error (&io->write_error);
                 g_free (io);
 
                 return TRUE;
@@ -355,10 +366,41 @@ soup_server_message_io_http2_unprotect (SoupServerMessageIOHTTP2 *io)
         return FALSE;
 }
 
+static gboolean
+io_want_write (SoupServerMessageIOHTTP2 *io)
+{
+        return io->pending_frame || nghttp2_session_want_write (io->session);
+}
+
 static void
 io_write (SoupServerMessageIOHTTP2 *io,
           GError                  **error)
 {
+        gssize ret;
+
+        /* A DATA frame partially written by on_send_data_callback must be
+         * completed before anything else goes to the socket.
+         */
+        if (io->pending_frame) {
+                if (!io->ostream) {
+                        g_clear_pointer (&io->pending_frame, g_byte_array_unref);
+                        return;
+                }
+
+                ret = g_pollable_stream_write (io->ostream,
+                                               io->pending_frame->data + io->pending_frame_written,
+                                               io->pending_frame->len - io->pending_frame_written,
+                                               FALSE, NULL, error);
+                if (ret > 0) {
+                        io->pending_frame_written += ret;
+                        if (io->pending_frame_written == io->pending_frame->len) {
+                                g_clear_pointer (&io->pending_frame, g_byte_array_unref);
+                                io->pending_frame_written = 0;
+                        }
+                }
+                return;
+        }
+
         /* We must write all of nghttp2's buffer before we ask for more */
         if (io->written_bytes == io->write_buffer_size)
                 io->write_buffer = NULL;
@@ -367,20 +409,35 @@ io_write (SoupServerMessageIOHTTP2 *io,
                 io->written_bytes = 0;
                 g_assert (io->in_callback == 0);
                 io->write_buffer_size = nghttp2_session_mem_send (io->session, (const guint8**)&io->write_buffer);
+                if (io->write_error) {
+                        io->write_buffer = NULL;
+                        io->write_buffer_size = 0;
+                        g_propagate_error (error, g_steal_pointer (&io->write_error));
+                        return;
+                }
                 if (io->write_buffer_size == 0) {
                         /* Done */
                         io->write_buffer = NULL;
+                        if (io->write_would_block) {
+                                io->write_would_block = FALSE;
+                                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                                                     _("Operation would block"));
+                        }
                         return;
                 }
+
+                /* Frames already handed to on_send_data_callback come first */
+                if (io->pending_frame)
+                        return;
         }
 
         if (!io->ostream)
                 return;
 
-        gssize ret = g_pollable_stream_write (io->ostream,
-                                              io->write_buffer + io->written_bytes,
-                                              io->write_buffer_size - io->written_bytes,
-                                              FALSE, NULL, error);
+        ret = g_pollable_stream_write (io->ostream,
+                                       io->write_buffer + io->written_bytes,
+                                       io->write_buffer_size - io->written_bytes,
+                                       FALSE, NULL, error);
         if (ret > 0)
                 io->written_bytes += ret;
 }
@@ -397,7 +454,7 @@ io_write_ready (GObject                  *stream,
                 if (io->destroyed)
                         break;
 
-                if (!nghttp2_session_want_write (io->session))
+                if (!io_want_write (io))
                         break;
 
                 io_write (io, &error);
@@ -415,7 +472,7 @@ io_write_ready (GObject                  *stream,
 
                 g_clear_pointer (&io->write_source, g_source_unref);
 
-                if (error || (!nghttp2_session_want_read (io->session) && !nghttp2_session_want_write (io->session)))
+                if (error || (!nghttp2_session_want_read (io->session) && !io_want_write (io)))
                         soup_server_connection_disconnect (io->conn);
         }
 
@@ -425,8 +482,6 @@ io_write_ready (GObject                  *stream,
         return G_SOURCE_REMOVE;
 }
 
-static gboolean io_write_idle_cb (SoupServerMessageIOHTTP2* io);
-
 static void
 io_try_write (SoupServerMessageIOHTTP2 *io)
 {
@@ -436,24 +491,16 @@ io_try_write (SoupServerMessageIOHTTP2 *io)
                 return;
 
         if (io->in_callback && !io->destroyed) {
-                if (!nghttp2_session_want_write (io->session))
-                        return;
-
-                if (io->write_idle_source)
+                if (!io_want_write (io))
                         return;
 
-                io->write_idle_source = g_idle_source_new ();
-                g_source_set_static_name (io->write_idle_source, "Soup server HTTP/2 write idle source");
-                g_source_set_priority (io->write_idle_source, G_PRIORITY_DEFAULT);
-                g_source_set_callback (io->write_idle_source, (GSourceFunc)io_write_idle_cb, io, NULL);
-                g_source_attach (io->write_idle_source, g_main_context_get_thread_default ());
+                g_source_set_ready_time (io->write_dispatch_source, 0);
                 return;
         }
 
-        if (io->write_idle_source) {
-                g_source_destroy (io->write_idle_source);
-                g_clear_pointer (&io->write_idle_source, g_source_unref);
-        }
+        /* Everything pending is written now */
+        if (io->write_dispatch_source)
+                g_source_set_ready_time (io->write_dispatch_source, -1);
 
         soup_server_message_io_http2_protect (io);
 
@@ -461,7 +508,7 @@ io_try_write (SoupServerMessageIOHTTP2 *io)
                 if (io->destroyed)
                         break;
 
-                if (!nghttp2_session_want_write (io->session))
+                if (!io_want_write (io))
                         break;
 
                 io_write (io, &error);
@@ -479,7 +526,7 @@ io_try_write (SoupServerMessageIOHTTP2 *io)
                 if (error)
                         h2_debug (io, NULL, "[SESSION] IO error: %s", error->message);
 
-                if (error || (!nghttp2_session_want_read (io->session) && !nghttp2_session_want_write (io->session)))
+                if (error || (!nghttp2_session_want_read (io->session) && !io_want_write (io)))
                         soup_server_connection_disconnect (io->conn);
         }
 
@@ -488,11 +535,10 @@ io_try_write (SoupServerMessageIOHTTP2 *io)
 }
 
 static gboolean
-io_write_idle_cb (SoupServerMessageIOHTTP2* io)
+io_write_dispatch_cb (SoupServerMessageIOHTTP2 *io)
 {
-        g_clear_pointer (&io->write_idle_source, g_source_unref);
         io_try_write (io);
-        return G_SOURCE_REMOVE;
+        return G_SOURCE_CONTINUE;
 }
 
 static gboolean
@@ -552,7 +598,7 @@ io_read_ready (GObject                  *stream,
                 if (error)
                         h2_debug (io, NULL, "[SESSION] IO error: %s", error->message);
 
-                if (error || (!nghttp2_session_want_read (io->session) && !nghttp2_session_want_write (io->session)))
+                if (error || (!nghttp2_session_want_read (io->session) && !io_want_write (io)))
                         soup_server_connection_disconnect (io->conn);
         }
 
@@ -623,16 +669,15 @@ on_begin_headers_callback (nghttp2_session     *session,
 static int
 on_header_callback (nghttp2_session     *session,
                     const nghttp2_frame *frame,
-                    const uint8_t       *name,
-                    size_t               namelen,
-                    const uint8_t       *value,
-                    size_t               valuelen,
+                    nghttp2_rcbuf       *name,
+                    nghttp2_rcbuf       *value,
                     uint8_t              flags,
                     void                *user_data)
 {
         SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)user_data;
         SoupMessageIOHTTP2 *msg_io;
         SoupServerMessage *msg;
+        nghttp2_vec name_buf, value_buf;
 
         if (frame->hd.type != NGHTTP2_HEADERS)
                 return 0;
@@ -647,23 +692,26 @@ on_header_callback (nghttp2_session     *session,
         io->in_callback++;
 
         msg = msg_io->msg;
-        if (name[0] == ':') {
-                if (strcmp ((char *)name, ":method") == 0)
-                        soup_server_message_set_method (msg, (char *)value);
-                else if (strcmp ((char *)name, ":scheme") == 0)
-                        msg_io->scheme = g_strndup ((char *)value, valuelen);
-                else if (strcmp ((char *)name, ":authority") == 0)
-                        msg_io->authority = g_strndup ((char *)value, valuelen);
-                else if (strcmp ((char *)name, ":path") == 0)
-                        msg_io->path = g_strndup ((char *)value, valuelen);
+        name_buf = nghttp2_rcbuf_get_buf (name);
+        if (name_buf.base[0] == ':') {
+                const char *name_str = (const char *)name_buf.base;
+
+                value_buf = nghttp2_rcbuf_get_buf (value);
+                if (strcmp (name_str, ":method") == 0)
+                        soup_server_message_set_method (msg, (char *)value_buf.base);
+                else if (strcmp (name_str, ":scheme") == 0)
+                        msg_io->scheme = g_strndup ((char *)value_buf.base, value_buf.len);
+                else if (strcmp (name_str, ":authority") == 0)
+                        msg_io->authority = g_strndup ((char *)value_buf.base, value_buf.len);
+                else if (strcmp (name_str, ":path") == 0)
+                        msg_io->path = g_strndup ((char *)value_buf.base, value_buf.len);
                 else
-                        g_debug ("Unknown header: %s = %s", name, value);
+                        g_debug ("Unknown header: %s = %s", name_str, value_buf.base);
                 io->in_callback--;
                 return 0;
         }
 
-        soup_message_headers_append_untrusted_data (soup_server_message_get_request_headers (msg),
-                                                    (const char*)name, (const char*)value);
+        soup_http2_message_headers_append (soup_server_message_get_request_headers (msg), name, value);
 
         io->in_callback--;
         return 0;
@@ -699,6 +747,37 @@ on_data_chunk_recv_callback (nghttp2_session *session,
         return 0;
 }
 
+/* Chunks mapped from a file are sent by on_send_data_callback straight
+ * from the mapping instead of being copied into nghttp2's buffer.
+ */
+static gboolean
+chunk_is_from_file (SoupMessageIOHTTP2 *msg_io,
+                    GBytes             *chunk)
+{
+        int fd;
+        goffset offset;
+
+        return soup_server_message_get_response_file_range (msg_io->msg, chunk, &fd, &offset);
+}
+
+static void
+msg_io_wrote_body_data (SoupMessageIOHTTP2 *msg_io,
+                        SoupMessageBody    *response_body,
+                        gsize               count)
+{
+        msg_io->chunk_written += count;
+        msg_io->write_offset += count;
+        h2_debug (NULL, msg_io, "[SEND_BODY] wrote %zd %u/%u", count, msg_io->write_offset, response_body->length);
+        soup_server_message_wrote_body_data (msg_io->msg, count);
+
+        if (msg_io->chunk_written == (goffset)g_bytes_get_size (msg_io->write_chunk)) {
+                soup_message_body_wrote_chunk (response_body, msg_io->write_chunk);
+                g_clear_pointer (&msg_io->write_chunk, g_bytes_unref);
+                soup_server_message_wrote_chunk (msg_io->msg);
+                msg_io->chunk_written = 0;
+        }
+}
+
 static ssize_t
 on_data_source_read_callback (nghttp2_session     *session,
                               int32_t              stream_id,
@@ -729,19 +808,25 @@ on_data_source_read_callback (nghttp2_session     *session,
 
                 data = g_bytes_get_data (msg_io->write_chunk, &data_length);
                 bytes_to_write = MIN (length - bytes_written, data_length - msg_io->chunk_written);
+
+                if (chunk_is_from_file (msg_io, msg_io->write_chunk)) {
+                        /* Mapped chunks get DATA frames of their own */
+                        if (bytes_written > 0)
+                                break;
+
+                        *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+                        if (msg_io->write_offset + bytes_to_write == response_body->length) {
+                                h2_debug (user_data, msg_io, "[SEND_BODY] EOF");
+                                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                        }
+
+                        io->in_callback--;
+                        return bytes_to_write;
+                }
+
                 memcpy (buf + bytes_written, (uint8_t *)data + msg_io->chunk_written, bytes_to_write);
                 bytes_written += bytes_to_write;
-                msg_io->chunk_written += bytes_to_write;
-                msg_io->write_offset += bytes_to_write;
-                h2_debug (user_data, msg_io, "[SEND_BODY] wrote %zd %u/%u", bytes_to_write, msg_io->write_offset, response_body->length);
-                soup_server_message_wrote_body_data (msg_io->msg, bytes_to_write);
-
-                if (msg_io->chunk_written == data_length) {
-                        soup_message_body_wrote_chunk (response_body, msg_io->write_chunk);
-                        g_clear_pointer (&msg_io->write_chunk, g_bytes_unref);
-                        soup_server_message_wrote_chunk (msg_io->msg);
-                        msg_io->chunk_written = 0;
-                }
+                msg_io_wrote_body_data (msg_io, response_body, bytes_to_write);
         }
 
         if (msg_io->write_offset == response_body->length) {
@@ -755,6 +840,108 @@ on_data_source_read_callback (nghttp2_session     *session,
         return bytes_written;
 }
 
+static int
+on_send_data_callback (nghttp2_session     *session,
+                       nghttp2_frame       *frame,
+                       const uint8_t       *framehd,
+                       size_t               length,
+                       nghttp2_data_source *source,
+                       void                *user_data)
+{
+        static const guint8 padding[256] = { 0, };
+        SoupServerMessageIOHTTP2 *io = (SoupServerMessageIOHTTP2 *)user_data;
+        SoupMessageIOHTTP2 *msg_io;
+        SoupMessageBody *response_body = (SoupMessageBody *)source->ptr;
+        GOutputVector vectors[4];
+        guint n_vectors = 0;
+        const guint8 *payload;
+        guint8 padlen;
+        gsize frame_len, written = 0;
+        GPollableReturn ret;
+        GError *error = NULL;
+
+        msg_io = nghttp2_session_get_stream_user_data (session, frame->hd.stream_id);
+        if (!msg_io || !msg_io->write_chunk)
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+
+        /* The connection is gone, nothing can be sent */
+        if (!io->ostream)
+                return NGHTTP2_ERR_CALLBACK_FAILURE;
+
+        /* nghttp2_session_mem_send() keeps going after a frame is handed
+         * to us, so the tail of a previous frame may still be unsent. It
+         * must reach the socket first; nghttp2 will retry this frame.
+         */
+        if (io->pending_frame) {
+                io->write_would_block = TRUE;
+                return NGHTTP2_ERR_WOULDBLOCK;
+        }
+
+        io->in_callback++;
+
+        payload = (const guint8 *)g_bytes_get_data (msg_io->write_chunk, NULL) + msg_io->chunk_written;
+
+        vectors[n_vectors].buffer = framehd;
+        vectors[n_vectors++].size = 9;
+        if (frame->data.padlen > 0) {
+                padlen = frame->data.padlen - 1;
+                vectors[n_vectors].buffer = &padlen;
+                vectors[n_vectors++].size = 1;
+        }
+        vectors[n_vectors].buffer = payload;
+        vectors[n_vectors++].size = length;
+        if (frame->data.padlen > 1) {
+                vectors[n_vectors].buffer = padding;
+                vectors[n_vectors++].size = frame->data.padlen - 1;
+        }
+        frame_len = 9 + length + frame->data.padlen;
+
+        ret = g_pollable_output_stream_writev_nonblocking (G_POLLABLE_OUTPUT_STREAM (io->ostream),
+                                                           vectors, n_vectors, &written, NULL, &error);
+        if (ret == G_POLLABLE_RETURN_WOULD_BLOCK) {
+                /* nghttp2 will call us again with the same frame */
+                io->write_would_block = TRUE;
+                io->in_callback--;
+                return NGHTTP2_ERR_WOULDBLOCK;
+        }
+
+        if (error) {
+                h2_debug (io, msg_io, "[SEND_BODY] Error writing frame: %s", error->message);
+                g_clear_error (&io->write_error);
+                io->write_error = error;
+                io->in_callback--;
+                return NGHTTP2_ERR_CALLBACK_FAILURE;
+        }
+
+        if (written < frame_len) {
+                guint i;
+
+                /* Once part of a frame is on the wire the rest must
+                 * follow before anything else, so keep a copy of
+                 * what's missing.
+                 */
+                io->pending_frame = g_byte_array_sized_new (frame_len - written);
+                io->pending_frame_written = 0;
+                for (i = 0; i < n_vectors; i++) {
+                        if (written >= vectors[i].size) {
+                                written -= vectors[i].size;
+                                continue;
+                        }
+
+                        g_byte_array_append (io->pending_frame, (const guint8 *)vectors[i].buffer + written, vectors[i].size - written);
+                        written = 0;
+                }
+        }
+
+        soup_server_message_add_response_file_bytes_sent (msg_io->msg, length);
+        msg_io_wrote_body_data (msg_io, response_body, length);
+        if (msg_io->write_offset == response_body->length)
+                soup_server_message_wrote_body (msg_io->msg);
+
+        io->in_callback--;
+        return 0;
+}
+
 static void
 soup_server_message_io_http2_send_response (SoupServerMessageIOHTTP2 *io,
                                             SoupMessageIOHTTP2       *msg_io)
@@ -936,13 +1123,27 @@ soup_server_message_io_http2_init (SoupServerMessageIOHTTP2 *io)
 
         nghttp2_session_callbacks_new (&callbacks);
         nghttp2_session_callbacks_set_on_begin_headers_callback (callbacks, on_begin_headers_callback);
-        nghttp2_session_callbacks_set_on_header_callback (callbacks, on_header_callback);
+        nghttp2_session_callbacks_set_on_header_callback2 (callbacks, on_header_callback);
         nghttp2_session_callbacks_set_on_data_chunk_recv_callback (callbacks, on_data_chunk_recv_callback);
         nghttp2_session_callbacks_set_on_frame_recv_callback (callbacks, on_frame_recv_callback);
         nghttp2_session_callbacks_set_on_frame_send_callback (callbacks, on_frame_send_callback);
         nghttp2_session_callbacks_set_on_stream_close_callback (callbacks, on_stream_close_callback);
+        nghttp2_session_callbacks_set_send_data_callback (callbacks, on_send_data_callback);
 
+#ifdef HAVE_NGHTTP2_EXTENSIBLE_PRIORITIES
+        nghttp2_option *option;
+
+        /* Once SETTINGS_NO_RFC7540_PRIORITIES is sent, nghttp2 takes the
+         * urgency and incremental parameters from the Priority header and
+         * PRIORITY_UPDATE frames, and schedules DATA frames accordingly.
+         */
+        nghttp2_option_new (&option);
+        nghttp2_option_set_builtin_recv_extension_type (option, NGHTTP2_PRIORITY_UPDATE);
+        nghttp2_session_server_new2 (&io->session, callbacks, io, option);
+        nghttp2_option_del (option);
+#else
         nghttp2_session_server_new (&io->session, callbacks, io);
+#endif
         nghttp2_session_callbacks_del (callbacks);
 }
 
@@ -970,6 +1171,12 @@ soup_server_message_io_http2_new (SoupServerConnection  *conn,
         g_source_set_callback (io->read_source, (GSourceFunc)io_read_ready, io, NULL);
         g_source_attach (io->read_source, g_main_context_get_thread_default ());
 
+        io->write_dispatch_source = soup_http2_dispatch_source_new ("Soup server HTTP/2 write dispatch source",
+                                                                    G_PRIORITY_DEFAULT,
+                                                                    (GSourceFunc)io_write_dispatch_cb,
+                                                                    io);
+        g_source_attach (io->write_dispatch_source, g_main_context_get_thread_default ());
+
         io->iface.funcs = &io_funcs;
 
         io->messages = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)soup_message_io_http2_free);
@@ -977,8 +1184,11 @@ soup_server_message_io_http2_new (SoupServerConnection  *conn,
         soup_server_message_set_http_version (msg, SOUP_HTTP_2_0);
 
         const nghttp2_settings_entry settings[] = {
-                { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100 },
-                { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 }
+                { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, soup_server_connection_get_http2_max_concurrent_streams (conn) },
+                { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 },
+#ifdef HAVE_NGHTTP2_EXTENSIBLE_PRIORITIES
+                { NGHTTP2_SETTINGS_NO_RFC7540_PRIORITIES, 1 },
+#endif
         };
         nghttp2_submit_settings (io->session, NGHTTP2_FLAG_NONE, settings, G_N_ELEMENTS (settings));
         io_try_write (io);
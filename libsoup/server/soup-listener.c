@@ -34,6 +34,7 @@ enum {
         PROP_TLS_CERTIFICATE,
         PROP_TLS_DATABASE,
         PROP_TLS_AUTH_MODE,
+        PROP_ACCEPT_BATCH_SIZE,
 
         LAST_PROPERTY
 };
@@ -54,7 +55,13 @@ typedef struct {
         GTlsDatabase *tls_database;
         GTlsAuthenticationMode tls_auth_mode;
 
+        guint accept_batch_size;
+
+        /* The source may be paused and resumed from other threads */
+        GMutex mutex;
+        GMainContext *context;
         GSource *source;
+        int paused;
 } SoupListenerPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupListener, soup_listener, G_TYPE_OBJECT)
@@ -62,6 +69,9 @@ G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupListener, soup_listener, G_TYPE_OBJECT)
 static void
 soup_listener_init (SoupListener *listener)
 {
+        SoupListenerPrivate *priv = soup_listener_get_instance_private (listener);
+
+        g_mutex_init (&priv->mutex);
 }
 
 static gboolean
@@ -71,20 +81,48 @@ listen_watch (GObject      *pollable,
         SoupListenerPrivate *priv = soup_listener_get_instance_private (listener);
         GSocket *socket;
         SoupServerConnection *conn;
+        GError *error = NULL;
+        guint i;
+
+        /* Drain the accept queue a batch at a time, so that a
+         * connection storm doesn't cost a main loop iteration
+         * per connection.
+         */
+        for (i = 0; i < priv->accept_batch_size && !g_atomic_int_get (&priv->paused); i++) {
+                socket = g_socket_accept (priv->socket, NULL, &error);
+                if (!socket) {
+                        gboolean would_block = g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
 
-        socket = g_socket_accept (priv->socket, NULL, NULL);
-        if (!socket)
-                return G_SOURCE_REMOVE;
+                        g_error_free (error);
+                        return would_block ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+                }
 
-        conn = soup_server_connection_new (socket, priv->tls_certificate, priv->tls_database, priv->tls_auth_mode);
-        g_object_unref (socket);
+                conn = soup_server_connection_new (socket, priv->tls_certificate, priv->tls_database, priv->tls_auth_mode);
+                g_object_unref (socket);
 
-        g_signal_emit (listener, signals[NEW_CONNECTION], 0, conn);
-        g_object_unref (conn);
+                g_signal_emit (listener, signals[NEW_CONNECTION], 0, conn);
+                g_object_unref (conn);
+
+                /* A handler may have disconnected us */
+                if (!priv->socket)
+                        break;
+        }
 
         return G_SOURCE_CONTINUE;
 }
 
+/* Must be called with priv->mutex held */
+static void
+soup_listener_attach_source (SoupListener *listener)
+{
+        SoupListenerPrivate *priv = soup_listener_get_instance_private (listener);
+
+        priv->source = g_pollable_input_stream_create_source (G_POLLABLE_INPUT_STREAM (g_io_stream_get_input_stream (priv->iostream)), NULL);
+        g_source_set_static_name (priv->source, "SoupListener");
+        g_source_set_callback (priv->source, (GSourceFunc)listen_watch, listener, NULL);
+        g_source_attach (priv->source, priv->context);
+}
+
 static void
 soup_listener_constructed (GObject *object)
 {
@@ -95,10 +133,10 @@ soup_listener_constructed (GObject *object)
 
         priv->conn = (GIOStream *)g_socket_connection_factory_create_connection (priv->socket);
         priv->iostream = soup_io_stream_new (priv->conn, FALSE);
-        priv->source = g_pollable_input_stream_create_source (G_POLLABLE_INPUT_STREAM (g_io_stream_get_input_stream (priv->iostream)), NULL);
-        g_source_set_static_name (priv->source, "SoupListener");
-        g_source_set_callback (priv->source, (GSourceFunc)listen_watch, listener, NULL);
-        g_source_attach (priv->source, g_main_context_get_thread_default ());
+        priv->context = g_main_context_ref_thread_default ();
+        g_mutex_lock (&priv->mutex);
+        soup_listener_attach_source (listener);
+        g_mutex_unlock (&priv->mutex);
 
         G_OBJECT_CLASS (soup_listener_parent_class)->constructed (object);
 }
@@ -125,6 +163,8 @@ soup_listener_finalize (GObject *object)
                 g_source_destroy (priv->source);
                 g_source_unref (priv->source);
         }
+        g_clear_pointer (&priv->context, g_main_context_unref);
+        g_mutex_clear (&priv->mutex);
 
         G_OBJECT_CLASS (soup_listener_parent_class)->finalize (object);
 }
@@ -151,6 +191,9 @@ soup_listener_set_property (GObject      *object,
         case PROP_TLS_AUTH_MODE:
                 priv->tls_auth_mode = g_value_get_enum (value);
                 break;
+        case PROP_ACCEPT_BATCH_SIZE:
+                priv->accept_batch_size = g_value_get_uint (value);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -179,6 +222,9 @@ soup_listener_get_property (GObject    *object,
         case PROP_TLS_AUTH_MODE:
                 g_value_set_enum (value, priv->tls_auth_mode);
                 break;
+        case PROP_ACCEPT_BATCH_SIZE:
+                g_value_set_uint (value, priv->accept_batch_size);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -249,6 +295,15 @@ soup_listener_class_init (SoupListenerClass *listener_class)
                                    G_PARAM_READWRITE |
                                    G_PARAM_STATIC_STRINGS);
 
+        properties[PROP_ACCEPT_BATCH_SIZE] =
+                g_param_spec_uint ("accept-batch-size",
+                                   "Accept batch size",
+                                   "Maximum number of connections accepted per wakeup",
+                                   1, G_MAXUINT,
+                                   SOUP_LISTENER_DEFAULT_ACCEPT_BATCH_SIZE,
+                                   G_PARAM_READWRITE | G_PARAM_CONSTRUCT |
+                                   G_PARAM_STATIC_STRINGS);
+
         g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
 }
 
@@ -278,6 +333,18 @@ soup_listener_new (GSocket *socket,
 SoupListener *
 soup_listener_new_for_address (GSocketAddress *address,
                                GError        **error)
+{
+        return soup_listener_new_for_address_full (address, FALSE, error);
+}
+
+/* If @reuse_port is %TRUE, the socket is bound with SO_REUSEPORT so that
+ * several listeners (typically one per thread) can share @address and
+ * have the kernel balance incoming connections between them.
+ */
+SoupListener *
+soup_listener_new_for_address_full (GSocketAddress *address,
+                                    gboolean        reuse_port,
+                                    GError        **error)
 {
         GSocket *socket;
         GSocketFamily family;
@@ -301,6 +368,22 @@ soup_listener_new_for_address (GSocketAddress *address,
                 }
         }
 
+        if (reuse_port) {
+#ifdef SO_REUSEPORT
+                if (!g_socket_set_option (socket, SOL_SOCKET, SO_REUSEPORT, TRUE, error)) {
+                        g_object_unref (socket);
+
+                        return NULL;
+                }
+#else
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                     _("Port reuse is not supported on this platform"));
+                g_object_unref (socket);
+
+                return NULL;
+#endif
+        }
+
         if (!g_socket_bind (socket, address, TRUE, error)) {
                 g_object_unref (socket);
 
@@ -339,11 +422,53 @@ soup_listener_disconnect (SoupListener *listener)
         g_return_if_fail (SOUP_IS_LISTENER (listener));
 
         priv = soup_listener_get_instance_private (listener);
+        g_mutex_lock (&priv->mutex);
+        if (priv->source) {
+                g_source_destroy (priv->source);
+                g_clear_pointer (&priv->source, g_source_unref);
+        }
         g_clear_object (&priv->socket);
         if (priv->conn) {
                 g_io_stream_close (priv->conn, NULL, NULL);
                 g_clear_object (&priv->conn);
         }
+        g_mutex_unlock (&priv->mutex);
+}
+
+/* Stops accepting connections, leaving them in the socket backlog,
+ * until soup_listener_resume() is called. Both can be called from
+ * any thread.
+ */
+void
+soup_listener_pause (SoupListener *listener)
+{
+        SoupListenerPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_LISTENER (listener));
+
+        priv = soup_listener_get_instance_private (listener);
+        g_mutex_lock (&priv->mutex);
+        g_atomic_int_set (&priv->paused, TRUE);
+        if (priv->source) {
+                g_source_destroy (priv->source);
+                g_clear_pointer (&priv->source, g_source_unref);
+        }
+        g_mutex_unlock (&priv->mutex);
+}
+
+void
+soup_listener_resume (SoupListener *listener)
+{
+        SoupListenerPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_LISTENER (listener));
+
+        priv = soup_listener_get_instance_private (listener);
+        g_mutex_lock (&priv->mutex);
+        g_atomic_int_set (&priv->paused, FALSE);
+        if (!priv->source && priv->conn)
+                soup_listener_attach_source (listener);
+        g_mutex_unlock (&priv->mutex);
 }
 
 gboolean
@@ -10,6 +10,9 @@
 
 G_BEGIN_DECLS
 
+/* Maximum number of connections accepted per wakeup */
+#define SOUP_LISTENER_DEFAULT_ACCEPT_BATCH_SIZE 32
+
 #define SOUP_TYPE_LISTENER (soup_listener_get_type ())
 G_DECLARE_FINAL_TYPE (SoupListener, soup_listener, SOUP, LISTENER, GObject)
 
@@ -17,8 +20,13 @@ SoupListener       *soup_listener_new              (GSocket        *socket,
                                                     GError        **error);
 SoupListener       *soup_listener_new_for_address  (GSocketAddress *address,
                                                     GError        **error);
+SoupListener       *soup_listener_new_for_address_full (GSocketAddress *address,
+                                                        gboolean        reuse_port,
+                                                        GError        **error);
 
 void                soup_listener_disconnect       (SoupListener   *listener);
+void                soup_listener_pause            (SoupListener   *listener);
+void                soup_listener_resume           (SoupListener   *listener);
 gboolean            soup_listener_is_ssl           (SoupListener   *listener);
 GSocket            *soup_listener_get_socket       (SoupListener   *listener);
 GInetSocketAddress *soup_listener_get_address      (SoupListener   *listener);
@@ -13,24 +13,149 @@
 
 #include "soup-path-map.h"
 
-/* This could be replaced with something more clever, like a Patricia
- * trie, but it's probably not worth it since the total number of
- * mappings is likely to always be small. So we keep an array of
- * paths, sorted by decreasing length. (The first prefix match will
- * therefore be the longest.)
+/* The map is a radix tree (a trie where nodes with a single child and
+ * no data are merged into their child), so that the longest prefix of
+ * a path can be found in time proportional to the path length rather
+ * than to the number of mappings. Paths are matched as plain strings,
+ * so "/foo" is a prefix of "/foobar" too, and anything after a "?" is
+ * ignored.
  */
 
-typedef struct {
-	char     *path;
-	int       len;
-	gpointer  data;
-} SoupPathMapping;
+typedef struct SoupPathMapNode SoupPathMapNode;
+
+struct SoupPathMapNode {
+	/* The part of the path between the parent node and this one */
+	char            *label;
+	int              label_len;
+
+	gboolean         has_data;
+	gpointer         data;
+
+	/* Sorted by the first byte of their labels, which are unique */
+	GPtrArray       *children;
+};
 
 struct SoupPathMap {
-	GArray *mappings;
+	SoupPathMapNode root;
 	GDestroyNotify free_func;
 };
 
+static SoupPathMapNode *
+path_map_node_new (const char *label,
+		   int         label_len)
+{
+	SoupPathMapNode *node;
+
+	node = g_slice_new0 (SoupPathMapNode);
+	node->label = g_strndup (label, label_len);
+	node->label_len = label_len;
+
+	return node;
+}
+
+static void
+path_map_node_clear (SoupPathMap     *map,
+		     SoupPathMapNode *node)
+{
+	guint i;
+
+	if (node->has_data && map->free_func)
+		map->free_func (node->data);
+
+	if (node->children) {
+		for (i = 0; i < node->children->len; i++) {
+			SoupPathMapNode *child = node->children->pdata[i];
+
+			path_map_node_clear (map, child);
+			g_slice_free (SoupPathMapNode, child);
+		}
+		g_ptr_array_free (node->children, TRUE);
+	}
+	g_free (node->label);
+}
+
+/* Finds the child of @node whose label starts with @c. Returns its
+ * index, or the index to insert such a child at, as a negative number
+ * minus one, if there isn't one.
+ */
+static int
+path_map_node_find_child (SoupPathMapNode *node,
+			  char             c)
+{
+	int low = 0, high;
+
+	if (!node->children)
+		return -1;
+
+	high = node->children->len - 1;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		SoupPathMapNode *child = node->children->pdata[mid];
+		guchar mid_c = child->label[0];
+
+		if (mid_c == (guchar)c)
+			return mid;
+		if (mid_c < (guchar)c)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+
+	return -low - 1;
+}
+
+static SoupPathMapNode *
+path_map_node_get_child (SoupPathMapNode *node,
+			 const char      *path,
+			 int              path_len)
+{
+	SoupPathMapNode *child;
+	int index;
+
+	index = path_map_node_find_child (node, path[0]);
+	if (index < 0)
+		return NULL;
+
+	child = node->children->pdata[index];
+	if (child->label_len > path_len || memcmp (child->label, path, child->label_len) != 0)
+		return NULL;
+
+	return child;
+}
+
+/* Merges @node with its only child, when it has no data of its own */
+static void
+path_map_node_compact (SoupPathMapNode *node)
+{
+	SoupPathMapNode *child;
+	char *label;
+
+	if (node->has_data || !node->children || node->children->len != 1)
+		return;
+
+	child = node->children->pdata[0];
+	label = g_malloc (node->label_len + child->label_len + 1);
+	memcpy (label, node->label, node->label_len);
+	memcpy (label + node->label_len, child->label, child->label_len + 1);
+	g_free (node->label);
+	node->label = label;
+	node->label_len += child->label_len;
+
+	node->has_data = child->has_data;
+	node->data = child->data;
+	g_ptr_array_free (node->children, TRUE);
+	node->children = child->children;
+
+	g_free (child->label);
+	g_slice_free (SoupPathMapNode, child);
+}
+
+static int
+path_map_key_len (const char *path)
+{
+	return strcspn (path, "?");
+}
+
 /**
  * soup_path_map_new:
  * @data_free_func: function to use to free data added with
@@ -46,7 +171,6 @@ soup_path_map_new (GDestroyNotify data_free_func)
 	SoupPathMap *map;
 
 	map = g_slice_new0 (SoupPathMap);
-	map->mappings = g_array_new (FALSE, FALSE, sizeof (SoupPathMapping));
 	map->free_func = data_free_func;
 
 	return map;
@@ -61,59 +185,10 @@ soup_path_map_new (GDestroyNotify data_free_func)
 void
 soup_path_map_free (SoupPathMap *map)
 {
-	SoupPathMapping *mappings = (SoupPathMapping *)map->mappings->data;
-	guint i;
-
-	for (i = 0; i < map->mappings->len; i++) {
-		g_free (mappings[i].path);
-		if (map->free_func)
-			map->free_func (mappings[i].data);
-	}
-	g_array_free (map->mappings, TRUE);
-	
+	path_map_node_clear (map, &map->root);
 	g_slice_free (SoupPathMap, map);
 }
 
-/* Scan @map looking for @path or one of its ancestors.
- * Sets *@match to the index of a match, or -1 if no match is found.
- * Sets *@insert to the index to insert @path at if a new mapping is
- * desired. Returns %TRUE if *@match is an exact match.
- */
-static gboolean
-mapping_lookup (SoupPathMap *map, const char *path, int *match, int *insert)
-{
-	SoupPathMapping *mappings = (SoupPathMapping *)map->mappings->data;
-	guint i;
-	int path_len;
-	gboolean exact = FALSE;
-
-	*match = -1;
-
-	path_len = strcspn (path, "?");
-	for (i = 0; i < map->mappings->len; i++) {
-		if (mappings[i].len > path_len)
-			continue;
-
-		if (insert && mappings[i].len < path_len) {
-			*insert = i;
-			/* Clear insert so we don't try to set it again */
-			insert = NULL;
-		}
-
-		if (!strncmp (mappings[i].path, path, mappings[i].len)) {
-			*match = i;
-			if (path_len == mappings[i].len)
-				exact = TRUE;
-			if (!insert)
-				return exact;
-		}
-	}
-
-	if (insert)
-		*insert = i;
-	return exact;
-}	
-
 /**
  * soup_path_map_add:
  * @map: a #SoupPathMap
@@ -126,21 +201,52 @@ mapping_lookup (SoupPathMap *map, const char *path, int *match, int *insert)
 void
 soup_path_map_add (SoupPathMap *map, const char *path, gpointer data)
 {
-	SoupPathMapping *mappings = (SoupPathMapping *)map->mappings->data;
-	int match, insert;
-
-	if (mapping_lookup (map, path, &match, &insert)) {
-		if (map->free_func)
-			map->free_func (mappings[match].data);
-		mappings[match].data = data;
-	} else {
-		SoupPathMapping mapping;
-
-		mapping.path = g_strdup (path);
-		mapping.len = strlen (path);
-		mapping.data = data;
-		g_array_insert_val (map->mappings, insert, mapping);
+	SoupPathMapNode *node = &map->root;
+	int path_len = path_map_key_len (path);
+
+	while (path_len > 0) {
+		SoupPathMapNode *child, *split;
+		int index, common;
+
+		index = path_map_node_find_child (node, path[0]);
+		if (index < 0) {
+			child = path_map_node_new (path, path_len);
+			if (!node->children)
+				node->children = g_ptr_array_new ();
+			g_ptr_array_insert (node->children, -index - 1, child);
+			node = child;
+			break;
+		}
+
+		child = node->children->pdata[index];
+		for (common = 1; common < child->label_len && common < path_len; common++) {
+			if (child->label[common] != path[common])
+				break;
+		}
+
+		if (common < child->label_len) {
+			/* @path diverges in the middle of the label, so
+			 * split @child at that point.
+			 */
+			split = path_map_node_new (child->label, common);
+			split->children = g_ptr_array_new ();
+			g_ptr_array_add (split->children, child);
+			node->children->pdata[index] = split;
+
+			memmove (child->label, child->label + common, child->label_len - common + 1);
+			child->label_len -= common;
+			child = split;
+		}
+
+		node = child;
+		path += common;
+		path_len -= common;
 	}
+
+	if (node->has_data && map->free_func)
+		map->free_func (node->data);
+	node->has_data = TRUE;
+	node->data = data;
 }
 
 /**
@@ -154,16 +260,46 @@ soup_path_map_add (SoupPathMap *map, const char *path, gpointer data)
 void
 soup_path_map_remove (SoupPathMap *map, const char *path)
 {
-	SoupPathMapping *mappings = (SoupPathMapping *)map->mappings->data;
-	int match;
+	SoupPathMapNode *node = &map->root, *parent = NULL;
+	int path_len = path_map_key_len (path);
+
+	while (path_len > 0) {
+		SoupPathMapNode *child;
 
-	if (!mapping_lookup (map, path, &match, NULL))
+		child = path_map_node_get_child (node, path, path_len);
+		if (!child)
+			return;
+
+		parent = node;
+		node = child;
+		path += child->label_len;
+		path_len -= child->label_len;
+	}
+
+	if (!node->has_data)
 		return;
 
 	if (map->free_func)
-		map->free_func (mappings[match].data);
-	g_free (mappings[match].path);
-	g_array_remove_index (map->mappings, match);
+		map->free_func (node->data);
+	node->has_data = FALSE;
+	node->data = NULL;
+
+	/* The root is never removed or merged, since it has no label */
+	if (!parent)
+		return;
+
+	if (!node->children) {
+		g_ptr_array_remove_index (parent->children,
+					  path_map_node_find_child (parent, node->label[0]));
+		if (parent->children->len == 0)
+			g_clear_pointer (&parent->children, g_ptr_array_unref);
+		g_free (node->label);
+		g_slice_free (SoupPathMapNode, node);
+
+		if (parent != &map->root)
+			path_map_node_compact (parent);
+	} else
+		path_map_node_compact (node);
 }
 
 /**
@@ -181,12 +317,22 @@ soup_path_map_remove (SoupPathMap *map, const char *path)
 gpointer
 soup_path_map_lookup (SoupPathMap *map, const char *path)
 {
-	SoupPathMapping *mappings = (SoupPathMapping *)map->mappings->data;
-	int match;
+	SoupPathMapNode *node = &map->root, *match = NULL;
+	int path_len = path_map_key_len (path);
 
-	mapping_lookup (map, path, &match, NULL);
-	if (match == -1)
-		return NULL;
-	else
-		return mappings[match].data;
+	if (node->has_data)
+		match = node;
+
+	while (path_len > 0) {
+		node = path_map_node_get_child (node, path, path_len);
+		if (!node)
+			break;
+
+		if (node->has_data)
+			match = node;
+		path += node->label_len;
+		path_len -= node->label_len;
+	}
+
+	return match ? match->data : NULL;
 }
@@ -60,6 +60,7 @@ typedef struct {
         GIOStream *iostream;
         SoupServerMessage *initial_msg;
         gboolean advertise_http2;
+        guint http2_max_concurrent_streams;
         SoupHTTPVersion http_version;
         SoupServerMessageIO *io_data;
         GCancellable *cancellable;
@@ -70,6 +71,7 @@ typedef struct {
         GTlsCertificate *tls_certificate;
         GTlsDatabase *tls_database;
         GTlsAuthenticationMode tls_auth_mode;
+        gboolean tls_handshaking;
 } SoupServerConnectionPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupServerConnection, soup_server_connection, G_TYPE_OBJECT)
@@ -87,6 +89,7 @@ soup_server_connection_init (SoupServerConnection *conn)
         SoupServerConnectionPrivate *priv = soup_server_connection_get_instance_private (conn);
 
         priv->http_version = SOUP_HTTP_1_1;
+        priv->http2_max_concurrent_streams = SOUP_SERVER_CONNECTION_HTTP2_MAX_CONCURRENT_STREAMS;
         priv->cancellable = g_cancellable_new ();
 }
 
@@ -442,6 +445,8 @@ tls_connection_handshake_ready_cb (GTlsConnection       *tls_conn,
         if (g_tls_connection_handshake_finish (tls_conn, result, &error)) {
                 const char *protocol = g_tls_connection_get_negotiated_protocol (tls_conn);
 
+                priv->tls_handshaking = FALSE;
+
                 if (g_strcmp0 (protocol, "h2") == 0)
                         priv->http_version = SOUP_HTTP_2_0;
                 else if (g_strcmp0 (protocol, "http/1.0") == 0)
@@ -469,6 +474,29 @@ soup_server_connection_set_advertise_http2 (SoupServerConnection *conn,
         priv->advertise_http2 = advertise_http2;
 }
 
+void
+soup_server_connection_set_http2_max_concurrent_streams (SoupServerConnection *conn,
+                                                         guint                 max_concurrent_streams)
+{
+        SoupServerConnectionPrivate *priv;
+
+        g_return_if_fail (SOUP_IS_SERVER_CONNECTION (conn));
+
+        priv = soup_server_connection_get_instance_private (conn);
+        priv->http2_max_concurrent_streams = max_concurrent_streams;
+}
+
+guint
+soup_server_connection_get_http2_max_concurrent_streams (SoupServerConnection *conn)
+{
+        SoupServerConnectionPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_CONNECTION (conn), 0);
+
+        priv = soup_server_connection_get_instance_private (conn);
+        return priv->http2_max_concurrent_streams;
+}
+
 void
 soup_server_connection_accepted (SoupServerConnection *conn)
 {
@@ -529,6 +557,7 @@ soup_server_connection_accepted (SoupServerConnection *conn)
                                          G_CALLBACK (tls_connection_peer_certificate_changed),
                                          conn, G_CONNECT_SWAPPED);
 
+                priv->tls_handshaking = TRUE;
                 g_tls_connection_handshake_async (G_TLS_CONNECTION (priv->conn),
                                                   G_PRIORITY_DEFAULT, priv->cancellable,
                                                   (GAsyncReadyCallback)tls_connection_handshake_ready_cb,
@@ -644,10 +673,27 @@ soup_server_connection_disconnect (SoupServerConnection *conn)
 
         /* Then let everyone know we're disconnected */
         g_signal_emit (conn, signals[DISCONNECTED], 0);
+        priv->tls_handshaking = FALSE;
 
         g_object_unref (conn);
 }
 
+/* Whether the TLS handshake has started and not succeeded yet. This is
+ * still %TRUE while #SoupServerConnection::disconnected is emitted for
+ * a connection whose handshake failed.
+ */
+gboolean
+soup_server_connection_is_tls_handshaking (SoupServerConnection *conn)
+{
+        SoupServerConnectionPrivate *priv;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_CONNECTION (conn), FALSE);
+
+        priv = soup_server_connection_get_instance_private (conn);
+
+        return priv->tls_handshaking;
+}
+
 /**
  * soup_server_connection_is_connected:
  * @conn: a #SoupServerConnection
@@ -15,6 +15,8 @@ G_BEGIN_DECLS
 #define SOUP_TYPE_SERVER_CONNECTION (soup_server_connection_get_type ())
 G_DECLARE_FINAL_TYPE (SoupServerConnection, soup_server_connection, SOUP, SERVER_CONNECTION, GObject)
 
+#define SOUP_SERVER_CONNECTION_HTTP2_MAX_CONCURRENT_STREAMS 100
+
 SoupServerConnection *soup_server_connection_new                             (GSocket               *socket,
                                                                               GTlsCertificate       *tls_certificate,
                                                                               GTlsDatabase          *tls_database,
@@ -24,11 +26,15 @@ SoupServerConnection *soup_server_connection_new_for_connection              (GI
                                                                               GSocketAddress        *remote_addr);
 void                  soup_server_connection_set_advertise_http2             (SoupServerConnection *conn,
                                                                               gboolean              advertise_http2);
+void                  soup_server_connection_set_http2_max_concurrent_streams (SoupServerConnection *conn,
+                                                                              guint                 max_concurrent_streams);
+guint                 soup_server_connection_get_http2_max_concurrent_streams (SoupServerConnection *conn);
 void                  soup_server_connection_accepted                        (SoupServerConnection  *conn);
 SoupServerMessageIO  *soup_server_connection_get_io_data                     (SoupServerConnection  *conn);
 gboolean              soup_server_connection_is_ssl                          (SoupServerConnection  *conn);
 void                  soup_server_connection_disconnect                      (SoupServerConnection  *conn);
 gboolean              soup_server_connection_is_connected                    (SoupServerConnection  *conn);
+gboolean              soup_server_connection_is_tls_handshaking              (SoupServerConnection  *conn);
 GSocket              *soup_server_connection_get_socket                      (SoupServerConnection  *conn);
 GIOStream            *soup_server_connection_steal                           (SoupServerConnection  *conn);
 GIOStream            *soup_server_connection_get_iostream                    (SoupServerConnection  *conn);
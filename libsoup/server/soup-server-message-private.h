@@ -43,5 +43,13 @@ void               soup_server_message_set_options_ping    (SoupServerMessage
 
 SoupServerMessageIO *soup_server_message_get_io_data       (SoupServerMessage        *msg);
 
+gboolean           soup_server_message_get_response_file_range (SoupServerMessage    *msg,
+                                                                GBytes               *chunk,
+                                                                int                  *fd,
+                                                                goffset              *offset);
+void               soup_server_message_add_response_file_bytes_sent (SoupServerMessage *msg,
+                                                                     gsize              count);
+gsize              soup_server_message_get_response_file_bytes_sent (SoupServerMessage *msg);
+
 
 #endif /* __SOUP_SERVER_MESSAGE_PRIVATE_H__ */
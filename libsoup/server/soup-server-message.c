@@ -8,7 +8,10 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
 
 #include "soup-server-message.h"
 #include "soup.h"
@@ -64,6 +67,10 @@ struct _SoupServerMessage {
 
         GTlsCertificate      *tls_peer_certificate;
         GTlsCertificateFlags  tls_peer_certificate_errors;
+
+        GMappedFile          *response_file;
+        int                   response_file_fd;
+        gsize                 response_file_bytes_sent;
 };
 
 struct _SoupServerMessageClass {
@@ -113,6 +120,17 @@ soup_server_message_init (SoupServerMessage *msg)
         msg->response_body = soup_message_body_new ();
         msg->response_headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
         soup_message_headers_set_encoding (msg->response_headers, SOUP_ENCODING_CONTENT_LENGTH);
+        msg->response_file_fd = -1;
+}
+
+static void
+soup_server_message_clear_response_file (SoupServerMessage *msg)
+{
+        g_clear_pointer (&msg->response_file, g_mapped_file_unref);
+        if (msg->response_file_fd != -1) {
+                g_close (msg->response_file_fd, NULL);
+                msg->response_file_fd = -1;
+        }
 }
 
 static void
@@ -137,6 +155,8 @@ soup_server_message_finalize (GObject *object)
         soup_message_body_unref (msg->response_body);
         soup_message_headers_unref (msg->response_headers);
 
+        soup_server_message_clear_response_file (msg);
+
         G_OBJECT_CLASS (soup_server_message_parent_class)->finalize (object);
 }
 
@@ -948,6 +968,193 @@ soup_server_message_set_response (SoupServerMessage *msg,
         }
 }
 
+/**
+ * soup_server_message_set_response_body_from_fd:
+ * @msg: the message
+ * @content_type: MIME Content-Type of the body
+ * @fd: a file descriptor of a regular file open for reading
+ * @offset: offset in the file of the first byte of the body
+ * @length: number of bytes of the body, or -1 to read until the end of the file
+ * @error: return location for a #GError, or %NULL
+ *
+ * Appends @length bytes of the file referred to by @fd, starting at
+ * @offset, to the response body of @msg, and sets its Content-Type.
+ *
+ * The file is mapped into memory rather than read, and the contents are
+ * never copied into the response body. When @msg is sent over a plain
+ * HTTP/1 connection they are written to the socket directly from the
+ * file with sendfile(2) where available, and over HTTP/2 the DATA frames
+ * are written straight from the mapping. Range requests are served from
+ * the corresponding file offsets.
+ *
+ * @fd is not consumed; it can be closed as soon as this function returns.
+ * The file must not be truncated while @msg is being sent.
+ *
+ * Returns: %TRUE on success, or %FALSE if @fd could not be mapped or
+ *   the range is outside the file.
+ *
+ * Since: 3.8
+ */
+gboolean
+soup_server_message_set_response_body_from_fd (SoupServerMessage *msg,
+                                               const char        *content_type,
+                                               int                fd,
+                                               goffset            offset,
+                                               goffset            length,
+                                               GError           **error)
+{
+        GMappedFile *mapping;
+        GBytes *contents, *body;
+        goffset size;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_MESSAGE (msg), FALSE);
+        g_return_val_if_fail (content_type != NULL, FALSE);
+        g_return_val_if_fail (fd >= 0, FALSE);
+        g_return_val_if_fail (offset >= 0, FALSE);
+        g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+        mapping = g_mapped_file_new_from_fd (fd, FALSE, error);
+        if (!mapping)
+                return FALSE;
+
+        size = g_mapped_file_get_length (mapping);
+        if (length < 0 && offset <= size)
+                length = size - offset;
+        if (offset > size || length > size - offset) {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                             "Range %" G_GOFFSET_FORMAT "-%" G_GOFFSET_FORMAT " is outside of a file of %" G_GOFFSET_FORMAT " bytes",
+                             offset, offset + MAX (length, 0), size);
+                g_mapped_file_unref (mapping);
+                return FALSE;
+        }
+
+        soup_server_message_clear_response_file (msg);
+        msg->response_file = mapping;
+#ifdef G_OS_UNIX
+        /* Keep our own descriptor for sendfile(2); if this fails
+         * the body is still written from the mapping.
+         */
+        msg->response_file_fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+#endif
+
+        g_warn_if_fail (strchr (content_type, '/') != NULL);
+        soup_message_headers_replace_common (msg->response_headers,
+                                             SOUP_HEADER_CONTENT_TYPE,
+                                             content_type, SOUP_HEADER_VALUE_UNTRUSTED);
+
+        /* An empty chunk would terminate the body */
+        if (length == 0)
+                return TRUE;
+
+        contents = g_mapped_file_get_bytes (mapping);
+        body = g_bytes_new_from_bytes (contents, offset, length);
+        soup_message_body_append_bytes (msg->response_body, body);
+        g_bytes_unref (body);
+        g_bytes_unref (contents);
+
+        return TRUE;
+}
+
+/**
+ * soup_server_message_set_response_body_from_file:
+ * @msg: the message
+ * @content_type: MIME Content-Type of the body
+ * @file: a local #GFile
+ * @error: return location for a #GError, or %NULL
+ *
+ * Appends the whole contents of @file to the response body of @msg and
+ * sets its Content-Type. See
+ * [method@ServerMessage.set_response_body_from_fd] for details.
+ *
+ * Returns: %TRUE on success, or %FALSE if @file is not a local file or
+ *   could not be opened or mapped.
+ *
+ * Since: 3.8
+ */
+gboolean
+soup_server_message_set_response_body_from_file (SoupServerMessage *msg,
+                                                 const char        *content_type,
+                                                 GFile             *file,
+                                                 GError           **error)
+{
+        char *path;
+        int fd;
+        gboolean retval;
+
+        g_return_val_if_fail (SOUP_IS_SERVER_MESSAGE (msg), FALSE);
+        g_return_val_if_fail (G_IS_FILE (file), FALSE);
+
+        path = g_file_get_path (file);
+        if (!path) {
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                     "Response bodies can only be read from local files");
+                return FALSE;
+        }
+
+#ifdef O_CLOEXEC
+        fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+#else
+        fd = g_open (path, O_RDONLY, 0);
+#endif
+        if (fd == -1) {
+                int errsv = errno;
+
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             "Could not open %s: %s", path, g_strerror (errsv));
+                g_free (path);
+                return FALSE;
+        }
+        g_free (path);
+
+        retval = soup_server_message_set_response_body_from_fd (msg, content_type, fd, 0, -1, error);
+        g_close (fd, NULL);
+
+        return retval;
+}
+
+/* Returns the file descriptor and offset that @chunk of the response
+ * body was mapped from, if it was set with
+ * soup_server_message_set_response_body_from_fd().
+ */
+gboolean
+soup_server_message_get_response_file_range (SoupServerMessage *msg,
+                                             GBytes            *chunk,
+                                             int               *fd,
+                                             goffset           *offset)
+{
+        const char *base, *data;
+        gsize size;
+
+        if (msg->response_file_fd == -1)
+                return FALSE;
+
+        base = g_mapped_file_get_contents (msg->response_file);
+        data = g_bytes_get_data (chunk, &size);
+        if (!base || !data || data < base ||
+            (gsize)(data - base) + size > g_mapped_file_get_length (msg->response_file))
+                return FALSE;
+
+        *fd = msg->response_file_fd;
+        *offset = data - base;
+        return TRUE;
+}
+
+/* Records that @count bytes of the response body were written to the
+ * connection straight from the file, without copying them first.
+ */
+void
+soup_server_message_add_response_file_bytes_sent (SoupServerMessage *msg,
+                                                  gsize              count)
+{
+        msg->response_file_bytes_sent += count;
+}
+
+gsize
+soup_server_message_get_response_file_bytes_sent (SoupServerMessage *msg)
+{
+        return msg->response_file_bytes_sent;
+}
+
 /**
  * soup_server_message_set_redirect:
  * @msg: a #SoupServerMessage
@@ -92,6 +92,20 @@ GTlsCertificate     *soup_server_message_get_tls_peer_certificate          (Soup
 SOUP_AVAILABLE_IN_3_2
 GTlsCertificateFlags soup_server_message_get_tls_peer_certificate_errors   (SoupServerMessage *msg);
 
+SOUP_AVAILABLE_IN_3_8
+gboolean             soup_server_message_set_response_body_from_fd   (SoupServerMessage *msg,
+                                                                      const char        *content_type,
+                                                                      int                fd,
+                                                                      goffset            offset,
+                                                                      goffset            length,
+                                                                      GError           **error);
+
+SOUP_AVAILABLE_IN_3_8
+gboolean             soup_server_message_set_response_body_from_file (SoupServerMessage *msg,
+                                                                      const char        *content_type,
+                                                                      GFile             *file,
+                                                                      GError           **error);
+
 G_END_DECLS
 
 #endif /* __SOUP_SERVER_MESSAGE_H__ */
@@ -10,6 +10,8 @@
 
 void soup_server_set_http2_enabled (SoupServer *server,
                                     gboolean    enabled);
+void soup_server_set_http2_max_concurrent_streams (SoupServer *server,
+                                                   guint       max_concurrent_streams);
 GSList *soup_server_get_clients (SoupServer *server);
 
 #endif /* __SOUP_SERVER_PRIVATE_H__ */
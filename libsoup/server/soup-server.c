@@ -21,6 +21,7 @@
 #include "soup-path-map.h"
 #include "soup-listener.h"
 #include "soup-uri-utils-private.h"
+#include "soup-date-utils-private.h"
 #include "websocket/soup-websocket.h"
 #include "websocket/soup-websocket-connection.h"
 #include "websocket/soup-websocket-extension-deflate.h"
@@ -114,6 +115,27 @@
  * [class@Server] will begin processing connections as soon as you return
  * to (or start) the main loop for the current thread-default
  * [struct@GLib.MainContext].
+ *
+ * ## Worker threads
+ *
+ * By default every listener, connection and handler of a [class@Server]
+ * runs in that single [struct@GLib.MainContext]. Setting the
+ * [property@Server:worker-threads] property makes the server spawn that
+ * many threads, each running its own [struct@GLib.MainContext]. Where
+ * the platform supports `SO_REUSEPORT`, every worker gets its own
+ * listening socket for each address passed to [method@Server.listen] and
+ * friends, and the kernel balances incoming connections between them;
+ * otherwise (and for sockets imported with [method@Server.listen_socket])
+ * connections are accepted in the server's context and handed off to the
+ * workers in turn. A connection stays in the worker that accepted it for
+ * its whole lifetime, so the [class@ServerMessage]s it carries, and the
+ * server signals emitted for them, are only ever used from that thread.
+ *
+ * Handler callbacks run in the worker thread too. Unless a handler has
+ * been flagged with [method@Server.set_handler_thread_safe], its callbacks
+ * are serialized with those of every other such handler, so existing
+ * handlers keep working unmodified. Handlers, auth domains and WebSocket
+ * extensions should be set up before the server starts listening.
  */
 
 enum {
@@ -127,7 +149,9 @@ enum {
 static guint signals[LAST_SIGNAL] = { 0 };
 
 typedef struct {
+	gatomicrefcount     ref_count;
 	char               *path;
+	gboolean            thread_safe;
 
 	SoupServerCallback  early_callback;
 	GDestroyNotify      early_destroy;
@@ -139,12 +163,31 @@ typedef struct {
 
 	char                         *websocket_origin;
 	char                        **websocket_protocols;
-	GList                        *websocket_extensions;
 	SoupServerWebsocketCallback   websocket_callback;
 	GDestroyNotify                websocket_destroy;
 	gpointer                      websocket_user_data;
 } SoupServerHandler;
 
+/* The "Date" header value, formatted once per second */
+typedef struct {
+        char               string[SOUP_HTTP_DATE_SIZE];
+        gint64             time;
+} SoupServerDateCache;
+
+typedef struct {
+        SoupServer         *server;
+        GThread            *thread;
+        GMainContext       *context;
+        GMainLoop          *loop;
+
+        /* Only accessed from the worker thread */
+        GHashTable         *listeners;
+        SoupServerDateCache date_cache;
+
+        /* Modified by the worker thread with workers_mutex held */
+        GSList             *clients;
+} SoupServerWorker;
+
 typedef struct {
 	GSList            *listeners;
 	GSList            *clients;
@@ -160,6 +203,7 @@ typedef struct {
 
 	gboolean           raw_paths;
 	SoupPathMap       *handlers;
+        GRecMutex          handlers_mutex;
 
 	GSList            *auth_domains;
 
@@ -167,7 +211,30 @@ typedef struct {
 
 	gboolean           disposed;
         gboolean           http2_enabled;
-
+        guint              http2_max_concurrent_streams;
+
+        SoupServerDateCache date_cache;
+
+        guint              n_workers;
+        GPtrArray         *workers;
+        guint              next_worker;
+        GHashTable        *worker_listeners;
+        GMutex             workers_mutex;
+        GCond              workers_cond;
+        GRecMutex          handler_callback_mutex;
+
+        guint              accept_batch_size;
+
+        /* Admission control, shared with the worker threads */
+        guint              max_connections;
+        guint              max_pending_handshakes;
+        guint              n_connections;
+        guint              n_pending_handshakes;
+        guint              n_accepted;
+        guint              n_rejected;
+        GMutex             admission_mutex;
+        int                listeners_paused;
+        GPtrArray         *admission_listeners;
 } SoupServerPrivate;
 
 #define SOUP_SERVER_SERVER_HEADER_BASE "libsoup/" PACKAGE_VERSION
@@ -180,6 +247,10 @@ enum {
         PROP_TLS_AUTH_MODE,
 	PROP_RAW_PATHS,
 	PROP_SERVER_HEADER,
+        PROP_WORKER_THREADS,
+        PROP_MAX_CONNECTIONS,
+        PROP_MAX_PENDING_HANDSHAKES,
+        PROP_ACCEPT_BATCH_SIZE,
 
 	LAST_PROPERTY
 };
@@ -202,13 +273,27 @@ static void request_finished (SoupServerMessage      *msg,
                               SoupMessageIOCompletion completion,
                               SoupServer             *server);
 
+static void soup_server_stop_workers (SoupServer *server);
+static void soup_server_update_admission (SoupServer *server);
+
+static GPrivate current_worker;
+
+static SoupServerHandler *
+handler_ref (SoupServerHandler *handler)
+{
+        g_atomic_ref_count_inc (&handler->ref_count);
+        return handler;
+}
+
 static void
-free_handler (SoupServerHandler *handler)
+handler_unref (SoupServerHandler *handler)
 {
+        if (!g_atomic_ref_count_dec (&handler->ref_count))
+                return;
+
 	g_free (handler->path);
 	g_free (handler->websocket_origin);
 	g_strfreev (handler->websocket_protocols);
-	g_list_free_full (handler->websocket_extensions, g_object_unref);
 	if (handler->early_destroy)
 		handler->early_destroy (handler->early_user_data);
 	if (handler->destroy)
@@ -218,13 +303,28 @@ free_handler (SoupServerHandler *handler)
 	g_slice_free (SoupServerHandler, handler);
 }
 
+static void
+admission_listener_free (GWeakRef *ref)
+{
+        g_weak_ref_clear (ref);
+        g_free (ref);
+}
+
 static void
 soup_server_init (SoupServer *server)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
 
         priv->http2_enabled = !!g_getenv ("SOUP_SERVER_HTTP2");
-	priv->handlers = soup_path_map_new ((GDestroyNotify)free_handler);
+        priv->http2_max_concurrent_streams = SOUP_SERVER_CONNECTION_HTTP2_MAX_CONCURRENT_STREAMS;
+	priv->handlers = soup_path_map_new ((GDestroyNotify)handler_unref);
+        g_rec_mutex_init (&priv->handlers_mutex);
+        g_rec_mutex_init (&priv->handler_callback_mutex);
+        g_mutex_init (&priv->workers_mutex);
+        g_cond_init (&priv->workers_cond);
+        priv->worker_listeners = g_hash_table_new (NULL, NULL);
+        g_mutex_init (&priv->admission_mutex);
+        priv->admission_listeners = g_ptr_array_new_with_free_func ((GDestroyNotify)admission_listener_free);
 
 	priv->websocket_extension_types = g_ptr_array_new_with_free_func ((GDestroyNotify)g_type_class_unref);
 
@@ -240,6 +340,7 @@ soup_server_dispose (GObject *object)
 
 	priv->disposed = TRUE;
 	soup_server_disconnect (server);
+        soup_server_stop_workers (server);
 
 	G_OBJECT_CLASS (soup_server_parent_class)->dispose (object);
 }
@@ -256,6 +357,16 @@ soup_server_finalize (GObject *object)
 	g_free (priv->server_header);
 
 	soup_path_map_free (priv->handlers);
+        g_rec_mutex_clear (&priv->handlers_mutex);
+        g_rec_mutex_clear (&priv->handler_callback_mutex);
+
+        g_clear_pointer (&priv->workers, g_ptr_array_unref);
+        g_hash_table_destroy (priv->worker_listeners);
+        g_mutex_clear (&priv->workers_mutex);
+        g_cond_clear (&priv->workers_cond);
+
+        g_ptr_array_unref (priv->admission_listeners);
+        g_mutex_clear (&priv->admission_mutex);
 
 	g_slist_free_full (priv->auth_domains, g_object_unref);
 
@@ -302,6 +413,20 @@ soup_server_set_property (GObject *object, guint prop_id,
 		} else
 			priv->server_header = g_strdup (header);
 		break;
+        case PROP_WORKER_THREADS:
+                priv->n_workers = g_value_get_uint (value);
+                break;
+        case PROP_MAX_CONNECTIONS:
+                g_atomic_int_set (&priv->max_connections, g_value_get_uint (value));
+                soup_server_update_admission (server);
+                break;
+        case PROP_MAX_PENDING_HANDSHAKES:
+                g_atomic_int_set (&priv->max_pending_handshakes, g_value_get_uint (value));
+                soup_server_update_admission (server);
+                break;
+        case PROP_ACCEPT_BATCH_SIZE:
+                priv->accept_batch_size = g_value_get_uint (value);
+                break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -331,6 +456,18 @@ soup_server_get_property (GObject *object, guint prop_id,
 	case PROP_SERVER_HEADER:
 		g_value_set_string (value, priv->server_header);
 		break;
+        case PROP_WORKER_THREADS:
+                g_value_set_uint (value, priv->n_workers);
+                break;
+        case PROP_MAX_CONNECTIONS:
+                g_value_set_uint (value, g_atomic_int_get (&priv->max_connections));
+                break;
+        case PROP_MAX_PENDING_HANDSHAKES:
+                g_value_set_uint (value, g_atomic_int_get (&priv->max_pending_handshakes));
+                break;
+        case PROP_ACCEPT_BATCH_SIZE:
+                g_value_set_uint (value, priv->accept_batch_size);
+                break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -549,6 +686,91 @@ soup_server_class_init (SoupServerClass *server_class)
                                      G_PARAM_CONSTRUCT |
                                      G_PARAM_STATIC_STRINGS);
 
+        /**
+         * SoupServer:worker-threads:
+         *
+         * The number of worker threads used to serve connections.
+         *
+         * If 0 (the default), everything runs in the thread-default
+         * [struct@GLib.MainContext] of the thread that calls
+         * [method@Server.listen] and friends. Otherwise the server runs
+         * that many threads with their own [struct@GLib.MainContext] and
+         * distributes connections between them; see the
+         * [class@Server] documentation for the details.
+         *
+         * Since: 3.8
+         */
+        properties[PROP_WORKER_THREADS] =
+                g_param_spec_uint ("worker-threads",
+                                   "Worker threads",
+                                   "Number of worker threads",
+                                   0, G_MAXINT, 0,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_CONSTRUCT_ONLY |
+                                   G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupServer:max-connections:
+         *
+         * The maximum number of client connections the server keeps open.
+         *
+         * When the limit is reached the server stops accepting new
+         * connections, which wait in the listening sockets' backlog until
+         * some existing connection is closed. 0 means no limit.
+         *
+         * Since: 3.8
+         */
+        properties[PROP_MAX_CONNECTIONS] =
+                g_param_spec_uint ("max-connections",
+                                   "Max connections",
+                                   "Maximum number of client connections",
+                                   0, G_MAXINT, 0,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupServer:max-pending-handshakes:
+         *
+         * The maximum number of connections whose TLS handshake is in
+         * progress.
+         *
+         * TLS handshakes are expensive, so a burst of new https clients can
+         * starve the ones already connected. When the limit is reached the
+         * server stops accepting new connections until some handshake
+         * completes. 0 means no limit.
+         *
+         * Since: 3.8
+         */
+        properties[PROP_MAX_PENDING_HANDSHAKES] =
+                g_param_spec_uint ("max-pending-handshakes",
+                                   "Max pending handshakes",
+                                   "Maximum number of TLS handshakes in progress",
+                                   0, G_MAXINT, 0,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_STATIC_STRINGS);
+
+        /**
+         * SoupServer:accept-batch-size:
+         *
+         * The maximum number of connections accepted from a listening
+         * socket each time it becomes readable.
+         *
+         * Larger batches handle a burst of new connections with fewer
+         * main loop iterations, smaller ones give the existing
+         * connections a chance to run in between.
+         *
+         * Since: 3.8
+         */
+        properties[PROP_ACCEPT_BATCH_SIZE] =
+                g_param_spec_uint ("accept-batch-size",
+                                   "Accept batch size",
+                                   "Maximum number of connections accepted per wakeup",
+                                   1, G_MAXINT,
+                                   SOUP_LISTENER_DEFAULT_ACCEPT_BATCH_SIZE,
+                                   G_PARAM_READWRITE |
+                                   G_PARAM_CONSTRUCT_ONLY |
+                                   G_PARAM_STATIC_STRINGS);
+
         g_object_class_install_properties (object_class, LAST_PROPERTY, properties);
 }
 
@@ -739,6 +961,55 @@ soup_server_is_https (SoupServer *server)
 	return priv->tls_cert != NULL;
 }
 
+/**
+ * soup_server_get_accepted_connections:
+ * @server: a #SoupServer
+ *
+ * Gets the number of connections accepted by @server's listeners.
+ *
+ * Returns: the number of accepted connections
+ *
+ * Since: 3.8
+ */
+guint
+soup_server_get_accepted_connections (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	priv = soup_server_get_instance_private (server);
+
+        return g_atomic_int_get (&priv->n_accepted);
+}
+
+/**
+ * soup_server_get_rejected_connections:
+ * @server: a #SoupServer
+ *
+ * Gets the number of connections that @server's listeners closed right
+ * after accepting them, because the server had reached its
+ * [property@Server:max-connections] or [property@Server:max-pending-handshakes]
+ * limits.
+ *
+ * Connections arriving once the limits are reached are normally left
+ * waiting in the backlog instead, so this only counts the ones accepted
+ * before all the listeners were paused.
+ *
+ * Returns: the number of rejected connections
+ *
+ * Since: 3.8
+ */
+guint
+soup_server_get_rejected_connections (SoupServer *server)
+{
+	SoupServerPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SERVER (server), 0);
+	priv = soup_server_get_instance_private (server);
+
+        return g_atomic_int_get (&priv->n_rejected);
+}
+
 /**
  * soup_server_get_listeners:
  * @server: a #SoupServer
@@ -771,12 +1042,30 @@ soup_server_get_listeners (SoupServer *server)
 	return listeners;
 }
 
+/* Returns the connections of the main context and of all the worker
+ * threads. The connections are referenced, since a worker can drop
+ * them at any time.
+ */
 GSList *
 soup_server_get_clients (SoupServer *server)
 {
         SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        GSList *clients;
+        guint i;
+
+        clients = g_slist_copy_deep (priv->clients, (GCopyFunc)g_object_ref, NULL);
+        if (!priv->workers)
+                return clients;
 
-        return priv->clients;
+        g_mutex_lock (&priv->workers_mutex);
+        for (i = 0; i < priv->workers->len; i++) {
+                SoupServerWorker *worker = priv->workers->pdata[i];
+
+                clients = g_slist_concat (clients, g_slist_copy_deep (worker->clients, (GCopyFunc)g_object_ref, NULL));
+        }
+        g_mutex_unlock (&priv->workers_mutex);
+
+        return clients;
 }
 
 /* "" was never documented as meaning the same thing as "/", but it
@@ -795,13 +1084,54 @@ get_msg_path (SoupServerMessage *msg)
                 return NORMALIZED_PATH (g_uri_get_path (soup_server_message_get_uri (msg)));
 }
 
+static SoupServerWorker *
+soup_server_get_current_worker (SoupServer *server)
+{
+        SoupServerWorker *worker = g_private_get (&current_worker);
+
+        return worker && worker->server == server ? worker : NULL;
+}
+
+/* Returns a new reference, since with worker threads the handler
+ * may be removed from another thread while it is being run.
+ */
 static SoupServerHandler *
 get_handler (SoupServer        *server,
 	     SoupServerMessage *msg)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+	SoupServerHandler *handler;
+
+        g_rec_mutex_lock (&priv->handlers_mutex);
+	handler = soup_path_map_lookup (priv->handlers, get_msg_path (msg));
+        if (handler)
+                handler_ref (handler);
+        g_rec_mutex_unlock (&priv->handlers_mutex);
+
+        return handler;
+}
+
+/* Callbacks of handlers that are not flagged as thread-safe never run
+ * concurrently when the server uses worker threads.
+ */
+static void
+handler_callback_lock (SoupServer        *server,
+                       SoupServerHandler *handler)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+
+        if (priv->n_workers && !handler->thread_safe)
+                g_rec_mutex_lock (&priv->handler_callback_mutex);
+}
+
+static void
+handler_callback_unlock (SoupServer        *server,
+                         SoupServerHandler *handler)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
 
-	return soup_path_map_lookup (priv->handlers, get_msg_path (msg));
+        if (priv->n_workers && !handler->thread_safe)
+                g_rec_mutex_unlock (&priv->handler_callback_mutex);
 }
 
 static void
@@ -827,6 +1157,7 @@ call_handler (SoupServer        *server,
 	else
 		form_data_set = NULL;
 
+	handler_callback_lock (server, handler);
 	if (early) {
 		(*handler->early_callback) (server, msg,
 					    get_msg_path (msg), form_data_set,
@@ -836,6 +1167,7 @@ call_handler (SoupServer        *server,
 				      get_msg_path (msg), form_data_set,
 				      handler->user_data);
 	}
+	handler_callback_unlock (server, handler);
 
 	if (form_data_set)
 		g_hash_table_unref (form_data_set);
@@ -848,28 +1180,28 @@ got_headers (SoupServer        *server,
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
 	SoupServerHandler *handler;
 	GUri *uri;
-	GDateTime *date;
-	char *date_string;
+	gint64 now;
 	SoupAuthDomain *domain;
 	GSList *iter;
 	gboolean rejected = FALSE;
 	char *auth_user;
 	SoupMessageHeaders *headers;
 	SoupServerConnection *conn;
+        SoupServerWorker *worker;
+        SoupServerDateCache *date_cache;
 
 	/* Add required response headers */
 	headers = soup_server_message_get_response_headers (msg);
 
-	date = g_date_time_new_now_utc ();
-	date_string = soup_date_time_to_string (date, SOUP_DATE_HTTP);
-	if (!date_string) {
-		g_date_time_unref (date);
-		return;
+        worker = soup_server_get_current_worker (server);
+        date_cache = worker ? &worker->date_cache : &priv->date_cache;
+	now = g_get_real_time () / G_USEC_PER_SEC;
+	if (now != date_cache->time) {
+		soup_date_time_format_http_unix (now, date_cache->string);
+		date_cache->time = now;
 	}
 
-	soup_message_headers_replace_common (headers, SOUP_HEADER_DATE, date_string, SOUP_HEADER_VALUE_TRUSTED);
-	g_free (date_string);
-	g_date_time_unref (date);
+	soup_message_headers_replace_common (headers, SOUP_HEADER_DATE, date_cache->string, SOUP_HEADER_VALUE_TRUSTED);
 
 	if (soup_server_message_get_status (msg) != 0)
 		return;
@@ -943,8 +1275,22 @@ got_headers (SoupServer        *server,
 
 	/* Otherwise, call the early handlers. */
 	handler = get_handler (server, msg);
-	if (handler)
+	if (handler) {
 		call_handler (server, handler, msg, TRUE);
+                handler_unref (handler);
+        }
+}
+
+/* The extensions negotiated in got_body() are kept on the message
+ * rather than the handler, since several upgrades for the same handler
+ * can be in progress at once on different worker threads.
+ */
+#define WEBSOCKET_EXTENSIONS_KEY "soup-server-websocket-extensions"
+
+static void
+free_websocket_extensions (GList *extensions)
+{
+	g_list_free_full (extensions, g_object_unref);
 }
 
 static void
@@ -955,12 +1301,19 @@ complete_websocket_upgrade (SoupServer        *server,
 	SoupServerHandler *handler;
 	GIOStream *stream;
 	SoupWebsocketConnection *conn;
+	GList *extensions;
 
 	handler = get_handler (server, msg);
-	if (!handler || !handler->websocket_callback)
+	if (!handler)
+		return;
+
+	if (!handler->websocket_callback) {
+                handler_unref (handler);
 		return;
+        }
 
 	g_object_ref (msg);
+	extensions = g_object_steal_data (G_OBJECT (msg), WEBSOCKET_EXTENSIONS_KEY);
 	stream = soup_server_message_steal_connection (msg);
 	conn = SOUP_WEBSOCKET_CONNECTION (g_object_new (SOUP_TYPE_WEBSOCKET_CONNECTION,
 					  "io-stream", stream,
@@ -968,16 +1321,18 @@ complete_websocket_upgrade (SoupServer        *server,
 					  "connection-type", SOUP_WEBSOCKET_CONNECTION_SERVER,
 					  "origin", soup_message_headers_get_one_common (soup_server_message_get_request_headers (msg), SOUP_HEADER_ORIGIN),
 					  "protocol", soup_message_headers_get_one_common (soup_server_message_get_response_headers (msg), SOUP_HEADER_SEC_WEBSOCKET_PROTOCOL),
-					  "extensions", handler->websocket_extensions,
+					  "extensions", extensions,
 					  "max-total-message-size", (guint64)MAX_TOTAL_MESSAGE_SIZE_DEFAULT,
 					  NULL));
-	handler->websocket_extensions = NULL;
 	g_object_unref (stream);
 
+	handler_callback_lock (server, handler);
 	(*handler->websocket_callback) (server, msg, g_uri_get_path (uri), conn,
 					handler->websocket_user_data);
+	handler_callback_unlock (server, handler);
 	g_object_unref (conn);
 	g_object_unref (msg);
+        handler_unref (handler);
 }
 
 static void
@@ -998,23 +1353,30 @@ got_body (SoupServer        *server,
 	}
 
 	call_handler (server, handler, msg, FALSE);
-	if (soup_server_message_get_status (msg) != 0)
+	if (soup_server_message_get_status (msg) != 0) {
+                handler_unref (handler);
 		return;
+        }
 
 	if (handler->websocket_callback) {
 		SoupServerPrivate *priv;
+		GList *extensions = NULL;
 
 		priv = soup_server_get_instance_private (server);
 		if (soup_websocket_server_process_handshake (msg,
 							     handler->websocket_origin,
 							     handler->websocket_protocols,
 							     priv->websocket_extension_types,
-							     &handler->websocket_extensions)) {
+							     &extensions)) {
+			g_object_set_data_full (G_OBJECT (msg), WEBSOCKET_EXTENSIONS_KEY,
+						extensions, (GDestroyNotify)free_websocket_extensions);
 			g_signal_connect_object (msg, "wrote-informational",
 						 G_CALLBACK (complete_websocket_upgrade),
 						 server, G_CONNECT_SWAPPED);
 		}
 	}
+
+        handler_unref (handler);
 }
 
 static void
@@ -1026,14 +1388,118 @@ message_connected (SoupServer        *server,
                                           server);
 }
 
+static gboolean
+soup_server_is_under_pressure (SoupServer *server)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        guint max_connections = g_atomic_int_get (&priv->max_connections);
+        guint max_pending_handshakes = g_atomic_int_get (&priv->max_pending_handshakes);
+
+        if (max_connections && (guint)g_atomic_int_get (&priv->n_connections) >= max_connections)
+                return TRUE;
+
+        if (max_pending_handshakes && (guint)g_atomic_int_get (&priv->n_pending_handshakes) >= max_pending_handshakes)
+                return TRUE;
+
+        return FALSE;
+}
+
+/* Pauses the listeners when the server reaches its connection limits
+ * and resumes them once it's back under them. Can be called from any
+ * thread.
+ */
+static void
+soup_server_update_admission (SoupServer *server)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        gboolean under_pressure;
+        guint i;
+
+        if (soup_server_is_under_pressure (server) == g_atomic_int_get (&priv->listeners_paused))
+                return;
+
+        g_mutex_lock (&priv->admission_mutex);
+        under_pressure = soup_server_is_under_pressure (server);
+        if (under_pressure != priv->listeners_paused) {
+                g_atomic_int_set (&priv->listeners_paused, under_pressure);
+
+                for (i = 0; i < priv->admission_listeners->len; ) {
+                        SoupListener *listener = g_weak_ref_get (priv->admission_listeners->pdata[i]);
+
+                        if (!listener) {
+                                g_ptr_array_remove_index_fast (priv->admission_listeners, i);
+                                continue;
+                        }
+
+                        if (under_pressure)
+                                soup_listener_pause (listener);
+                        else
+                                soup_listener_resume (listener);
+                        g_object_unref (listener);
+                        i++;
+                }
+        }
+        g_mutex_unlock (&priv->admission_mutex);
+}
+
+static void
+soup_server_add_admission_listener (SoupServer   *server,
+                                    SoupListener *listener)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        GWeakRef *ref;
+        guint i;
+
+        g_mutex_lock (&priv->admission_mutex);
+        for (i = 0; i < priv->admission_listeners->len; ) {
+                SoupListener *old = g_weak_ref_get (priv->admission_listeners->pdata[i]);
+
+                if (!old) {
+                        g_ptr_array_remove_index_fast (priv->admission_listeners, i);
+                        continue;
+                }
+                g_object_unref (old);
+                i++;
+        }
+
+        ref = g_new (GWeakRef, 1);
+        g_weak_ref_init (ref, listener);
+        g_ptr_array_add (priv->admission_listeners, ref);
+        if (priv->listeners_paused)
+                soup_listener_pause (listener);
+        g_mutex_unlock (&priv->admission_mutex);
+}
+
+static void
+tls_handshake_finished (SoupServer           *server,
+                        SoupServerConnection *conn)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+
+        g_atomic_int_add (&priv->n_pending_handshakes, -1);
+        soup_server_update_admission (server);
+}
+
 static void
 client_disconnected (SoupServer           *server,
 		     SoupServerConnection *conn)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
-
-	priv->clients = g_slist_remove (priv->clients, conn);
+        SoupServerWorker *worker = soup_server_get_current_worker (server);
+
+        if (soup_server_connection_is_tls_handshaking (conn))
+                g_atomic_int_add (&priv->n_pending_handshakes, -1);
+        g_atomic_int_add (&priv->n_connections, -1);
+
+        if (worker) {
+                g_mutex_lock (&priv->workers_mutex);
+                worker->clients = g_slist_remove (worker->clients, conn);
+                g_mutex_unlock (&priv->workers_mutex);
+        } else
+                priv->clients = g_slist_remove (priv->clients, conn);
         g_object_unref (conn);
+
+        soup_server_update_admission (server);
 }
 
 static void
@@ -1076,8 +1542,15 @@ soup_server_accept_connection (SoupServer           *server,
                                SoupServerConnection *conn)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
-
-        priv->clients = g_slist_prepend (priv->clients, g_object_ref (conn));
+        SoupServerWorker *worker = soup_server_get_current_worker (server);
+
+        g_atomic_int_inc (&priv->n_connections);
+        if (worker) {
+                g_mutex_lock (&priv->workers_mutex);
+                worker->clients = g_slist_prepend (worker->clients, g_object_ref (conn));
+                g_mutex_unlock (&priv->workers_mutex);
+        } else
+                priv->clients = g_slist_prepend (priv->clients, g_object_ref (conn));
         g_signal_connect_object (conn, "disconnected",
                                  G_CALLBACK (client_disconnected),
                                  server, G_CONNECT_SWAPPED);
@@ -1086,6 +1559,15 @@ soup_server_accept_connection (SoupServer           *server,
                                  server, G_CONNECT_SWAPPED);
 
         soup_server_connection_accepted (conn);
+
+        if (soup_server_connection_is_tls_handshaking (conn)) {
+                g_atomic_int_inc (&priv->n_pending_handshakes);
+                g_signal_connect_object (conn, "connected",
+                                         G_CALLBACK (tls_handshake_finished),
+                                         server, G_CONNECT_SWAPPED);
+        }
+
+        soup_server_update_admission (server);
 }
 
 static void
@@ -1153,15 +1635,242 @@ soup_server_accept_iostream (SoupServer     *server,
 	return TRUE;
 }
 
+typedef struct {
+        SoupServer           *server;
+        SoupServerConnection *conn;
+} WorkerAcceptData;
+
+static gboolean
+worker_accept_connection (WorkerAcceptData *data)
+{
+        soup_server_accept_connection (data->server, data->conn);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+worker_accept_data_free (WorkerAcceptData *data)
+{
+        g_object_unref (data->conn);
+        g_object_unref (data->server);
+        g_free (data);
+}
+
 static void
 new_connection (SoupListener         *listener,
                 SoupServerConnection *conn,
                 SoupServer           *server)
 {
         SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupServerWorker *worker;
+        WorkerAcceptData *data;
+
+        /* Listeners are paused once the limits are reached, but
+         * the ones in other threads may still get a few more.
+         */
+        if (soup_server_is_under_pressure (server)) {
+                g_atomic_int_inc (&priv->n_rejected);
+                soup_server_update_admission (server);
+                return;
+        }
+        g_atomic_int_inc (&priv->n_accepted);
 
         soup_server_connection_set_advertise_http2 (conn, priv->http2_enabled);
-	soup_server_accept_connection (server, conn);
+        soup_server_connection_set_http2_max_concurrent_streams (conn, priv->http2_max_concurrent_streams);
+
+        if (!priv->workers || soup_server_get_current_worker (server)) {
+                soup_server_accept_connection (server, conn);
+                return;
+        }
+
+        /* The listener runs in the server's context, so hand the
+         * connection off to the next worker.
+         */
+        worker = priv->workers->pdata[priv->next_worker++ % priv->workers->len];
+        data = g_new (WorkerAcceptData, 1);
+        data->server = g_object_ref (server);
+        data->conn = g_object_ref (conn);
+        g_main_context_invoke_full (worker->context, G_PRIORITY_DEFAULT,
+                                    (GSourceFunc)worker_accept_connection,
+                                    data, (GDestroyNotify)worker_accept_data_free);
+}
+
+static void
+worker_listener_free (SoupListener *listener)
+{
+        soup_listener_disconnect (listener);
+        g_object_unref (listener);
+}
+
+static gpointer
+soup_server_worker_thread (SoupServerWorker *worker)
+{
+        /* Keep our own references, the worker may be freed
+         * before the thread exits if the server is disposed
+         * from within it.
+         */
+        GMainContext *context = g_main_context_ref (worker->context);
+        GMainLoop *loop = g_main_loop_ref (worker->loop);
+
+        g_private_set (&current_worker, worker);
+        g_main_context_push_thread_default (context);
+        g_main_loop_run (loop);
+        g_main_context_pop_thread_default (context);
+        g_private_set (&current_worker, NULL);
+
+        g_main_loop_unref (loop);
+        g_main_context_unref (context);
+
+        return NULL;
+}
+
+static void
+soup_server_worker_free (SoupServerWorker *worker)
+{
+        g_hash_table_destroy (worker->listeners);
+        g_slist_free_full (worker->clients, g_object_unref);
+        g_main_loop_unref (worker->loop);
+        g_main_context_unref (worker->context);
+        g_free (worker);
+}
+
+static void
+soup_server_start_workers (SoupServer *server)
+{
+        SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        guint i;
+
+        if (priv->workers)
+                return;
+
+        priv->workers = g_ptr_array_new_full (priv->n_workers, (GDestroyNotify)soup_server_worker_free);
+        for (i = 0; i < priv->n_workers; i++) {
+                SoupServerWorker *worker = g_new0 (SoupServerWorker, 1);
+                char *name;
+
+                worker->server = server;
+                worker->context = g_main_context_new ();
+                worker->loop = g_main_loop_new (worker->context, FALSE);
+                worker->listeners = g_hash_table_new_full (NULL, NULL, NULL,
+                                                           (GDestroyNotify)worker_listener_free);
+
+                name = g_strdup_printf ("soup-server-%u", i);
+                worker->thread = g_thread_new (name, (GThreadFunc)soup_server_worker_thread, worker);
+                g_free (name);
+
+                g_ptr_array_add (priv->workers, worker);
+        }
+}
+
+static gboolean
+worker_disconnect (SoupServerWorker *worker)
+{
+        SoupServerPrivate *priv = soup_server_get_instance_private (worker->server);
+        GSList *clients, *iter;
+
+        g_hash_table_remove_all (worker->listeners);
+
+        g_mutex_lock (&priv->workers_mutex);
+        clients = g_steal_pointer (&worker->clients);
+        g_mutex_unlock (&priv->workers_mutex);
+        for (iter = clients; iter; iter = iter->next)
+                soup_server_connection_disconnect (iter->data);
+        g_slist_free (clients);
+
+        return G_SOURCE_REMOVE;
+}
+
+static gboolean
+worker_shutdown (SoupServerWorker *worker)
+{
+        worker_disconnect (worker);
+        g_main_loop_quit (worker->loop);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+soup_server_stop_workers (SoupServer *server)
+{
+        SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        guint i;
+
+        if (!priv->workers)
+                return;
+
+        for (i = 0; i < priv->workers->len; i++) {
+                SoupServerWorker *worker = priv->workers->pdata[i];
+
+                if (worker->thread)
+                        g_main_context_invoke (worker->context, (GSourceFunc)worker_shutdown, worker);
+        }
+
+        for (i = 0; i < priv->workers->len; i++) {
+                SoupServerWorker *worker = priv->workers->pdata[i];
+
+                if (!worker->thread)
+                        continue;
+
+                /* The last reference was dropped by a worker: it
+                 * can't join itself, it will exit once its loop returns.
+                 */
+                if (worker->thread == g_thread_self ()) {
+                        g_private_set (&current_worker, NULL);
+                        g_thread_unref (worker->thread);
+                } else
+                        g_thread_join (worker->thread);
+                worker->thread = NULL;
+        }
+}
+
+typedef struct {
+        SoupServerWorker *worker;
+        SoupListener     *listener;
+} WorkerRemoveListenerData;
+
+static gboolean
+worker_remove_listener (WorkerRemoveListenerData *data)
+{
+        g_hash_table_remove (data->worker->listeners, data->listener);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+worker_remove_listener_data_free (WorkerRemoveListenerData *data)
+{
+        g_object_unref (data->listener);
+        g_free (data);
+}
+
+/* Removes @listener, and the listeners sharing its address in the
+ * other workers, if any.
+ */
+static void
+soup_server_remove_listener (SoupServer   *server,
+                             SoupListener *listener)
+{
+        SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        guint i;
+
+        priv->listeners = g_slist_remove (priv->listeners, listener);
+
+        if (!g_hash_table_remove (priv->worker_listeners, listener)) {
+                soup_listener_disconnect (listener);
+                g_object_unref (listener);
+                return;
+        }
+
+        for (i = 0; i < priv->workers->len; i++) {
+                WorkerRemoveListenerData *data = g_new (WorkerRemoveListenerData, 1);
+
+                data->worker = priv->workers->pdata[i];
+                data->listener = g_object_ref (listener);
+                g_main_context_invoke_full (data->worker->context, G_PRIORITY_DEFAULT,
+                                            (GSourceFunc)worker_remove_listener,
+                                            data, (GDestroyNotify)worker_remove_listener_data_free);
+        }
+        g_object_unref (listener);
 }
 
 /**
@@ -1174,6 +1883,9 @@ new_connection (SoupListener         *listener,
  * will continue to be processed if @server's [struct@GLib.MainContext] is still
  * running.
  *
+ * When [property@Server:worker-threads] is set, the connections owned by
+ * the worker threads are closed asynchronously from those threads.
+ *
  * You can call [method@Server.listen], etc, after calling this function
  * if you want to start listening again.
  **/
@@ -1199,10 +1911,23 @@ soup_server_disconnect (SoupServer *server)
 
 	for (iter = listeners; iter; iter = iter->next) {
 		listener = iter->data;
-		soup_listener_disconnect (listener);
+                /* Listeners owned by the workers are disconnected below */
+                if (!g_hash_table_contains (priv->worker_listeners, listener))
+                        soup_listener_disconnect (listener);
 		g_object_unref (listener);
 	}
 	g_slist_free (listeners);
+        g_hash_table_remove_all (priv->worker_listeners);
+
+        if (priv->workers) {
+                guint i;
+
+                for (i = 0; i < priv->workers->len; i++) {
+                        SoupServerWorker *worker = priv->workers->pdata[i];
+
+                        g_main_context_invoke (worker->context, (GSourceFunc)worker_disconnect, worker);
+                }
+        }
 }
 
 /**
@@ -1222,22 +1947,33 @@ soup_server_disconnect (SoupServer *server)
  */
 
 static gboolean
-soup_server_listen_internal (SoupServer             *server,
-                             SoupListener           *listener,
-			     SoupServerListenOptions options,
-			     GError                **error)
+soup_server_check_listen_options (SoupServer             *server,
+                                  SoupServerListenOptions options,
+                                  GError                **error)
 {
 	SoupServerPrivate *priv = soup_server_get_instance_private (server);
 
-	if (options & SOUP_SERVER_LISTEN_HTTPS) {
-		if (!priv->tls_cert) {
-			g_set_error_literal (error,
-					     G_IO_ERROR,
-					     G_IO_ERROR_INVALID_ARGUMENT,
-					     _("Can’t create a TLS server without a TLS certificate"));
-			return FALSE;
-		}
+	if ((options & SOUP_SERVER_LISTEN_HTTPS) && !priv->tls_cert) {
+                g_set_error_literal (error,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_INVALID_ARGUMENT,
+                                     _("Can’t create a TLS server without a TLS certificate"));
+                return FALSE;
+	}
+
+        return TRUE;
+}
+
+static void
+soup_server_setup_listener (SoupServer             *server,
+                            SoupListener           *listener,
+                            SoupServerListenOptions options)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+
+        g_object_set (listener, "accept-batch-size", priv->accept_batch_size, NULL);
 
+	if (options & SOUP_SERVER_LISTEN_HTTPS) {
                 g_object_bind_property (server, "tls-certificate",
                                         listener, "tls-certificate",
                                         G_BINDING_SYNC_CREATE);
@@ -1253,6 +1989,25 @@ soup_server_listen_internal (SoupServer             *server,
 			  G_CALLBACK (new_connection),
                           server);
 
+        soup_server_add_admission_listener (server, listener);
+}
+
+static gboolean
+soup_server_listen_internal (SoupServer             *server,
+                             SoupListener           *listener,
+			     SoupServerListenOptions options,
+			     GError                **error)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+
+        if (!soup_server_check_listen_options (server, options, error))
+                return FALSE;
+
+        if (priv->n_workers)
+                soup_server_start_workers (server);
+
+        soup_server_setup_listener (server, listener, options);
+
 	/* Note: soup_server_listen_ipv4_ipv6() below relies on the
 	 * fact that this does g_slist_prepend().
 	 */
@@ -1260,6 +2015,127 @@ soup_server_listen_internal (SoupServer             *server,
 	return TRUE;
 }
 
+typedef struct {
+        SoupServer             *server;
+        SoupServerWorker       *worker;
+        GSocketAddress         *address;
+        SoupServerListenOptions options;
+        SoupListener           *primary;
+
+        SoupListener           *listener;
+        GError                 *error;
+        gboolean                done;
+} WorkerListenData;
+
+static gboolean
+worker_listen (WorkerListenData *data)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (data->server);
+        SoupListener *listener;
+
+        listener = soup_listener_new_for_address_full (data->address, TRUE, &data->error);
+        if (listener) {
+                soup_server_setup_listener (data->server, listener, data->options);
+                g_hash_table_insert (data->worker->listeners,
+                                     data->primary ? data->primary : listener,
+                                     g_object_ref (listener));
+        }
+
+        g_mutex_lock (&priv->workers_mutex);
+        data->listener = listener;
+        data->done = TRUE;
+        g_cond_broadcast (&priv->workers_cond);
+        g_mutex_unlock (&priv->workers_mutex);
+
+        return G_SOURCE_REMOVE;
+}
+
+/* Creates a SO_REUSEPORT listener for @address from @worker's thread,
+ * so that it's attached to the worker's context, and waits for it.
+ * @primary is the listener created for @address in the first worker.
+ */
+static SoupListener *
+soup_server_worker_listen (SoupServer             *server,
+                           SoupServerWorker       *worker,
+                           GSocketAddress         *address,
+                           SoupServerListenOptions options,
+                           SoupListener           *primary,
+                           GError                **error)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        WorkerListenData data = { server, worker, address, options, primary, NULL, NULL, FALSE };
+
+        g_main_context_invoke (worker->context, (GSourceFunc)worker_listen, &data);
+
+        g_mutex_lock (&priv->workers_mutex);
+        while (!data.done)
+                g_cond_wait (&priv->workers_cond, &priv->workers_mutex);
+        g_mutex_unlock (&priv->workers_mutex);
+
+        if (data.error)
+                g_propagate_error (error, data.error);
+
+        return data.listener;
+}
+
+static gboolean
+soup_server_listen_workers (SoupServer             *server,
+                            GSocketAddress         *address,
+                            SoupServerListenOptions options,
+                            GError                **error)
+{
+	SoupServerPrivate *priv = soup_server_get_instance_private (server);
+        SoupListener *primary, *listener;
+        GSocketAddress *bound_address;
+        GError *my_error = NULL;
+        gboolean success;
+        guint i;
+
+        if (!soup_server_check_listen_options (server, options, error))
+                return FALSE;
+
+        soup_server_start_workers (server);
+
+        primary = soup_server_worker_listen (server, priv->workers->pdata[0],
+                                             address, options, NULL, &my_error);
+        if (!primary) {
+                if (!g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+                        g_propagate_error (error, my_error);
+                        return FALSE;
+                }
+
+                /* No SO_REUSEPORT, accept the connections in the
+                 * server's context and hand them off to the workers.
+                 */
+                g_error_free (my_error);
+                listener = soup_listener_new_for_address (address, error);
+                if (!listener)
+                        return FALSE;
+
+                success = soup_server_listen_internal (server, listener, options, error);
+                g_object_unref (listener);
+
+                return success;
+        }
+
+        /* See the note in soup_server_listen_internal() */
+        priv->listeners = g_slist_prepend (priv->listeners, primary);
+        g_hash_table_add (priv->worker_listeners, primary);
+
+        bound_address = G_SOCKET_ADDRESS (soup_listener_get_address (primary));
+        for (i = 1; i < priv->workers->len; i++) {
+                listener = soup_server_worker_listen (server, priv->workers->pdata[i],
+                                                      bound_address, options, primary, error);
+                if (!listener) {
+                        soup_server_remove_listener (server, primary);
+                        return FALSE;
+                }
+                g_object_unref (listener);
+        }
+
+        return TRUE;
+}
+
 /**
  * soup_server_listen:
  * @server: a #SoupServer
@@ -1304,6 +2180,9 @@ soup_server_listen (SoupServer *server, GSocketAddress *address,
 	priv = soup_server_get_instance_private (server);
 	g_return_val_if_fail (priv->disposed == FALSE, FALSE);
 
+        if (priv->n_workers)
+                return soup_server_listen_workers (server, address, options, error);
+
         listener = soup_listener_new_for_address (address, error);
         if (!listener)
                 return FALSE;
@@ -1369,11 +2248,8 @@ soup_server_listen_ipv4_ipv6 (SoupServer *server,
 		return TRUE;
 	}
 
-	if (v4sock) {
-		priv->listeners = g_slist_remove (priv->listeners, v4sock);
-		soup_listener_disconnect (v4sock);
-		g_object_unref (v4sock);
-	}
+	if (v4sock)
+                soup_server_remove_listener (server, v4sock);
 
 	if (port == 0 && g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE)) {
 		/* The randomly-assigned IPv4 port was in use on the IPv6 side... Try again */
@@ -1624,13 +2500,15 @@ get_or_create_handler (SoupServer *server, const char *exact_path)
 
 	exact_path = NORMALIZED_PATH (exact_path);
 
+        g_rec_mutex_lock (&priv->handlers_mutex);
 	handler = soup_path_map_lookup (priv->handlers, exact_path);
-	if (handler && !strcmp (handler->path, exact_path))
-		return handler;
-
-	handler = g_slice_new0 (SoupServerHandler);
-	handler->path = g_strdup (exact_path);
-	soup_path_map_add (priv->handlers, exact_path, handler);
+	if (!handler || strcmp (handler->path, exact_path) != 0) {
+                handler = g_slice_new0 (SoupServerHandler);
+                g_atomic_ref_count_init (&handler->ref_count);
+                handler->path = g_strdup (exact_path);
+                soup_path_map_add (priv->handlers, exact_path, handler);
+        }
+        g_rec_mutex_unlock (&priv->handlers_mutex);
 
 	return handler;
 }
@@ -1823,14 +2701,12 @@ soup_server_add_websocket_handler (SoupServer                   *server,
 		handler->websocket_destroy (handler->websocket_user_data);
 	g_free (handler->websocket_origin);
 	g_strfreev (handler->websocket_protocols);
-	g_list_free_full (handler->websocket_extensions, g_object_unref);
 
 	handler->websocket_callback   = callback;
 	handler->websocket_destroy    = destroy;
 	handler->websocket_user_data  = user_data;
 	handler->websocket_origin     = g_strdup (origin);
 	handler->websocket_protocols  = g_strdupv (protocols);
-	handler->websocket_extensions = NULL;
 }
 
 /**
@@ -1848,7 +2724,51 @@ soup_server_remove_handler (SoupServer *server, const char *path)
 	g_return_if_fail (SOUP_IS_SERVER (server));
 	priv = soup_server_get_instance_private (server);
 
+        g_rec_mutex_lock (&priv->handlers_mutex);
 	soup_path_map_remove (priv->handlers, NORMALIZED_PATH (path));
+        g_rec_mutex_unlock (&priv->handlers_mutex);
+}
+
+/**
+ * soup_server_set_handler_thread_safe:
+ * @server: a #SoupServer
+ * @path: (nullable): the toplevel path of an existing handler
+ * @thread_safe: whether the handler's callbacks are thread-safe
+ *
+ * Sets whether the callbacks of the handler registered for @path (with
+ * [method@Server.add_handler], [method@Server.add_early_handler] or
+ * [method@Server.add_websocket_handler]) can be run concurrently from
+ * several threads.
+ *
+ * This only matters when [property@Server:worker-threads] is set: the
+ * callbacks of handlers that are not thread-safe are serialized, while
+ * thread-safe ones run in parallel in every worker thread. In either case
+ * the callbacks are invoked in the worker thread handling the request,
+ * whose thread-default [struct@GLib.MainContext] is the one to use for
+ * any asynchronous work on the message.
+ *
+ * Since: 3.8
+ */
+void
+soup_server_set_handler_thread_safe (SoupServer *server,
+                                     const char *path,
+                                     gboolean    thread_safe)
+{
+	SoupServerPrivate *priv;
+	SoupServerHandler *handler;
+
+	g_return_if_fail (SOUP_IS_SERVER (server));
+	priv = soup_server_get_instance_private (server);
+
+        path = NORMALIZED_PATH (path);
+
+        g_rec_mutex_lock (&priv->handlers_mutex);
+	handler = soup_path_map_lookup (priv->handlers, path);
+        if (handler && strcmp (handler->path, path) == 0)
+                handler->thread_safe = thread_safe;
+        else
+                g_warning ("No handler registered for path %s", path);
+        g_rec_mutex_unlock (&priv->handlers_mutex);
 }
 
 /**
@@ -2024,3 +2944,12 @@ soup_server_set_http2_enabled (SoupServer *server,
 
         priv->http2_enabled = enabled;
 }
+
+void
+soup_server_set_http2_max_concurrent_streams (SoupServer *server,
+                                              guint       max_concurrent_streams)
+{
+        SoupServerPrivate *priv = soup_server_get_instance_private (server);
+
+        priv->http2_max_concurrent_streams = max_concurrent_streams;
+}
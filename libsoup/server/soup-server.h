@@ -87,6 +87,11 @@ GSList         *soup_server_get_uris           (SoupServer               *server
 SOUP_AVAILABLE_IN_ALL
 GSList         *soup_server_get_listeners      (SoupServer               *server);
 
+SOUP_AVAILABLE_IN_3_8
+guint           soup_server_get_accepted_connections (SoupServer         *server);
+SOUP_AVAILABLE_IN_3_8
+guint           soup_server_get_rejected_connections (SoupServer         *server);
+
 SOUP_AVAILABLE_IN_ALL
 void            soup_server_disconnect         (SoupServer               *server);
 
@@ -142,6 +147,11 @@ SOUP_AVAILABLE_IN_ALL
 void            soup_server_remove_handler     (SoupServer         *server,
 					        const char         *path);
 
+SOUP_AVAILABLE_IN_3_8
+void            soup_server_set_handler_thread_safe (SoupServer *server,
+                                                     const char *path,
+                                                     gboolean    thread_safe);
+
 SOUP_AVAILABLE_IN_ALL
 void            soup_server_add_auth_domain    (SoupServer         *server,
 					        SoupAuthDomain     *auth_domain);
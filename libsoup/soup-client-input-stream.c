@@ -5,15 +5,33 @@
  * Copyright 2010-2012 Red Hat, Inc.
  */
 
+/* For splice() */
+#define _GNU_SOURCE
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
 
+#include <glib/gi18n-lib.h>
+
 #include "soup-client-input-stream.h"
 #include "soup.h"
+#include "soup-connection.h"
 #include "soup-message-private.h"
 #include "soup-message-metrics-private.h"
 #include "soup-misc.h"
+#include "http1/soup-body-input-stream.h"
+
+#ifdef HAVE_SPLICE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <gio/gfiledescriptorbased.h>
+
+/* Bytes moved through the pipe per splice(2) call */
+#define SPLICE_PIPE_SIZE (1024 * 1024)
+#endif
 
 struct _SoupClientInputStream {
 	SoupFilterInputStream parent_instance;
@@ -22,6 +40,15 @@ struct _SoupClientInputStream {
 typedef struct {
 	SoupMessage  *msg;
         SoupMessageMetrics *metrics;
+
+        /* Set up by soup_client_input_stream_can_splice() */
+        GSocket *splice_socket;
+        int splice_out_fd;
+        int splice_pipe[2];
+        gsize splice_pipe_size;
+        gsize splice_piped;
+        GIOCondition splice_wait;
+        gint64 splice_last_progress;
 } SoupClientInputStreamPrivate;
 
 enum {
@@ -52,6 +79,10 @@ G_DEFINE_FINAL_TYPE_WITH_CODE (SoupClientInputStream, soup_client_input_stream,
 static void
 soup_client_input_stream_init (SoupClientInputStream *stream)
 {
+        SoupClientInputStreamPrivate *priv = soup_client_input_stream_get_instance_private (stream);
+
+        priv->splice_out_fd = -1;
+        priv->splice_pipe[0] = priv->splice_pipe[1] = -1;
 }
 
 static void
@@ -61,6 +92,13 @@ soup_client_input_stream_finalize (GObject *object)
         SoupClientInputStreamPrivate *priv = soup_client_input_stream_get_instance_private (cistream);
 
 	g_clear_object (&priv->msg);
+        g_clear_object (&priv->splice_socket);
+#ifdef HAVE_SPLICE
+        if (priv->splice_pipe[0] != -1) {
+                close (priv->splice_pipe[0]);
+                close (priv->splice_pipe[1]);
+        }
+#endif
 
 	G_OBJECT_CLASS (soup_client_input_stream_parent_class)->finalize (object);
 }
@@ -305,3 +343,312 @@ soup_client_input_stream_new (GInputStream *base_stream,
 			     "message", msg,
 			     NULL);
 }
+
+/* Checks whether the rest of the response body can be moved from the
+ * connection to @ostream inside the kernel with splice(2). That is only
+ * possible when the body is not transformed on its way to the caller
+ * (no TLS, chunked encoding, content decoders, cache or body logging)
+ * and @ostream is backed by a file descriptor. If it returns %TRUE,
+ * use soup_client_input_stream_splice() to transfer the body.
+ */
+gboolean
+soup_client_input_stream_can_splice (SoupClientInputStream *cistream,
+                                     GOutputStream         *ostream)
+{
+#ifdef HAVE_SPLICE
+        SoupClientInputStreamPrivate *priv = soup_client_input_stream_get_instance_private (cistream);
+        GInputStream *body_stream, *net_stream;
+        SoupConnection *conn;
+        gsize buffered;
+        int out_fd, flags, pipe_size;
+
+        if (priv->splice_out_fd != -1)
+                return TRUE;
+
+        body_stream = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (cistream));
+        if (!SOUP_IS_BODY_INPUT_STREAM (body_stream) ||
+            soup_body_input_stream_get_remaining (SOUP_BODY_INPUT_STREAM (body_stream)) <= 0)
+                return FALSE;
+
+        soup_filter_input_stream_peek_buffer (SOUP_FILTER_INPUT_STREAM (cistream), &buffered);
+        if (buffered)
+                return FALSE;
+
+        net_stream = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (body_stream));
+        if (!SOUP_IS_FILTER_INPUT_STREAM (net_stream) ||
+            !G_IS_FILE_DESCRIPTOR_BASED (g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (net_stream))))
+                return FALSE;
+
+        if (!G_IS_FILE_DESCRIPTOR_BASED (ostream))
+                return FALSE;
+
+        /* splice(2) refuses files opened for appending */
+        out_fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (ostream));
+        flags = fcntl (out_fd, F_GETFL);
+        if (flags == -1 || (flags & O_APPEND))
+                return FALSE;
+
+        conn = soup_message_get_connection (priv->msg);
+        if (!conn)
+                return FALSE;
+        priv->splice_socket = soup_connection_get_socket (conn);
+        if (priv->splice_socket)
+                g_object_ref (priv->splice_socket);
+        g_object_unref (conn);
+        if (!priv->splice_socket)
+                return FALSE;
+
+        if (!g_unix_open_pipe (priv->splice_pipe, FD_CLOEXEC, NULL)) {
+                priv->splice_pipe[0] = priv->splice_pipe[1] = -1;
+                g_clear_object (&priv->splice_socket);
+                return FALSE;
+        }
+
+        pipe_size = fcntl (priv->splice_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+        if (pipe_size == -1)
+                pipe_size = fcntl (priv->splice_pipe[1], F_GETPIPE_SZ);
+        priv->splice_pipe_size = pipe_size > 0 ? pipe_size : 65536;
+
+        priv->splice_out_fd = out_fd;
+        priv->splice_last_progress = g_get_monotonic_time ();
+
+        return TRUE;
+#else
+        return FALSE;
+#endif
+}
+
+#ifdef HAVE_SPLICE
+/* Waits for the output to become writable, or fails with
+ * %G_IO_ERROR_WOULD_BLOCK if not @blocking. Like reads from the socket,
+ * this gives up after the socket's timeout.
+ */
+static gboolean
+wait_for_output (SoupClientInputStreamPrivate *priv,
+                 gboolean                      blocking,
+                 GCancellable                 *cancellable,
+                 GError                      **error)
+{
+        GPollFD fds[2] = { { priv->splice_out_fd, G_IO_OUT, 0 }, };
+        guint nfds = 1;
+        guint timeout;
+        int res;
+
+        if (!blocking) {
+                priv->splice_wait = G_IO_OUT;
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                                     g_strerror (EAGAIN));
+                return FALSE;
+        }
+
+        if (g_cancellable_make_pollfd (cancellable, &fds[1]))
+                nfds++;
+
+        timeout = g_socket_get_timeout (priv->splice_socket);
+        do {
+                res = g_poll (fds, nfds, timeout ? (int)(timeout * 1000) : -1);
+        } while (res == -1 && errno == EINTR);
+
+        if (nfds > 1)
+                g_cancellable_release_fd (cancellable);
+
+        if (res == 0) {
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                                     _("Socket I/O timed out"));
+                return FALSE;
+        }
+
+        return !g_cancellable_set_error_if_cancelled (cancellable, error);
+}
+
+static void
+set_error_from_errno (GError **error,
+                      int      errsv)
+{
+        g_set_error_literal (error, G_IO_ERROR,
+                             g_io_error_from_errno (errsv),
+                             g_strerror (errsv));
+}
+#endif
+
+/* Moves the next part of the response body to the output stream given
+ * to soup_client_input_stream_can_splice(). Returns the number of bytes
+ * written to it, 0 at the end of the body, or -1 on error. If @blocking
+ * is %FALSE and no progress can be made, it fails with
+ * %G_IO_ERROR_WOULD_BLOCK; wait on
+ * soup_client_input_stream_create_splice_source() and try again.
+ */
+gssize
+soup_client_input_stream_splice (SoupClientInputStream *cistream,
+                                 gboolean               blocking,
+                                 GCancellable          *cancellable,
+                                 GError               **error)
+{
+#ifdef HAVE_SPLICE
+        SoupClientInputStreamPrivate *priv = soup_client_input_stream_get_instance_private (cistream);
+        GInputStream *body_stream;
+        GInputStream *net_stream;
+        int socket_fd;
+        const guint8 *buffered;
+        gsize buffered_len;
+        guint8 dummy;
+
+        g_return_val_if_fail (priv->splice_out_fd != -1, -1);
+
+        if (g_cancellable_set_error_if_cancelled (soup_message_io_get_cancellable (priv->msg), error) ||
+            g_cancellable_set_error_if_cancelled (cancellable, error))
+                return -1;
+
+        body_stream = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (cistream));
+        net_stream = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (body_stream));
+        socket_fd = g_socket_get_fd (priv->splice_socket);
+
+        while (TRUE) {
+                goffset remaining;
+                gssize nspliced;
+
+                if (priv->splice_piped > 0) {
+                        nspliced = splice (priv->splice_pipe[0], NULL, priv->splice_out_fd, NULL,
+                                           priv->splice_piped, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                        if (nspliced > 0) {
+                                priv->splice_piped -= nspliced;
+                                if (priv->metrics)
+                                        priv->metrics->response_body_size += nspliced;
+                                return nspliced;
+                        }
+
+                        if (nspliced == -1 && errno == EINTR)
+                                continue;
+
+                        if (nspliced == -1 && errno == EAGAIN) {
+                                if (!wait_for_output (priv, blocking, cancellable, error))
+                                        return -1;
+                                continue;
+                        }
+
+                        set_error_from_errno (error, errno);
+                        return -1;
+                }
+
+                remaining = soup_body_input_stream_get_remaining (SOUP_BODY_INPUT_STREAM (body_stream));
+                if (remaining == 0)
+                        break;
+
+                /* The start of the body usually arrived with the headers */
+                buffered = soup_filter_input_stream_peek_buffer (SOUP_FILTER_INPUT_STREAM (net_stream), &buffered_len);
+                if (buffered_len > 0) {
+                        gssize nwritten;
+
+                        nwritten = write (priv->splice_out_fd, buffered, MIN (buffered_len, (gsize)remaining));
+                        if (nwritten > 0) {
+                                soup_filter_input_stream_consume (SOUP_FILTER_INPUT_STREAM (net_stream), nwritten);
+                                soup_body_input_stream_skipped (SOUP_BODY_INPUT_STREAM (body_stream), nwritten);
+                                if (priv->metrics)
+                                        priv->metrics->response_body_size += nwritten;
+                                return nwritten;
+                        }
+
+                        if (nwritten == -1 && errno == EINTR)
+                                continue;
+
+                        if (nwritten == -1 && errno == EAGAIN) {
+                                if (!wait_for_output (priv, blocking, cancellable, error))
+                                        return -1;
+                                continue;
+                        }
+
+                        set_error_from_errno (error, errno);
+                        return -1;
+                }
+
+                nspliced = splice (socket_fd, NULL, priv->splice_pipe[1], NULL,
+                                   MIN ((gsize)remaining, priv->splice_pipe_size),
+                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (nspliced > 0) {
+                        soup_body_input_stream_skipped (SOUP_BODY_INPUT_STREAM (body_stream), nspliced);
+                        soup_filter_input_stream_notify_read_data (SOUP_FILTER_INPUT_STREAM (net_stream), nspliced);
+                        priv->splice_piped = nspliced;
+                        priv->splice_last_progress = g_get_monotonic_time ();
+                        continue;
+                }
+
+                /* The peer closed the connection; whether that is an
+                 * error depends on the body encoding, so let the regular
+                 * read path find out.
+                 */
+                if (nspliced == 0)
+                        break;
+
+                if (errno == EINTR)
+                        continue;
+
+                if (errno == EAGAIN) {
+                        guint timeout = g_socket_get_timeout (priv->splice_socket);
+
+                        if (timeout && g_get_monotonic_time () - priv->splice_last_progress >= (gint64)timeout * G_USEC_PER_SEC) {
+                                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                                                     _("Socket I/O timed out"));
+                                return -1;
+                        }
+
+                        if (!blocking) {
+                                priv->splice_wait = G_IO_IN;
+                                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                                                     g_strerror (EAGAIN));
+                                return -1;
+                        }
+
+                        if (!g_socket_condition_wait (priv->splice_socket, G_IO_IN, cancellable, error))
+                                return -1;
+                        continue;
+                }
+
+                set_error_from_errno (error, errno);
+                return -1;
+        }
+
+        /* Nothing left for the kernel to move: a regular read notices
+         * the end of the body and finishes the message.
+         */
+        if (blocking)
+                return soup_client_input_stream_read_fn (G_INPUT_STREAM (cistream), &dummy, 1, cancellable, error);
+        return soup_client_input_stream_read_nonblocking (G_POLLABLE_INPUT_STREAM (cistream), &dummy, 1, error);
+#else
+        g_return_val_if_reached (-1);
+#endif
+}
+
+/* Returns a source that triggers when soup_client_input_stream_splice()
+ * can make progress after failing with %G_IO_ERROR_WOULD_BLOCK.
+ */
+GSource *
+soup_client_input_stream_create_splice_source (SoupClientInputStream *cistream,
+                                               GCancellable          *cancellable)
+{
+#ifdef HAVE_SPLICE
+        SoupClientInputStreamPrivate *priv = soup_client_input_stream_get_instance_private (cistream);
+        GSource *source;
+
+        if (priv->splice_wait == G_IO_OUT) {
+                source = g_unix_fd_source_new (priv->splice_out_fd, G_IO_OUT);
+        } else {
+                guint timeout = g_socket_get_timeout (priv->splice_socket);
+
+                source = g_unix_fd_source_new (g_socket_get_fd (priv->splice_socket), G_IO_IN);
+                if (timeout)
+                        g_source_set_ready_time (source, priv->splice_last_progress + (gint64)timeout * G_USEC_PER_SEC);
+        }
+
+        if (cancellable) {
+                GSource *cancellable_source = g_cancellable_source_new (cancellable);
+
+                g_source_set_dummy_callback (cancellable_source);
+                g_source_add_child_source (source, cancellable_source);
+                g_source_unref (cancellable_source);
+        }
+
+        return source;
+#else
+        g_return_val_if_reached (NULL);
+#endif
+}
@@ -16,5 +16,14 @@ G_DECLARE_FINAL_TYPE (SoupClientInputStream, soup_client_input_stream, SOUP, CLI
 GInputStream *soup_client_input_stream_new (GInputStream *base_stream,
 					    SoupMessage  *msg);
 
+gboolean      soup_client_input_stream_can_splice           (SoupClientInputStream *cistream,
+							     GOutputStream         *ostream);
+gssize        soup_client_input_stream_splice               (SoupClientInputStream *cistream,
+							     gboolean               blocking,
+							     GCancellable          *cancellable,
+							     GError               **error);
+GSource      *soup_client_input_stream_create_splice_source (SoupClientInputStream *cistream,
+							     GCancellable          *cancellable);
+
 G_END_DECLS
 
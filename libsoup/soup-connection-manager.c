@@ -22,24 +22,51 @@ struct _SoupConnectionManager {
         GSocketConnectable *remote_connectable;
         guint max_conns;
         guint max_conns_per_host;
+        guint max_pipeline_depth;
+        int http2_min_window_size;
+        int http2_max_window_size;
         guint num_conns;
 
         GHashTable *http_hosts;
         GHashTable *https_hosts;
         GHashTable *conns;
 
+        /* Host name -> SoupPipelineHost. Unlike SoupHost these are
+         * kept for the lifetime of the session, so that a server known
+         * to break pipelining is not pipelined to again.
+         */
+        GHashTable *pipeline_hosts;
+
         guint64 last_connection_id;
 };
 
+typedef struct {
+        /* Pipeline depth set for the host, or 0 for the session's */
+        guint max_depth;
+        /* A connection to the host failed while pipelining */
+        gboolean blocked;
+} SoupPipelineHost;
+
 typedef struct {
         GUri *uri;
         GMutex *mutex;
         GHashTable *owner_map;
         GNetworkAddress *addr;
+        SoupSession *session;
 
         GList *conns;
         guint  num_conns;
 
+        /* Resolved addresses, used to find HTTP/2 connections to
+         * other hosts that can be reused for this one.
+         */
+        GList *addresses;
+        gboolean addresses_resolved;
+        GCancellable *resolve_cancellable;
+
+        /* A coalesced request got 421 Misdirected Request */
+        gboolean coalescing_blocked;
+
         GMainContext *context;
         GSource *keep_alive_src;
 } SoupHost;
@@ -88,6 +115,12 @@ soup_host_free (SoupHost *host)
                 g_source_unref (host->keep_alive_src);
         }
 
+        if (host->resolve_cancellable) {
+                g_cancellable_cancel (host->resolve_cancellable);
+                g_object_unref (host->resolve_cancellable);
+        }
+        g_resolver_free_addresses (host->addresses);
+
         g_uri_unref (host->uri);
         g_object_unref (host->addr);
         g_free (host);
@@ -178,15 +211,73 @@ soup_host_remove_connection (SoupHost       *host,
         }
 }
 
-static SoupHost *
-soup_connection_manager_get_host_for_message (SoupConnectionManager *manager,
-                                              SoupMessage           *msg)
+static void
+soup_host_addresses_resolved (GResolver    *resolver,
+                              GAsyncResult *result,
+                              SoupHost     *host)
 {
-        GUri *uri = soup_message_get_uri (msg);
-        GHashTable *map;
+        GList *addresses;
+        GError *error = NULL;
 
-        map = soup_uri_is_https (uri) ?  manager->https_hosts : manager->http_hosts;
-        return g_hash_table_lookup (map, uri);
+        addresses = g_resolver_lookup_by_name_finish (resolver, result, &error);
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+                g_error_free (error);
+                return;
+        }
+        g_clear_error (&error);
+
+        g_mutex_lock (host->mutex);
+        host->addresses = addresses;
+        host->addresses_resolved = TRUE;
+        g_clear_object (&host->resolve_cancellable);
+        g_mutex_unlock (host->mutex);
+
+        soup_session_kick_queue (host->session);
+}
+
+static void
+soup_host_resolve_addresses (SoupHost *host)
+{
+        const char *hostname = g_uri_get_host (host->uri);
+        GResolver *resolver;
+
+        if (host->addresses_resolved || host->resolve_cancellable)
+                return;
+
+        if (g_hostname_is_ip_address (hostname)) {
+                GInetAddress *address = g_inet_address_new_from_string (hostname);
+
+                if (address)
+                        host->addresses = g_list_prepend (NULL, address);
+                host->addresses_resolved = TRUE;
+                return;
+        }
+
+        host->resolve_cancellable = g_cancellable_new ();
+        resolver = g_resolver_get_default ();
+        g_resolver_lookup_by_name_async (resolver, hostname, host->resolve_cancellable,
+                                         (GAsyncReadyCallback)soup_host_addresses_resolved,
+                                         host);
+        g_object_unref (resolver);
+}
+
+static gboolean
+soup_host_has_address (SoupHost       *host,
+                       GSocketAddress *address)
+{
+        GInetAddress *inet_address;
+        GList *l;
+
+        if (!G_IS_INET_SOCKET_ADDRESS (address))
+                return FALSE;
+
+        inet_address = g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address));
+        for (l = host->addresses; l; l = g_list_next (l)) {
+                if (g_inet_address_equal (l->data, inet_address))
+                        return TRUE;
+        }
+
+        return FALSE;
 }
 
 static SoupHost *
@@ -199,8 +290,10 @@ soup_connection_manager_get_or_create_host_for_item (SoupConnectionManager *mana
 
         map = soup_uri_is_https (uri) ?  manager->https_hosts : manager->http_hosts;
         host = g_hash_table_lookup (map, uri);
-        if (!host)
+        if (!host) {
                 host = soup_host_new (uri, map, &manager->mutex, soup_session_get_context (item->session));
+                host->session = manager->session;
+        }
 
         return host;
 }
@@ -236,6 +329,9 @@ soup_connection_manager_new (SoupSession *session,
         manager->session = session;
         manager->max_conns = max_conns;
         manager->max_conns_per_host = max_conns_per_host;
+        manager->max_pipeline_depth = 1;
+        manager->http2_min_window_size = SOUP_CONNECTION_HTTP2_MIN_WINDOW_SIZE;
+        manager->http2_max_window_size = SOUP_CONNECTION_HTTP2_MAX_WINDOW_SIZE;
         manager->http_hosts = g_hash_table_new_full (soup_host_uri_hash,
                                                      soup_host_uri_equal,
                                                      NULL,
@@ -245,6 +341,9 @@ soup_connection_manager_new (SoupSession *session,
                                                       NULL,
                                                       (GDestroyNotify)soup_host_free);
         manager->conns = g_hash_table_new (NULL, NULL);
+        manager->pipeline_hosts = g_hash_table_new_full (soup_str_case_hash,
+                                                         soup_str_case_equal,
+                                                         g_free, g_free);
         g_mutex_init (&manager->mutex);
         g_cond_init (&manager->cond);
 
@@ -261,6 +360,7 @@ soup_connection_manager_free (SoupConnectionManager *manager)
         g_hash_table_destroy (manager->http_hosts);
         g_hash_table_destroy (manager->https_hosts);
         g_hash_table_destroy (manager->conns);
+        g_hash_table_destroy (manager->pipeline_hosts);
         g_mutex_clear (&manager->mutex);
         g_cond_clear (&manager->cond);
 
@@ -295,6 +395,100 @@ soup_connection_manager_get_max_conns_per_host (SoupConnectionManager *manager)
         return manager->max_conns_per_host;
 }
 
+void
+soup_connection_manager_set_max_pipeline_depth (SoupConnectionManager *manager,
+                                                guint                  max_pipeline_depth)
+{
+        g_assert (manager->num_conns == 0);
+        manager->max_pipeline_depth = max_pipeline_depth;
+}
+
+guint
+soup_connection_manager_get_max_pipeline_depth (SoupConnectionManager *manager)
+{
+        return manager->max_pipeline_depth;
+}
+
+static SoupPipelineHost *
+soup_connection_manager_ensure_pipeline_host_locked (SoupConnectionManager *manager,
+                                                     const char            *hostname)
+{
+        SoupPipelineHost *pipeline_host;
+
+        pipeline_host = g_hash_table_lookup (manager->pipeline_hosts, hostname);
+        if (!pipeline_host) {
+                pipeline_host = g_new0 (SoupPipelineHost, 1);
+                g_hash_table_insert (manager->pipeline_hosts, g_strdup (hostname), pipeline_host);
+        }
+
+        return pipeline_host;
+}
+
+static guint
+soup_connection_manager_get_host_max_pipeline_depth_locked (SoupConnectionManager *manager,
+                                                            const char            *hostname)
+{
+        SoupPipelineHost *pipeline_host;
+
+        pipeline_host = g_hash_table_lookup (manager->pipeline_hosts, hostname);
+        if (!pipeline_host)
+                return manager->max_pipeline_depth;
+        if (pipeline_host->blocked)
+                return 1;
+        return pipeline_host->max_depth ? pipeline_host->max_depth : manager->max_pipeline_depth;
+}
+
+void
+soup_connection_manager_set_host_max_pipeline_depth (SoupConnectionManager *manager,
+                                                     const char            *hostname,
+                                                     guint                  max_pipeline_depth)
+{
+        g_mutex_lock (&manager->mutex);
+        soup_connection_manager_ensure_pipeline_host_locked (manager, hostname)->max_depth = max_pipeline_depth;
+        g_mutex_unlock (&manager->mutex);
+}
+
+guint
+soup_connection_manager_get_host_max_pipeline_depth (SoupConnectionManager *manager,
+                                                     const char            *hostname)
+{
+        guint max_pipeline_depth;
+
+        g_mutex_lock (&manager->mutex);
+        max_pipeline_depth = soup_connection_manager_get_host_max_pipeline_depth_locked (manager, hostname);
+        g_mutex_unlock (&manager->mutex);
+
+        return max_pipeline_depth;
+}
+
+void
+soup_connection_manager_set_http2_min_window_size (SoupConnectionManager *manager,
+                                                   int                    window_size)
+{
+        g_assert (manager->num_conns == 0);
+        manager->http2_min_window_size = window_size;
+}
+
+int
+soup_connection_manager_get_http2_min_window_size (SoupConnectionManager *manager)
+{
+        return manager->http2_min_window_size;
+}
+
+void
+soup_connection_manager_set_http2_max_window_size (SoupConnectionManager *manager,
+                                                   int                    window_size)
+{
+        g_assert (manager->num_conns == 0);
+        manager->http2_max_window_size = window_size;
+}
+
+int
+soup_connection_manager_get_http2_max_window_size (SoupConnectionManager *manager)
+{
+        return manager->http2_max_window_size;
+}
+
 void
 soup_connection_manager_set_remote_connectable (SoupConnectionManager *manager,
                                                 GSocketConnectable    *connectable)
@@ -362,14 +556,27 @@ connection_disconnected (SoupConnection        *conn,
 
         g_mutex_lock (&manager->mutex);
         g_hash_table_steal_extended (manager->conns, conn, NULL, (gpointer *)&host);
-        if (host)
+        if (host) {
+                if (soup_connection_get_pipeline_failed (conn))
+                        soup_connection_manager_ensure_pipeline_host_locked (manager, g_uri_get_host (host->uri))->blocked = TRUE;
                 soup_host_remove_connection (host, conn);
+        }
         soup_connection_manager_drop_connection (manager, conn);
         g_mutex_unlock (&manager->mutex);
 
         soup_session_kick_queue (manager->session);
 }
 
+static void
+connection_stream_finished (SoupConnection        *conn,
+                            SoupConnectionManager *manager)
+{
+        /* Sync requests may be waiting for a stream slot */
+        g_mutex_lock (&manager->mutex);
+        g_cond_broadcast (&manager->cond);
+        g_mutex_unlock (&manager->mutex);
+}
+
 static void
 connection_state_changed (SoupConnection        *conn,
                           GParamSpec            *param,
@@ -385,6 +592,92 @@ connection_state_changed (SoupConnection        *conn,
         soup_session_kick_queue (manager->session);
 }
 
+/* RFC 7540 section 9.1.1: an HTTP/2 connection can be reused for
+ * another origin when the origin resolves to the address the
+ * connection is established to and the server certificate is valid
+ * for the origin's host. If the server answers 421 Misdirected Request
+ * the message is retried on a new connection to its own host.
+ */
+static gboolean
+soup_connection_can_coalesce (SoupConnection *conn,
+                              SoupHost       *host)
+{
+        GTlsCertificate *certificate;
+
+        if (soup_connection_get_negotiated_protocol (conn) != SOUP_HTTP_2_0)
+                return FALSE;
+
+        if (soup_connection_get_owner (conn) != g_thread_self ())
+                return FALSE;
+
+        switch (soup_connection_get_state (conn)) {
+        case SOUP_CONNECTION_IN_USE:
+                if (!soup_connection_is_reusable (conn) || !soup_connection_has_http2_stream_available (conn))
+                        return FALSE;
+                break;
+        case SOUP_CONNECTION_IDLE:
+                if (!soup_connection_is_idle_open (conn))
+                        return FALSE;
+                break;
+        default:
+                return FALSE;
+        }
+
+        if (soup_connection_is_via_proxy (conn))
+                return FALSE;
+
+        certificate = soup_connection_get_tls_certificate (conn);
+        if (!certificate || soup_connection_get_tls_certificate_errors (conn) != 0)
+                return FALSE;
+
+        return !(g_tls_certificate_verify (certificate, G_SOCKET_CONNECTABLE (host->addr), NULL) & G_TLS_CERTIFICATE_BAD_IDENTITY);
+}
+
+static SoupConnection *
+soup_connection_manager_get_coalesced_connection_locked (SoupConnectionManager *manager,
+                                                         SoupHost              *host,
+                                                         SoupMessageQueueItem  *item,
+                                                         gboolean              *resolving)
+{
+        GHashTableIter iter;
+        SoupConnection *conn;
+        SoupHost *conn_host;
+        gboolean has_candidates = FALSE;
+
+        *resolving = FALSE;
+
+        if (manager->remote_connectable || host->coalescing_blocked || !soup_uri_is_https (host->uri))
+                return NULL;
+
+        g_hash_table_iter_init (&iter, manager->conns);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&conn, (gpointer *)&conn_host)) {
+                if (conn_host == host || !soup_uri_is_https (conn_host->uri) ||
+                    g_uri_get_port (conn_host->uri) != g_uri_get_port (host->uri))
+                        continue;
+
+                if (!soup_connection_can_coalesce (conn, host))
+                        continue;
+
+                if (!host->addresses_resolved) {
+                        has_candidates = TRUE;
+                        break;
+                }
+
+                if (soup_host_has_address (host, soup_connection_get_remote_address (conn)))
+                        return conn;
+        }
+
+        /* Resolving the host is not wasted if we end up creating a new
+         * connection, since the connection does the same lookup.
+         */
+        if (has_candidates && item->async) {
+                soup_host_resolve_addresses (host);
+                *resolving = !host->addresses_resolved;
+        }
+
+        return NULL;
+}
+
 static SoupConnection *
 soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                                                SoupMessageQueueItem  *item)
@@ -392,13 +685,14 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
         static int env_force_http1 = -1;
         SoupMessage *msg = item->msg;
         gboolean need_new_connection;
-        SoupConnection *conn;
+        SoupConnection *conn, *pipeline_conn;
         SoupSocketProperties *socket_props;
         SoupHost *host;
         guint8 force_http_version;
         GList *l;
         GSocketConnectable *remote_connectable;
         gboolean try_cleanup = TRUE;
+        guint max_pipeline_depth;
 
         if (env_force_http1 == -1)
                 env_force_http1 = g_getenv ("SOUP_FORCE_HTTP1") != NULL ? 1 : 0;
@@ -410,9 +704,20 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                  !SOUP_METHOD_IS_IDEMPOTENT (soup_message_get_method (msg)));
 
         host = soup_connection_manager_get_or_create_host_for_item (manager, item);
+        if (soup_message_is_misdirected_retry (msg))
+                host->coalescing_blocked = TRUE;
 
         force_http_version = env_force_http1 ? SOUP_HTTP_1_1 : soup_message_get_force_http_version (msg);
         while (TRUE) {
+                SoupConnection *http2_conn = NULL;
+                guint http2_conn_streams = G_MAXUINT;
+                SoupConnection *full_http2_conn = NULL;
+                guint full_http2_conn_streams = G_MAXUINT;
+                gboolean wait_for_connection = FALSE;
+
+                pipeline_conn = NULL;
+                max_pipeline_depth = soup_connection_manager_get_host_max_pipeline_depth_locked (manager, g_uri_get_host (host->uri));
+
                 for (l = host->conns; l && l->data; l = g_list_next (l)) {
                         SoupHTTPVersion http_version;
 
@@ -424,8 +729,30 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
 
                         switch (soup_connection_get_state (conn)) {
                         case SOUP_CONNECTION_IN_USE:
-                                if (!need_new_connection && http_version == SOUP_HTTP_2_0 && soup_connection_get_owner (conn) == g_thread_self () && soup_connection_is_reusable (conn))
-                                        return conn;
+                                if (!need_new_connection && http_version == SOUP_HTTP_2_0 && soup_connection_get_owner (conn) == g_thread_self () && soup_connection_is_reusable (conn)) {
+                                        guint streams;
+
+                                        streams = soup_connection_get_http2_active_streams (conn);
+
+                                        /* Don't queue streams beyond the peer's limit */
+                                        if (!soup_connection_has_http2_stream_available (conn)) {
+                                                if (streams < full_http2_conn_streams) {
+                                                        full_http2_conn = conn;
+                                                        full_http2_conn_streams = streams;
+                                                }
+                                                break;
+                                        }
+
+                                        if (streams < http2_conn_streams) {
+                                                http2_conn = conn;
+                                                http2_conn_streams = streams;
+                                        }
+                                        break;
+                                }
+                                if (!need_new_connection && !pipeline_conn && max_pipeline_depth > 1 &&
+                                    item->async && soup_connection_get_owner (conn) == g_thread_self () &&
+                                    soup_connection_can_pipeline (conn, msg, max_pipeline_depth))
+                                        pipeline_conn = conn;
                                 break;
                         case SOUP_CONNECTION_IDLE:
                                 if (!need_new_connection && soup_connection_is_idle_open (conn))
@@ -439,12 +766,44 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                                  * an h2 connection which will be shared. http/1.x connections
                                  * will only be slightly delayed. */
                                 if (force_http_version > SOUP_HTTP_1_1 && !need_new_connection && !item->connect_only && item->async && soup_connection_get_owner (conn) == g_thread_self ())
-                                        return NULL;
+                                        wait_for_connection = TRUE;
+                                break;
                         default:
                                 break;
                         }
                 }
 
+                /* Spread new streams over the HTTP/2 connections that
+                 * are below the peer's SETTINGS_MAX_CONCURRENT_STREAMS,
+                 * picking the least loaded one. When all of them are
+                 * full a new connection is opened if the host limit
+                 * allows it; otherwise async requests wait and sync
+                 * ones go over the limit on the least loaded one.
+                 */
+                if (http2_conn)
+                        return http2_conn;
+
+                if (wait_for_connection)
+                        return NULL;
+
+                /* No idle connection, but a busy HTTP/1.1 one can take
+                 * the request right away instead of opening another.
+                 */
+                if (pipeline_conn)
+                        return pipeline_conn;
+
+                if (!need_new_connection && force_http_version >= SOUP_HTTP_2_0) {
+                        gboolean resolving;
+
+                        conn = soup_connection_manager_get_coalesced_connection_locked (manager, host, item, &resolving);
+                        if (conn)
+                                return conn;
+
+                        /* Wait for the host to be resolved */
+                        if (resolving)
+                                return NULL;
+                }
+
                 if (host->num_conns >= manager->max_conns_per_host) {
                         if (need_new_connection && try_cleanup) {
                                 GList *conns;
@@ -463,6 +822,12 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                         if (item->async)
                                 return NULL;
 
+                        /* The streams filling the connection may belong to
+                         * this thread, which would then never be woken up.
+                         */
+                        if (full_http2_conn)
+                                return full_http2_conn;
+
                         g_cond_wait (&manager->cond, &manager->mutex);
                         try_cleanup = TRUE;
                         continue;
@@ -486,6 +851,9 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                         if (item->async)
                                 return NULL;
 
+                        if (full_http2_conn)
+                                return full_http2_conn;
+
                         g_cond_wait (&manager->cond, &manager->mutex);
                         try_cleanup = TRUE;
                         continue;
@@ -505,6 +873,9 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
                              "socket-properties", socket_props,
                              "force-http-version", force_http_version,
                              NULL);
+        soup_connection_set_http2_window_size_bounds (conn,
+                                                      manager->http2_min_window_size,
+                                                      manager->http2_max_window_size);
 
         g_signal_connect (conn, "disconnected",
                           G_CALLBACK (connection_disconnected),
@@ -512,6 +883,9 @@ soup_connection_manager_get_connection_locked (SoupConnectionManager *manager,
         g_signal_connect (conn, "notify::state",
                           G_CALLBACK (connection_state_changed),
                           manager);
+        g_signal_connect (conn, "stream-finished",
+                          G_CALLBACK (connection_stream_finished),
+                          manager);
 
         g_hash_table_insert (manager->conns, conn, host);
 
@@ -582,7 +956,8 @@ soup_connection_manager_steal_connection (SoupConnectionManager *manager,
         }
 
         g_mutex_lock (&manager->mutex);
-        host = soup_connection_manager_get_host_for_message (manager, msg);
+        /* The connection might belong to another host if it was coalesced */
+        host = g_hash_table_lookup (manager->conns, conn);
         g_hash_table_remove (manager->conns, conn);
         soup_host_remove_connection (host, conn);
         soup_connection_manager_drop_connection (manager, conn);
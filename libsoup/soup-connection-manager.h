@@ -22,6 +22,20 @@ guint                  soup_connection_manager_get_max_conns          (SoupConne
 void                   soup_connection_manager_set_max_conns_per_host (SoupConnectionManager *manager,
                                                                        guint                  max_conns_per_host);
 guint                  soup_connection_manager_get_max_conns_per_host (SoupConnectionManager *manager);
+void                   soup_connection_manager_set_max_pipeline_depth (SoupConnectionManager *manager,
+                                                                       guint                  max_pipeline_depth);
+guint                  soup_connection_manager_get_max_pipeline_depth (SoupConnectionManager *manager);
+void                   soup_connection_manager_set_host_max_pipeline_depth (SoupConnectionManager *manager,
+                                                                            const char            *hostname,
+                                                                            guint                  max_pipeline_depth);
+guint                  soup_connection_manager_get_host_max_pipeline_depth (SoupConnectionManager *manager,
+                                                                            const char            *hostname);
+void                   soup_connection_manager_set_http2_min_window_size (SoupConnectionManager *manager,
+                                                                          int                    window_size);
+int                    soup_connection_manager_get_http2_min_window_size (SoupConnectionManager *manager);
+void                   soup_connection_manager_set_http2_max_window_size (SoupConnectionManager *manager,
+                                                                          int                    window_size);
+int                    soup_connection_manager_get_http2_max_window_size (SoupConnectionManager *manager);
 void                   soup_connection_manager_set_remote_connectable (SoupConnectionManager *manager,
                                                                        GSocketConnectable    *connectable);
 GSocketConnectable    *soup_connection_manager_get_remote_connectable (SoupConnectionManager *manager);
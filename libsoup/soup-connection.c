@@ -12,6 +12,7 @@
 #include "soup-connection.h"
 #include "soup.h"
 #include "soup-io-stream.h"
+#include "soup-filter-input-stream.h"
 #include "soup-message-queue-item.h"
 #include "soup-client-message-io-http1.h"
 #include "soup-client-message-io-http2.h"
@@ -51,6 +52,7 @@ typedef struct {
 
         int window_size;
         int stream_window_size;
+        int max_window_size;
 } SoupConnectionPrivate;
 
 G_DEFINE_FINAL_TYPE_WITH_PRIVATE (SoupConnection, soup_connection, G_TYPE_OBJECT)
@@ -61,6 +63,7 @@ enum {
         REQUEST_CERTIFICATE,
         REQUEST_CERTIFICATE_PASSWORD,
 	DISCONNECTED,
+        STREAM_FINISHED,
 	LAST_SIGNAL
 };
 
@@ -94,8 +97,6 @@ static gboolean idle_timeout (gpointer conn);
  */
 #define SOUP_CONNECTION_UNUSED_TIMEOUT 3
 
-#define HTTP2_INITIAL_WINDOW_SIZE (15 * 1024 * 1024) /* 15MB */
-#define HTTP2_INITIAL_STREAM_WINDOW_SIZE (6 * 1024 * 1024) /* 6MB */
 
 static void
 soup_connection_init (SoupConnection *conn)
@@ -105,8 +106,9 @@ soup_connection_init (SoupConnection *conn)
         priv->http_version = SOUP_HTTP_1_1;
         priv->force_http_version = G_MAXUINT8;
         priv->owner = g_thread_self ();
-        priv->window_size = HTTP2_INITIAL_WINDOW_SIZE;
-        priv->stream_window_size = HTTP2_INITIAL_STREAM_WINDOW_SIZE;
+        soup_connection_set_http2_window_size_bounds (conn,
+                                                      SOUP_CONNECTION_HTTP2_MIN_WINDOW_SIZE,
+                                                      SOUP_CONNECTION_HTTP2_MAX_WINDOW_SIZE);
 }
 
 static void
@@ -304,6 +306,18 @@ soup_connection_class_init (SoupConnectionClass *connection_class)
 			      NULL, NULL,
 			      NULL,
 			      G_TYPE_NONE, 0);
+        /* Emitted when a stream of an HTTP/2 connection that is still
+         * in use by other streams finishes, since it doesn't change the
+         * connection state.
+         */
+        signals[STREAM_FINISHED] =
+                g_signal_new ("stream-finished",
+                              G_OBJECT_CLASS_TYPE (object_class),
+                              G_SIGNAL_RUN_FIRST,
+                              0,
+                              NULL, NULL,
+                              NULL,
+                              G_TYPE_NONE, 0);
 
 	/* properties */
         properties[PROP_REMOTE_CONNECTABLE] =
@@ -500,6 +514,8 @@ soup_connection_set_connection (SoupConnection *conn,
 	priv->connection = connection;
 	g_clear_object (&priv->iostream);
 	priv->iostream = soup_io_stream_new (G_IO_STREAM (priv->connection), FALSE);
+	soup_filter_input_stream_set_socket_properties (SOUP_FILTER_INPUT_STREAM (g_io_stream_get_input_stream (priv->iostream)),
+							priv->socket_props);
 }
 
 static void
@@ -1198,7 +1214,8 @@ soup_connection_set_in_use (SoupConnection *conn,
                         soup_connection_set_state (conn, SOUP_CONNECTION_IDLE);
                 else
                         soup_connection_disconnect (conn);
-        }
+        } else if (priv->http_version == SOUP_HTTP_2_0)
+                g_signal_emit (conn, signals[STREAM_FINISHED], 0);
 }
 
 SoupClientMessageIO *
@@ -1206,6 +1223,7 @@ soup_connection_setup_message_io (SoupConnection *conn,
                                   SoupMessage    *msg)
 {
         SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+        gboolean reusable;
 
         g_assert (g_atomic_int_get (&priv->state) == SOUP_CONNECTION_IN_USE);
 
@@ -1215,7 +1233,15 @@ soup_connection_setup_message_io (SoupConnection *conn,
         if (priv->proxy_uri && soup_message_get_method (msg) == SOUP_METHOD_CONNECT)
                 set_proxy_msg (conn, msg);
 
-        if (!soup_client_message_io_is_reusable (priv->io_data)) {
+        reusable = soup_client_message_io_is_reusable (priv->io_data);
+        if (!reusable && priv->http_version != SOUP_HTTP_2_0) {
+                /* An HTTP/1.1 connection reading a response can still
+                 * take the request if it was picked for pipelining.
+                 */
+                reusable = soup_client_message_io_http1_can_pipeline (priv->io_data, msg);
+        }
+
+        if (!reusable) {
                 /* The connection (typically a shared HTTP/2 session) failed
                  * during its handshake while another queue item was
                  * coalesced onto it via the CONNECTING fast-path in
@@ -1425,6 +1451,39 @@ soup_connection_get_owner (SoupConnection *conn)
         return priv->owner;
 }
 
+/* Whether @msg can be sent on @conn, which is in use, without waiting
+ * for the responses to the requests already sent on it.
+ */
+gboolean
+soup_connection_can_pipeline (SoupConnection *conn,
+                              SoupMessage    *msg,
+                              guint           max_depth)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        if (priv->http_version != SOUP_HTTP_1_1 || !priv->io_data || priv->proxy_msg)
+                return FALSE;
+
+        if (g_atomic_int_get (&priv->state) != SOUP_CONNECTION_IN_USE)
+                return FALSE;
+
+        if ((guint)g_atomic_int_get (&priv->in_use) >= max_depth)
+                return FALSE;
+
+        return soup_client_message_io_http1_can_pipeline (priv->io_data, msg);
+}
+
+gboolean
+soup_connection_get_pipeline_failed (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        if (priv->http_version == SOUP_HTTP_2_0 || !priv->io_data)
+                return FALSE;
+
+        return soup_client_message_io_http1_get_pipeline_failed (priv->io_data);
+}
+
 void
 soup_connection_set_http2_initial_window_size (SoupConnection *conn,
                                                int             window_size)
@@ -1458,3 +1517,77 @@ soup_connection_get_http2_initial_stream_window_size (SoupConnection *conn)
 
         return priv->stream_window_size;
 }
+
+/* Sets the initial HTTP/2 connection window to @min_window_size, and
+ * the initial stream window to 2/5 of it so that a single stream can't
+ * take the whole connection window. Both windows are scaled together
+ * by the window tuning, up to a connection window of @max_window_size.
+ */
+void
+soup_connection_set_http2_window_size_bounds (SoupConnection *conn,
+                                              int             min_window_size,
+                                              int             max_window_size)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        priv->window_size = min_window_size;
+        priv->stream_window_size = MAX (min_window_size / 5 * 2, 65535);
+        priv->max_window_size = MAX (max_window_size, min_window_size);
+}
+
+int
+soup_connection_get_http2_max_window_size (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        return priv->max_window_size;
+}
+
+/* Returns the current HTTP/2 connection window, which differs from the
+ * initial one once it has been tuned.
+ */
+int
+soup_connection_get_http2_window_size (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        if (priv->http_version != SOUP_HTTP_2_0 || !priv->io_data)
+                return priv->window_size;
+
+        return soup_client_message_io_http2_get_window_size (priv->io_data);
+}
+
+guint
+soup_connection_get_http2_ping_interval (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        return priv->socket_props->http2_ping_interval;
+}
+
+guint
+soup_connection_get_http2_active_streams (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        if (priv->http_version != SOUP_HTTP_2_0 || !priv->io_data)
+                return 0;
+
+        return soup_client_message_io_http2_get_active_streams (priv->io_data);
+}
+
+/* Returns whether a new request sent on the HTTP/2 connection @conn
+ * would stay within the peer's SETTINGS_MAX_CONCURRENT_STREAMS instead
+ * of being queued until another stream is closed.
+ */
+gboolean
+soup_connection_has_http2_stream_available (SoupConnection *conn)
+{
+        SoupConnectionPrivate *priv = soup_connection_get_instance_private (conn);
+
+        if (priv->http_version != SOUP_HTTP_2_0 || !priv->io_data)
+                return FALSE;
+
+        return soup_client_message_io_http2_get_active_streams (priv->io_data) <
+                soup_client_message_io_http2_get_max_concurrent_streams (priv->io_data);
+}
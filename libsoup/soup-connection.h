@@ -12,6 +12,13 @@
 
 G_BEGIN_DECLS
 
+/* Default bounds for the HTTP/2 connection flow-control window, which
+ * starts at the minimum and is tuned from the measured bandwidth-delay
+ * product.
+ */
+#define SOUP_CONNECTION_HTTP2_MIN_WINDOW_SIZE (1024 * 1024)
+#define SOUP_CONNECTION_HTTP2_MAX_WINDOW_SIZE (16 * 1024 * 1024)
+
 #define SOUP_TYPE_CONNECTION (soup_connection_get_type ())
 G_DECLARE_FINAL_TYPE (SoupConnection, soup_connection, SOUP, CONNECTION, GObject)
 
@@ -86,6 +93,10 @@ GSocketAddress      *soup_connection_get_remote_address         (SoupConnection
 SoupHTTPVersion      soup_connection_get_negotiated_protocol    (SoupConnection *conn);
 gboolean             soup_connection_is_reusable                (SoupConnection *conn);
 GThread             *soup_connection_get_owner                  (SoupConnection *conn);
+gboolean             soup_connection_can_pipeline               (SoupConnection *conn,
+                                                                 SoupMessage    *msg,
+                                                                 guint           max_depth);
+gboolean             soup_connection_get_pipeline_failed        (SoupConnection *conn);
 
 void soup_connection_set_http2_initial_window_size        (SoupConnection *conn,
                                                            int             window_size);
@@ -93,6 +104,14 @@ int  soup_connection_get_http2_initial_window_size        (SoupConnection *conn)
 void soup_connection_set_http2_initial_stream_window_size (SoupConnection *conn,
                                                            int             window_size);
 int  soup_connection_get_http2_initial_stream_window_size (SoupConnection *conn);
+void soup_connection_set_http2_window_size_bounds         (SoupConnection *conn,
+                                                           int             min_window_size,
+                                                           int             max_window_size);
+int  soup_connection_get_http2_max_window_size            (SoupConnection *conn);
+int  soup_connection_get_http2_window_size                (SoupConnection *conn);
+guint soup_connection_get_http2_ping_interval             (SoupConnection *conn);
+guint soup_connection_get_http2_active_streams            (SoupConnection *conn);
+gboolean soup_connection_has_http2_stream_available       (SoupConnection *conn);
 
 G_END_DECLS
 
@@ -25,6 +25,15 @@ G_BEGIN_DECLS
 
 gboolean        soup_date_time_is_past          (GDateTime      *date);
 
+/* "Sun, 06 Nov 1994 08:49:37 GMT" plus the trailing nul */
+#define SOUP_HTTP_DATE_SIZE 30
+
+gboolean        soup_date_time_parse_http_string (const char    *date_string,
+                                                  gint64        *unix_time);
+
+void            soup_date_time_format_http_unix  (gint64         unix_time,
+                                                  char           buf[SOUP_HTTP_DATE_SIZE]);
+
 G_END_DECLS
 
 
@@ -22,6 +22,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "soup-date-utils.h"
 #include "soup-date-utils-private.h"
@@ -120,6 +121,126 @@ soup_date_time_to_string (GDateTime      *date,
         g_return_val_if_reached (NULL);
 }
 
+/* Proleptic Gregorian calendar conversions between (@year, @month,
+ * @day) and days since 1970-01-01, so that the common formats can be
+ * handled without creating a #GDateTime.
+ */
+static gint64
+days_from_civil (int year, int month, int day)
+{
+	gint64 y = year - (month <= 2);
+	gint64 era = (y >= 0 ? y : y - 399) / 400;
+	gint64 yoe = y - era * 400;
+	gint64 doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	gint64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+static void
+civil_from_days (gint64 days, int *year, int *month, int *day)
+{
+	gint64 era, doe, yoe, doy, mp;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	doe = days - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = yoe + era * 400 + (*month <= 2);
+}
+
+/**
+ * soup_date_time_format_http_unix:
+ * @unix_time: seconds since the Unix epoch
+ * @buf: buffer to write the date to
+ *
+ * Formats @unix_time in the same format as [func@date_time_to_string]
+ * with %SOUP_DATE_HTTP, without allocating.
+ */
+void
+soup_date_time_format_http_unix (gint64 unix_time,
+                                 char   buf[SOUP_HTTP_DATE_SIZE])
+{
+	gint64 n_days, secs;
+	int year, month, day;
+
+	n_days = unix_time / 86400;
+	secs = unix_time % 86400;
+	if (secs < 0) {
+		secs += 86400;
+		n_days--;
+	}
+	civil_from_days (n_days, &year, &month, &day);
+
+	/* 1970-01-01 was a Thursday */
+	g_snprintf (buf, SOUP_HTTP_DATE_SIZE, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+		    days[((n_days % 7) + 10) % 7], day, months[month - 1],
+		    CLAMP (year, 0, 9999), (int)(secs / 3600),
+		    (int)(secs / 60 % 60), (int)(secs % 60));
+}
+
+static inline int
+parse_two_digits (const char *p)
+{
+	if (!g_ascii_isdigit (p[0]) || !g_ascii_isdigit (p[1]))
+		return -1;
+	return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/* Parses the preferred RFC 9110 IMF-fixdate format
+ * ("Sun, 06 Nov 1994 08:49:37 GMT") exactly. Anything else is left to
+ * the lenient parser.
+ */
+static gboolean
+parse_imf_fixdate (const char *date_string, gint64 *unix_time)
+{
+	const char *p = date_string;
+	int day, month, century, year, hour, minute, second, i;
+
+	for (i = 0; i < SOUP_HTTP_DATE_SIZE - 1; i++) {
+		if (!p[i])
+			return FALSE;
+	}
+	if (p[SOUP_HTTP_DATE_SIZE - 1])
+		return FALSE;
+
+	if (!g_ascii_isalpha (p[0]) || !g_ascii_isalpha (p[1]) || !g_ascii_isalpha (p[2]) ||
+	    p[3] != ',' || p[4] != ' ' || p[7] != ' ' || p[11] != ' ' || p[16] != ' ' ||
+	    p[19] != ':' || p[22] != ':' || p[25] != ' ' || strcmp (p + 26, "GMT") != 0)
+		return FALSE;
+
+	for (month = 0; month < G_N_ELEMENTS (months); month++) {
+		if (!strncmp (p + 8, months[month], 3))
+			break;
+	}
+	if (month == G_N_ELEMENTS (months))
+		return FALSE;
+	month++;
+
+	day = parse_two_digits (p + 5);
+	century = parse_two_digits (p + 12);
+	year = parse_two_digits (p + 14);
+	hour = parse_two_digits (p + 17);
+	minute = parse_two_digits (p + 20);
+	second = parse_two_digits (p + 23);
+	if (day < 0 || century < 0 || year < 0 || hour < 0 || minute < 0 || second < 0)
+		return FALSE;
+	year += century * 100;
+
+	/* Same range as parse_year() */
+	if (year >= 9999 || !g_date_valid_dmy (day, month, year) ||
+	    hour >= 24 || minute >= 60 || second >= 60)
+		return FALSE;
+
+	*unix_time = days_from_civil (year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	return TRUE;
+}
+
 static inline gboolean
 parse_day (int *day, const char **date_string)
 {
@@ -320,6 +441,8 @@ parse_textual_date (const char *date_string)
 GDateTime *
 soup_date_time_new_from_http_string (const char *date_string)
 {
+        gint64 unix_time;
+
         g_return_val_if_fail (date_string != NULL, NULL);
 
 	while (g_ascii_isspace (*date_string))
@@ -338,5 +461,40 @@ soup_date_time_new_from_http_string (const char *date_string)
                 return NULL;
         }
 
+        if (parse_imf_fixdate (date_string, &unix_time))
+                return g_date_time_new_from_unix_utc (unix_time);
+
 	return parse_textual_date (date_string);
 }
+
+/**
+ * soup_date_time_parse_http_string:
+ * @date_string: The date as a string
+ * @unix_time: (out): return location for the date, in seconds since the
+ *   Unix epoch
+ *
+ * Like [func@date_time_new_from_http_string], but returns the date as
+ * a Unix time. Dates in the IMF-fixdate format, which is what servers
+ * are required to send, are parsed without any allocation.
+ *
+ * Returns: %TRUE if @date_string could be parsed
+ */
+gboolean
+soup_date_time_parse_http_string (const char *date_string,
+                                  gint64     *unix_time)
+{
+        GDateTime *date;
+
+        g_return_val_if_fail (date_string != NULL, FALSE);
+
+        if (parse_imf_fixdate (date_string, unix_time))
+                return TRUE;
+
+        date = soup_date_time_new_from_http_string (date_string);
+        if (!date)
+                return FALSE;
+
+        *unix_time = g_date_time_to_unix (date);
+        g_date_time_unref (date);
+        return TRUE;
+}
@@ -12,6 +12,7 @@
 #include <string.h>
 
 #include "soup-filter-input-stream.h"
+#include "soup-socket-properties.h"
 #include "soup.h"
 
 /* This is essentially a subset of GDataInputStream, except that we
@@ -20,12 +21,32 @@
  * via fill_async(), but that would be more work...)
  */
 
+/* Buffered data lives at buf[buf_start, buf_start + buf_len). Reads
+ * just advance buf_start, the data is only moved to the front when
+ * read_until() needs more contiguous room than what is left at the
+ * end of the allocation.
+ */
 typedef struct {
-	GByteArray *buf;
+	guint8 *buf;
+	gsize buf_size;
+	gsize buf_start;
+	gsize buf_len;
 	gboolean need_more;
 	gboolean in_read_until;
+
+	/* Adaptive read size, see soup_filter_input_stream_get_read_size() */
+	gsize read_size;
+	gsize read_size_min;
+	gsize read_size_max;
+	gint64 last_read_time;
+
+	guint64 n_reads;
+	guint64 n_bytes;
 } SoupFilterInputStreamPrivate;
 
+/* Time without reads after which the read size goes back to the minimum */
+#define READ_SIZE_IDLE_TIMEOUT G_USEC_PER_SEC
+
 enum {
         READ_DATA,
 
@@ -44,6 +65,11 @@ G_DEFINE_TYPE_WITH_CODE (SoupFilterInputStream, soup_filter_input_stream, G_TYPE
 static void
 soup_filter_input_stream_init (SoupFilterInputStream *stream)
 {
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (stream);
+
+	priv->read_size_min = SOUP_FILTER_INPUT_STREAM_READ_SIZE_MIN;
+	priv->read_size_max = SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX;
+	priv->read_size = priv->read_size_min;
 }
 
 static void
@@ -52,30 +78,51 @@ soup_filter_input_stream_finalize (GObject *object)
 	SoupFilterInputStream *fstream = SOUP_FILTER_INPUT_STREAM (object);
         SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
 
-	g_clear_pointer (&priv->buf, g_byte_array_unref);
+	g_free (priv->buf);
 
 	G_OBJECT_CLASS (soup_filter_input_stream_parent_class)->finalize (object);
 }
 
+/* Called for every read that reaches the base stream. The read size
+ * doubles each time a read fills the whole buffer, which means more
+ * data was already waiting, and halves when the base stream returns
+ * much less than what was asked for.
+ */
+static void
+note_base_read (SoupFilterInputStream *fstream,
+                gsize                  requested,
+                gsize                  nread)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+	gint64 now = g_get_monotonic_time ();
+
+	priv->n_reads++;
+	priv->n_bytes += nread;
+
+	if (priv->last_read_time && now - priv->last_read_time > READ_SIZE_IDLE_TIMEOUT)
+		priv->read_size = priv->read_size_min;
+	else if (nread == requested && requested >= priv->read_size)
+		priv->read_size = MIN (priv->read_size * 2, priv->read_size_max);
+	else if (nread < requested && nread < priv->read_size / 4)
+		priv->read_size = MAX (priv->read_size / 2, priv->read_size_min);
+	priv->last_read_time = now;
+}
+
 static gssize
 read_from_buf (SoupFilterInputStream *fstream, gpointer buffer, gsize count)
 {
         SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
-	GByteArray *buf = priv->buf;
 
-	if (buf->len < count)
-		count = buf->len;
+	if (priv->buf_len < count)
+		count = priv->buf_len;
 	if (buffer)
-	        memcpy (buffer, buf->data, count);
-
-	if (count == buf->len) {
-		g_byte_array_free (buf, TRUE);
-		priv->buf = NULL;
-	} else {
-		memmove (buf->data, buf->data + count,
-			 buf->len - count);
-		g_byte_array_set_size (buf, buf->len - count);
-	}
+	        memcpy (buffer, priv->buf + priv->buf_start, count);
+
+	priv->buf_len -= count;
+	if (priv->buf_len == 0)
+		priv->buf_start = 0;
+	else
+		priv->buf_start += count;
 
 	return count;
 }
@@ -97,14 +144,16 @@ soup_filter_input_stream_read_fn (GInputStream  *stream,
 	if (!priv->in_read_until)
 		priv->need_more = FALSE;
 
-	if (priv->buf && !priv->in_read_until)
+	if (priv->buf_len && !priv->in_read_until)
 		return read_from_buf (fstream, buffer, count);
 
         bytes_read = g_pollable_stream_read (G_FILTER_INPUT_STREAM (fstream)->base_stream,
                                              buffer, count,
                                              TRUE, cancellable, error);
-        if (bytes_read > 0)
+        if (bytes_read > 0) {
+                note_base_read (fstream, count, bytes_read);
                 g_signal_emit (fstream, signals[READ_DATA], 0, bytes_read);
+        }
 
         return bytes_read;
 }
@@ -125,7 +174,7 @@ soup_filter_input_stream_skip (GInputStream  *stream,
         if (!priv->in_read_until)
                 priv->need_more = FALSE;
 
-        if (priv->buf && !priv->in_read_until)
+        if (priv->buf_len && !priv->in_read_until)
                 return read_from_buf (fstream, NULL, count);
 
         bytes_skipped = g_input_stream_skip (G_FILTER_INPUT_STREAM (fstream)->base_stream,
@@ -142,7 +191,7 @@ soup_filter_input_stream_is_readable (GPollableInputStream *stream)
 	SoupFilterInputStream *fstream = SOUP_FILTER_INPUT_STREAM (stream);
         SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
 
-	if (priv->buf && !priv->need_more)
+	if (priv->buf_len && !priv->need_more)
 		return TRUE;
 	else
 		return g_pollable_input_stream_is_readable (G_POLLABLE_INPUT_STREAM (G_FILTER_INPUT_STREAM (fstream)->base_stream));
@@ -161,14 +210,16 @@ soup_filter_input_stream_read_nonblocking (GPollableInputStream  *stream,
 	if (!priv->in_read_until)
 		priv->need_more = FALSE;
 
-	if (priv->buf && !priv->in_read_until)
+	if (priv->buf_len && !priv->in_read_until)
 		return read_from_buf (fstream, buffer, count);
 
         bytes_read = g_pollable_stream_read (G_FILTER_INPUT_STREAM (fstream)->base_stream,
                                              buffer, count,
                                              FALSE, NULL, error);
-        if (bytes_read > 0)
+        if (bytes_read > 0) {
+                note_base_read (fstream, count, bytes_read);
                 g_signal_emit (fstream, signals[READ_DATA], 0, bytes_read);
+        }
 
         return bytes_read;
 }
@@ -181,7 +232,7 @@ soup_filter_input_stream_create_source (GPollableInputStream *stream,
         SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
 	GSource *base_source, *pollable_source;
 
-	if (priv->buf && !priv->need_more)
+	if (priv->buf_len && !priv->need_more)
 		base_source = g_timeout_source_new (0);
 	else
 		base_source = g_pollable_input_stream_create_source (G_POLLABLE_INPUT_STREAM (G_FILTER_INPUT_STREAM (fstream)->base_stream), cancellable);
@@ -250,6 +301,53 @@ soup_filter_input_stream_read_line (SoupFilterInputStream  *fstream,
 						    cancellable, error);
 }
 
+/* Makes room for @length contiguous bytes starting at the buffered
+ * data and returns a pointer to it.
+ */
+static guint8 *
+ensure_buffer_space (SoupFilterInputStream *fstream,
+                     gsize                  length)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+
+	if (priv->buf_start + length > priv->buf_size) {
+		if (priv->buf_len)
+			memmove (priv->buf, priv->buf + priv->buf_start, priv->buf_len);
+		priv->buf_start = 0;
+		if (priv->buf_size < length) {
+			priv->buf = g_realloc (priv->buf, length);
+			priv->buf_size = length;
+		}
+	}
+
+	return priv->buf + priv->buf_start;
+}
+
+static guint8 *
+find_boundary (guint8       *buf,
+               gsize         len,
+               const guint8 *boundary,
+               gsize         boundary_length)
+{
+	guint8 *p, *last;
+
+	if (len < boundary_length)
+		return NULL;
+
+	p = buf;
+	last = buf + len - boundary_length;
+	while (p <= last) {
+		p = memchr (p, boundary[0], last - p + 1);
+		if (!p)
+			return NULL;
+		if (!memcmp (p + 1, boundary + 1, boundary_length - 1))
+			return p;
+		p++;
+	}
+
+	return NULL;
+}
+
 gssize
 soup_filter_input_stream_read_until (SoupFilterInputStream  *fstream,
 				     void                   *buffer,
@@ -264,40 +362,33 @@ soup_filter_input_stream_read_until (SoupFilterInputStream  *fstream,
 {
         SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
 	gssize nread, read_length;
-	guint8 *p, *buf, *end;
+	guint8 *p, *buf;
+	gsize scan_length, fill_length;
 	gboolean eof = FALSE;
 	GError *my_error = NULL;
 
 	g_return_val_if_fail (SOUP_IS_FILTER_INPUT_STREAM (fstream), -1);
+	g_return_val_if_fail (boundary_length > 0, -1);
 	g_return_val_if_fail (!include_boundary || (boundary_length < length), -1);
 
 	*got_boundary = FALSE;
 	priv->need_more = FALSE;
 
-	if (!priv->buf || priv->buf->len < boundary_length) {
-		guint prev_len;
+	if (priv->buf_len < boundary_length) {
+		gsize prev_len;
 
 	fill_buffer:
-		if (!priv->buf)
-			priv->buf = g_byte_array_new ();
-		prev_len = priv->buf->len;
-		g_byte_array_set_size (priv->buf, length);
-		buf = priv->buf->data;
+		prev_len = priv->buf_len;
+		fill_length = MAX (length, soup_filter_input_stream_get_read_size (fstream));
+		buf = ensure_buffer_space (fstream, fill_length);
 
 		priv->in_read_until = TRUE;
 		nread = g_pollable_stream_read (G_INPUT_STREAM (fstream),
-						buf + prev_len, length - prev_len,
+						buf + prev_len, fill_length - prev_len,
 						blocking,
 						cancellable, &my_error);
 		priv->in_read_until = FALSE;
 		if (nread <= 0) {
-			if (prev_len)
-				priv->buf->len = prev_len;
-			else {
-				g_byte_array_free (priv->buf, TRUE);
-				priv->buf = NULL;
-			}
-
 			if (nread == 0 && prev_len)
 				eof = TRUE;
 			else {
@@ -312,32 +403,155 @@ soup_filter_input_stream_read_until (SoupFilterInputStream  *fstream,
 			if (my_error)
 				g_propagate_error (error, my_error);
 		} else
-			priv->buf->len = prev_len + nread;
+			priv->buf_len = prev_len + nread;
 	} else
-		buf = priv->buf->data;
-
-	/* Scan for the boundary within the range we can possibly return. */
-	if (include_boundary)
-		end = buf + MIN (priv->buf->len, length) - boundary_length;
-	else
-		end = buf + MIN (priv->buf->len - boundary_length, length);
-	for (p = buf; p <= end; p++) {
-		if (*p == *(guint8*)boundary &&
-		    !memcmp (p, boundary, boundary_length)) {
-			if (include_boundary)
-				p += boundary_length;
-			*got_boundary = TRUE;
-			break;
-		}
-	}
-
-	if (!*got_boundary && priv->buf->len < length && !eof)
+		buf = priv->buf + priv->buf_start;
+
+	/* Scan for the boundary within the range we can possibly
+	 * return; without include_boundary the boundary itself may
+	 * extend past @length.
+	 */
+	scan_length = MIN (priv->buf_len, include_boundary ? length : length + boundary_length);
+	p = find_boundary (buf, scan_length, boundary, boundary_length);
+	if (p) {
+		if (include_boundary)
+			p += boundary_length;
+		*got_boundary = TRUE;
+	} else if (priv->buf_len < length && !eof)
 		goto fill_buffer;
+	else if (scan_length >= boundary_length) {
+		/* Hold back anything that could be the start of a
+		 * boundary split across reads.
+		 */
+		p = buf + scan_length - boundary_length + 1;
+	} else
+		p = buf;
 
 	if (eof && !*got_boundary)
-		read_length = MIN (priv->buf->len, length);
+		read_length = MIN (priv->buf_len, length);
 	else
                 read_length = MIN ((gsize)(p - buf), length);
 
 	return read_from_buf (fstream, buffer, read_length);
 }
+
+/* Reads up to @length bytes from the base stream and appends them to
+ * the buffered data, to be picked up with
+ * soup_filter_input_stream_peek_buffer() or regular reads.
+ */
+gssize
+soup_filter_input_stream_fill (SoupFilterInputStream  *fstream,
+                               gsize                   length,
+                               gboolean                blocking,
+                               GCancellable           *cancellable,
+                               GError                **error)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+	GError *my_error = NULL;
+	guint8 *buf;
+	gssize nread;
+
+	g_return_val_if_fail (SOUP_IS_FILTER_INPUT_STREAM (fstream), -1);
+
+	priv->need_more = FALSE;
+	buf = ensure_buffer_space (fstream, priv->buf_len + length);
+
+	priv->in_read_until = TRUE;
+	nread = g_pollable_stream_read (G_INPUT_STREAM (fstream),
+					buf + priv->buf_len, length,
+					blocking,
+					cancellable, &my_error);
+	priv->in_read_until = FALSE;
+	if (nread > 0)
+		priv->buf_len += nread;
+	else if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+		priv->need_more = TRUE;
+
+	if (my_error)
+		g_propagate_error (error, my_error);
+
+	return nread;
+}
+
+/* Returns the data that has already been read from the base stream
+ * but not returned yet, without copying it. It stays valid until the
+ * next read from or consume on @fstream.
+ */
+const guint8 *
+soup_filter_input_stream_peek_buffer (SoupFilterInputStream *fstream,
+                                      gsize                 *length)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+
+        *length = priv->buf_len;
+        return priv->buf_len ? priv->buf + priv->buf_start : NULL;
+}
+
+/* Drops @count bytes returned by soup_filter_input_stream_peek_buffer() */
+void
+soup_filter_input_stream_consume (SoupFilterInputStream *fstream,
+                                  gsize                  count)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+
+        g_return_if_fail (count <= priv->buf_len);
+
+        priv->need_more = FALSE;
+        read_from_buf (fstream, NULL, count);
+}
+
+/* Sets the bounds for the adaptive read size from @props */
+void
+soup_filter_input_stream_set_socket_properties (SoupFilterInputStream *fstream,
+                                                SoupSocketProperties  *props)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+
+        priv->read_size_min = props->read_buffer_min_size;
+        priv->read_size_max = MAX (props->read_buffer_max_size, priv->read_size_min);
+        priv->read_size = CLAMP (priv->read_size, priv->read_size_min, priv->read_size_max);
+}
+
+/* Returns how much to ask the base stream for when reading ahead. It
+ * grows while the peer keeps the connection saturated and goes back
+ * to the minimum after a second without reads. The buffer is kept
+ * across reads, but one grown for a burst of data is released at that
+ * point too, so idle keep-alive connections don't hold on to it.
+ */
+gsize
+soup_filter_input_stream_get_read_size (SoupFilterInputStream *fstream)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+
+        if (g_get_monotonic_time () - priv->last_read_time <= READ_SIZE_IDLE_TIMEOUT)
+                return priv->read_size;
+
+        priv->read_size = priv->read_size_min;
+        if (priv->buf_len == 0 && priv->buf_size > priv->read_size_min) {
+                g_clear_pointer (&priv->buf, g_free);
+                priv->buf_size = 0;
+        }
+
+        return priv->read_size;
+}
+
+void
+soup_filter_input_stream_get_read_stats (SoupFilterInputStream *fstream,
+                                         guint64               *n_reads,
+                                         guint64               *n_bytes)
+{
+        SoupFilterInputStreamPrivate *priv = soup_filter_input_stream_get_instance_private (fstream);
+
+        *n_reads = priv->n_reads;
+        *n_bytes = priv->n_bytes;
+}
+
+/* Reports @count bytes that were taken from the base stream without
+ * going through @fstream, e.g. with splice(2).
+ */
+void
+soup_filter_input_stream_notify_read_data (SoupFilterInputStream *fstream,
+                                           gsize                  count)
+{
+        g_signal_emit (fstream, signals[READ_DATA], 0, (guint)count);
+}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "soup-types.h"
+#include "soup-socket-properties.h"
 
 G_BEGIN_DECLS
 
@@ -16,6 +17,10 @@ struct _SoupFilterInputStreamClass {
 	GFilterInputStreamClass parent_class;
 };
 
+/* Default bounds for soup_filter_input_stream_get_read_size() */
+#define SOUP_FILTER_INPUT_STREAM_READ_SIZE_MIN (8 * 1024)
+#define SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX (256 * 1024)
+
 GInputStream *soup_filter_input_stream_new        (GInputStream           *base_stream);
 
 gssize        soup_filter_input_stream_read_line  (SoupFilterInputStream  *fstream,
@@ -36,4 +41,23 @@ gssize        soup_filter_input_stream_read_until (SoupFilterInputStream  *fstre
 						   GCancellable           *cancellable,
 						   GError                **error);
 
+gssize        soup_filter_input_stream_fill        (SoupFilterInputStream  *fstream,
+						    gsize                   length,
+						    gboolean                blocking,
+						    GCancellable           *cancellable,
+						    GError                **error);
+const guint8 *soup_filter_input_stream_peek_buffer (SoupFilterInputStream  *fstream,
+						    gsize                  *length);
+void          soup_filter_input_stream_consume     (SoupFilterInputStream  *fstream,
+						    gsize                   count);
+
+void          soup_filter_input_stream_set_socket_properties (SoupFilterInputStream *fstream,
+							      SoupSocketProperties  *props);
+gsize         soup_filter_input_stream_get_read_size         (SoupFilterInputStream *fstream);
+void          soup_filter_input_stream_get_read_stats        (SoupFilterInputStream *fstream,
+							      guint64               *n_reads,
+							      guint64               *n_bytes);
+void          soup_filter_input_stream_notify_read_data      (SoupFilterInputStream *fstream,
+							      gsize                  count);
+
 G_END_DECLS
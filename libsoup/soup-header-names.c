@@ -689,6 +689,15 @@ SoupHeaderName soup_header_name_from_string (const char *str)
         return entry ? entry->header_name : SOUP_HEADER_UNKNOWN;
 }
 
+SoupHeaderName soup_header_name_from_string_len (const char *str,
+                                                 size_t      len)
+{
+        const struct SoupHeaderHashEntry *entry;
+
+        entry = soup_header_name_find (str, len);
+        return entry ? entry->header_name : SOUP_HEADER_UNKNOWN;
+}
+
 const char *soup_header_name_to_string (SoupHeaderName name)
 {
         if (name == SOUP_HEADER_UNKNOWN)
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 typedef enum {
         SOUP_HEADER_ACCEPT,
         SOUP_HEADER_ACCEPT_CHARSET,
@@ -94,5 +96,7 @@ typedef enum {
         SOUP_HEADER_UNKNOWN
 } SoupHeaderName;
 
-SoupHeaderName soup_header_name_from_string (const char    *str);
-const char    *soup_header_name_to_string   (SoupHeaderName name);
+SoupHeaderName soup_header_name_from_string     (const char    *str);
+SoupHeaderName soup_header_name_from_string_len (const char    *str,
+                                                 size_t         len);
+const char    *soup_header_name_to_string       (SoupHeaderName name);
@@ -17,6 +17,18 @@
 #include "soup-message-headers-private.h"
 #include "soup.h"
 
+static inline gboolean
+is_lws (char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline gboolean
+is_trailing_ws (char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
 /**
  * soup_headers_parse:
  * @str: the header string (including the Request-Line or Status-Line,
@@ -37,10 +49,9 @@
 gboolean
 soup_headers_parse (const char *str, int len, SoupMessageHeaders *dest)
 {
-	const char *headers_start;
-	char *headers_copy, *name, *name_end, *value, *value_end;
-	char *eol, *sol, *p;
-	gsize copy_len;
+	const char *end, *line, *eol, *name_end, *value, *value_end, *p;
+	char *buf, *name, *out, *out_value, *cr;
+	guint n_headers = 0;
 	gboolean success = FALSE;
 
 	g_return_val_if_fail (str != NULL, FALSE);
@@ -59,96 +70,114 @@ soup_headers_parse (const char *str, int len, SoupMessageHeaders *dest)
 		return FALSE;
 
 	/* Skip over the Request-Line / Status-Line */
-	headers_start = memchr (str, '\n', len);
-	if (!headers_start)
+	end = str + len;
+	line = memchr (str, '\n', len);
+	if (!line)
 		return FALSE;
-
-	/* We work on a copy of the headers, which we can write '\0's
-	 * into, so that we don't have to individually g_strndup and
-	 * then g_free each header name and value.
+	line++;
+
+	/* The headers are scanned in a single pass over @str, using
+	 * memchr() (which the C library vectorizes) to find the line
+	 * and field delimiters. Each header's name and unfolded value
+	 * are written one after the other as C strings into a single
+	 * buffer; unfolding never makes a header longer than it was on
+	 * the wire, so the remaining length of @str is always enough.
+	 * The buffer is then handed over to @dest, which keeps
+	 * pointing into it instead of copying every name and value.
 	 */
-	copy_len = len - (headers_start - str);
-	headers_copy = g_malloc (copy_len + 1);
-	memcpy (headers_copy, headers_start, copy_len);
-	headers_copy[copy_len] = '\0';
-	value_end = headers_copy;
+	buf = out = g_malloc (end - line + 1);
 
-	while (*(value_end + 1)) {
-		name = value_end + 1;
-		name_end = strchr (name, ':');
+	while (line < end) {
+		eol = memchr (line, '\n', end - line);
+		if (!eol)
+			goto done;
 
 		/* Reject if there is no ':', or the header name is
 		 * empty, or it contains whitespace.
 		 */
-		if (!name_end ||
-		    name_end == name ||
-		    name + strcspn (name, " \t\r\n") < name_end) {
+		name_end = memchr (line, ':', eol - line);
+		for (p = line; name_end && p < name_end; p++) {
+			if (is_trailing_ws (*p))
+				break;
+		}
+		if (!name_end || name_end == line || p != name_end) {
 			/* Ignore this line. Note that if it has
 			 * continuation lines, we'll end up ignoring
 			 * them too since they'll start with spaces.
 			 */
-			value_end = strchr (name, '\n');
-			if (!value_end)
-				goto done;
+			line = eol + 1;
 			continue;
 		}
 
 		/* Find the end of the value; ie, an end-of-line that
 		 * isn't followed by a continuation line.
 		 */
-		value = name_end + 1;
-		value_end = strchr (name, '\n');
-		if (!value_end)
-			goto done;
-		while (*(value_end + 1) == ' ' || *(value_end + 1) == '\t') {
-			value_end = strchr (value_end + 1, '\n');
+		value_end = eol;
+		while (value_end + 1 < end && is_lws (value_end[1])) {
+			value_end = memchr (value_end + 1, '\n', end - value_end - 1);
 			if (!value_end)
 				goto done;
 		}
 
-		*name_end = '\0';
-		*value_end = '\0';
+		name = out;
+		memcpy (name, line, name_end - line);
+		name[name_end - line] = '\0';
+		out = out_value = name + (name_end - line) + 1;
 
 		/* Skip leading whitespace */
+		value = name_end + 1;
 		while (value < value_end &&
-		       (*value == ' ' || *value == '\t' ||
-			*value == '\r' || *value == '\n'))
+		       (is_trailing_ws (*value) || *value == '\n'))
 			value++;
 
-		/* Collapse continuation lines */
-		while ((eol = strchr (value, '\n'))) {
-			/* find start of next line */
-			sol = eol + 1;
-			while (*sol == ' ' || *sol == '\t')
-				sol++;
+		/* Copy the value, collapsing each continuation line
+		 * (and the whitespace around it) into a single SP.
+		 */
+		while (value < value_end) {
+			eol = memchr (value, '\n', value_end - value);
+			if (!eol)
+				eol = value_end;
+
+			memcpy (out, value, eol - value);
+			out += eol - value;
+			if (eol == value_end)
+				break;
 
 			/* back up over trailing whitespace on current line */
-			while (eol[-1] == ' ' || eol[-1] == '\t' || eol[-1] == '\r')
-				eol--;
+			while (out > out_value && is_trailing_ws (out[-1]))
+				out--;
+			*out++ = ' ';
 
-			/* Delete all but one SP */
-			*eol = ' ';
-			memmove (eol + 1, sol, strlen (sol) + 1);
+			/* find start of next line */
+			value = eol + 1;
+			while (value < value_end && is_lws (*value))
+				value++;
 		}
 
 		/* clip trailing whitespace */
-		eol = strchr (value, '\0');
-		while (eol > value &&
-		       (eol[-1] == ' ' || eol[-1] == '\t' || eol[-1] == '\r'))
-			eol--;
-		*eol = '\0';
+		while (out > out_value && is_trailing_ws (out[-1]))
+			out--;
+		*out = '\0';
 
 		/* convert (illegal) '\r's to spaces */
-		for (p = strchr (value, '\r'); p; p = strchr (p, '\r'))
-			*p = ' ';
+		for (cr = memchr (out_value, '\r', out - out_value); cr;
+		     cr = memchr (cr, '\r', out - cr))
+			*cr = ' ';
 
-		if (!soup_message_headers_append_untrusted_data (dest, name, value))
+		if (!soup_message_headers_append_untrusted_arena_data (dest, name, out_value))
                         goto done;
+		n_headers++;
+
+		out++;
+		line = value_end + 1;
         }
 	success = TRUE;
 
 done:
-	g_free (headers_copy);
+	if (n_headers > 0)
+		soup_message_headers_take_arena_block (dest, buf);
+	else
+		g_free (buf);
 	return success;
 }
 
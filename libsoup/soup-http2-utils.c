@@ -5,6 +5,7 @@
 #include <glib.h>
 
 #include "soup-http2-utils.h"
+#include "soup-message-headers-private.h"
 
 const char *
 soup_http2_io_state_to_string (SoupHTTP2IOState state)
@@ -103,6 +104,76 @@ debug_nghttp2 (const char *format,
         g_free (message);
 }
 
+/*
+ * Appends a header received in a HEADERS frame to @hdrs.
+ *
+ * nghttp2 has already checked that @name is a lowercase token and that
+ * @value contains no CR, LF or NUL, so known header names are mapped to
+ * their #SoupHeaderName straight from the length-delimited buffer and
+ * appended as common headers, skipping the name validation and second
+ * name lookup of soup_message_headers_append_untrusted_data().
+ */
+gboolean
+soup_http2_message_headers_append (SoupMessageHeaders *hdrs,
+                                   nghttp2_rcbuf      *name,
+                                   nghttp2_rcbuf      *value)
+{
+        nghttp2_vec name_buf = nghttp2_rcbuf_get_buf (name);
+        nghttp2_vec value_buf = nghttp2_rcbuf_get_buf (value);
+        SoupHeaderName header_name;
+
+        header_name = soup_header_name_from_string_len ((const char *)name_buf.base, name_buf.len);
+        if (header_name == SOUP_HEADER_UNKNOWN ||
+            !g_utf8_validate_len ((const char *)value_buf.base, value_buf.len, NULL)) {
+                return soup_message_headers_append_untrusted_data (hdrs,
+                                                                   (const char *)name_buf.base,
+                                                                   (const char *)value_buf.base);
+        }
+
+        return soup_message_headers_append_common (hdrs, header_name,
+                                                   (const char *)value_buf.base,
+                                                   SOUP_HEADER_VALUE_TRUSTED);
+}
+
+static gboolean
+dispatch_source_dispatch (GSource    *source,
+                          GSourceFunc callback,
+                          gpointer    user_data)
+{
+        g_source_set_ready_time (source, -1);
+
+        return callback (user_data);
+}
+
+static GSourceFuncs dispatch_source_funcs = {
+        NULL,
+        NULL,
+        dispatch_source_dispatch,
+        NULL,
+        NULL, NULL
+};
+
+/* A source that stays attached for the lifetime of a connection and
+ * is scheduled with g_source_set_ready_time (source, 0), so that all
+ * the work requested during a main loop iteration is done by a single
+ * dispatch instead of one idle source each time.
+ */
+GSource *
+soup_http2_dispatch_source_new (const char  *name,
+                                int          priority,
+                                GSourceFunc  callback,
+                                gpointer     user_data)
+{
+        GSource *source;
+
+        source = g_source_new (&dispatch_source_funcs, sizeof (GSource));
+        g_source_set_static_name (source, name);
+        g_source_set_priority (source, priority);
+        g_source_set_callback (source, callback, user_data, NULL);
+
+        return source;
+}
+
 void
 soup_http2_debug_init (void)
 {
@@ -6,6 +6,8 @@
 
 #include <nghttp2/nghttp2.h>
 
+#include "soup-message-headers.h"
+
 #define NGCHECK(stm)                                                                             \
         G_STMT_START {                                                                           \
                 int return_code = stm;                                                           \
@@ -47,3 +49,12 @@ const char *soup_http2_frame_type_to_string (nghttp2_frame_type type);
 const char *soup_http2_headers_category_to_string (nghttp2_headers_category catergory);
 
 void soup_http2_debug_init (void);
+
+GSource *soup_http2_dispatch_source_new (const char  *name,
+                                         int          priority,
+                                         GSourceFunc  callback,
+                                         gpointer     user_data);
+
+gboolean soup_http2_message_headers_append (SoupMessageHeaders *hdrs,
+                                            nghttp2_rcbuf      *name,
+                                            nghttp2_rcbuf      *value);
@@ -20,6 +20,11 @@ typedef enum {
 gboolean    soup_message_headers_append_untrusted_data  (SoupMessageHeaders *hdrs,
                                                          const char         *name,
                                                          const char         *value);
+gboolean    soup_message_headers_append_untrusted_arena_data (SoupMessageHeaders *hdrs,
+                                                              const char         *name,
+                                                              const char         *value);
+void        soup_message_headers_take_arena_block       (SoupMessageHeaders *hdrs,
+                                                         char               *block);
 gboolean    soup_message_headers_append_common          (SoupMessageHeaders *hdrs,
                                                          SoupHeaderName      name,
                                                          const char         *value,
@@ -40,5 +45,10 @@ gboolean    soup_message_headers_header_contains_common (SoupMessageHeaders *hdr
 gboolean    soup_message_headers_header_equals_common   (SoupMessageHeaders *hdrs,
                                                          SoupHeaderName      name,
                                                          const char         *value);
+GHashTable *soup_message_headers_get_param_list_common  (SoupMessageHeaders *hdrs,
+                                                         SoupHeaderName      name);
+GHashTable *soup_message_headers_get_content_type_params (SoupMessageHeaders *hdrs);
+void        soup_message_headers_serialize              (SoupMessageHeaders *hdrs,
+                                                         GString            *str);
 
 G_END_DECLS
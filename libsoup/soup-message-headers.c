@@ -36,29 +36,73 @@ static gboolean parse_content_foo (SoupMessageHeaders *hdrs,
                                    SoupHeaderName      header_name,
                                    char              **foo,
                                    GHashTable        **params);
+static void     uncommon_index_add (SoupMessageHeaders *hdrs,
+                                    guint               index);
+
 typedef struct {
         SoupHeaderName name;
+        gboolean in_arena;
         char *value;
 } SoupCommonHeader;
 
 typedef struct {
 	char *name;
 	char *value;
+        gboolean in_arena;
+        /* Index of the previous header with the same name, or -1;
+         * only valid while the uncommon headers index exists.
+         */
+        int prev;
 } SoupUncommonHeader;
 
+/* Number of uncommon headers from which lookups go through a hash
+ * index rather than a linear scan of the array.
+ */
+#define UNCOMMON_HEADERS_INDEX_THRESHOLD 16
+
 struct _SoupMessageHeaders {
         GArray *common_headers;
         GHashTable *common_concat;
 	GArray *uncommon_headers;
 	GHashTable *uncommon_concat;
+        GHashTable *uncommon_index;
 	SoupMessageHeadersType type;
 
 	SoupEncoding encoding;
 	goffset content_length;
 	SoupExpectation expectations;
 	char *content_type;
+
+        /* Parsed forms of header values, invalidated when the header
+         * changes. See soup_message_headers_get_param_list_common() and
+         * soup_message_headers_get_content_type_params().
+         */
+        GHashTable *param_lists;
+        GHashTable *content_type_params;
+
+        /* Blocks owned by the headers that names and values may point
+         * into (see soup_message_headers_take_arena_block()), so that
+         * parsed headers don't need to be copied one by one.
+         */
+        GSList *arena;
 };
 
+static inline void
+soup_common_header_free (SoupCommonHeader *header)
+{
+        if (!header->in_arena)
+                g_free (header->value);
+}
+
+static inline void
+soup_uncommon_header_free (SoupUncommonHeader *header)
+{
+        if (!header->in_arena) {
+                g_free (header->name);
+                g_free (header->value);
+        }
+}
+
 /**
  * soup_message_headers_new:
  * @type: the type of headers
@@ -109,6 +153,8 @@ soup_message_headers_destroy (SoupMessageHeaders *hdrs)
         if (hdrs->uncommon_headers)
                 g_array_free (hdrs->uncommon_headers, TRUE);
         g_clear_pointer (&hdrs->uncommon_concat, g_hash_table_destroy);
+        g_clear_pointer (&hdrs->uncommon_index, g_hash_table_destroy);
+        g_clear_pointer (&hdrs->param_lists, g_hash_table_destroy);
 }
 
 /**
@@ -156,6 +202,7 @@ soup_message_headers_set (SoupMessageHeaders *hdrs,
                 break;
         case SOUP_HEADER_CONTENT_TYPE:
                 g_clear_pointer (&hdrs->content_type, g_free);
+                g_clear_pointer (&hdrs->content_type_params, soup_header_free_param_list);
                 if (value) {
                         char *content_type = NULL, *p;
 
@@ -200,7 +247,7 @@ soup_message_headers_clear (SoupMessageHeaders *hdrs)
                 SoupCommonHeader *hdr_array_common = (SoupCommonHeader *)hdrs->common_headers->data;
 
                 for (i = 0; i < hdrs->common_headers->len; i++) {
-                        g_free (hdr_array_common[i].value);
+                        soup_common_header_free (&hdr_array_common[i]);
                         soup_message_headers_set (hdrs, hdr_array_common[i].name, NULL);
                 }
                 g_array_set_size (hdrs->common_headers, 0);
@@ -208,24 +255,39 @@ soup_message_headers_clear (SoupMessageHeaders *hdrs)
 
         if (hdrs->common_concat)
                 g_hash_table_remove_all (hdrs->common_concat);
+        if (hdrs->param_lists)
+                g_hash_table_remove_all (hdrs->param_lists);
 
         if (hdrs->uncommon_headers) {
                 SoupUncommonHeader *hdr_array = (SoupUncommonHeader *)hdrs->uncommon_headers->data;
 
-                for (i = 0; i < hdrs->uncommon_headers->len; i++) {
-                        g_free (hdr_array[i].name);
-                        g_free (hdr_array[i].value);
-                }
+                for (i = 0; i < hdrs->uncommon_headers->len; i++)
+                        soup_uncommon_header_free (&hdr_array[i]);
                 g_array_set_size (hdrs->uncommon_headers, 0);
         }
 
 	if (hdrs->uncommon_concat)
 		g_hash_table_remove_all (hdrs->uncommon_concat);
+        g_clear_pointer (&hdrs->uncommon_index, g_hash_table_destroy);
 
         hdrs->encoding = -1;
         hdrs->content_length = 0;
         hdrs->expectations = 0;
         g_clear_pointer (&hdrs->content_type, g_free);
+
+        g_slist_free_full (g_steal_pointer (&hdrs->arena), g_free);
+}
+
+/*
+ * Hands ownership of @block over to @hdrs, so that headers appended with
+ * soup_message_headers_append_untrusted_arena_data() can keep pointing
+ * into it. @block is freed when @hdrs is cleared or destroyed.
+ */
+void
+soup_message_headers_take_arena_block (SoupMessageHeaders *hdrs,
+                                       char               *block)
+{
+        hdrs->arena = g_slist_prepend (hdrs->arena, block);
 }
 
 /**
@@ -263,11 +325,12 @@ static inline gboolean is_valid_header_value (const char *value)
         return value && strpbrk (value, "\r\n") == NULL;
 }
 
-gboolean
-soup_message_headers_append_common (SoupMessageHeaders    *hdrs,
-                                    SoupHeaderName         name,
-                                    const char            *value,
-                                    SoupHeaderValueTrusted trusted_value)
+static gboolean
+soup_message_headers_append_common_internal (SoupMessageHeaders    *hdrs,
+                                             SoupHeaderName         name,
+                                             const char            *value,
+                                             SoupHeaderValueTrusted trusted_value,
+                                             gboolean               in_arena)
 {
         SoupCommonHeader header;
 
@@ -320,18 +383,31 @@ soup_message_headers_append_common (SoupMessageHeaders    *hdrs,
                 hdrs->common_headers = g_array_sized_new (FALSE, FALSE, sizeof (SoupCommonHeader), 6);
 
         header.name = name;
-        header.value = g_strdup (value);
+        header.in_arena = in_arena;
+        header.value = in_arena ? (char *)value : g_strdup (value);
         g_array_append_val (hdrs->common_headers, header);
         if (hdrs->common_concat)
                 g_hash_table_remove (hdrs->common_concat, GUINT_TO_POINTER (header.name));
+        if (hdrs->param_lists)
+                g_hash_table_remove (hdrs->param_lists, GUINT_TO_POINTER (header.name));
 
         soup_message_headers_set (hdrs, name, value);
         return TRUE;
 }
 
+gboolean
+soup_message_headers_append_common (SoupMessageHeaders    *hdrs,
+                                    SoupHeaderName         name,
+                                    const char            *value,
+                                    SoupHeaderValueTrusted trusted_value)
+{
+        return soup_message_headers_append_common_internal (hdrs, name, value, trusted_value, FALSE);
+}
+
 static gboolean
 soup_message_headers_append_internal (SoupMessageHeaders *hdrs,
-			              const char *name, const char *value)
+			              const char *name, const char *value,
+                                      gboolean in_arena)
 {
 	SoupUncommonHeader header;
         SoupHeaderName header_name;
@@ -347,7 +423,7 @@ soup_message_headers_append_internal (SoupMessageHeaders *hdrs,
 
         header_name = soup_header_name_from_string (name);
         if (header_name != SOUP_HEADER_UNKNOWN)
-                return soup_message_headers_append_common (hdrs, header_name, value, SOUP_HEADER_VALUE_UNTRUSTED);
+                return soup_message_headers_append_common_internal (hdrs, header_name, value, SOUP_HEADER_VALUE_UNTRUSTED, in_arena);
 
         if (!is_valid_header_value (value)) {
                 g_warning ("soup_message_headers_append: Rejecting bad value '%s'", value);
@@ -357,11 +433,14 @@ soup_message_headers_append_internal (SoupMessageHeaders *hdrs,
         if (!hdrs->uncommon_headers)
                 hdrs->uncommon_headers = g_array_sized_new (FALSE, FALSE, sizeof (SoupUncommonHeader), 6);
 
-	header.name = g_strdup (name);
-	header.value = g_strdup (value);
+        header.in_arena = in_arena;
+	header.name = in_arena ? (char *)name : g_strdup (name);
+	header.value = in_arena ? (char *)value : g_strdup (value);
 	g_array_append_val (hdrs->uncommon_headers, header);
 	if (hdrs->uncommon_concat)
 		g_hash_table_remove (hdrs->uncommon_concat, header.name);
+        if (hdrs->uncommon_index)
+                uncommon_index_add (hdrs, hdrs->uncommon_headers->len - 1);
         return TRUE;
 }
 
@@ -384,7 +463,7 @@ void
 soup_message_headers_append (SoupMessageHeaders *hdrs,
 			     const char *name, const char *value)
 {
-	soup_message_headers_append_internal (hdrs, name, value);
+	soup_message_headers_append_internal (hdrs, name, value, FALSE);
 }
 
 /*
@@ -397,15 +476,39 @@ soup_message_headers_append_untrusted_data (SoupMessageHeaders *hdrs,
                                             const char         *name,
                                             const char         *value)
 {
-        char *safe_value = g_utf8_make_valid (value, -1);
-        char *safe_name = g_utf8_make_valid (name, -1);
-        gboolean result = soup_message_headers_append_internal (hdrs, safe_name, safe_value);
+        char *safe_value;
+        char *safe_name;
+        gboolean result;
+
+        if (g_utf8_validate (name, -1, NULL) && g_utf8_validate (value, -1, NULL))
+                return soup_message_headers_append_internal (hdrs, name, value, FALSE);
+
+        safe_value = g_utf8_make_valid (value, -1);
+        safe_name = g_utf8_make_valid (name, -1);
+        result = soup_message_headers_append_internal (hdrs, safe_name, safe_value, FALSE);
 
         g_free (safe_value);
         g_free (safe_name);
         return result;
 }
 
+/*
+ * Like soup_message_headers_append_untrusted_data(), but @name and @value
+ * are not copied if they are valid: they must point into a block that has
+ * been (or will be, before @hdrs is used again) passed to
+ * soup_message_headers_take_arena_block().
+ */
+gboolean
+soup_message_headers_append_untrusted_arena_data (SoupMessageHeaders *hdrs,
+                                                  const char         *name,
+                                                  const char         *value)
+{
+        if (g_utf8_validate (name, -1, NULL) && g_utf8_validate (value, -1, NULL))
+                return soup_message_headers_append_internal (hdrs, name, value, TRUE);
+
+        return soup_message_headers_append_untrusted_data (hdrs, name, value);
+}
+
 void
 soup_message_headers_replace_common (SoupMessageHeaders    *hdrs,
                                      SoupHeaderName         name,
@@ -439,6 +542,35 @@ soup_message_headers_replace (SoupMessageHeaders *hdrs,
 	soup_message_headers_append (hdrs, name, value);
 }
 
+static void
+uncommon_index_add (SoupMessageHeaders *hdrs,
+                    guint               index)
+{
+        SoupUncommonHeader *hdr_array = (SoupUncommonHeader *)hdrs->uncommon_headers->data;
+
+        hdr_array[index].prev = GPOINTER_TO_INT (g_hash_table_lookup (hdrs->uncommon_index, hdr_array[index].name)) - 1;
+        g_hash_table_insert (hdrs->uncommon_index, hdr_array[index].name, GINT_TO_POINTER (index + 1));
+}
+
+static GHashTable *
+get_uncommon_index (SoupMessageHeaders *hdrs)
+{
+        guint i;
+
+        if (hdrs->uncommon_index)
+                return hdrs->uncommon_index;
+
+        /* Scanning a handful of headers is cheaper than hashing */
+        if (hdrs->uncommon_headers->len < UNCOMMON_HEADERS_INDEX_THRESHOLD)
+                return NULL;
+
+        hdrs->uncommon_index = g_hash_table_new (soup_str_case_hash, soup_str_case_equal);
+        for (i = 0; i < hdrs->uncommon_headers->len; i++)
+                uncommon_index_add (hdrs, i);
+
+        return hdrs->uncommon_index;
+}
+
 static int
 find_common_header (GArray        *array,
                     SoupHeaderName name,
@@ -456,23 +588,6 @@ find_common_header (GArray        *array,
         return -1;
 }
 
-static int
-find_uncommon_header (GArray     *array,
-                      const char *name,
-                      int         nth)
-{
-        SoupUncommonHeader *hdr_array = (SoupUncommonHeader *)array->data;
-	int i;
-
-	for (i = 0; i < array->len; i++) {
-                if (g_ascii_strcasecmp (hdr_array[i].name, name) == 0) {
-			if (nth-- == 0)
-				return i;
-		}
-	}
-	return -1;
-}
-
 static int
 find_last_common_header (GArray        *array,
                          SoupHeaderName name,
@@ -491,13 +606,21 @@ find_last_common_header (GArray        *array,
 }
 
 static int
-find_last_uncommon_header (GArray     *array,
-                           const char *name,
-                           int         nth)
+find_last_uncommon_header (SoupMessageHeaders *hdrs,
+                           const char         *name,
+                           int                 nth)
 {
+        GArray *array = hdrs->uncommon_headers;
         SoupUncommonHeader *hdr_array = (SoupUncommonHeader *)array->data;
 	int i;
 
+        if (get_uncommon_index (hdrs)) {
+                i = GPOINTER_TO_INT (g_hash_table_lookup (hdrs->uncommon_index, name)) - 1;
+                while (i != -1 && nth-- > 0)
+                        i = hdr_array[i].prev;
+                return i;
+        }
+
 	for (i = array->len - 1; i >= 0; i--) {
                 if (g_ascii_strcasecmp (hdr_array[i].name, name) == 0) {
 			if (nth-- == 0)
@@ -520,7 +643,7 @@ soup_message_headers_remove_common (SoupMessageHeaders *hdrs,
 #ifndef __clang_analyzer__ /* False positive for double-free */
                         SoupCommonHeader *hdr_array = (SoupCommonHeader *)hdrs->common_headers->data;
 
-                        g_free (hdr_array[index].value);
+                        soup_common_header_free (&hdr_array[index]);
 #endif
                         g_array_remove_index (hdrs->common_headers, index);
                 }
@@ -528,6 +651,8 @@ soup_message_headers_remove_common (SoupMessageHeaders *hdrs,
 
         if (hdrs->common_concat)
                 g_hash_table_remove (hdrs->common_concat, GUINT_TO_POINTER (name));
+        if (hdrs->param_lists)
+                g_hash_table_remove (hdrs->param_lists, GUINT_TO_POINTER (name));
 
         soup_message_headers_set (hdrs, name, NULL);
 }
@@ -544,7 +669,6 @@ soup_message_headers_remove_common (SoupMessageHeaders *hdrs,
 void
 soup_message_headers_remove (SoupMessageHeaders *hdrs, const char *name)
 {
-	int index;
         SoupHeaderName header_name;
 
 	g_return_if_fail (hdrs);
@@ -557,14 +681,23 @@ soup_message_headers_remove (SoupMessageHeaders *hdrs, const char *name)
         }
 
         if (hdrs->uncommon_headers) {
-                while ((index = find_uncommon_header (hdrs->uncommon_headers, name, 0)) != -1) {
-#ifndef __clang_analyzer__ /* False positive for double-free */
-                        SoupUncommonHeader *hdr_array = (SoupUncommonHeader *)hdrs->uncommon_headers->data;
+                SoupUncommonHeader *hdr_array = (SoupUncommonHeader *)hdrs->uncommon_headers->data;
+                guint i, j;
+
+                /* Remove all the matching headers in a single pass */
+                for (i = j = 0; i < hdrs->uncommon_headers->len; i++) {
+                        if (g_ascii_strcasecmp (hdr_array[i].name, name) == 0) {
+                                soup_uncommon_header_free (&hdr_array[i]);
+                                continue;
+                        }
+                        if (i != j)
+                                hdr_array[j] = hdr_array[i];
+                        j++;
+                }
 
-                        g_free (hdr_array[index].name);
-                        g_free (hdr_array[index].value);
-#endif
-                        g_array_remove_index (hdrs->uncommon_headers, index);
+                if (j != hdrs->uncommon_headers->len) {
+                        g_array_set_size (hdrs->uncommon_headers, j);
+                        g_clear_pointer (&hdrs->uncommon_index, g_hash_table_destroy);
                 }
         }
 
@@ -624,7 +757,7 @@ soup_message_headers_get_one (SoupMessageHeaders *hdrs, const char *name)
                 return NULL;
 
         hdr_array = (SoupUncommonHeader *)hdrs->uncommon_headers->data;
-	index = find_last_uncommon_header (hdrs->uncommon_headers, name, 0);
+	index = find_last_uncommon_header (hdrs, name, 0);
 
 	return (index == -1) ? NULL : hdr_array[index].value;
 }
@@ -792,20 +925,41 @@ soup_message_headers_get_list (SoupMessageHeaders *hdrs, const char *name)
 			return value;
 	}
 
-	index = find_uncommon_header (hdrs->uncommon_headers, name, 0);
+	index = find_last_uncommon_header (hdrs, name, 0);
 	if (index == -1)
 		return NULL;
 
         hdr_array = (SoupUncommonHeader *)hdrs->uncommon_headers->data;
-        if (find_uncommon_header (hdrs->uncommon_headers, name, 1) == -1)
+        if (find_last_uncommon_header (hdrs, name, 1) == -1)
 		return hdr_array[index].value;
 
 	concat = g_string_new (NULL);
-	for (i = 0; (index = find_uncommon_header (hdrs->uncommon_headers, name, i)) != -1; i++) {
-		if (i != 0)
-			g_string_append (concat, ", ");
-		g_string_append (concat, hdr_array[index].value);
-	}
+        if (hdrs->uncommon_index) {
+                GArray *matches = g_array_new (FALSE, FALSE, sizeof (int));
+
+                /* Walk the index chain once, from the last header back
+                 * to the first, and then join the values in order.
+                 */
+                for (i = index; i != -1; i = hdr_array[i].prev)
+                        g_array_append_val (matches, i);
+                for (i = matches->len - 1; i >= 0; i--) {
+                        g_string_append (concat, hdr_array[g_array_index (matches, int, i)].value);
+                        if (i != 0)
+                                g_string_append (concat, ", ");
+                }
+                g_array_free (matches, TRUE);
+        } else {
+                gboolean first = TRUE;
+
+                for (i = 0; i < hdrs->uncommon_headers->len; i++) {
+                        if (g_ascii_strcasecmp (hdr_array[i].name, name) != 0)
+                                continue;
+                        if (!first)
+                                g_string_append (concat, ", ");
+                        g_string_append (concat, hdr_array[i].value);
+                        first = FALSE;
+                }
+        }
 	value = g_string_free (concat, FALSE);
 
 	if (!hdrs->uncommon_concat)
@@ -816,6 +970,38 @@ soup_message_headers_get_list (SoupMessageHeaders *hdrs, const char *name)
 	return value;
 }
 
+/*
+ * Gets the value of the list-valued header @name in @hdrs parsed with
+ * soup_header_parse_param_list(). The result is cached until the header
+ * changes, so it must not be modified or freed by the caller.
+ *
+ * Returns: (nullable): the parsed parameters, or %NULL if @name is not
+ *   present.
+ */
+GHashTable *
+soup_message_headers_get_param_list_common (SoupMessageHeaders *hdrs,
+                                            SoupHeaderName      name)
+{
+        const char *value;
+        GHashTable *params;
+
+        if (hdrs->param_lists) {
+                params = g_hash_table_lookup (hdrs->param_lists, GUINT_TO_POINTER (name));
+                if (params)
+                        return params;
+        }
+
+        value = soup_message_headers_get_list_common (hdrs, name);
+        if (!value)
+                return NULL;
+
+        params = soup_header_parse_param_list (value);
+        if (!hdrs->param_lists)
+                hdrs->param_lists = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)soup_header_free_param_list);
+        g_hash_table_insert (hdrs->param_lists, GUINT_TO_POINTER (name), params);
+        return params;
+}
+
 /**
  * SoupMessageHeadersIter:
  *
@@ -952,6 +1138,26 @@ soup_message_headers_foreach (SoupMessageHeaders           *hdrs,
         }
 }
 
+/*
+ * Appends @hdrs to @str in the HTTP/1 wire format, as one "Name: value\r\n"
+ * line per header, using plain appends rather than printf formatting.
+ */
+void
+soup_message_headers_serialize (SoupMessageHeaders *hdrs,
+                                GString            *str)
+{
+        SoupMessageHeadersIter iter;
+        const char *name, *value;
+
+        soup_message_headers_iter_init (&iter, hdrs);
+        while (soup_message_headers_iter_next (&iter, &name, &value)) {
+                g_string_append (str, name);
+                g_string_append_len (str, ": ", 2);
+                g_string_append (str, value);
+                g_string_append_len (str, "\r\n", 2);
+        }
+}
+
 /* Specific headers */
 
 static gboolean
@@ -1734,6 +1940,25 @@ soup_message_headers_get_content_type (SoupMessageHeaders  *hdrs,
 	return hdrs->content_type;
 }
 
+/*
+ * Like soup_message_headers_get_content_type(), but returns the
+ * parameters of the Content-Type header, which are cached until the
+ * header changes and must not be modified or freed by the caller.
+ *
+ * Returns: (nullable): the Content-Type parameters, or %NULL if @hdrs
+ *   has no valid Content-Type.
+ */
+GHashTable *
+soup_message_headers_get_content_type_params (SoupMessageHeaders *hdrs)
+{
+        if (!hdrs->content_type)
+                return NULL;
+
+        if (!hdrs->content_type_params)
+                parse_content_foo (hdrs, SOUP_HEADER_CONTENT_TYPE, NULL, &hdrs->content_type_params);
+        return hdrs->content_type_params;
+}
+
 /**
  * soup_message_headers_set_content_type:
  * @hdrs: a #SoupMessageHeaders
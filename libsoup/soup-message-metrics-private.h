@@ -26,6 +26,9 @@ struct _SoupMessageMetrics {
         guint64 response_header_bytes_received;
         guint64 response_body_size;
         guint64 response_body_bytes_received;
+
+        guint64 rtt;
+        guint64 min_rtt;
 };
 
 SoupMessageMetrics *soup_message_metrics_new   (void);
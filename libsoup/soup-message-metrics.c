@@ -372,3 +372,45 @@ soup_message_metrics_get_response_body_bytes_received (SoupMessageMetrics *metri
 
         return metrics->response_body_bytes_received;
 }
+
+/**
+ * soup_message_metrics_get_rtt:
+ * @metrics: a #SoupMessageMetrics
+ *
+ * Get the smoothed round-trip time of the connection, in microseconds.
+ *
+ * The round-trip time is sampled with HTTP/2 PING frames. The value is the
+ * one known when the request was sent, and it is updated with the samples
+ * taken while the message is in progress. It is 0 for HTTP/1 connections
+ * and for HTTP/2 connections without samples yet.
+ *
+ * Returns: the smoothed round-trip time
+ *
+ * Since: 3.8
+ */
+guint64
+soup_message_metrics_get_rtt (SoupMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->rtt;
+}
+
+/**
+ * soup_message_metrics_get_min_rtt:
+ * @metrics: a #SoupMessageMetrics
+ *
+ * Get the minimum round-trip time sampled on the connection, in
+ * microseconds. See soup_message_metrics_get_rtt().
+ *
+ * Returns: the minimum round-trip time
+ *
+ * Since: 3.8
+ */
+guint64
+soup_message_metrics_get_min_rtt (SoupMessageMetrics *metrics)
+{
+        g_return_val_if_fail (metrics != NULL, 0);
+
+        return metrics->min_rtt;
+}
@@ -66,6 +66,12 @@ guint64             soup_message_metrics_get_response_body_size             (Sou
 SOUP_AVAILABLE_IN_ALL
 guint64             soup_message_metrics_get_response_body_bytes_received   (SoupMessageMetrics *metrics);
 
+SOUP_AVAILABLE_IN_3_8
+guint64             soup_message_metrics_get_rtt                            (SoupMessageMetrics *metrics);
+
+SOUP_AVAILABLE_IN_3_8
+guint64             soup_message_metrics_get_min_rtt                        (SoupMessageMetrics *metrics);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(SoupMessageMetrics, soup_message_metrics_free)
 
 G_END_DECLS
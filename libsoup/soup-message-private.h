@@ -120,6 +120,7 @@ gboolean            soup_message_try_sniff_content      (SoupMessage        *msg
                                                          GCancellable       *cancellable,
                                                          GError            **error);
 GInputStream       *soup_message_get_request_body_stream (SoupMessage        *msg);
+GBytes             *soup_message_get_request_body_bytes  (SoupMessage        *msg);
 
 void                soup_message_set_reason_phrase       (SoupMessage        *msg,
                                                           const char         *reason_phrase);
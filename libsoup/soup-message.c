@@ -58,6 +58,7 @@ typedef struct {
 	SoupMessageHeaders *response_headers;
 
 	GInputStream      *request_body_stream;
+        GBytes            *request_body_bytes;
         const char        *method;
         char              *reason_phrase;
         SoupStatus         status_code;
@@ -212,6 +213,7 @@ soup_message_finalize (GObject *object)
 	soup_message_headers_unref (priv->request_headers);
 	soup_message_headers_unref (priv->response_headers);
 	g_clear_object (&priv->request_body_stream);
+        g_clear_pointer (&priv->request_body_bytes, g_bytes_unref);
 
 	g_free (priv->reason_phrase);
 
@@ -1165,6 +1167,7 @@ soup_message_set_request_body (SoupMessage  *msg,
         SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
 
         g_clear_object (&priv->request_body_stream);
+        g_clear_pointer (&priv->request_body_bytes, g_bytes_unref);
 
         if (stream) {
                 if (content_type) {
@@ -1207,11 +1210,13 @@ soup_message_set_request_body_from_bytes (SoupMessage  *msg,
         g_return_if_fail (SOUP_IS_MESSAGE (msg));
 
         if (bytes) {
+                SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
                 GInputStream *stream;
 
                 stream = g_memory_input_stream_new_from_bytes (bytes);
                 soup_message_set_request_body (msg, content_type, stream, g_bytes_get_size (bytes));
                 g_object_unref (stream);
+                priv->request_body_bytes = g_bytes_ref (bytes);
         } else
                 soup_message_set_request_body (msg, NULL, NULL, 0);
 }
@@ -2973,6 +2978,18 @@ soup_message_get_request_body_stream (SoupMessage *msg)
         return priv->request_body_stream;
 }
 
+/* Returns the bytes the request body stream was created from by
+ * soup_message_set_request_body_from_bytes(), if any, so that they
+ * can be sent without reading them through the stream.
+ */
+GBytes *
+soup_message_get_request_body_bytes (SoupMessage *msg)
+{
+        SoupMessagePrivate *priv = soup_message_get_instance_private (msg);
+
+        return priv->request_body_bytes;
+}
+
 /**
  * soup_message_get_method: (attributes org.gtk.Method.get_property=method)
  * @msg: The #SoupMessage
@@ -14,6 +14,7 @@
 #include "soup-body-input-stream.h"
 #include "soup-filter-input-stream.h"
 #include "soup-enum-types.h"
+#include "soup-message-headers-private.h"
 #include "soup-message.h"
 #include "soup-message-private.h"
 #include "soup-multipart-input-stream.h"
@@ -229,10 +230,9 @@ soup_multipart_input_stream_constructed (GObject *object)
 	base_stream = G_FILTER_INPUT_STREAM (multipart)->base_stream;
 	priv->base_stream = SOUP_FILTER_INPUT_STREAM (soup_filter_input_stream_new (base_stream));
 
-	soup_message_headers_get_content_type (soup_message_get_response_headers (priv->msg),
-					       &params);
+	params = soup_message_headers_get_content_type_params (soup_message_get_response_headers (priv->msg));
 
-	boundary = g_hash_table_lookup (params, "boundary");
+	boundary = params ? g_hash_table_lookup (params, "boundary") : NULL;
 	if (boundary) {
 		if (g_str_has_prefix (boundary, "--"))
 			priv->boundary = g_strdup (boundary);
@@ -244,8 +244,6 @@ soup_multipart_input_stream_constructed (GObject *object)
 		g_warning ("No boundary found in message tagged as multipart.");
 	}
 
-	g_hash_table_destroy (params);
-
 	if (G_OBJECT_CLASS (soup_multipart_input_stream_parent_class)->constructed)
 		G_OBJECT_CLASS (soup_multipart_input_stream_parent_class)->constructed (object);
 }
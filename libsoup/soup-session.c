@@ -16,7 +16,9 @@
 #include "auth/soup-auth-manager.h"
 #include "auth/soup-auth-ntlm.h"
 #include "cache/soup-cache-private.h"
+#include "soup-client-input-stream.h"
 #include "soup-connection-manager.h"
+#include "soup-filter-input-stream.h"
 #include "soup-message-private.h"
 #include "soup-message-headers-private.h"
 #include "soup-misc.h"
@@ -74,6 +76,8 @@ typedef struct {
 	gboolean tlsdb_use_default;
 
 	guint io_timeout, idle_timeout;
+	guint http2_ping_interval;
+	guint read_buffer_min_size, read_buffer_max_size;
 	GInetSocketAddress *local_addr;
 
 	GProxyResolver *proxy_resolver;
@@ -139,6 +143,12 @@ enum {
 	PROP_IDLE_TIMEOUT,
 	PROP_LOCAL_ADDRESS,
 	PROP_TLS_INTERACTION,
+	PROP_MAX_PIPELINE_DEPTH,
+	PROP_HTTP2_MIN_WINDOW_SIZE,
+	PROP_HTTP2_MAX_WINDOW_SIZE,
+	PROP_HTTP2_PING_INTERVAL,
+	PROP_READ_BUFFER_MIN_SIZE,
+	PROP_READ_BUFFER_MAX_SIZE,
 
 	LAST_PROPERTY
 };
@@ -294,6 +304,8 @@ soup_session_init (SoupSession *session)
         g_mutex_init (&priv->queue_sources_mutex);
 
         priv->io_timeout = priv->idle_timeout = 60;
+        priv->read_buffer_min_size = SOUP_FILTER_INPUT_STREAM_READ_SIZE_MIN;
+        priv->read_buffer_max_size = SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX;
 
         priv->conn_manager = soup_connection_manager_new (session,
                                                           SOUP_SESSION_MAX_CONNS_DEFAULT,
@@ -392,6 +404,9 @@ soup_session_ensure_socket_props (SoupSession *session)
 							 priv->tls_interaction,
 							 priv->io_timeout,
 							 priv->idle_timeout);
+	priv->socket_props->http2_ping_interval = priv->http2_ping_interval;
+	priv->socket_props->read_buffer_min_size = priv->read_buffer_min_size;
+	priv->socket_props->read_buffer_max_size = MAX (priv->read_buffer_max_size, priv->read_buffer_min_size);
 	if (!priv->proxy_use_default)
 		soup_socket_properties_set_proxy_resolver (priv->socket_props, priv->proxy_resolver);
 	if (!priv->tlsdb_use_default)
@@ -433,6 +448,15 @@ soup_session_set_property (GObject *object, guint prop_id,
 	case PROP_MAX_CONNS_PER_HOST:
                 soup_connection_manager_set_max_conns_per_host (priv->conn_manager, g_value_get_int (value));
 		break;
+	case PROP_MAX_PIPELINE_DEPTH:
+                soup_connection_manager_set_max_pipeline_depth (priv->conn_manager, g_value_get_int (value));
+		break;
+	case PROP_HTTP2_MIN_WINDOW_SIZE:
+                soup_connection_manager_set_http2_min_window_size (priv->conn_manager, g_value_get_int (value));
+		break;
+	case PROP_HTTP2_MAX_WINDOW_SIZE:
+                soup_connection_manager_set_http2_max_window_size (priv->conn_manager, g_value_get_int (value));
+		break;
 	case PROP_TLS_DATABASE:
 		soup_session_set_tls_database (session, g_value_get_object (value));
 		break;
@@ -457,6 +481,17 @@ soup_session_set_property (GObject *object, guint prop_id,
 	case PROP_IDLE_TIMEOUT:
 		soup_session_set_idle_timeout (session, g_value_get_uint (value));
 		break;
+	case PROP_HTTP2_PING_INTERVAL:
+		soup_session_set_http2_ping_interval (session, g_value_get_uint (value));
+		break;
+	case PROP_READ_BUFFER_MIN_SIZE:
+		priv->read_buffer_min_size = g_value_get_uint (value);
+		socket_props_changed (session);
+		break;
+	case PROP_READ_BUFFER_MAX_SIZE:
+		priv->read_buffer_max_size = g_value_get_uint (value);
+		socket_props_changed (session);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -482,6 +517,15 @@ soup_session_get_property (GObject *object, guint prop_id,
 	case PROP_MAX_CONNS_PER_HOST:
 		g_value_set_int (value, soup_session_get_max_conns_per_host (session));
 		break;
+	case PROP_MAX_PIPELINE_DEPTH:
+		g_value_set_int (value, soup_session_get_max_pipeline_depth (session));
+		break;
+	case PROP_HTTP2_MIN_WINDOW_SIZE:
+		g_value_set_int (value, soup_session_get_http2_min_window_size (session));
+		break;
+	case PROP_HTTP2_MAX_WINDOW_SIZE:
+		g_value_set_int (value, soup_session_get_http2_max_window_size (session));
+		break;
 	case PROP_TLS_DATABASE:
 		g_value_set_object (value, soup_session_get_tls_database (session));
 		break;
@@ -506,6 +550,15 @@ soup_session_get_property (GObject *object, guint prop_id,
 	case PROP_IDLE_TIMEOUT:
 		g_value_set_uint (value, soup_session_get_idle_timeout (session));
 		break;
+	case PROP_HTTP2_PING_INTERVAL:
+		g_value_set_uint (value, soup_session_get_http2_ping_interval (session));
+		break;
+	case PROP_READ_BUFFER_MIN_SIZE:
+		g_value_set_uint (value, soup_session_get_read_buffer_min_size (session));
+		break;
+	case PROP_READ_BUFFER_MAX_SIZE:
+		g_value_set_uint (value, soup_session_get_read_buffer_max_size (session));
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -608,6 +661,134 @@ soup_session_get_max_conns_per_host (SoupSession *session)
 	return soup_connection_manager_get_max_conns_per_host (priv->conn_manager);
 }
 
+/**
+ * soup_session_get_max_pipeline_depth: (attributes org.gtk.Method.get_property=max-pipeline-depth)
+ * @session: a #SoupSession
+ *
+ * Get the maximum number of requests that @session can have in flight
+ * at once on a single HTTP/1.1 connection.
+ *
+ * Returns: the maximum pipeline depth
+ *
+ * Since: 3.8
+ */
+guint
+soup_session_get_max_pipeline_depth (SoupSession *session)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+
+	priv = soup_session_get_instance_private (session);
+	return soup_connection_manager_get_max_pipeline_depth (priv->conn_manager);
+}
+
+/**
+ * soup_session_set_max_pipeline_depth_for_host:
+ * @session: a #SoupSession
+ * @host: a host name or IP address
+ * @depth: the maximum pipeline depth, or 0 to use the session's
+ *
+ * Sets the maximum number of requests that @session can have in flight
+ * at once on a single HTTP/1.1 connection to @host, overriding
+ * [property@Session:max-pipeline-depth] for that host. This can be used
+ * to enable pipelining only for servers known to support it, or to
+ * disable it for some servers with a depth of 1.
+ *
+ * The depth applies to connections to @host on any port, and takes
+ * effect for requests queued from now on.
+ *
+ * Since: 3.8
+ */
+void
+soup_session_set_max_pipeline_depth_for_host (SoupSession *session,
+					      const char  *host,
+					      guint        depth)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SESSION (session));
+	g_return_if_fail (host != NULL);
+
+	priv = soup_session_get_instance_private (session);
+	soup_connection_manager_set_host_max_pipeline_depth (priv->conn_manager, host, depth);
+}
+
+/**
+ * soup_session_get_max_pipeline_depth_for_host:
+ * @session: a #SoupSession
+ * @host: a host name or IP address
+ *
+ * Get the maximum number of requests that @session can have in flight
+ * at once on a single HTTP/1.1 connection to @host.
+ *
+ * This is the depth set with
+ * [method@Session.set_max_pipeline_depth_for_host], or
+ * [property@Session:max-pipeline-depth] if none was set. It is 1 if a
+ * server at @host was found to drop pipelined requests, since @session
+ * does not pipeline to it anymore.
+ *
+ * Returns: the maximum pipeline depth for @host
+ *
+ * Since: 3.8
+ */
+guint
+soup_session_get_max_pipeline_depth_for_host (SoupSession *session,
+					      const char  *host)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+	g_return_val_if_fail (host != NULL, 0);
+
+	priv = soup_session_get_instance_private (session);
+	return soup_connection_manager_get_host_max_pipeline_depth (priv->conn_manager, host);
+}
+
+/**
+ * soup_session_get_http2_min_window_size: (attributes org.gtk.Method.get_property=http2-min-window-size)
+ * @session: a #SoupSession
+ *
+ * Get the flow-control window that @session's HTTP/2 connections start
+ * with, and below which the window tuning never shrinks them.
+ *
+ * Returns: the minimum HTTP/2 connection window size, in bytes
+ *
+ * Since: 3.8
+ */
+int
+soup_session_get_http2_min_window_size (SoupSession *session)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+
+	priv = soup_session_get_instance_private (session);
+	return soup_connection_manager_get_http2_min_window_size (priv->conn_manager);
+}
+
+/**
+ * soup_session_get_http2_max_window_size: (attributes org.gtk.Method.get_property=http2-max-window-size)
+ * @session: a #SoupSession
+ *
+ * Get the flow-control window up to which the window tuning can grow
+ * @session's HTTP/2 connections.
+ *
+ * Returns: the maximum HTTP/2 connection window size, in bytes
+ *
+ * Since: 3.8
+ */
+int
+soup_session_get_http2_max_window_size (SoupSession *session)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+
+	priv = soup_session_get_instance_private (session);
+	return soup_connection_manager_get_http2_max_window_size (priv->conn_manager);
+}
+
 /**
  * soup_session_set_proxy_resolver: (attributes org.gtk.Method.set_property=proxy-resolver)
  * @session: a #SoupSession
@@ -854,6 +1035,101 @@ soup_session_get_idle_timeout (SoupSession *session)
 	return priv->idle_timeout;
 }
 
+/**
+ * soup_session_get_read_buffer_min_size: (attributes org.gtk.Method.get_property=read-buffer-min-size)
+ * @session: a #SoupSession
+ *
+ * Get the size of the reads that @session's connections start with, and
+ * below which the adaptive read size never shrinks.
+ *
+ * Returns: the minimum read size, in bytes
+ *
+ * Since: 3.8
+ */
+guint
+soup_session_get_read_buffer_min_size (SoupSession *session)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+
+	priv = soup_session_get_instance_private (session);
+	return priv->read_buffer_min_size;
+}
+
+/**
+ * soup_session_get_read_buffer_max_size: (attributes org.gtk.Method.get_property=read-buffer-max-size)
+ * @session: a #SoupSession
+ *
+ * Get the size up to which the reads of @session's connections grow
+ * while the peer keeps them saturated.
+ *
+ * Returns: the maximum read size, in bytes
+ *
+ * Since: 3.8
+ */
+guint
+soup_session_get_read_buffer_max_size (SoupSession *session)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+
+	priv = soup_session_get_instance_private (session);
+	return MAX (priv->read_buffer_max_size, priv->read_buffer_min_size);
+}
+
+/**
+ * soup_session_set_http2_ping_interval: (attributes org.gtk.Method.set_property=http2-ping-interval)
+ * @session: a #SoupSession
+ * @interval: an interval in seconds
+ *
+ * Set the interval in seconds for the health checks of HTTP/2 connections
+ * created by @session from now on, or 0 to disable them.
+ *
+ * See [property@Session:http2-ping-interval] for more information.
+ *
+ * Since: 3.8
+ */
+void
+soup_session_set_http2_ping_interval (SoupSession *session,
+				      guint        interval)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_if_fail (SOUP_IS_SESSION (session));
+
+	priv = soup_session_get_instance_private (session);
+	if (priv->http2_ping_interval == interval)
+		return;
+
+	priv->http2_ping_interval = interval;
+	socket_props_changed (session);
+	g_object_notify_by_pspec (G_OBJECT (session), properties[PROP_HTTP2_PING_INTERVAL]);
+}
+
+/**
+ * soup_session_get_http2_ping_interval: (attributes org.gtk.Method.get_property=http2-ping-interval)
+ * @session: a #SoupSession
+ *
+ * Get the interval in seconds for the health checks of HTTP/2 connections
+ * currently used by @session.
+ *
+ * Returns: the interval in seconds, or 0 if health checks are disabled
+ *
+ * Since: 3.8
+ */
+guint
+soup_session_get_http2_ping_interval (SoupSession *session)
+{
+	SoupSessionPrivate *priv;
+
+	g_return_val_if_fail (SOUP_IS_SESSION (session), 0);
+
+	priv = soup_session_get_instance_private (session);
+	return priv->http2_ping_interval;
+}
+
 /**
  * soup_session_set_user_agent: (attributes org.gtk.Method.set_property=user-agent)
  * @session: a #SoupSession
@@ -2514,6 +2790,88 @@ soup_session_class_init (SoupSessionClass *session_class)
 				  G_PARAM_READWRITE |
 				  G_PARAM_CONSTRUCT_ONLY |
 				  G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * SoupSession:max-pipeline-depth: (attributes org.gtk.Property.get=soup_session_get_max_pipeline_depth)
+	 *
+	 * The maximum number of requests that the session can have in
+	 * flight at once on a single HTTP/1.1 connection.
+	 *
+	 * With the default of 1, a request is only sent on a connection
+	 * once the response to the previous one has been read. Larger
+	 * values enable HTTP/1.1 pipelining: when no idle connection to
+	 * the host is available, a request can be written on a busy one
+	 * and its response is read after the ones already pending.
+	 *
+	 * Only idempotent requests without a body are pipelined, and only
+	 * on connections where the server has already kept the connection
+	 * open after an HTTP/1.1 response. Requests that are not answered
+	 * because the server closes the connection are sent again, and
+	 * pipelining is disabled for the rest of the session's lifetime
+	 * for a host whose server drops pipelined requests.
+	 *
+	 * This is the default for every host; use
+	 * [method@Session.set_max_pipeline_depth_for_host] to set a
+	 * different depth for specific hosts.
+	 *
+	 * Since: 3.8
+	 */
+        properties[PROP_MAX_PIPELINE_DEPTH] =
+		g_param_spec_int ("max-pipeline-depth",
+				  "Max Pipeline Depth",
+				  "The maximum number of requests in flight at once on an HTTP/1.1 connection",
+				  1,
+				  G_MAXINT,
+				  1,
+				  G_PARAM_READWRITE |
+				  G_PARAM_CONSTRUCT_ONLY |
+				  G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * SoupSession:http2-min-window-size: (attributes org.gtk.Property.get=soup_session_get_http2_min_window_size)
+	 *
+	 * The flow-control window, in bytes, that HTTP/2 connections
+	 * start with. Each stream starts with 2/5 of it.
+	 *
+	 * While a connection receives data, the session measures the
+	 * bandwidth-delay product with PING frames. It grows the
+	 * connection and stream windows when the peer is limited by them
+	 * and the application keeps up with the data. It shrinks them back
+	 * when they are much larger than needed. They never go below
+	 * this size or above #SoupSession:http2-max-window-size.
+	 *
+	 * Since: 3.8
+	 */
+        properties[PROP_HTTP2_MIN_WINDOW_SIZE] =
+		g_param_spec_int ("http2-min-window-size",
+				  "HTTP/2 Min Window Size",
+				  "The initial and minimum HTTP/2 connection flow-control window size",
+				  65535,
+				  G_MAXINT32,
+				  SOUP_CONNECTION_HTTP2_MIN_WINDOW_SIZE,
+				  G_PARAM_READWRITE |
+				  G_PARAM_CONSTRUCT_ONLY |
+				  G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * SoupSession:http2-max-window-size: (attributes org.gtk.Property.get=soup_session_get_http2_max_window_size)
+	 *
+	 * The size, in bytes, up to which the flow-control window of HTTP/2
+	 * connections can grow. See #SoupSession:http2-min-window-size.
+	 * Setting both to the same value disables the window tuning.
+	 *
+	 * Since: 3.8
+	 */
+        properties[PROP_HTTP2_MAX_WINDOW_SIZE] =
+		g_param_spec_int ("http2-max-window-size",
+				  "HTTP/2 Max Window Size",
+				  "The maximum HTTP/2 connection flow-control window size",
+				  65535,
+				  G_MAXINT32,
+				  SOUP_CONNECTION_HTTP2_MAX_WINDOW_SIZE,
+				  G_PARAM_READWRITE |
+				  G_PARAM_CONSTRUCT_ONLY |
+				  G_PARAM_STATIC_STRINGS);
 	/**
 	 * SoupSession:idle-timeout: (attributes org.gtk.Property.get=soup_session_get_idle_timeout org.gtk.Property.set=soup_session_set_idle_timeout)
 	 *
@@ -2534,6 +2892,79 @@ soup_session_class_init (SoupSessionClass *session_class)
 				   G_PARAM_READWRITE |
 				   G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * SoupSession:http2-ping-interval: (attributes org.gtk.Property.get=soup_session_get_http2_ping_interval org.gtk.Property.set=soup_session_set_http2_ping_interval)
+	 *
+	 * Interval in seconds for the health checks of HTTP/2 connections,
+	 * or 0 to disable them, which is the default.
+	 *
+	 * When nothing has been received on a connection for this long,
+	 * whether it is idle or waiting for a stalled stream, a PING frame
+	 * is sent. If the PING is not acknowledged within the same
+	 * interval, the connection is no longer used for new requests and
+	 * the requests in progress on it fail with
+	 * %G_IO_ERROR_TIMED_OUT. This detects connections that silently
+	 * stopped working, for example behind a NAT, without waiting for
+	 * [property@Session:timeout].
+	 *
+	 * Health checks only run on connections used from a thread with a
+	 * running main loop. Like [property@Session:idle-timeout], this
+	 * property only affects newly-created connections.
+	 *
+	 * Since: 3.8
+	 */
+        properties[PROP_HTTP2_PING_INTERVAL] =
+		g_param_spec_uint ("http2-ping-interval",
+				   "HTTP/2 PING Interval",
+				   "Interval for the health checks of HTTP/2 connections",
+				   0, G_MAXUINT, 0,
+				   G_PARAM_READWRITE |
+				   G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * SoupSession:read-buffer-min-size: (attributes org.gtk.Property.get=soup_session_get_read_buffer_min_size)
+	 *
+	 * The size, in bytes, of the reads that connections start with.
+	 *
+	 * The read size of each connection doubles while the peer keeps
+	 * filling the reads, up to #SoupSession:read-buffer-max-size, and
+	 * goes back to this size when reads come back short or the
+	 * connection has been idle for a second. The read buffer is
+	 * released whenever all the data in it has been consumed.
+	 *
+	 * Since: 3.8
+	 */
+        properties[PROP_READ_BUFFER_MIN_SIZE] =
+		g_param_spec_uint ("read-buffer-min-size",
+				   "Read Buffer Min Size",
+				   "The initial and minimum size of connection reads",
+				   1024,
+				   G_MAXINT32,
+				   SOUP_FILTER_INPUT_STREAM_READ_SIZE_MIN,
+				   G_PARAM_READWRITE |
+				   G_PARAM_CONSTRUCT_ONLY |
+				   G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * SoupSession:read-buffer-max-size: (attributes org.gtk.Property.get=soup_session_get_read_buffer_max_size)
+	 *
+	 * The size, in bytes, up to which connection reads grow under
+	 * sustained throughput. See #SoupSession:read-buffer-min-size.
+	 * It is never less than the minimum size.
+	 *
+	 * Since: 3.8
+	 */
+        properties[PROP_READ_BUFFER_MAX_SIZE] =
+		g_param_spec_uint ("read-buffer-max-size",
+				   "Read Buffer Max Size",
+				   "The maximum size of connection reads",
+				   1024,
+				   G_MAXINT32,
+				   SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX,
+				   G_PARAM_READWRITE |
+				   G_PARAM_CONSTRUCT_ONLY |
+				   G_PARAM_STATIC_STRINGS);
+
 	/**
 	 * SoupSession:tls-database: (attributes org.gtk.Property.get=soup_session_get_tls_database org.gtk.Property.set=soup_session_set_tls_database)
 	 *
@@ -2940,15 +3371,16 @@ static void
 async_return_from_cache (SoupMessageQueueItem *item,
 			 GInputStream         *stream)
 {
+	SoupMessageHeaders *response_headers;
 	const char *content_type;
-	GHashTable *params = NULL;
 
 	soup_message_got_headers (item->msg);
 
-	content_type = soup_message_headers_get_content_type (soup_message_get_response_headers (item->msg), &params);
+	response_headers = soup_message_get_response_headers (item->msg);
+	content_type = soup_message_headers_get_content_type (response_headers, NULL);
 	if (content_type) {
-		soup_message_content_sniffed (item->msg, content_type, params);
-		g_hash_table_unref (params);
+		soup_message_content_sniffed (item->msg, content_type,
+					      soup_message_headers_get_content_type_params (response_headers));
 	}
 
 	soup_message_queue_item_ref (item);
@@ -3367,29 +3799,277 @@ soup_session_send (SoupSession   *session,
 	return stream;
 }
 
+/* Response bodies read by soup_session_send_and_read() are collected
+ * straight into their final allocation when the length is known in
+ * advance. Otherwise (or if the server sends more than it announced)
+ * they go into fixed-size blocks taken from a small pool, which are
+ * flattened once when the body is complete.
+ */
+#define BODY_COLLECTOR_BLOCK_SIZE 16384
+#define BODY_COLLECTOR_POOL_MAX 32
+#define BODY_COLLECTOR_MAX_PREALLOC (8 * 1024 * 1024)
+
+G_LOCK_DEFINE_STATIC (body_collector_pool);
+static gpointer body_collector_pool;
+static guint body_collector_pool_len;
+
+typedef struct {
+        guint8 *head;
+        gsize head_size;
+        gsize head_len;
+        GPtrArray *blocks;
+        gsize block_len;
+} SoupBodyCollector;
+
+static guint8 *
+body_collector_block_new (void)
+{
+        guint8 *block = NULL;
+
+        G_LOCK (body_collector_pool);
+        if (body_collector_pool) {
+                /* Free blocks are chained through their first word */
+                block = body_collector_pool;
+                body_collector_pool = *(gpointer *)block;
+                body_collector_pool_len--;
+        }
+        G_UNLOCK (body_collector_pool);
+
+        return block ? block : g_malloc (BODY_COLLECTOR_BLOCK_SIZE);
+}
+
 static void
-send_and_read_splice_ready_cb (SoupSession  *session,
-			       GAsyncResult *result,
-			       GTask        *task)
+body_collector_block_free (guint8 *block)
 {
-	GOutputStream *ostream;
-	GError *error = NULL;
+        G_LOCK (body_collector_pool);
+        if (body_collector_pool_len < BODY_COLLECTOR_POOL_MAX) {
+                *(gpointer *)block = body_collector_pool;
+                body_collector_pool = block;
+                body_collector_pool_len++;
+                block = NULL;
+        }
+        G_UNLOCK (body_collector_pool);
+
+        g_free (block);
+}
+
+static void
+body_collector_init (SoupBodyCollector *collector,
+                     SoupMessage       *msg)
+{
+        SoupMessageHeaders *headers = soup_message_get_response_headers (msg);
+        goffset length;
+
+        memset (collector, 0, sizeof (SoupBodyCollector));
+
+        if (soup_message_get_method (msg) == SOUP_METHOD_HEAD ||
+            soup_message_get_status (msg) == SOUP_STATUS_NO_CONTENT ||
+            soup_message_get_status (msg) == SOUP_STATUS_NOT_MODIFIED)
+                return;
+
+        if (soup_message_headers_get_encoding (headers) != SOUP_ENCODING_CONTENT_LENGTH)
+                return;
+
+        /* The content decoder changes the length of the data we read */
+        if (soup_message_headers_get_one_common (headers, SOUP_HEADER_CONTENT_ENCODING))
+                return;
+
+        length = soup_message_headers_get_content_length (headers);
+        if (length <= 0 || length > BODY_COLLECTOR_MAX_PREALLOC)
+                return;
+
+        collector->head = g_malloc (length);
+        collector->head_size = length;
+}
+
+static guint8 *
+body_collector_get_buffer (SoupBodyCollector *collector,
+                           gsize             *size)
+{
+        guint8 *block;
+
+        if (collector->head_len < collector->head_size) {
+                *size = collector->head_size - collector->head_len;
+                return collector->head + collector->head_len;
+        }
 
-        ostream = g_task_get_task_data (task);
+        if (!collector->blocks)
+                collector->blocks = g_ptr_array_new ();
+
+        if (collector->blocks->len == 0 || collector->block_len == BODY_COLLECTOR_BLOCK_SIZE) {
+                g_ptr_array_add (collector->blocks, body_collector_block_new ());
+                collector->block_len = 0;
+        }
+
+        block = collector->blocks->pdata[collector->blocks->len - 1];
+        *size = BODY_COLLECTOR_BLOCK_SIZE - collector->block_len;
+        return block + collector->block_len;
+}
+
+static void
+body_collector_advance (SoupBodyCollector *collector,
+                        gsize              nread)
+{
+        if (collector->head_len < collector->head_size)
+                collector->head_len += nread;
+        else
+                collector->block_len += nread;
+}
+
+static void
+body_collector_clear (SoupBodyCollector *collector)
+{
+        g_clear_pointer (&collector->head, g_free);
+        if (collector->blocks) {
+                g_ptr_array_foreach (collector->blocks, (GFunc)body_collector_block_free, NULL);
+                g_clear_pointer (&collector->blocks, g_ptr_array_unref);
+        }
+}
+
+static GBytes *
+body_collector_steal_bytes (SoupBodyCollector *collector)
+{
+        gsize n_blocks = collector->blocks ? collector->blocks->len : 0;
+        gsize last_len = collector->block_len;
+        gsize total;
+        guint8 *data;
+        gsize offset, i;
+
+        /* The final read that hit EOF may have opened an empty block */
+        if (n_blocks > 0 && last_len == 0) {
+                n_blocks--;
+                last_len = BODY_COLLECTOR_BLOCK_SIZE;
+        }
+
+        if (n_blocks == 0) {
+                GBytes *bytes;
+
+                if (collector->head_len == 0) {
+                        body_collector_clear (collector);
+                        return g_bytes_new (NULL, 0);
+                }
+
+                /* Shorter than announced: realloc can shrink in place */
+                if (collector->head_len < collector->head_size)
+                        collector->head = g_realloc (collector->head, collector->head_len);
+                bytes = g_bytes_new_take (g_steal_pointer (&collector->head), collector->head_len);
+                body_collector_clear (collector);
+                return bytes;
+        }
+
+        total = collector->head_len + (n_blocks - 1) * BODY_COLLECTOR_BLOCK_SIZE + last_len;
+        data = g_malloc (total);
+        if (collector->head_len)
+                memcpy (data, collector->head, collector->head_len);
+        offset = collector->head_len;
+        for (i = 0; i < n_blocks; i++) {
+                gsize len = i == n_blocks - 1 ? last_len : BODY_COLLECTOR_BLOCK_SIZE;
+
+                memcpy (data + offset, collector->blocks->pdata[i], len);
+                offset += len;
+        }
+        body_collector_clear (collector);
+
+        return g_bytes_new_take (data, total);
+}
+
+typedef struct {
+        SoupBodyCollector collector;
+        GInputStream *stream;
+        GError *error;
+        GTask *task;
+} SendAndReadAsyncData;
+
+static void
+send_and_read_async_data_free (SendAndReadAsyncData *data)
+{
+        body_collector_clear (&data->collector);
+        g_clear_object (&data->stream);
+        g_clear_error (&data->error);
+        g_clear_object (&data->task);
+
+        g_free (data);
+}
+
+static void
+send_and_read_close_ready_cb (GInputStream         *stream,
+                              GAsyncResult         *result,
+                              SendAndReadAsyncData *data)
+{
+        GError *error = NULL;
+
+        g_input_stream_close_finish (stream, result, data->error ? NULL : &error);
+        if (!data->error)
+                data->error = error;
+
+        if (data->error) {
+                g_task_return_error (data->task, g_steal_pointer (&data->error));
+        } else {
+                g_task_return_pointer (data->task,
+                                       body_collector_steal_bytes (&data->collector),
+                                       (GDestroyNotify)g_bytes_unref);
+        }
+        send_and_read_async_data_free (data);
+}
+
+static void send_and_read_read_next (SendAndReadAsyncData *data);
+
+static void
+send_and_read_read_ready_cb (GInputStream         *stream,
+                             GAsyncResult         *result,
+                             SendAndReadAsyncData *data)
+{
+        gssize nread;
+
+        nread = g_input_stream_read_finish (stream, result, &data->error);
+        if (nread > 0) {
+                body_collector_advance (&data->collector, nread);
+                send_and_read_read_next (data);
+                return;
+        }
+
+        g_input_stream_close_async (stream,
+                                    g_task_get_priority (data->task),
+                                    NULL,
+                                    (GAsyncReadyCallback)send_and_read_close_ready_cb,
+                                    data);
+}
+
+static void
+send_and_read_read_next (SendAndReadAsyncData *data)
+{
+        guint8 *buffer;
+        gsize size;
+
+        buffer = body_collector_get_buffer (&data->collector, &size);
+        g_input_stream_read_async (data->stream, buffer, size,
+                                   g_task_get_priority (data->task),
+                                   g_task_get_cancellable (data->task),
+                                   (GAsyncReadyCallback)send_and_read_read_ready_cb,
+                                   data);
+}
+
+static void
+send_and_read_stream_ready_cb (SoupSession          *session,
+                               GAsyncResult         *result,
+                               SendAndReadAsyncData *data)
+{
+        GError *error = NULL;
 
         // In order for soup_session_get_async_result_message() to work it must
         // have the task data for the task it wrapped
         SoupMessageQueueItem *item = g_task_get_task_data (G_TASK (result));
-        g_task_set_task_data (task, soup_message_queue_item_ref (item), (GDestroyNotify)soup_message_queue_item_unref);
+        g_task_set_task_data (data->task, soup_message_queue_item_ref (item), (GDestroyNotify)soup_message_queue_item_unref);
 
-        if (soup_session_send_and_splice_finish (session, result, &error) != -1) {
-                g_task_return_pointer (task,
-                                       g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream)),
-                                       (GDestroyNotify)g_bytes_unref);
-        } else {
-                g_task_return_error (task, error);
+        data->stream = soup_session_send_finish (session, result, &error);
+        if (!data->stream) {
+                g_task_return_error (data->task, error);
+                send_and_read_async_data_free (data);
+                return;
         }
-        g_object_unref (task);
+
+        body_collector_init (&data->collector, item->msg);
+        send_and_read_read_next (data);
 }
 
 /**
@@ -3419,25 +4099,21 @@ soup_session_send_and_read_async (SoupSession        *session,
 				  GAsyncReadyCallback callback,
 				  gpointer            user_data)
 {
-	GTask *task;
-        GOutputStream *ostream;
+        SendAndReadAsyncData *data;
 
 	g_return_if_fail (SOUP_IS_SESSION (session));
 	g_return_if_fail (SOUP_IS_MESSAGE (msg));
 
-        ostream = g_memory_output_stream_new_resizable ();
-	task = g_task_new (session, cancellable, callback, user_data);
-        g_task_set_source_tag (task, soup_session_send_and_read_async);
-	g_task_set_priority (task, io_priority);
-        g_task_set_task_data (task, ostream, g_object_unref);
+        data = g_new0 (SendAndReadAsyncData, 1);
+	data->task = g_task_new (session, cancellable, callback, user_data);
+        g_task_set_source_tag (data->task, soup_session_send_and_read_async);
+	g_task_set_priority (data->task, io_priority);
 
-        soup_session_send_and_splice_async (session, msg, ostream,
-                                            G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-                                            G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-                                            g_task_get_priority (task),
-                                            g_task_get_cancellable (task),
-                                            (GAsyncReadyCallback)send_and_read_splice_ready_cb,
-                                            task);
+        soup_session_send_async (session, msg,
+                                 g_task_get_priority (data->task),
+                                 g_task_get_cancellable (data->task),
+                                 (GAsyncReadyCallback)send_and_read_stream_ready_cb,
+                                 data);
 }
 
 /**
@@ -3486,24 +4162,92 @@ soup_session_send_and_read (SoupSession  *session,
 			    GCancellable *cancellable,
 			    GError      **error)
 {
-	GOutputStream *ostream;
+        SoupBodyCollector collector;
+	GInputStream *stream;
 	GBytes *bytes = NULL;
+        GError *my_error = NULL;
+        gssize nread;
+
+        stream = soup_session_send (session, msg, cancellable, error);
+        if (!stream)
+                return NULL;
+
+        body_collector_init (&collector, msg);
+        do {
+                guint8 *buffer;
+                gsize size;
+
+                buffer = body_collector_get_buffer (&collector, &size);
+                nread = g_input_stream_read (stream, buffer, size, cancellable, &my_error);
+                if (nread > 0)
+                        body_collector_advance (&collector, nread);
+        } while (nread > 0);
+
+        g_input_stream_close (stream, NULL, my_error ? NULL : &my_error);
+        g_object_unref (stream);
 
-        ostream = g_memory_output_stream_new_resizable ();
-        if (soup_session_send_and_splice (session, msg, ostream,
-                                          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-                                          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-                                          cancellable, error) != -1)
-                bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
-        g_object_unref (ostream);
+        if (my_error) {
+                g_propagate_error (error, my_error);
+                body_collector_clear (&collector);
+        } else
+                bytes = body_collector_steal_bytes (&collector);
 
 	return bytes;
 }
 
+/* Whether the response body in @stream can be moved to @out_stream by
+ * the kernel instead of being copied through user space.
+ */
+static gboolean
+can_splice_in_kernel (GInputStream  *stream,
+                      GOutputStream *out_stream)
+{
+        return SOUP_IS_CLIENT_INPUT_STREAM (stream) &&
+                !g_output_stream_is_closed (out_stream) &&
+                !g_output_stream_has_pending (out_stream) &&
+                soup_client_input_stream_can_splice (SOUP_CLIENT_INPUT_STREAM (stream), out_stream);
+}
+
+static gssize
+splice_in_kernel (GInputStream            *stream,
+                  GOutputStream           *out_stream,
+                  GOutputStreamSpliceFlags flags,
+                  GCancellable            *cancellable,
+                  GError                 **error)
+{
+        gssize total = 0;
+        gssize nspliced;
+        GError *my_error = NULL;
+
+        do {
+                nspliced = soup_client_input_stream_splice (SOUP_CLIENT_INPUT_STREAM (stream), TRUE,
+                                                            cancellable, &my_error);
+                if (nspliced > 0)
+                        total += nspliced;
+        } while (nspliced > 0);
+
+        if (flags & G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE)
+                g_input_stream_close (stream, cancellable, my_error ? NULL : &my_error);
+        if (flags & G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET)
+                g_output_stream_close (out_stream, cancellable, my_error ? NULL : &my_error);
+
+        if (my_error) {
+                g_propagate_error (error, my_error);
+                return -1;
+        }
+
+        return total;
+}
+
 typedef struct {
         GOutputStream *out_stream;
         GOutputStreamSpliceFlags flags;
         GTask *task;
+
+        /* Only used when splicing in the kernel */
+        GInputStream *stream;
+        gssize nspliced;
+        GError *error;
 } SendAndSpliceAsyncData;
 
 static void
@@ -3511,10 +4255,115 @@ send_and_splice_async_data_free (SendAndSpliceAsyncData *data)
 {
         g_clear_object (&data->out_stream);
         g_clear_object (&data->task);
+        g_clear_object (&data->stream);
+        g_clear_error (&data->error);
 
         g_free (data);
 }
 
+/* Don't hold the main context for more than this per dispatch */
+#define SPLICE_IN_KERNEL_DISPATCH_MAX (4 * 1024 * 1024)
+
+static void send_and_splice_in_kernel (SendAndSpliceAsyncData *data);
+static void send_and_splice_in_kernel_finish (SendAndSpliceAsyncData *data);
+
+static void
+send_and_splice_source_closed_cb (GInputStream           *stream,
+                                  GAsyncResult           *result,
+                                  SendAndSpliceAsyncData *data)
+{
+        g_input_stream_close_finish (stream, result, data->error ? NULL : &data->error);
+        send_and_splice_in_kernel_finish (data);
+}
+
+static void
+send_and_splice_target_closed_cb (GOutputStream          *stream,
+                                  GAsyncResult           *result,
+                                  SendAndSpliceAsyncData *data)
+{
+        g_output_stream_close_finish (stream, result, data->error ? NULL : &data->error);
+        send_and_splice_in_kernel_finish (data);
+}
+
+static void
+send_and_splice_in_kernel_finish (SendAndSpliceAsyncData *data)
+{
+        if (data->flags & G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE) {
+                data->flags &= ~G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE;
+                g_input_stream_close_async (data->stream,
+                                            g_task_get_priority (data->task),
+                                            g_task_get_cancellable (data->task),
+                                            (GAsyncReadyCallback)send_and_splice_source_closed_cb,
+                                            data);
+                return;
+        }
+
+        if (data->flags & G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET) {
+                data->flags &= ~G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET;
+                g_output_stream_close_async (data->out_stream,
+                                             g_task_get_priority (data->task),
+                                             g_task_get_cancellable (data->task),
+                                             (GAsyncReadyCallback)send_and_splice_target_closed_cb,
+                                             data);
+                return;
+        }
+
+        if (data->error)
+                g_task_return_error (data->task, g_steal_pointer (&data->error));
+        else
+                g_task_return_int (data->task, data->nspliced);
+        send_and_splice_async_data_free (data);
+}
+
+static gboolean
+send_and_splice_in_kernel_idle_cb (SendAndSpliceAsyncData *data)
+{
+        send_and_splice_in_kernel (data);
+        return G_SOURCE_REMOVE;
+}
+
+static gboolean
+send_and_splice_in_kernel_ready_cb (int                     fd,
+                                    GIOCondition            condition,
+                                    SendAndSpliceAsyncData *data)
+{
+        send_and_splice_in_kernel (data);
+        return G_SOURCE_REMOVE;
+}
+
+static void
+send_and_splice_in_kernel (SendAndSpliceAsyncData *data)
+{
+        SoupClientInputStream *stream = SOUP_CLIENT_INPUT_STREAM (data->stream);
+        GCancellable *cancellable = g_task_get_cancellable (data->task);
+        GSource *source = NULL;
+        gsize moved = 0;
+        gssize nspliced;
+
+        while ((nspliced = soup_client_input_stream_splice (stream, FALSE, cancellable, &data->error)) > 0) {
+                data->nspliced += nspliced;
+                moved += nspliced;
+                if (moved >= SPLICE_IN_KERNEL_DISPATCH_MAX) {
+                        source = g_idle_source_new ();
+                        g_source_set_callback (source, (GSourceFunc)send_and_splice_in_kernel_idle_cb, data, NULL);
+                        break;
+                }
+        }
+
+        if (nspliced == -1 && g_error_matches (data->error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+                g_clear_error (&data->error);
+                source = soup_client_input_stream_create_splice_source (stream, cancellable);
+                g_source_set_callback (source, (GSourceFunc)send_and_splice_in_kernel_ready_cb, data, NULL);
+        } else if (nspliced <= 0) {
+                send_and_splice_in_kernel_finish (data);
+                return;
+        }
+
+        g_source_set_priority (source, g_task_get_priority (data->task));
+        g_source_attach (source, g_task_get_context (data->task));
+        g_source_unref (source);
+}
+
 static void
 send_and_splice_ready_cb (GOutputStream *ostream,
                           GAsyncResult  *result,
@@ -3552,6 +4401,12 @@ send_and_splice_stream_ready_cb (SoupSession            *session,
                 return;
         }
 
+        if (can_splice_in_kernel (stream, data->out_stream)) {
+                data->stream = stream;
+                send_and_splice_in_kernel (data);
+                return;
+        }
+
         task = g_steal_pointer (&data->task);
         g_output_stream_splice_async (data->out_stream, stream, data->flags,
                                       g_task_get_priority (task),
@@ -3577,6 +4432,11 @@ send_and_splice_stream_ready_cb (SoupSession            *session,
  * When @callback is called, then either @msg has been sent and its response body
  * spliced, or else an error has occurred.
  *
+ * If @out_stream is backed by a file descriptor, such as a local file or a
+ * socket, and the response body is received unmodified over a plain HTTP/1
+ * connection, it is moved by the kernel without being copied to user space,
+ * where supported.
+ *
  * See [method@Session.send] for more details on the general semantics.
  *
  * Since: 3.4
@@ -3645,6 +4505,11 @@ soup_session_send_and_splice_finish (SoupSession  *session,
  *
  * Synchronously sends @msg and splices the response body stream into @out_stream.
  *
+ * If @out_stream is backed by a file descriptor, such as a local file or a
+ * socket, and the response body is received unmodified over a plain HTTP/1
+ * connection, it is moved by the kernel without being copied to user space,
+ * where supported.
+ *
  * See [method@Session.send] for more details on the general semantics.
  *
  * Returns: a #gssize containing the size of the data spliced, or -1 if an error occurred.
@@ -3668,7 +4533,10 @@ soup_session_send_and_splice (SoupSession             *session,
         if (!stream)
                 return -1;
 
-        retval = g_output_stream_splice (out_stream, stream, flags, cancellable, error);
+        if (can_splice_in_kernel (stream, out_stream))
+                retval = splice_in_kernel (stream, out_stream, flags, cancellable, error);
+        else
+                retval = g_output_stream_splice (out_stream, stream, flags, cancellable, error);
         g_object_unref (stream);
 
         return retval;
@@ -69,6 +69,24 @@ guint               soup_session_get_max_conns            (SoupSession     *sess
 SOUP_AVAILABLE_IN_ALL
 guint               soup_session_get_max_conns_per_host   (SoupSession     *session);
 
+SOUP_AVAILABLE_IN_3_8
+guint               soup_session_get_max_pipeline_depth   (SoupSession     *session);
+
+SOUP_AVAILABLE_IN_3_8
+void                soup_session_set_max_pipeline_depth_for_host (SoupSession *session,
+								  const char  *host,
+								  guint        depth);
+
+SOUP_AVAILABLE_IN_3_8
+guint               soup_session_get_max_pipeline_depth_for_host (SoupSession *session,
+								  const char  *host);
+
+SOUP_AVAILABLE_IN_3_8
+int                 soup_session_get_http2_min_window_size (SoupSession    *session);
+
+SOUP_AVAILABLE_IN_3_8
+int                 soup_session_get_http2_max_window_size (SoupSession    *session);
+
 SOUP_AVAILABLE_IN_ALL
 void                soup_session_set_proxy_resolver       (SoupSession     *session,
 							   GProxyResolver  *proxy_resolver);
@@ -104,6 +122,19 @@ void                soup_session_set_idle_timeout         (SoupSession     *sess
 SOUP_AVAILABLE_IN_ALL
 guint               soup_session_get_idle_timeout         (SoupSession     *session);
 
+SOUP_AVAILABLE_IN_3_8
+void                soup_session_set_http2_ping_interval  (SoupSession     *session,
+							   guint            interval);
+
+SOUP_AVAILABLE_IN_3_8
+guint               soup_session_get_http2_ping_interval  (SoupSession     *session);
+
+SOUP_AVAILABLE_IN_3_8
+guint               soup_session_get_read_buffer_min_size (SoupSession     *session);
+
+SOUP_AVAILABLE_IN_3_8
+guint               soup_session_get_read_buffer_max_size (SoupSession     *session);
+
 SOUP_AVAILABLE_IN_ALL
 void                soup_session_set_user_agent           (SoupSession     *session,
 							   const char      *user_agent);
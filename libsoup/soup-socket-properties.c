@@ -8,6 +8,7 @@
 #endif
 
 #include "soup-socket-properties.h"
+#include "soup-filter-input-stream.h"
 #include "soup.h"
 
 SoupSocketProperties *
@@ -29,6 +30,9 @@ soup_socket_properties_new (GInetSocketAddress *local_addr,
 	props->io_timeout = io_timeout;
 	props->idle_timeout = idle_timeout;
 
+	props->read_buffer_min_size = SOUP_FILTER_INPUT_STREAM_READ_SIZE_MIN;
+	props->read_buffer_max_size = SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX;
+
 	return props;
 }
 
@@ -19,6 +19,17 @@ typedef struct {
 
 	guint io_timeout;
 	guint idle_timeout;
+
+	/* Seconds without receiving anything after which HTTP/2
+	 * connections are checked with a PING, 0 to disable it.
+	 */
+	guint http2_ping_interval;
+
+	/* Bounds for the adaptive size of reads on the connection, see
+	 * SoupSession:read-buffer-min-size.
+	 */
+	gsize read_buffer_min_size;
+	gsize read_buffer_max_size;
 } SoupSocketProperties;
 
 GType soup_socket_properties_get_type (void);
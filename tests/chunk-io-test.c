@@ -568,6 +568,111 @@ do_io_tests (void)
 	g_string_free (chunkified, TRUE);
 }
 
+static void
+do_small_chunks_test (void)
+{
+	static const gsize chunk_sizes[] = { 1, 16, 1024, 65536 };
+	static const gsize read_sizes[] = { 1, 7, 4096, 100000 };
+	GBytes *raw_contents;
+	const char *raw_data;
+	gsize raw_length;
+	int c, r;
+
+	raw_contents = soup_test_get_index ();
+	raw_data = g_bytes_get_data (raw_contents, &raw_length);
+
+	for (c = 0; c < G_N_ELEMENTS (chunk_sizes); c++) {
+		GString *chunked = g_string_new (NULL);
+		gsize i, size;
+
+		for (i = 0; i < raw_length; i += chunk_sizes[c]) {
+			size = MIN (chunk_sizes[c], raw_length - i);
+			if (i % 3)
+				g_string_append_printf (chunked, "%" G_GSIZE_MODIFIER "x;ext=%" G_GSIZE_MODIFIER "u\r\n", size, i);
+			else
+				g_string_append_printf (chunked, "%" G_GSIZE_MODIFIER "X\r\n", size);
+			g_string_append_len (chunked, raw_data + i, size);
+			g_string_append (chunked, "\r\n");
+		}
+		g_string_append (chunked, "0\r\nTrailer: yes\r\n\r\nNEXT");
+
+		for (r = 0; r < G_N_ELEMENTS (read_sizes); r++) {
+			GInputStream *imem, *filter, *in;
+			GError *error = NULL;
+			char *buf, next[5];
+			gsize total = 0;
+			gssize nread;
+
+			debug_printf (1, "  chunk size %" G_GSIZE_FORMAT ", read size %" G_GSIZE_FORMAT "\n",
+				      chunk_sizes[c], read_sizes[r]);
+
+			imem = g_memory_input_stream_new_from_data (chunked->str, chunked->len, NULL);
+			filter = soup_filter_input_stream_new (imem);
+			in = soup_body_input_stream_new (filter, SOUP_ENCODING_CHUNKED, 0);
+
+			buf = g_malloc (raw_length + read_sizes[r]);
+			do {
+				nread = g_input_stream_read (in, buf + total, read_sizes[r], NULL, &error);
+				g_assert_no_error (error);
+				total += MAX (nread, 0);
+			} while (nread > 0);
+			soup_assert_cmpmem (buf, total, raw_data, raw_length);
+			g_free (buf);
+
+			/* Data after the body must be left for the next reader */
+			nread = g_input_stream_read (filter, next, sizeof (next), NULL, &error);
+			g_assert_no_error (error);
+			soup_assert_cmpmem (next, nread, "NEXT", 4);
+
+			g_object_unref (in);
+			g_object_unref (filter);
+			g_object_unref (imem);
+		}
+
+		g_string_free (chunked, TRUE);
+	}
+}
+
+static void
+do_adaptive_read_size_test (void)
+{
+	GInputStream *imem, *filter, *in;
+	GError *error = NULL;
+	char *data, buf[4096];
+	gsize length = 1024 * 1024, total = 0;
+	guint64 n_reads, n_bytes;
+	gssize nread;
+
+	data = g_malloc (length);
+	memset (data, 'a', length);
+	imem = g_memory_input_stream_new_from_data (data, length, g_free);
+	filter = soup_filter_input_stream_new (imem);
+	in = soup_body_input_stream_new (filter, SOUP_ENCODING_CONTENT_LENGTH, length);
+
+	g_assert_cmpuint (soup_filter_input_stream_get_read_size (SOUP_FILTER_INPUT_STREAM (filter)), ==,
+			  SOUP_FILTER_INPUT_STREAM_READ_SIZE_MIN);
+
+	do {
+		nread = g_input_stream_read (in, buf, sizeof (buf), NULL, &error);
+		g_assert_no_error (error);
+		total += MAX (nread, 0);
+	} while (nread > 0);
+	g_assert_cmpuint (total, ==, length);
+
+	/* The memory stream always fills the whole buffer, so the
+	 * read size keeps growing and 4K reads are batched.
+	 */
+	g_assert_cmpuint (soup_filter_input_stream_get_read_size (SOUP_FILTER_INPUT_STREAM (filter)), ==,
+			  SOUP_FILTER_INPUT_STREAM_READ_SIZE_MAX);
+	soup_filter_input_stream_get_read_stats (SOUP_FILTER_INPUT_STREAM (filter), &n_reads, &n_bytes);
+	g_assert_cmpuint (n_bytes, ==, length);
+	g_assert_cmpuint (n_reads, <, 16);
+
+	g_object_unref (in);
+	g_object_unref (filter);
+	g_object_unref (imem);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -576,6 +681,8 @@ main (int argc, char **argv)
 	test_init (argc, argv, NULL);
 
 	g_test_add_func ("/chunk-io", do_io_tests);
+	g_test_add_func ("/chunk-io/small-chunks", do_small_chunks_test);
+	g_test_add_func ("/chunk-io/adaptive-read-size", do_adaptive_read_size_test);
 
 	ret = g_test_run ();
 
@@ -164,6 +164,17 @@ server_callback (SoupServer        *server,
 		return;
 	}
 
+	if (g_str_has_prefix (path, "/pipeline/")) {
+		soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+		soup_server_message_set_response (msg, "text/plain",
+						  SOUP_MEMORY_COPY, path, strlen (path));
+		if (!strcmp (path, "/pipeline/close")) {
+			soup_message_headers_append (soup_server_message_get_response_headers (msg),
+						     "Connection", "close");
+		}
+		return;
+	}
+
 	if (!strcmp (path, "/timeout-persistent")) {
 		SoupServerConnection *conn;
 
@@ -1654,6 +1665,164 @@ do_connection_force_http2_test (void)
         soup_test_session_abort_unref (session);
 }
 
+#define PIPELINE_MSGS 4
+
+typedef struct {
+        GString *events;
+        int done;
+        int ok;
+} PipelineTestData;
+
+static void
+pipeline_wrote_headers (SoupMessage      *msg,
+                        PipelineTestData *data)
+{
+        g_string_append_c (data->events, 'w');
+}
+
+static void
+pipeline_got_body (SoupMessage      *msg,
+                   PipelineTestData *data)
+{
+        g_string_append_c (data->events, 'b');
+}
+
+static void
+pipeline_message_read (SoupSession      *session,
+                       GAsyncResult     *result,
+                       PipelineTestData *data)
+{
+        SoupMessage *msg = soup_session_get_async_result_message (session, result);
+        GBytes *body;
+        GError *error = NULL;
+        char *expected;
+
+        body = soup_session_send_and_read_finish (session, result, &error);
+        g_assert_no_error (error);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        if (soup_message_get_status (msg) == SOUP_STATUS_OK)
+                data->ok++;
+
+        expected = g_strdup (g_uri_get_path (soup_message_get_uri (msg)));
+        g_assert_cmpmem (g_bytes_get_data (body, NULL), g_bytes_get_size (body),
+                         expected, strlen (expected));
+        g_free (expected);
+        g_bytes_unref (body);
+
+        data->done++;
+}
+
+static void
+do_pipeline_burst (SoupSession       *session,
+                   const char       **paths,
+                   PipelineTestData  *data)
+{
+        SoupMessage *msgs[PIPELINE_MSGS];
+        int i;
+
+        g_string_truncate (data->events, 0);
+        data->done = 0;
+        data->ok = 0;
+        for (i = 0; i < PIPELINE_MSGS; i++) {
+                GUri *uri = g_uri_parse_relative (base_uri, paths[i], SOUP_HTTP_URI_FLAGS, NULL);
+
+                msgs[i] = soup_message_new_from_uri ("GET", uri);
+                g_uri_unref (uri);
+                g_signal_connect (msgs[i], "wrote-headers",
+                                  G_CALLBACK (pipeline_wrote_headers), data);
+                g_signal_connect (msgs[i], "got-body",
+                                  G_CALLBACK (pipeline_got_body), data);
+                soup_session_send_and_read_async (session, msgs[i], G_PRIORITY_DEFAULT, NULL,
+                                                  (GAsyncReadyCallback)pipeline_message_read,
+                                                  data);
+        }
+
+        while (data->done < PIPELINE_MSGS)
+                g_main_context_iteration (NULL, TRUE);
+
+        for (i = 0; i < PIPELINE_MSGS; i++)
+                g_object_unref (msgs[i]);
+}
+
+static void
+do_connection_pipelining_test (void)
+{
+        SoupSession *session;
+        SoupMessage *msg;
+        GBytes *body;
+        PipelineTestData data = { NULL, 0, 0 };
+        static const char *paths[PIPELINE_MSGS] = {
+                "/pipeline/1", "/pipeline/2", "/pipeline/3", "/pipeline/4"
+        };
+        static const char *close_paths[PIPELINE_MSGS] = {
+                "/pipeline/1", "/pipeline/close", "/pipeline/3", "/pipeline/4"
+        };
+
+        session = soup_test_session_new ("max-conns-per-host", 1,
+                                         "max-pipeline-depth", PIPELINE_MSGS,
+                                         NULL);
+        g_assert_cmpuint (soup_session_get_max_pipeline_depth (session), ==, PIPELINE_MSGS);
+        data.events = g_string_new (NULL);
+
+        /* Pipelining is only attempted on a connection already known
+         * to be persistent, so warm one up first.
+         */
+        msg = soup_message_new_from_uri ("GET", base_uri);
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        debug_printf (1, "  burst\n");
+        do_pipeline_burst (session, paths, &data);
+        /* Every request is written before the first response is read */
+        g_assert_cmpstr (data.events->str, ==, "wwwwbbbb");
+        g_assert_cmpint (data.ok, ==, PIPELINE_MSGS);
+
+        debug_printf (1, "  Connection: close in the middle\n");
+        do_pipeline_burst (session, close_paths, &data);
+        /* The requests behind the closing one are replayed on a new
+         * connection, one at a time since it is not known to be
+         * persistent yet.
+         */
+        g_assert_cmpstr (data.events->str, ==, "wwwwbbwbwb");
+        g_assert_cmpint (data.ok, ==, PIPELINE_MSGS);
+        /* Closing after a Connection: close response is not misbehaving */
+        g_assert_cmpuint (soup_session_get_max_pipeline_depth_for_host (session, g_uri_get_host (base_uri)), ==, PIPELINE_MSGS);
+
+        g_string_free (data.events, TRUE);
+        soup_test_session_abort_unref (session);
+
+        debug_printf (1, "  enabled for a single host\n");
+        session = soup_test_session_new ("max-conns-per-host", 1, NULL);
+        soup_session_set_max_pipeline_depth_for_host (session, g_uri_get_host (base_uri), PIPELINE_MSGS);
+        g_assert_cmpuint (soup_session_get_max_pipeline_depth (session), ==, 1);
+        g_assert_cmpuint (soup_session_get_max_pipeline_depth_for_host (session, g_uri_get_host (base_uri)), ==, PIPELINE_MSGS);
+        g_assert_cmpuint (soup_session_get_max_pipeline_depth_for_host (session, "other.example"), ==, 1);
+        data.events = g_string_new (NULL);
+
+        msg = soup_message_new_from_uri ("GET", base_uri);
+        body = soup_test_session_async_send (session, msg, NULL, NULL);
+        soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+        g_bytes_unref (body);
+        g_object_unref (msg);
+
+        do_pipeline_burst (session, paths, &data);
+        g_assert_cmpstr (data.events->str, ==, "wwwwbbbb");
+        g_assert_cmpint (data.ok, ==, PIPELINE_MSGS);
+        g_string_free (data.events, TRUE);
+        soup_test_session_abort_unref (session);
+
+        debug_printf (1, "  disabled by default\n");
+        session = soup_test_session_new ("max-conns-per-host", 1, NULL);
+        data.events = g_string_new (NULL);
+        do_pipeline_burst (session, paths, &data);
+        g_assert_cmpstr (data.events->str, ==, "wbwbwbwb");
+        g_assert_cmpint (data.ok, ==, PIPELINE_MSGS);
+        g_string_free (data.events, TRUE);
+        soup_test_session_abort_unref (session);
+}
+
 static void
 message_restarted (SoupMessage *msg,
                    gboolean    *was_restarted)
@@ -1715,6 +1884,7 @@ main (int argc, char **argv)
         g_test_add_func ("/connection/metrics", do_connection_metrics_test);
         g_test_add_func ("/connection/force-http2", do_connection_force_http2_test);
         g_test_add_func ("/connection/http2/http-1-1-required", do_connection_http_1_1_required_test);
+        g_test_add_func ("/connection/pipelining", do_connection_pipelining_test);
 
 	ret = g_test_run ();
 
@@ -4,6 +4,7 @@
  */
 
 #include "test-utils.h"
+#include "soup-date-utils-private.h"
 
 static void check_ok (gconstpointer data);
 
@@ -291,6 +292,40 @@ check_conversion (gconstpointer data)
 	g_date_time_unref (date);
 }
 
+static void
+do_unix_time_test (void)
+{
+	char buf[SOUP_HTTP_DATE_SIZE];
+	gint64 unix_time;
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (ok_dates); i++) {
+		GDateTime *date = make_date (ok_dates[i].date);
+
+		g_assert_true (soup_date_time_parse_http_string (ok_dates[i].date, &unix_time));
+		g_assert_cmpint (unix_time, ==, g_date_time_to_unix (date));
+		g_date_time_unref (date);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (bad_dates); i++)
+		g_assert_false (soup_date_time_parse_http_string (bad_dates[i].date, &unix_time));
+
+	/* Rejected or not handled by the IMF-fixdate fast path */
+	g_assert_false (soup_date_time_parse_http_string ("Sat, 31 Feb 2004 08:09:07 GMT", &unix_time));
+	g_assert_false (soup_date_time_parse_http_string ("Sat, 06 Nov 9999 08:09:07 GMT", &unix_time));
+	g_assert_true (soup_date_time_parse_http_string ("Sat, 06 nov 2004 08:09:07 GMT", &unix_time));
+	g_assert_cmpint (unix_time, ==, 1099728547);
+
+	soup_date_time_format_http_unix (1099728547, buf);
+	g_assert_cmpstr (buf, ==, "Sat, 06 Nov 2004 08:09:07 GMT");
+	soup_date_time_format_http_unix (0, buf);
+	g_assert_cmpstr (buf, ==, "Thu, 01 Jan 1970 00:00:00 GMT");
+	soup_date_time_format_http_unix (951782400, buf);
+	g_assert_cmpstr (buf, ==, "Tue, 29 Feb 2000 00:00:00 GMT");
+	soup_date_time_format_http_unix (-1, buf);
+	g_assert_cmpstr (buf, ==, "Wed, 31 Dec 1969 23:59:59 GMT");
+}
+
 int
 main (int argc, char **argv)
 {
@@ -323,6 +358,8 @@ main (int argc, char **argv)
 		g_free (path);
 	}
 
+	g_test_add_func ("/date/unix", do_unix_time_test);
+
 	ret = g_test_run ();
 
 	test_cleanup ();
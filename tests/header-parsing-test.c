@@ -1,6 +1,7 @@
 /* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*- */
 
 #include "test-utils.h"
+#include "soup-message-headers-private.h"
 
 typedef struct {
 	const char *name, *value;
@@ -100,6 +101,16 @@ static struct RequestTest {
 	  }, 0
 	},
 
+	{ "Req w/ 1 header, wrapped multiple times with blank continuation line", NULL,
+	  "GET / HTTP/1.1\r\nFoo: bar \r\n \r\n\tbaz \r\n  qux\r\nHost: example.com\r\n", -1,
+	  SOUP_STATUS_OK,
+	  "GET", "/", SOUP_HTTP_1_1,
+	  { { "Host", "example.com" },
+	    { "Foo", "bar baz qux" },
+	    { NULL }
+	  }, 0
+	},
+
 	{ "Req w/ 1 header with empty value", NULL,
 	  "GET / HTTP/1.1\r\nHost:\r\n", -1,
 	  SOUP_STATUS_OK,
@@ -1570,6 +1581,110 @@ do_append_duplicate_content_length_test (void)
         soup_message_headers_unref (hdrs);
 }
 
+static void
+do_modify_parsed_headers_test (void)
+{
+        SoupMessageHeaders *hdrs;
+        const char *raw = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nX-Foo: foo\r\nX-Bar: bar\r\nX-Foo: baz\r\n";
+
+        hdrs = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+        g_assert_true (soup_headers_parse_response (raw, strlen (raw), hdrs, NULL, NULL, NULL));
+        g_assert_cmpstr (soup_message_headers_get_list (hdrs, "X-Foo"), ==, "foo, baz");
+
+        /* Parsed headers can be replaced and removed, and mixed with
+         * appended ones, independently of the parsed block.
+         */
+        soup_message_headers_replace (hdrs, "Content-Type", "text/html");
+        soup_message_headers_remove (hdrs, "X-Foo");
+        soup_message_headers_append (hdrs, "X-Foo", "qux");
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "Content-Type"), ==, "text/html");
+        g_assert_cmpstr (soup_message_headers_get_list (hdrs, "X-Foo"), ==, "qux");
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "X-Bar"), ==, "bar");
+
+        /* Parsing again into the same headers adds to them */
+        raw = "HTTP/1.1 200 OK\r\nX-Bar: quux\r\n";
+        g_assert_true (soup_headers_parse_response (raw, strlen (raw), hdrs, NULL, NULL, NULL));
+        g_assert_cmpstr (soup_message_headers_get_list (hdrs, "X-Bar"), ==, "bar, quux");
+
+        soup_message_headers_clear (hdrs);
+        g_assert_null (soup_message_headers_get_one (hdrs, "X-Bar"));
+
+        soup_message_headers_unref (hdrs);
+}
+
+static void
+do_many_uncommon_headers_test (void)
+{
+        SoupMessageHeaders *hdrs;
+        char *name, *value;
+        int i;
+
+        hdrs = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+        for (i = 0; i < 100; i++) {
+                name = g_strdup_printf ("X-Trace-%d", i);
+                value = g_strdup_printf ("%d", i);
+                soup_message_headers_append (hdrs, name, value);
+                g_free (name);
+                g_free (value);
+        }
+        soup_message_headers_append (hdrs, "x-trace-10", "again");
+        soup_message_headers_append (hdrs, "X-TRACE-10", "and again");
+
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "X-Trace-0"), ==, "0");
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "x-trace-99"), ==, "99");
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "X-Trace-10"), ==, "and again");
+        g_assert_cmpstr (soup_message_headers_get_list (hdrs, "X-Trace-10"), ==, "10, again, and again");
+        g_assert_null (soup_message_headers_get_one (hdrs, "X-Trace-100"));
+
+        soup_message_headers_remove (hdrs, "x-trace-10");
+        g_assert_null (soup_message_headers_get_one (hdrs, "X-Trace-10"));
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "X-Trace-11"), ==, "11");
+
+        soup_message_headers_append (hdrs, "X-Trace-11", "again");
+        g_assert_cmpstr (soup_message_headers_get_list (hdrs, "X-Trace-11"), ==, "11, again");
+        g_assert_cmpstr (soup_message_headers_get_one (hdrs, "X-Trace-99"), ==, "99");
+
+        soup_message_headers_unref (hdrs);
+}
+
+static void
+do_cached_param_list_tests (void)
+{
+        SoupMessageHeaders *hdrs;
+        GHashTable *params;
+
+        hdrs = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+        g_assert_null (soup_message_headers_get_param_list_common (hdrs, SOUP_HEADER_CACHE_CONTROL));
+        g_assert_null (soup_message_headers_get_content_type_params (hdrs));
+
+        soup_message_headers_append (hdrs, "Cache-Control", "max-age=60");
+        params = soup_message_headers_get_param_list_common (hdrs, SOUP_HEADER_CACHE_CONTROL);
+        g_assert_cmpstr (g_hash_table_lookup (params, "max-age"), ==, "60");
+        g_assert_true (soup_message_headers_get_param_list_common (hdrs, SOUP_HEADER_CACHE_CONTROL) == params);
+
+        /* Appending to the list invalidates the parsed form */
+        soup_message_headers_append (hdrs, "Cache-Control", "no-store");
+        params = soup_message_headers_get_param_list_common (hdrs, SOUP_HEADER_CACHE_CONTROL);
+        g_assert_cmpstr (g_hash_table_lookup (params, "max-age"), ==, "60");
+        g_assert_true (g_hash_table_contains (params, "no-store"));
+
+        soup_message_headers_remove (hdrs, "Cache-Control");
+        g_assert_null (soup_message_headers_get_param_list_common (hdrs, SOUP_HEADER_CACHE_CONTROL));
+
+        soup_message_headers_append (hdrs, "Content-Type", "multipart/mixed; boundary=foo");
+        params = soup_message_headers_get_content_type_params (hdrs);
+        g_assert_cmpstr (g_hash_table_lookup (params, "boundary"), ==, "foo");
+
+        soup_message_headers_replace (hdrs, "Content-Type", "multipart/mixed; boundary=bar");
+        params = soup_message_headers_get_content_type_params (hdrs);
+        g_assert_cmpstr (g_hash_table_lookup (params, "boundary"), ==, "bar");
+
+        soup_message_headers_clear (hdrs);
+        g_assert_null (soup_message_headers_get_content_type_params (hdrs));
+
+        soup_message_headers_unref (hdrs);
+}
+
 static void
 do_content_length_test (void)
 {
@@ -1693,6 +1808,9 @@ main (int argc, char **argv)
 	g_test_add_func ("/header-parsing/append-duplicate-host", do_append_duplicate_host_test);
         g_test_add_func ("/header-parsing/append-duplicate-content-length", do_append_duplicate_content_length_test);
         g_test_add_func ("/header-parsing/content-length", do_content_length_test);
+        g_test_add_func ("/header-parsing/modify-parsed", do_modify_parsed_headers_test);
+        g_test_add_func ("/header-parsing/many-uncommon-headers", do_many_uncommon_headers_test);
+        g_test_add_func ("/header-parsing/cached-param-list", do_cached_param_list_tests);
 
 	ret = g_test_run ();
 
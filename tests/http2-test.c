@@ -22,6 +22,7 @@
 #include "soup-message-private.h"
 #include "soup-message-headers-private.h"
 #include "soup-server-message-private.h"
+#include "soup-server-private.h"
 #include "soup-body-input-stream-http2.h"
 #include <gio/gnetworking.h>
 
@@ -492,6 +493,67 @@ do_post_large_async_test (Test *test, gconstpointer data)
         g_uri_unref (uri);
 }
 
+static void
+on_post_large_multiple_send_ready (GObject      *source,
+                                   GAsyncResult *res,
+                                   gpointer      user_data)
+{
+        GBytes **response = user_data;
+        GError *error = NULL;
+
+        *response = soup_session_send_and_read_finish (SOUP_SESSION (source), res, &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (*response);
+}
+
+static void
+do_post_large_multiple_test (Test *test, gconstpointer data)
+{
+        GUri *uri;
+        GBytes *bodies[4];
+        GBytes *responses[4] = { NULL, };
+        guint large_size = 1000000;
+        guint i, j, n_done = 0;
+
+        /* Several large uploads at once fill the socket, so some DATA
+         * frames only get partially written and the rest has to go out
+         * before any frame of the other streams.
+         */
+        uri = g_uri_parse_relative (base_uri, "/echo_post", SOUP_HTTP_URI_FLAGS, NULL);
+        for (i = 0; i < G_N_ELEMENTS (bodies); i++) {
+                SoupMessage *msg;
+                char *large_data;
+
+                large_data = g_malloc (large_size);
+                for (j = 0; j < large_size; j++)
+                        large_data[j] = (j + i) & 0xFF;
+                bodies[i] = g_bytes_new_take (large_data, large_size);
+
+                msg = soup_message_new_from_uri (SOUP_METHOD_POST, uri);
+                soup_message_set_request_body_from_bytes (msg, "text/plain", bodies[i]);
+                soup_session_send_and_read_async (test->session, msg, G_PRIORITY_DEFAULT, NULL,
+                                                  on_post_large_multiple_send_ready, &responses[i]);
+                g_object_unref (msg);
+        }
+
+        while (n_done < G_N_ELEMENTS (responses)) {
+                g_main_context_iteration (NULL, TRUE);
+
+                for (i = 0, n_done = 0; i < G_N_ELEMENTS (responses); i++) {
+                        if (responses[i])
+                                n_done++;
+                }
+        }
+
+        for (i = 0; i < G_N_ELEMENTS (bodies); i++) {
+                g_assert_true (g_bytes_equal (bodies[i], responses[i]));
+                g_bytes_unref (responses[i]);
+                g_bytes_unref (bodies[i]);
+        }
+
+        g_uri_unref (uri);
+}
+
 static void
 do_post_blocked_async_test (Test *test, gconstpointer data)
 {
@@ -842,6 +904,123 @@ do_flow_control_multi_message_test (Test *test, gconstpointer data)
         g_main_context_unref (async_context);
 }
 
+static void
+do_flow_control_window_tuning_test (Test *test, gconstpointer data)
+{
+        SoupSession *session;
+        GUri *uri;
+        SoupMessage *msg;
+        SoupConnection *conn;
+        GInputStream *stream;
+        guint8 *buffer;
+        gssize nread;
+        gsize total = 0;
+        int max_seen;
+        GError *error = NULL;
+
+        g_assert_cmpint (soup_session_get_http2_min_window_size (test->session), ==, 1024 * 1024);
+        g_assert_cmpint (soup_session_get_http2_max_window_size (test->session), ==, 16 * 1024 * 1024);
+
+        session = soup_test_session_new ("http2-min-window-size", 65535,
+                                         "http2-max-window-size", 1024 * 1024,
+                                         NULL);
+        g_assert_cmpint (soup_session_get_http2_min_window_size (session), ==, 65535);
+        g_assert_cmpint (soup_session_get_http2_max_window_size (session), ==, 1024 * 1024);
+
+        /* The body is much larger than the initial window, so the server
+         * keeps it full and the BDP samples must grow it.
+         */
+        uri = g_uri_parse_relative (base_uri, "/larger-than-window", SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+        stream = soup_session_send (session, msg, NULL, &error);
+        g_assert_no_error (error);
+
+        conn = soup_message_get_connection (msg);
+        g_assert_nonnull (conn);
+        g_assert_cmpint (soup_connection_get_http2_initial_window_size (conn), ==, 65535);
+        g_assert_cmpint (soup_connection_get_http2_max_window_size (conn), ==, 1024 * 1024);
+        max_seen = soup_connection_get_http2_window_size (conn);
+
+        buffer = g_malloc (64 * 1024);
+        do {
+                nread = g_input_stream_read (stream, buffer, 64 * 1024, NULL, &error);
+                g_assert_no_error (error);
+                total += nread;
+                max_seen = MAX (max_seen, soup_connection_get_http2_window_size (conn));
+        } while (nread > 0);
+        g_free (buffer);
+
+        g_assert_cmpuint (total, ==, REALLY_LARGE_BUFFER_SIZE);
+        g_assert_cmpint (max_seen, >, 65535);
+        g_assert_cmpint (max_seen, <=, 1024 * 1024);
+        g_assert_cmpint (soup_connection_get_http2_window_size (conn), >=, 65535);
+
+        g_object_unref (conn);
+        g_object_unref (stream);
+        g_object_unref (msg);
+        g_uri_unref (uri);
+        soup_test_session_abort_unref (session);
+}
+
+static gboolean
+quit_loop (gpointer user_data)
+{
+        g_main_loop_quit (user_data);
+        return G_SOURCE_REMOVE;
+}
+
+static void
+do_ping_rtt_test (Test *test, gconstpointer data)
+{
+        SoupSession *session;
+        GUri *uri;
+        SoupMessage *msg;
+        SoupMessageMetrics *metrics;
+        SoupConnection *conn;
+        GMainLoop *loop;
+        GBytes *response;
+        GError *error = NULL;
+
+        g_assert_cmpuint (soup_session_get_http2_ping_interval (test->session), ==, 0);
+
+        session = soup_test_session_new ("http2-ping-interval", 1, NULL);
+        g_assert_cmpuint (soup_session_get_http2_ping_interval (session), ==, 1);
+
+        uri = g_uri_parse_relative (base_uri, "/", SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+        response = soup_test_session_async_send (session, msg, NULL, &error);
+        g_assert_no_error (error);
+        conn = soup_message_get_connection (msg);
+        g_assert_nonnull (conn);
+        g_object_add_weak_pointer (G_OBJECT (conn), (gpointer *)&conn);
+        g_bytes_unref (response);
+        g_object_unref (msg);
+
+        /* Let the idle connection send at least one health check PING */
+        loop = g_main_loop_new (NULL, FALSE);
+        g_timeout_add (2500, quit_loop, loop);
+        g_main_loop_run (loop);
+        g_main_loop_unref (loop);
+
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+        soup_message_add_flags (msg, SOUP_MESSAGE_COLLECT_METRICS);
+        response = soup_test_session_async_send (session, msg, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_true (soup_message_get_connection (msg) == conn);
+
+        metrics = soup_message_get_metrics (msg);
+        g_assert_nonnull (metrics);
+        g_assert_cmpuint (soup_message_metrics_get_rtt (metrics), >, 0);
+        g_assert_cmpuint (soup_message_metrics_get_min_rtt (metrics), >, 0);
+        g_assert_cmpuint (soup_message_metrics_get_min_rtt (metrics), <=, soup_message_metrics_get_rtt (metrics));
+
+        g_object_remove_weak_pointer (G_OBJECT (conn), (gpointer *)&conn);
+        g_bytes_unref (response);
+        g_object_unref (msg);
+        g_uri_unref (uri);
+        soup_test_session_abort_unref (session);
+}
+
 static SoupConnection *last_connection;
 
 static void
@@ -937,6 +1116,175 @@ do_misdirected_request_test (Test *test, gconstpointer data)
         g_uri_unref (uri);
 }
 
+static void
+do_connection_coalescing_test (Test *test, gconstpointer data)
+{
+        GResolver *resolver;
+        GInetAddress *loopback;
+        GList *addresses, *l;
+        gboolean localhost_is_loopback = FALSE;
+        GUri *uri, *localhost_uri;
+        SoupMessage *msg;
+        guint64 connection_id;
+        GBytes *response;
+        GError *error = NULL;
+
+        /* The test certificate is valid for both 127.0.0.1 and localhost */
+        resolver = g_resolver_get_default ();
+        addresses = g_resolver_lookup_by_name (resolver, "localhost", NULL, NULL);
+        loopback = g_inet_address_new_from_string ("127.0.0.1");
+        for (l = addresses; l; l = g_list_next (l)) {
+                if (g_inet_address_equal (l->data, loopback))
+                        localhost_is_loopback = TRUE;
+        }
+        g_resolver_free_addresses (addresses);
+        g_object_unref (loopback);
+        g_object_unref (resolver);
+        if (!localhost_is_loopback) {
+                g_test_skip ("localhost does not resolve to 127.0.0.1");
+                return;
+        }
+
+        uri = g_uri_parse_relative (base_uri, "/", SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+        response = soup_test_session_async_send (test->session, msg, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_cmpuint (soup_message_get_http_version (msg), ==, SOUP_HTTP_2_0);
+        connection_id = soup_message_get_connection_id (msg);
+        g_assert_cmpuint (connection_id, !=, 0);
+        g_bytes_unref (response);
+        g_object_unref (msg);
+
+        localhost_uri = soup_uri_copy (uri, SOUP_URI_HOST, "localhost", SOUP_URI_NONE);
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, localhost_uri);
+        response = soup_test_session_async_send (test->session, msg, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_cmpstr (g_bytes_get_data (response, NULL), ==, "Hello world");
+        g_assert_cmpuint (soup_message_get_connection_id (msg), ==, connection_id);
+
+        g_bytes_unref (response);
+        g_object_unref (msg);
+        g_uri_unref (localhost_uri);
+        g_uri_unref (uri);
+}
+
+static void
+on_max_concurrent_streams_send_ready (GObject      *source,
+                                      GAsyncResult *res,
+                                      gpointer      user_data)
+{
+        SoupSession *session = SOUP_SESSION (source);
+        SoupMessage *msg = soup_session_get_async_result_message (session, res);
+        GArray *connection_ids = user_data;
+        guint64 connection_id;
+        GBytes *body;
+        GError *error = NULL;
+
+        body = soup_session_send_and_read_finish (session, res, &error);
+        g_assert_no_error (error);
+        g_assert_nonnull (body);
+        g_bytes_unref (body);
+
+        connection_id = soup_message_get_connection_id (msg);
+        g_array_append_val (connection_ids, connection_id);
+}
+
+static void
+do_max_concurrent_streams_test (Test *test, gconstpointer data)
+{
+        SoupServer *server;
+        GUri *server_uri, *uri;
+        SoupMessage *msg;
+        GBytes *response;
+        GArray *connection_ids;
+        guint64 first_connection_id;
+        guint n_first_connection = 0;
+        GError *error = NULL;
+        guint i;
+
+        server = soup_test_server_new (SOUP_TEST_SERVER_IN_THREAD | SOUP_TEST_SERVER_HTTP2);
+        soup_server_set_http2_max_concurrent_streams (server, 2);
+        soup_server_add_handler (server, NULL, server_handler, NULL, NULL);
+        server_uri = soup_test_server_get_uri (server, "https", "127.0.0.1");
+
+        /* Get the server settings first */
+        uri = g_uri_parse_relative (server_uri, "/", SOUP_HTTP_URI_FLAGS, NULL);
+        msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+        response = soup_test_session_async_send (test->session, msg, NULL, &error);
+        g_assert_no_error (error);
+        first_connection_id = soup_message_get_connection_id (msg);
+        g_bytes_unref (response);
+        g_object_unref (msg);
+        g_uri_unref (uri);
+
+        /* Four slow requests need two connections, with two streams each */
+        connection_ids = g_array_new (FALSE, FALSE, sizeof (guint64));
+        uri = g_uri_parse_relative (server_uri, "/slow", SOUP_HTTP_URI_FLAGS, NULL);
+        for (i = 0; i < 4; i++) {
+                msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+                soup_session_send_and_read_async (test->session, msg, G_PRIORITY_DEFAULT, NULL,
+                                                  on_max_concurrent_streams_send_ready, connection_ids);
+                g_object_unref (msg);
+        }
+
+        while (connection_ids->len < 4)
+                g_main_context_iteration (NULL, TRUE);
+
+        for (i = 0; i < connection_ids->len; i++) {
+                guint64 connection_id = g_array_index (connection_ids, guint64, i);
+
+                if (connection_id == first_connection_id)
+                        n_first_connection++;
+                else
+                        g_assert_cmpuint (connection_id, ==, first_connection_id + 1);
+        }
+        g_assert_cmpuint (n_first_connection, ==, 2);
+
+        g_array_free (connection_ids, TRUE);
+        g_uri_unref (uri);
+        g_uri_unref (server_uri);
+        soup_test_server_quit_unref (server);
+}
+
+static void
+do_priority_header_test (Test *test, gconstpointer data)
+{
+        static const struct {
+                SoupMessagePriority priority;
+                const char *header;
+                const char *expected;
+        } tests[] = {
+                { SOUP_MESSAGE_PRIORITY_NORMAL, NULL, "none" },
+                { SOUP_MESSAGE_PRIORITY_VERY_HIGH, NULL, "u=1" },
+                { SOUP_MESSAGE_PRIORITY_HIGH, NULL, "u=2" },
+                { SOUP_MESSAGE_PRIORITY_LOW, NULL, "u=4" },
+                { SOUP_MESSAGE_PRIORITY_VERY_LOW, NULL, "u=5" },
+                { SOUP_MESSAGE_PRIORITY_HIGH, "u=6, i", "u=6, i" }
+        };
+        GUri *uri;
+        guint i;
+
+        uri = g_uri_parse_relative (base_uri, "/echo_priority", SOUP_HTTP_URI_FLAGS, NULL);
+        for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+                SoupMessage *msg;
+                GBytes *response;
+                GError *error = NULL;
+
+                msg = soup_message_new_from_uri (SOUP_METHOD_GET, uri);
+                soup_message_set_priority (msg, tests[i].priority);
+                if (tests[i].header)
+                        soup_message_headers_replace (soup_message_get_request_headers (msg), "Priority", tests[i].header);
+                response = soup_test_session_async_send (test->session, msg, NULL, &error);
+                g_assert_no_error (error);
+                g_assert_cmpmem (g_bytes_get_data (response, NULL), g_bytes_get_size (response),
+                                 tests[i].expected, strlen (tests[i].expected));
+
+                g_bytes_unref (response);
+                g_object_unref (msg);
+        }
+        g_uri_unref (uri);
+}
+
 static void
 log_printer (SoupLogger *logger,
              SoupLoggerLogLevel level,
@@ -1588,6 +1936,15 @@ server_handler (SoupServer        *server,
                 soup_server_message_set_response (msg, "text/plain",
                                                   SOUP_MEMORY_STATIC,
                                                   query_str, strlen (query_str));
+        } else if (strcmp (path, "/echo_priority") == 0) {
+                const char *priority = soup_message_headers_get_one (soup_server_message_get_request_headers (msg), "Priority");
+
+                if (!priority)
+                        priority = "none";
+                soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+                soup_server_message_set_response (msg, "text/plain",
+                                                  SOUP_MEMORY_COPY,
+                                                  priority, strlen (priority));
         } else if (strcmp (path, "/echo_post") == 0) {
                 SoupMessageBody *request_body;
 
@@ -1746,6 +2103,10 @@ main (int argc, char **argv)
                     setup_session,
                     do_post_large_async_test,
                     teardown_session);
+        g_test_add ("/http2/post/large/multiple", Test, NULL,
+                    setup_session,
+                    do_post_large_multiple_test,
+                    teardown_session);
         g_test_add ("/http2/post/blocked/async", Test, NULL,
                     setup_session,
                     do_post_blocked_async_test,
@@ -1782,6 +2143,14 @@ main (int argc, char **argv)
                     setup_session,
                     do_flow_control_close_buffered_body_test,
                     teardown_session);
+        g_test_add ("/http2/flow-control/window-tuning", Test, NULL,
+                    setup_session,
+                    do_flow_control_window_tuning_test,
+                    teardown_session);
+        g_test_add ("/http2/ping/rtt", Test, NULL,
+                    setup_session,
+                    do_ping_rtt_test,
+                    teardown_session);
         g_test_add ("/http2/connections", Test, NULL,
                     setup_session,
                     do_connections_test,
@@ -1790,6 +2159,18 @@ main (int argc, char **argv)
                     setup_session,
                     do_misdirected_request_test,
                     teardown_session);
+        g_test_add ("/http2/connection-coalescing", Test, NULL,
+                    setup_session,
+                    do_connection_coalescing_test,
+                    teardown_session);
+        g_test_add ("/http2/max-concurrent-streams", Test, NULL,
+                    setup_session,
+                    do_max_concurrent_streams_test,
+                    teardown_session);
+        g_test_add ("/http2/priority/header", Test, NULL,
+                    setup_session,
+                    do_priority_header_test,
+                    teardown_session);
         g_test_add ("/http2/logging", Test, NULL,
                     setup_session,
                     do_logging_test,
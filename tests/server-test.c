@@ -7,9 +7,13 @@
 #include "soup-message-private.h"
 #include "soup-uri-utils-private.h"
 #include "soup-server-private.h"
+#include "soup-server-message-private.h"
+#include "soup-path-map.h"
 #include "soup-misc.h"
 
 #include <gio/gnetworking.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
 
 typedef struct {
 	SoupServer *server;
@@ -1316,6 +1320,16 @@ do_steal_connect_test (ServerData *sd, gconstpointer test_data)
 	g_free (proxy_uri_str);
 }
 
+static guint
+count_clients (SoupServer *server)
+{
+        GSList *clients = soup_server_get_clients (server);
+        guint n_clients = g_slist_length (clients);
+
+        g_slist_free_full (clients, g_object_unref);
+        return n_clients;
+}
+
 static void
 do_idle_connection_closed_test (ServerData *sd, gconstpointer test_data)
 {
@@ -1323,7 +1337,6 @@ do_idle_connection_closed_test (ServerData *sd, gconstpointer test_data)
         SoupMessage *msg;
         GBytes *body;
         GError *error = NULL;
-        GSList *clients;
 
         soup_server_set_http2_enabled (sd->server, tls_available);
 
@@ -1335,8 +1348,7 @@ do_idle_connection_closed_test (ServerData *sd, gconstpointer test_data)
         g_bytes_unref (body);
         g_object_unref (msg);
 
-        clients = soup_server_get_clients (sd->server);
-        g_assert_cmpuint (g_slist_length (clients), ==, 1);
+        g_assert_cmpuint (count_clients (sd->server), ==, 1);
 
         if (tls_available) {
                 msg = soup_message_new_from_uri ("GET", sd->ssl_base_uri);
@@ -1345,13 +1357,12 @@ do_idle_connection_closed_test (ServerData *sd, gconstpointer test_data)
                 g_bytes_unref (body);
                 g_object_unref (msg);
 
-                clients = soup_server_get_clients (sd->server);
-                g_assert_cmpuint (g_slist_length (clients), ==, 2);
+                g_assert_cmpuint (count_clients (sd->server), ==, 2);
         }
 
         soup_test_session_abort_unref (session);
 
-        while (soup_server_get_clients (sd->server))
+        while (count_clients (sd->server))
                 g_main_context_iteration (NULL, FALSE);
 }
 
@@ -1499,6 +1510,593 @@ do_multiple_content_length_test (ServerData *sd, gconstpointer test_data)
         }
 }
 
+static void
+do_path_map_test (void)
+{
+	SoupPathMap *map;
+
+	map = soup_path_map_new (NULL);
+	g_assert_null (soup_path_map_lookup (map, "/foo"));
+
+	soup_path_map_add (map, "/foo", "foo");
+	soup_path_map_add (map, "/foo/bar", "foo/bar");
+	soup_path_map_add (map, "/fob", "fob");
+	soup_path_map_add (map, "/f", "f");
+
+	g_assert_null (soup_path_map_lookup (map, "/"));
+	g_assert_cmpstr (soup_path_map_lookup (map, "/f"), ==, "f");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/fo"), ==, "f");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo"), ==, "foo");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foobar"), ==, "foo");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/ba"), ==, "foo");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/bar/baz"), ==, "foo/bar");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/bar?x=/foo/bar/baz"), ==, "foo/bar");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo?/bar"), ==, "foo");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/fob/x"), ==, "fob");
+
+	/* Replacing */
+	soup_path_map_add (map, "/foo", "foo2");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/x"), ==, "foo2");
+
+	/* The empty path matches everything */
+	soup_path_map_add (map, "", "default");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/"), ==, "default");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/bar"), ==, "foo/bar");
+
+	/* Removing only removes exact matches */
+	soup_path_map_remove (map, "/foo/b");
+	soup_path_map_remove (map, "/fo");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/bar"), ==, "foo/bar");
+	soup_path_map_remove (map, "/foo");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/x"), ==, "f");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/bar"), ==, "foo/bar");
+	soup_path_map_remove (map, "/foo/bar");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo/bar"), ==, "f");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/fob"), ==, "fob");
+	soup_path_map_remove (map, "/f");
+	soup_path_map_remove (map, "");
+	g_assert_null (soup_path_map_lookup (map, "/foo"));
+	g_assert_cmpstr (soup_path_map_lookup (map, "/fob"), ==, "fob");
+
+	/* Adding back to the compacted tree */
+	soup_path_map_add (map, "/foo", "foo3");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/foo"), ==, "foo3");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/fob"), ==, "fob");
+	g_assert_null (soup_path_map_lookup (map, "/fo"));
+
+	soup_path_map_free (map);
+
+	/* Data is freed when replaced, removed and with the map */
+	map = soup_path_map_new ((GDestroyNotify)g_free);
+	soup_path_map_add (map, "/a", g_strdup ("a"));
+	soup_path_map_add (map, "/a", g_strdup ("a"));
+	soup_path_map_add (map, "/ab", g_strdup ("ab"));
+	soup_path_map_add (map, "/b", g_strdup ("b"));
+	soup_path_map_remove (map, "/ab");
+	g_assert_cmpstr (soup_path_map_lookup (map, "/ab"), ==, "a");
+	soup_path_map_free (map);
+
+}
+
+static void
+do_path_map_many_routes_test (void)
+{
+	SoupPathMap *map;
+	int i;
+
+	map = soup_path_map_new (NULL);
+	soup_path_map_add (map, "/", GINT_TO_POINTER (-1));
+	for (i = 0; i < 10; i++) {
+		char *path = g_strdup_printf ("/api/v%d/", i);
+
+		soup_path_map_add (map, path, GINT_TO_POINTER (1000 + i));
+		g_free (path);
+	}
+	for (i = 0; i < 1000; i++) {
+		char *path = g_strdup_printf ("/api/v%d/resource%d/", i % 10, i);
+
+		soup_path_map_add (map, path, GINT_TO_POINTER (i));
+		g_free (path);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		char *path = g_strdup_printf ("/api/v%d/resource%d/item/%d", i % 10, i, i);
+
+		g_assert_cmpint (GPOINTER_TO_INT (soup_path_map_lookup (map, path)), ==, i);
+		g_free (path);
+	}
+	g_assert_cmpint (GPOINTER_TO_INT (soup_path_map_lookup (map, "/api/v1/resource")), ==, 1001);
+	g_assert_cmpint (GPOINTER_TO_INT (soup_path_map_lookup (map, "/api/v10/resource1/")), ==, -1);
+	g_assert_cmpint (GPOINTER_TO_INT (soup_path_map_lookup (map, "/other")), ==, -1);
+
+	for (i = 0; i < 1000; i += 2) {
+		char *path = g_strdup_printf ("/api/v%d/resource%d/", i % 10, i);
+
+		soup_path_map_remove (map, path);
+		g_free (path);
+	}
+
+	/* Removed routes fall back to their version */
+	for (i = 0; i < 1000; i++) {
+		char *path = g_strdup_printf ("/api/v%d/resource%d/item", i % 10, i);
+
+		g_assert_cmpint (GPOINTER_TO_INT (soup_path_map_lookup (map, path)), ==, i % 2 ? i : 1000 + i % 10);
+		g_free (path);
+	}
+
+	soup_path_map_free (map);
+}
+
+typedef struct {
+	GMutex mutex;
+	GHashTable *threads;
+	int running;
+	gboolean overlapped;
+	int pending;
+} WorkerThreadsData;
+
+static void
+worker_threads_server_callback (SoupServer        *server,
+				SoupServerMessage *msg,
+				const char        *path,
+				GHashTable        *query,
+				gpointer           user_data)
+{
+	WorkerThreadsData *data = user_data;
+
+	g_mutex_lock (&data->mutex);
+	g_hash_table_add (data->threads, g_thread_self ());
+	g_mutex_unlock (&data->mutex);
+
+	if (!g_str_has_prefix (path, "/safe")) {
+		if (g_atomic_int_add (&data->running, 1) != 0)
+			g_atomic_int_set (&data->overlapped, TRUE);
+		g_usleep (G_USEC_PER_SEC / 100);
+		g_atomic_int_add (&data->running, -1);
+	}
+
+	soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+	soup_server_message_set_response (msg, "text/plain",
+					  SOUP_MEMORY_STATIC, "ok", 2);
+}
+
+static void
+worker_threads_request_done (SoupSession  *session,
+			     GAsyncResult *result,
+			     gpointer      user_data)
+{
+	WorkerThreadsData *data = user_data;
+	SoupMessage *msg = soup_session_get_async_result_message (session, result);
+	GBytes *body;
+	GError *error = NULL;
+
+	body = soup_session_send_and_read_finish (session, result, &error);
+	g_assert_no_error (error);
+	soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+	g_assert_cmpmem (g_bytes_get_data (body, NULL), g_bytes_get_size (body), "ok", 2);
+	g_bytes_unref (body);
+
+	data->pending--;
+}
+
+static void
+do_worker_threads_test (gconstpointer test_data)
+{
+	gboolean import_socket = GPOINTER_TO_INT (test_data);
+	WorkerThreadsData data = { 0, };
+	SoupServer *server;
+	SoupSession *session;
+	GSList *uris;
+	GUri *uri;
+	GError *error = NULL;
+	int i;
+
+	g_mutex_init (&data.mutex);
+	data.threads = g_hash_table_new (NULL, NULL);
+
+	server = soup_server_new ("worker-threads", 2, NULL);
+	soup_server_add_handler (server, NULL, worker_threads_server_callback, &data, NULL);
+	soup_server_add_handler (server, "/safe", worker_threads_server_callback, &data, NULL);
+	soup_server_set_handler_thread_safe (server, "/safe", TRUE);
+
+	if (import_socket) {
+		GSocket *gsock;
+		GSocketAddress *gaddr;
+
+		/* Imported sockets can't be cloned, connections are
+		 * accepted here and handed off to the workers.
+		 */
+		gsock = g_socket_new (G_SOCKET_FAMILY_IPV4,
+				      G_SOCKET_TYPE_STREAM,
+				      G_SOCKET_PROTOCOL_DEFAULT,
+				      &error);
+		g_assert_no_error (error);
+		gaddr = g_inet_socket_address_new_from_string ("127.0.0.1", 0);
+		g_socket_bind (gsock, gaddr, TRUE, &error);
+		g_object_unref (gaddr);
+		g_assert_no_error (error);
+		g_socket_listen (gsock, &error);
+		g_assert_no_error (error);
+
+		soup_server_listen_socket (server, gsock, 0, &error);
+		g_object_unref (gsock);
+	} else
+		soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+	g_assert_no_error (error);
+
+	uris = soup_server_get_uris (server);
+	g_assert_cmpuint (g_slist_length (uris), ==, 1);
+	uri = uris->data;
+
+	session = soup_test_session_new (NULL);
+	for (i = 0; i < 16; i++) {
+		SoupMessage *msg;
+		GUri *msg_uri;
+
+		msg_uri = soup_uri_copy (uri, SOUP_URI_PATH, i % 2 ? "/safe" : "/", SOUP_URI_NONE);
+		msg = soup_message_new_from_uri ("GET", msg_uri);
+		soup_session_send_and_read_async (session, msg, G_PRIORITY_DEFAULT, NULL,
+						  (GAsyncReadyCallback)worker_threads_request_done,
+						  &data);
+		data.pending++;
+		g_object_unref (msg);
+		g_uri_unref (msg_uri);
+	}
+
+	while (data.pending)
+		g_main_context_iteration (NULL, TRUE);
+
+	/* Handlers ran in the workers, and the ones that are not
+	 * thread-safe never ran concurrently.
+	 */
+	g_assert_false (g_hash_table_contains (data.threads, g_thread_self ()));
+	g_assert_cmpuint (g_hash_table_size (data.threads), >=, 1);
+	g_assert_cmpuint (g_hash_table_size (data.threads), <=, 2);
+	g_assert_false (data.overlapped);
+
+	/* The session's connections are owned by the workers */
+	g_assert_cmpuint (count_clients (server), >=, 1);
+
+	soup_test_session_abort_unref (session);
+	g_slist_free_full (uris, (GDestroyNotify)g_uri_unref);
+
+	soup_server_disconnect (server);
+	g_object_unref (server);
+
+	g_hash_table_destroy (data.threads);
+	g_mutex_clear (&data.mutex);
+}
+
+static gboolean
+set_flag_timeout (gpointer user_data)
+{
+	gboolean *flag = user_data;
+
+	*flag = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+static GIOStream *
+connect_to_uri (GUri *uri)
+{
+	GSocketClient *client;
+	GSocketConnection *conn;
+	GError *error = NULL;
+
+	client = g_socket_client_new ();
+	conn = g_socket_client_connect_to_host (client, g_uri_get_host (uri),
+						g_uri_get_port (uri), NULL, &error);
+	g_assert_no_error (error);
+	g_object_unref (client);
+
+	return G_IO_STREAM (conn);
+}
+
+static void
+do_max_connections_test (void)
+{
+	SoupServer *server;
+	GUri *uri;
+	GIOStream *first, *second;
+	gboolean timeout = FALSE;
+
+	server = soup_test_server_new (SOUP_TEST_SERVER_DEFAULT);
+	soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+	g_object_set (server, "max-connections", 1, NULL);
+	uri = soup_test_server_get_uri (server, "http", "127.0.0.1");
+
+	first = connect_to_uri (uri);
+	while (soup_server_get_accepted_connections (server) < 1)
+		g_main_context_iteration (NULL, TRUE);
+
+	/* The listener is paused, so the second connection waits
+	 * in the backlog rather than being accepted.
+	 */
+	second = connect_to_uri (uri);
+	g_timeout_add (100, set_flag_timeout, &timeout);
+	while (!timeout)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpuint (soup_server_get_accepted_connections (server), ==, 1);
+	g_assert_cmpuint (count_clients (server), ==, 1);
+
+	/* Closing the first one lets it in */
+	g_io_stream_close (first, NULL, NULL);
+	while (soup_server_get_accepted_connections (server) < 2)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpuint (soup_server_get_rejected_connections (server), ==, 0);
+
+	g_object_unref (first);
+	g_io_stream_close (second, NULL, NULL);
+	g_object_unref (second);
+	while (count_clients (server))
+		g_main_context_iteration (NULL, TRUE);
+
+	g_uri_unref (uri);
+	soup_test_server_quit_unref (server);
+}
+
+static void
+do_max_pending_handshakes_test (void)
+{
+	SoupServer *server;
+	SoupSession *session;
+	SoupMessage *msg;
+	GBytes *body;
+	GUri *uri;
+	GIOStream *first, *second;
+	gboolean timeout = FALSE;
+
+	SOUP_TEST_SKIP_IF_NO_TLS;
+
+	server = soup_test_server_new (SOUP_TEST_SERVER_DEFAULT);
+	soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+	g_object_set (server, "max-pending-handshakes", 1, NULL);
+	uri = soup_test_server_get_uri (server, "https", "127.0.0.1");
+
+	/* A plain TCP client never sends its ClientHello, so the
+	 * handshake stays pending.
+	 */
+	first = connect_to_uri (uri);
+	while (soup_server_get_accepted_connections (server) < 1)
+		g_main_context_iteration (NULL, TRUE);
+
+	second = connect_to_uri (uri);
+	g_timeout_add (100, set_flag_timeout, &timeout);
+	while (!timeout)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpuint (soup_server_get_accepted_connections (server), ==, 1);
+	g_assert_cmpuint (count_clients (server), ==, 1);
+
+	/* Giving up on the first handshake lets the second one in */
+	g_io_stream_close (first, NULL, NULL);
+	g_object_unref (first);
+	while (soup_server_get_accepted_connections (server) < 2)
+		g_main_context_iteration (NULL, TRUE);
+
+	g_io_stream_close (second, NULL, NULL);
+	g_object_unref (second);
+	while (count_clients (server))
+		g_main_context_iteration (NULL, TRUE);
+
+	/* A real client completes its handshake and gets an answer */
+	session = soup_test_session_new (NULL);
+	msg = soup_message_new_from_uri ("GET", uri);
+	body = soup_test_session_async_send (session, msg, NULL, NULL);
+	soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+	g_bytes_unref (body);
+	g_object_unref (msg);
+	soup_test_session_abort_unref (session);
+
+	g_assert_cmpuint (soup_server_get_accepted_connections (server), ==, 3);
+	g_assert_cmpuint (soup_server_get_rejected_connections (server), ==, 0);
+
+	g_uri_unref (uri);
+	soup_test_server_quit_unref (server);
+}
+
+static void
+do_max_connections_workers_test (void)
+{
+	SoupServer *server;
+	GSList *uris;
+	GIOStream *conns[6];
+	guint accept_batch_size;
+	guint i;
+	GError *error = NULL;
+
+	server = soup_server_new ("worker-threads", 2,
+				  "max-connections", 1,
+				  "accept-batch-size", 1,
+				  NULL);
+	g_object_get (server, "accept-batch-size", &accept_batch_size, NULL);
+	g_assert_cmpuint (accept_batch_size, ==, 1);
+	soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+	soup_server_listen_local (server, 0, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+	g_assert_no_error (error);
+	uris = soup_server_get_uris (server);
+
+	/* Each worker has its own listener, so one of them may take a
+	 * connection after another one reached the limit. Those are
+	 * rejected rather than accepted.
+	 */
+	for (i = 0; i < G_N_ELEMENTS (conns); i++)
+		conns[i] = connect_to_uri (uris->data);
+	while (soup_server_get_accepted_connections (server) < 1)
+		g_main_context_iteration (NULL, FALSE);
+	g_assert_cmpuint (count_clients (server), <=, soup_server_get_accepted_connections (server));
+
+	/* Every connection taken from the backlog is counted once */
+	for (i = 0; i < G_N_ELEMENTS (conns); i++) {
+		g_io_stream_close (conns[i], NULL, NULL);
+		g_object_unref (conns[i]);
+	}
+	while (soup_server_get_accepted_connections (server) +
+	       soup_server_get_rejected_connections (server) < G_N_ELEMENTS (conns))
+		g_main_context_iteration (NULL, FALSE);
+	g_assert_cmpuint (soup_server_get_accepted_connections (server) +
+			  soup_server_get_rejected_connections (server), ==, G_N_ELEMENTS (conns));
+
+	g_slist_free_full (uris, (GDestroyNotify)g_uri_unref);
+	soup_server_disconnect (server);
+	g_object_unref (server);
+}
+
+typedef struct {
+	GFile *file;
+	int fd;
+	int bytes_from_file;
+	int done;
+} FileBodyData;
+
+static void
+file_body_wrote_body (SoupServerMessage *msg,
+		      FileBodyData      *data)
+{
+	g_atomic_int_set (&data->bytes_from_file, soup_server_message_get_response_file_bytes_sent (msg));
+	g_atomic_int_set (&data->done, TRUE);
+}
+
+static void
+file_server_callback (SoupServer        *server,
+		      SoupServerMessage *msg,
+		      const char        *path,
+		      GHashTable        *query,
+		      gpointer           user_data)
+{
+	FileBodyData *data = user_data;
+	GError *error = NULL;
+
+	soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+	if (!strcmp (path, "/slice")) {
+		soup_server_message_set_response_body_from_fd (msg, "application/octet-stream",
+							       data->fd, 1000, 50000, &error);
+	} else {
+		soup_server_message_set_response_body_from_file (msg, "application/octet-stream",
+								 data->file, &error);
+	}
+	g_assert_no_error (error);
+
+	g_signal_connect (msg, "wrote-body",
+			  G_CALLBACK (file_body_wrote_body), data);
+}
+
+static void
+do_one_file_body_request (SoupSession  *session,
+			  GUri         *base_uri,
+			  const char   *path,
+			  goffset       range_start,
+			  goffset       range_end,
+			  GBytes       *expected,
+			  FileBodyData *data,
+			  gboolean      zero_copy)
+{
+	SoupMessage *msg;
+	GUri *uri;
+	GBytes *body;
+
+	uri = g_uri_parse_relative (base_uri, path, SOUP_HTTP_URI_FLAGS, NULL);
+	msg = soup_message_new_from_uri ("GET", uri);
+	if (range_end)
+		soup_message_headers_set_range (soup_message_get_request_headers (msg), range_start, range_end);
+
+	g_atomic_int_set (&data->done, FALSE);
+	body = soup_test_session_async_send (session, msg, NULL, NULL);
+	soup_test_assert_message_status (msg, range_end ? SOUP_STATUS_PARTIAL_CONTENT : SOUP_STATUS_OK);
+	g_assert_true (g_bytes_equal (body, expected));
+	if (soup_uri_is_https (uri))
+		g_assert_cmpuint (soup_message_get_http_version (msg), ==, SOUP_HTTP_2_0);
+
+	/* The body was written straight from the file, not copied */
+	while (!g_atomic_int_get (&data->done))
+		g_main_context_iteration (NULL, FALSE);
+	if (zero_copy)
+		g_assert_cmpint (g_atomic_int_get (&data->bytes_from_file), ==, g_bytes_get_size (expected));
+
+	g_bytes_unref (body);
+	g_object_unref (msg);
+	g_uri_unref (uri);
+}
+
+static void
+do_file_body_test_for_uri (SoupSession  *session,
+			   GUri         *uri,
+			   GBytes       *contents,
+			   FileBodyData *data,
+			   gboolean      zero_copy)
+{
+	GBytes *expected;
+
+	debug_printf (1, "    whole file\n");
+	do_one_file_body_request (session, uri, "/", 0, 0, contents, data, zero_copy);
+
+	expected = g_bytes_new_from_bytes (contents, 1000, 50000);
+
+	/* Ranges are only handled by the HTTP/1 I/O */
+	if (!soup_uri_is_https (uri)) {
+		debug_printf (1, "    single range\n");
+		do_one_file_body_request (session, uri, "/", 1000, 50999, expected, data, zero_copy);
+	}
+
+	debug_printf (1, "    file slice\n");
+	do_one_file_body_request (session, uri, "/slice", 0, 0, expected, data, zero_copy);
+
+	g_bytes_unref (expected);
+}
+
+static void
+do_file_body_test (ServerData *sd, gconstpointer test_data)
+{
+	SoupSession *session;
+	FileBodyData data = { NULL, -1, 0, FALSE };
+	GFileIOStream *iostream;
+	GBytes *contents;
+	guchar *buf;
+	char *path;
+	gsize i, size = 100000;
+	gboolean sendfile_available;
+	GError *error = NULL;
+
+	data.file = g_file_new_tmp ("server-test-XXXXXX", &iostream, &error);
+	g_assert_no_error (error);
+	buf = g_malloc (size);
+	for (i = 0; i < size; i++)
+		buf[i] = i % 251;
+	contents = g_bytes_new_take (buf, size);
+	g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (iostream)),
+				   buf, size, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_io_stream_close (G_IO_STREAM (iostream), NULL, NULL);
+	g_object_unref (iostream);
+
+	path = g_file_get_path (data.file);
+	data.fd = g_open (path, O_RDONLY, 0);
+	g_assert_cmpint (data.fd, !=, -1);
+	g_free (path);
+
+#ifdef HAVE_SENDFILE
+	sendfile_available = TRUE;
+#else
+	sendfile_available = FALSE;
+#endif
+
+	server_add_handler (sd, NULL, file_server_callback, &data, NULL);
+	soup_server_set_http2_enabled (sd->server, TRUE);
+	session = soup_test_session_new (NULL);
+
+	debug_printf (1, "  http\n");
+	do_file_body_test_for_uri (session, sd->base_uri, contents, &data, sendfile_available);
+	if (tls_available) {
+		debug_printf (1, "  https\n");
+		do_file_body_test_for_uri (session, sd->ssl_base_uri, contents, &data, TRUE);
+	}
+
+	soup_test_session_abort_unref (session);
+	g_close (data.fd, NULL);
+	g_file_delete (data.file, NULL, NULL);
+	g_object_unref (data.file);
+	g_bytes_unref (contents);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1525,6 +2123,13 @@ main (int argc, char **argv)
 	g_test_add_func ("/server/import/gsocket", do_gsocket_import_test);
 	g_test_add_func ("/server/import/fd", do_fd_import_test);
 	g_test_add_func ("/server/accept/iostream", do_iostream_accept_test);
+	g_test_add_func ("/server/path-map", do_path_map_test);
+	g_test_add_func ("/server/path-map/many-routes", do_path_map_many_routes_test);
+	g_test_add_data_func ("/server/worker-threads/reuse-port", GINT_TO_POINTER (FALSE), do_worker_threads_test);
+	g_test_add_data_func ("/server/worker-threads/hand-off", GINT_TO_POINTER (TRUE), do_worker_threads_test);
+	g_test_add_func ("/server/max-connections", do_max_connections_test);
+	g_test_add_func ("/server/max-connections/workers", do_max_connections_workers_test);
+	g_test_add_func ("/server/max-pending-handshakes", do_max_pending_handshakes_test);
 	g_test_add ("/server/fail/404", ServerData, NULL,
 		    server_setup_nohandler, do_fail_404_test, server_teardown);
 	g_test_add ("/server/fail/500", ServerData, GINT_TO_POINTER (FALSE),
@@ -1543,6 +2148,8 @@ main (int argc, char **argv)
                     NULL, do_chunked_test, server_teardown);
         g_test_add ("/server/multiple-content-length", ServerData, NULL,
                     NULL, do_multiple_content_length_test, server_teardown);
+	g_test_add ("/server/file-body", ServerData, NULL,
+		    server_setup_nohandler, do_file_body_test, server_teardown);
 
 	ret = g_test_run ();
 
@@ -2,6 +2,7 @@
 
 #include "test-utils.h"
 #include "soup-session-private.h"
+#include "soup-filter-input-stream.h"
 
 static GUri *base_uri;
 static gboolean server_processed_message;
@@ -34,8 +35,12 @@ server_handler (SoupServer        *server,
 		g_source_set_callback (timer, timeout_cb, &timeout, NULL);
 		g_source_attach (timer, context);
 		g_source_unref (timer);
-	} else if (!strcmp (path, "/index.txt")) {
+	} else if (!strcmp (path, "/index.txt") || !strcmp (path, "/index-chunked.txt")) {
 		soup_server_message_set_status (msg, SOUP_STATUS_OK, NULL);
+		if (!strcmp (path, "/index-chunked.txt")) {
+			soup_message_headers_set_encoding (soup_server_message_get_response_headers (msg),
+							   SOUP_ENCODING_CHUNKED);
+		}
 		soup_server_message_set_response (msg, "text/plain",
 						  SOUP_MEMORY_STATIC,
 						  g_bytes_get_data (index_bytes, NULL),
@@ -354,6 +359,20 @@ do_property_tests (void)
 		g_object_unref (tlsdb);
 		g_object_unref (session);
 	}
+
+	session = g_object_new (SOUP_TYPE_SESSION, NULL);
+	g_assert_cmpuint (soup_session_get_read_buffer_min_size (session), ==, 8 * 1024);
+	g_assert_cmpuint (soup_session_get_read_buffer_max_size (session), ==, 256 * 1024);
+	g_object_unref (session);
+
+	/* The maximum read size is never below the minimum */
+	session = g_object_new (SOUP_TYPE_SESSION,
+				"read-buffer-min-size", 64 * 1024,
+				"read-buffer-max-size", 16 * 1024,
+				NULL);
+	g_assert_cmpuint (soup_session_get_read_buffer_min_size (session), ==, 64 * 1024);
+	g_assert_cmpuint (soup_session_get_read_buffer_max_size (session), ==, 64 * 1024);
+	g_object_unref (session);
 }
 
 static gint
@@ -562,6 +581,200 @@ do_user_agent_test(void)
         soup_test_session_abort_unref (session);
 }
 
+static void
+send_and_read_ready (SoupSession  *session,
+                     GAsyncResult *result,
+                     GBytes      **body)
+{
+        GError *error = NULL;
+
+        *body = soup_session_send_and_read_finish (session, result, &error);
+        g_assert_no_error (error);
+}
+
+static void
+do_send_and_read_test (void)
+{
+        SoupSession *session;
+        static const char *paths[] = { "/index.txt", "/index-chunked.txt" };
+        guint i;
+
+        session = soup_test_session_new (NULL);
+
+        for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+                GUri *uri;
+                SoupMessage *msg;
+                GBytes *body = NULL;
+                GError *error = NULL;
+
+                debug_printf (1, "  %s\n", paths[i]);
+
+                uri = g_uri_parse_relative (base_uri, paths[i], SOUP_HTTP_URI_FLAGS, NULL);
+
+                msg = soup_message_new_from_uri ("GET", uri);
+                body = soup_session_send_and_read (session, msg, NULL, &error);
+                g_assert_no_error (error);
+                soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                g_assert_true (g_bytes_equal (body, index_bytes));
+                g_clear_pointer (&body, g_bytes_unref);
+                g_object_unref (msg);
+
+                msg = soup_message_new_from_uri ("GET", uri);
+                soup_session_send_and_read_async (session, msg, G_PRIORITY_DEFAULT, NULL,
+                                                  (GAsyncReadyCallback)send_and_read_ready,
+                                                  &body);
+                while (!body)
+                        g_main_context_iteration (NULL, TRUE);
+                soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                g_assert_true (g_bytes_equal (body, index_bytes));
+                g_clear_pointer (&body, g_bytes_unref);
+                g_object_unref (msg);
+
+                /* Content-Length is set but there is no body to read */
+                msg = soup_message_new_from_uri ("HEAD", uri);
+                body = soup_session_send_and_read (session, msg, NULL, &error);
+                g_assert_no_error (error);
+                soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                g_assert_cmpuint (g_bytes_get_size (body), ==, 0);
+                g_clear_pointer (&body, g_bytes_unref);
+                g_object_unref (msg);
+
+                g_uri_unref (uri);
+        }
+
+        soup_test_session_abort_unref (session);
+}
+
+static void
+send_and_splice_ready (SoupSession  *session,
+                       GAsyncResult *result,
+                       gssize       *nspliced)
+{
+        GError *error = NULL;
+
+        *nspliced = soup_session_send_and_splice_finish (session, result, &error);
+        g_assert_no_error (error);
+}
+
+static void
+assert_file_contents (GFile  *file,
+                      GBytes *expected)
+{
+        char *contents;
+        gsize length;
+        GError *error = NULL;
+
+        g_file_load_contents (file, NULL, &contents, &length, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_cmpmem (contents, length,
+                         g_bytes_get_data (expected, NULL), g_bytes_get_size (expected));
+        g_free (contents);
+}
+
+typedef struct {
+        SoupFilterInputStream *istream;
+        guint64 n_bytes;
+} SpliceReadData;
+
+static void
+splice_got_headers (SoupMessage    *msg,
+                    SpliceReadData *data)
+{
+        SoupConnection *conn;
+        guint64 n_reads;
+
+        conn = soup_message_get_connection (msg);
+        data->istream = g_object_ref (SOUP_FILTER_INPUT_STREAM (g_io_stream_get_input_stream (soup_connection_get_iostream (conn))));
+        soup_filter_input_stream_get_read_stats (data->istream, &n_reads, &data->n_bytes);
+        g_object_unref (conn);
+}
+
+static void
+do_send_and_splice_file_test (void)
+{
+        SoupSession *session;
+        GFile *file;
+        GFileIOStream *tmp_stream;
+        static const char *paths[] = { "/index.txt", "/index-chunked.txt" };
+        guint i;
+        GError *error = NULL;
+
+        file = g_file_new_tmp ("soup-splice-XXXXXX", &tmp_stream, &error);
+        g_assert_no_error (error);
+        g_object_unref (tmp_stream);
+
+        session = soup_test_session_new (NULL);
+
+        for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+                GUri *uri;
+                SoupMessage *msg;
+                GFileOutputStream *ostream;
+                gssize nspliced;
+                SpliceReadData read_data = { NULL, 0 };
+
+                debug_printf (1, "  %s\n", paths[i]);
+
+                uri = g_uri_parse_relative (base_uri, paths[i], SOUP_HTTP_URI_FLAGS, NULL);
+
+                msg = soup_message_new_from_uri ("GET", uri);
+                soup_message_add_flags (msg, SOUP_MESSAGE_COLLECT_METRICS);
+                g_signal_connect (msg, "got-headers",
+                                  G_CALLBACK (splice_got_headers), &read_data);
+                ostream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+                g_assert_no_error (error);
+                nspliced = soup_session_send_and_splice (session, msg, G_OUTPUT_STREAM (ostream),
+                                                         G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                                         G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                                         NULL, &error);
+                g_assert_no_error (error);
+                soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                g_assert_cmpint (nspliced, ==, g_bytes_get_size (index_bytes));
+                g_assert_cmpuint (soup_message_metrics_get_response_body_size (soup_message_get_metrics (msg)), ==, g_bytes_get_size (index_bytes));
+                assert_file_contents (file, index_bytes);
+
+#ifdef HAVE_SPLICE
+                /* With a Content-Length the body is moved by the kernel,
+                 * so nothing after the headers is read into userspace.
+                 */
+                if (i == 0) {
+                        guint64 n_reads, n_bytes;
+
+                        g_assert_nonnull (read_data.istream);
+                        soup_filter_input_stream_get_read_stats (read_data.istream, &n_reads, &n_bytes);
+                        g_assert_cmpuint (n_bytes, ==, read_data.n_bytes);
+                }
+#endif
+                g_clear_object (&read_data.istream);
+                g_object_unref (ostream);
+                g_object_unref (msg);
+
+                msg = soup_message_new_from_uri ("GET", uri);
+                ostream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+                g_assert_no_error (error);
+                nspliced = 0;
+                soup_session_send_and_splice_async (session, msg, G_OUTPUT_STREAM (ostream),
+                                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                                    G_PRIORITY_DEFAULT, NULL,
+                                                    (GAsyncReadyCallback)send_and_splice_ready,
+                                                    &nspliced);
+                while (nspliced == 0)
+                        g_main_context_iteration (NULL, TRUE);
+                soup_test_assert_message_status (msg, SOUP_STATUS_OK);
+                g_assert_cmpint (nspliced, ==, g_bytes_get_size (index_bytes));
+                assert_file_contents (file, index_bytes);
+                g_object_unref (ostream);
+                g_object_unref (msg);
+
+                g_uri_unref (uri);
+        }
+
+        soup_test_session_abort_unref (session);
+
+        g_file_delete (file, NULL, NULL);
+        g_object_unref (file);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -583,6 +796,8 @@ main (int argc, char **argv)
 	g_test_add_func ("/session/features", do_features_test);
 	g_test_add_func ("/session/queue-order", do_queue_order_test);
 	g_test_add_func ("/session/user-agent", do_user_agent_test);
+        g_test_add_func ("/session/send-and-read", do_send_and_read_test);
+        g_test_add_func ("/session/send-and-splice-file", do_send_and_splice_file_test);
 
 	ret = g_test_run ();
 